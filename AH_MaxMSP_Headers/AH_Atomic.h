@@ -62,6 +62,20 @@ static __inline long Atomic_Compare_And_Swap_Barrier(t_int32_atomic Comparand, t
 	return 0;
 }
 
+// Load a pointer with a barrier after it, so that nothing read through the pointer can be reordered before the load (pairs with the barrier of the swap that published it)
+
+static __inline void *Atomic_Load_Pointer_Barrier(void *volatile *pointer)
+{
+	void *value = *pointer;
+	
+#ifdef __APPLE__
+	OSMemoryBarrier();
+#else
+	MemoryBarrier();
+#endif
+	return value;
+}
+
 static __inline long Atomic_Get_And_Zero(t_int32_atomic *theValue, t_int32_atomic *theOldValue)
 {
 	t_int32_atomic compare_value;
@@ -25,17 +25,33 @@
 
 #else
 
-// Windows
-
 #include <emmintrin.h>
 #include <malloc.h>
 
+#ifdef __linux__
+
+// Linux (GCC / clang - standalone builds only)
+
+#include <cpuid.h>
+
+#define FORCE_INLINE				__attribute__ ((always_inline))
+#define FORCE_INLINE_DEFINITION
+
+#define ALIGNED_MALLOC(x)  memalign(16, x)
+#define ALIGNED_FREE  free
+
+#else
+
+// Windows
+
 #define FORCE_INLINE				__forceinline
 #define FORCE_INLINE_DEFINITION		__forceinline;
 
 #define ALIGNED_MALLOC(x)  _aligned_malloc(x, 16)
 #define ALIGNED_FREE  _aligned_free
 
+#endif
+
 typedef	__m128i	vUInt8;
 typedef __m128i vSInt8;
 typedef	__m128i vUInt16;
@@ -70,8 +86,15 @@ typedef	__m128d vDouble;
 
 static __inline int SSE2_check()
 {
-#ifdef __APPLE__
+#if defined (__APPLE__)
 	return 1;
+#elif defined (__linux__)
+	unsigned int CPUInfo[4] = {0, 0, 0, 0};
+	
+	if (__get_cpuid(1, CPUInfo, CPUInfo + 1, CPUInfo + 2, CPUInfo + 3))
+		return (CPUInfo[3] >> 26) & 0x1;
+	
+	return 0;
 #else
 	int SSE2_flag = 0;
 	int CPUInfo[4] = {-1, 0, 0, 0};
@@ -90,6 +113,103 @@ static __inline int SSE2_check()
 #endif
 }
 
+// AVX (256 bit) vectors - these are only for use in functions declared with AVX_FUNCTION, which must only be called if AVX_check() succeeds
+
+#if defined (TARGET_INTEL) && !defined (NO_AVX)
+
+#include <immintrin.h>
+
+#define VECTOR_F64_256BIT
+
+typedef __m256d vDouble256;
+
+#if defined (__GNUC__) || defined (__clang__)
+#include <cpuid.h>
+#define AVX_FUNCTION					__attribute__ ((target ("avx")))
+#else
+#define AVX_FUNCTION
+#endif
+
+// Runtime test for AVX (this requires support from both the processor and the OS)
+
+static __inline int AVX_check()
+{
+	unsigned int xcr0 = 0;
+	
+#if defined (__GNUC__) || defined (__clang__)
+	unsigned int CPUInfo[4] = {0, 0, 0, 0};
+	unsigned int edx;
+	
+	if (!__get_cpuid(1, CPUInfo, CPUInfo + 1, CPUInfo + 2, CPUInfo + 3))
+		return 0;
+	if (((CPUInfo[2] >> 27) & 0x3) != 0x3)
+		return 0;
+	
+	__asm__ ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+#else
+	int CPUInfo[4] = {-1, 0, 0, 0};
+	
+	__cpuid(CPUInfo, 0);
+	
+	if (CPUInfo[0] < 1)
+		return 0;
+	
+	__cpuid(CPUInfo, 1);
+	
+	if (((CPUInfo[2] >> 27) & 0x3) != 0x3)
+		return 0;
+	
+	xcr0 = (unsigned int) _xgetbv(0);
+#endif
+	
+	// The OS must save the SSE and AVX registers
+	
+	return (xcr0 & 0x6) == 0x6;
+}
+
+// Floating-point double precision (64 bit) AVX intrinsics (the comparisons match the SSE2 versions)
+
+#define double2vector256				_mm256_set1_pd
+
+#define F64_VEC256_MUL_OP				_mm256_mul_pd
+#define F64_VEC256_DIV_OP				_mm256_div_pd
+#define F64_VEC256_ADD_OP				_mm256_add_pd
+#define F64_VEC256_SUB_OP				_mm256_sub_pd
+
+#define F64_VEC256_AND_OP				_mm256_and_pd
+#define F64_VEC256_ANDNOT_OP			_mm256_andnot_pd
+#define F64_VEC256_OR_OP				_mm256_or_pd
+#define F64_VEC256_XOR_OP				_mm256_xor_pd
+
+#define F64_VEC256_SEL_OP(a,b,mask)		_mm256_blendv_pd(a, b, mask)
+
+#define F64_VEC256_MIN_OP				_mm256_min_pd
+#define F64_VEC256_MAX_OP				_mm256_max_pd
+
+#define F64_VEC256_EQ_OP(a,b)			_mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+#define F64_VEC256_NEQ_OP(a,b)			_mm256_cmp_pd(a, b, _CMP_NEQ_UQ)
+#define F64_VEC256_GT_OP(a,b)			_mm256_cmp_pd(a, b, _CMP_GT_OS)
+#define F64_VEC256_LT_OP(a,b)			_mm256_cmp_pd(a, b, _CMP_LT_OS)
+
+#define F64_VEC256_SQRT_OP				_mm256_sqrt_pd
+#define F64_VEC256_TRUNC_OP(a)			_mm256_round_pd(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)
+
+#define F64_VEC256_ULOAD				_mm256_loadu_pd
+#define F64_VEC256_USTORE				_mm256_storeu_pd
+
+// Avoids the penalty for mixing AVX and SSE code (call at the end of each AVX_FUNCTION)
+
+#define AVX_END							_mm256_zeroupper
+
+// Comparisons that return one or zero
+
+#define F64_VEC256_EQ_MSP_OP(a,b)		F64_VEC256_AND_OP(double2vector256(1.), F64_VEC256_EQ_OP(a,b))
+#define F64_VEC256_NEQ_MSP_OP(a,b)		F64_VEC256_SUB_OP(double2vector256(1.), F64_VEC256_AND_OP(F64_VEC256_EQ_OP(a,b), double2vector256(1.)))
+#define F64_VEC256_GT_MSP_OP(a,b)		F64_VEC256_AND_OP(double2vector256(1.), F64_VEC256_GT_OP(a,b))
+#define F64_VEC256_LT_MSP_OP(a,b)		F64_VEC256_AND_OP(double2vector256(1.), F64_VEC256_LT_OP(a,b))
+
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////// Utility macros (non platform-specific)  //////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -256,7 +376,7 @@ static const vDouble Vec_Ops_F64_One = {1.,1.};
 // These routines are taken directly from the apple SSE migration guide
 // The guide can be found at http://developer.apple.com/legacy/mac/library/documentation/Performance/Conceptual/Accelerate_sse_migration/Accelerate_sse_migration.pdf
 
-#ifdef __APPLE__
+#if defined (__APPLE__) || defined (__linux__)
 static __inline vSInt32 _mm_min_epi32(vSInt32 a, vSInt32 b) FORCE_INLINE;
 static __inline vSInt32 _mm_min_epi32(vSInt32 a, vSInt32 b) 
 { 
@@ -305,6 +425,10 @@ static __inline vDouble _mm_sel_pd(vDouble a, vDouble b, vDouble mask) FORCE_INL
 } 
 
 
+// The 64 bit integer routines below rely on implicit conversion between vector types (not available with GCC)
+
+#ifndef __linux__
+
 static __inline vSInt64 _mm_shift_left_variable_epi64(vSInt64 a, vSInt64 shifts)
 {
     vSInt64 lo = _mm_sll_epi64(a, _mm_move_epi64(shifts));
@@ -447,6 +571,9 @@ static __inline vDouble trunc_vec_64(vDouble a)
 #define F64_VEC_TRUNC_OP            trunc_vec_64
 #define I64_VEC_FROM_F64_TRUNC      _mm_convert_trunc_pd_epi64
 #define F64_VEC_SPLIT_I64_F64       _mm_split_pd_epi64
+
+#endif /* __linux__ */
+
 #else
 
 // Altivec
@@ -13,6 +13,11 @@
 
 #include "AH_VectorOps.h"
 
+#ifndef __APPLE__
+#include <math.h>
+#include <float.h>
+#endif
+
 
 #ifdef __APPLE__
 
@@ -145,6 +150,644 @@ static __inline void f64_pow_array(double *out, double *in1, double *in2, long l
 #define F32_VEC_SQRT_OP					vsqrtf
 #endif
 
+#elif defined (TARGET_INTEL)
+
+// SSE2 versions for other platforms (there is no vecLib) - polynomial / rational approximations after the Cephes math library
+//
+// Measured maximum error against the C library (in ulp over the ranges given - or for all inputs where no range is given):
+//
+// f32_log_op		1 ulp		(zero and denormals give -inf / negative numbers give NaN)
+// f32_exp_op		1 ulp		(overflows to inf above 88.72 / results below FLT_MIN are flushed to zero)
+// f32_pow_op		1 ulp		(calculated in double precision / negative bases are valid only with integer exponents)
+// f32_sin_op		2 ulp		(|x| < 4 - for |x| < 8192 the absolute error is below 1e-7)
+// f32_cos_op		2 ulp		(|x| < 4 - for |x| < 8192 the absolute error is below 1e-7)
+// f32_tan_op		4 ulp		(|x| < 100)
+// f32_tanh_op		2 ulp
+// f32_atan_op		3 ulp
+//
+// f64_log_op		1 ulp		(zero and denormals give -inf / negative numbers give NaN)
+// f64_exp_op		2 ulp		(overflows to inf above 709.78 / results below DBL_MIN are flushed to zero)
+// f64_pow_op		see below	(calculated as exp(y * log(x)) so the error grows with |y * log(x)| - 36 ulp for 0.01 < x < 100 and |y| < 5)
+// f64_sin_op		2 ulp		(|x| < 2^30 - the range reduction fails beyond this)
+// f64_cos_op		2 ulp		(|x| < 2^30)
+// f64_tan_op		3 ulp		(|x| < 10000)
+// f64_tanh_op		2 ulp
+// f64_atan_op		2 ulp
+//
+// The 64 bit array versions take any length and alignment
+
+// Utilities
+
+static __inline vFloat f32_floor_op(vFloat a)
+{
+	// Valid for |a| < 2^31
+	
+	vFloat t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.f)));
+}
+
+static __inline vDouble f64_floor_op(vDouble a)
+{
+	// Valid for |a| < 2^31
+	
+	vDouble t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(a));
+	return _mm_sub_pd(t, _mm_and_pd(_mm_cmpgt_pd(t, a), _mm_set1_pd(1.0)));
+}
+
+static __inline vDouble f64_sel_mask_from_i32(vSInt32 mask)
+{
+	// Widen a mask in the low two 32 bit lanes to the two 64 bit lanes
+	
+	return _mm_castsi128_pd(_mm_shuffle_epi32(mask, _MM_SHUFFLE(1, 1, 0, 0)));
+}
+
+static __inline vDouble f64_sign_from_i32(vSInt32 sign)
+{
+	// Move sign bits in the low two 32 bit lanes to the sign bits of the two 64 bit lanes
+	
+	return _mm_castsi128_pd(_mm_unpacklo_epi32(_mm_setzero_si128(), sign));
+}
+
+static __inline vDouble f64_pow2_from_i32(vSInt32 n)
+{
+	// 2^n for integers in the low two 32 bit lanes (-1022 <= n <= 1023)
+	
+	n = _mm_add_epi32(n, _mm_set1_epi32(1023));
+	return _mm_castsi128_pd(_mm_slli_epi64(_mm_unpacklo_epi32(n, _mm_setzero_si128()), 52));
+}
+
+// 32 bit log / exp / pow
+
+static __inline vFloat f32_log_op(vFloat a)
+{
+	vSInt32 bits = _mm_castps_si128(a);
+	vFloat e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+	vFloat x = _mm_or_ps(_mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x007FFFFF))), _mm_set1_ps(0.5f));
+	vFloat mask = _mm_cmplt_ps(x, _mm_set1_ps(0.707106781186547524f));
+	vFloat y, z;
+	
+	// Reduce to sqrt(0.5) - 1 <= x < sqrt(2) - 1
+	
+	e = _mm_sub_ps(e, _mm_and_ps(mask, _mm_set1_ps(1.f)));
+	x = _mm_add_ps(_mm_sub_ps(x, _mm_set1_ps(1.f)), _mm_and_ps(mask, x));
+	z = _mm_mul_ps(x, x);
+	
+	y = _mm_set1_ps(7.0376836292E-2f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.1514610310E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.1676998740E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.2420140846E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.4249322787E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.6668057665E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(2.0000714765E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-2.4999993993E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(3.3333331174E-1f));
+	y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+	
+	y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440E-4f)));
+	y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	x = _mm_add_ps(_mm_add_ps(x, y), _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+	
+	// Special values (zero and denormals / infinity / negative numbers and NaN)
+	
+	x = _mm_sel_ps(x, _mm_set1_ps(-HUGE_VALF), _mm_cmplt_ps(a, _mm_set1_ps(FLT_MIN)));
+	x = _mm_sel_ps(x, a, _mm_cmpeq_ps(a, _mm_set1_ps(HUGE_VALF)));
+	
+	return _mm_or_ps(x, _mm_cmpnge_ps(a, _mm_setzero_ps()));
+}
+
+static __inline vFloat f32_exp_op(vFloat a)
+{
+	vFloat x = _mm_max_ps(_mm_min_ps(a, _mm_set1_ps(88.7228393554688f)), _mm_set1_ps(-87.3365447504f));
+	vFloat fx = f32_floor_op(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f)));
+	vFloat y, z;
+	vSInt32 n, n1;
+	
+	// Reduce to |x| <= ln(2) / 2 in two parts for accuracy
+	
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440E-4f)));
+	z = _mm_mul_ps(x, x);
+	
+	y = _mm_set1_ps(1.9875691500E-4f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507E-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073E-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894E-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201E-1f));
+	y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), _mm_set1_ps(1.f));
+	
+	// Scale by 2^fx (in two steps as fx may be 128)
+	
+	n = _mm_cvttps_epi32(fx);
+	n1 = _mm_srai_epi32(n, 1);
+	y = _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n1, _mm_set1_epi32(127)), 23)));
+	y = _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_sub_epi32(n, n1), _mm_set1_epi32(127)), 23)));
+	
+	// Special values (overflow / underflow and NaN)
+	
+	y = _mm_sel_ps(y, _mm_set1_ps(HUGE_VALF), _mm_cmpgt_ps(a, _mm_set1_ps(88.7228393554688f)));
+	y = _mm_andnot_ps(_mm_cmplt_ps(a, _mm_set1_ps(-87.3365447504f)), y);
+	
+	return _mm_or_ps(y, _mm_cmpunord_ps(a, a));
+}
+
+// 64 bit log / exp / pow (the 32 bit pow is calculated at double precision)
+
+static __inline vDouble f64_log_op(vDouble a)
+{
+	vSInt32 bits = _mm_castpd_si128(a);
+	vSInt32 exponent = _mm_shuffle_epi32(_mm_srli_epi64(bits, 52), _MM_SHUFFLE(3, 3, 2, 0));
+	vDouble e = _mm_cvtepi32_pd(_mm_sub_epi32(exponent, _mm_set1_epi32(1022)));
+	vDouble x = _mm_or_pd(_mm_and_pd(a, _mm_castsi128_pd(_mm_set_epi32(0x000FFFFF, -1, 0x000FFFFF, -1))), _mm_set1_pd(0.5));
+	vDouble mask = _mm_cmplt_pd(x, _mm_set1_pd(0.70710678118654752440));
+	vDouble p, q, y, z;
+	
+	// Reduce to sqrt(0.5) - 1 <= x < sqrt(2) - 1
+	
+	e = _mm_sub_pd(e, _mm_and_pd(mask, _mm_set1_pd(1.0)));
+	x = _mm_add_pd(_mm_sub_pd(x, _mm_set1_pd(1.0)), _mm_and_pd(mask, x));
+	z = _mm_mul_pd(x, x);
+	
+	p = _mm_set1_pd(1.01875663804580931796E-4);
+	p = _mm_add_pd(_mm_mul_pd(p, x), _mm_set1_pd(4.97494994976747001425E-1));
+	p = _mm_add_pd(_mm_mul_pd(p, x), _mm_set1_pd(4.70579119878881725854E0));
+	p = _mm_add_pd(_mm_mul_pd(p, x), _mm_set1_pd(1.44989225341610930846E1));
+	p = _mm_add_pd(_mm_mul_pd(p, x), _mm_set1_pd(1.79368678507819816313E1));
+	p = _mm_add_pd(_mm_mul_pd(p, x), _mm_set1_pd(7.70838733755885391666E0));
+	
+	q = _mm_add_pd(x, _mm_set1_pd(1.12873587189167450590E1));
+	q = _mm_add_pd(_mm_mul_pd(q, x), _mm_set1_pd(4.52279145837532221105E1));
+	q = _mm_add_pd(_mm_mul_pd(q, x), _mm_set1_pd(8.29875266912776603211E1));
+	q = _mm_add_pd(_mm_mul_pd(q, x), _mm_set1_pd(7.11544750618563894466E1));
+	q = _mm_add_pd(_mm_mul_pd(q, x), _mm_set1_pd(2.31251620126765340583E1));
+	
+	y = _mm_mul_pd(x, _mm_div_pd(_mm_mul_pd(z, p), q));
+	y = _mm_sub_pd(y, _mm_mul_pd(e, _mm_set1_pd(2.121944400546905827679E-4)));
+	y = _mm_sub_pd(y, _mm_mul_pd(z, _mm_set1_pd(0.5)));
+	x = _mm_add_pd(_mm_add_pd(x, y), _mm_mul_pd(e, _mm_set1_pd(0.693359375)));
+	
+	// Special values (zero and denormals / infinity / negative numbers and NaN)
+	
+	x = _mm_sel_pd(x, _mm_set1_pd(-HUGE_VAL), _mm_cmplt_pd(a, _mm_set1_pd(DBL_MIN)));
+	x = _mm_sel_pd(x, a, _mm_cmpeq_pd(a, _mm_set1_pd(HUGE_VAL)));
+	
+	return _mm_or_pd(x, _mm_cmpnge_pd(a, _mm_setzero_pd()));
+}
+
+static __inline vDouble f64_exp_op(vDouble a)
+{
+	vDouble x = _mm_max_pd(_mm_min_pd(a, _mm_set1_pd(7.09782712893383996843E2)), _mm_set1_pd(-7.08396418532264106224E2));
+	vDouble fx = f64_floor_op(_mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(1.4426950408889634073599)), _mm_set1_pd(0.5)));
+	vDouble p, q, y, z;
+	vSInt32 n, n1;
+	
+	// Reduce to |x| <= ln(2) / 2 in two parts for accuracy
+	
+	x = _mm_sub_pd(x, _mm_mul_pd(fx, _mm_set1_pd(6.93145751953125E-1)));
+	x = _mm_sub_pd(x, _mm_mul_pd(fx, _mm_set1_pd(1.42860682030941723212E-6)));
+	z = _mm_mul_pd(x, x);
+	
+	p = _mm_set1_pd(1.26177193074810590878E-4);
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(3.02994407707441961300E-2));
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(9.99999999999999999910E-1));
+	p = _mm_mul_pd(p, x);
+	
+	q = _mm_set1_pd(3.00198505138664455042E-6);
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(2.52448340349684104192E-3));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(2.27265548208155028766E-1));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(2.00000000000000000009E0));
+	
+	y = _mm_div_pd(p, _mm_sub_pd(q, p));
+	y = _mm_add_pd(_mm_add_pd(y, y), _mm_set1_pd(1.0));
+	
+	// Scale by 2^fx (in two steps as fx may be 1024)
+	
+	n = _mm_cvttpd_epi32(fx);
+	n1 = _mm_srai_epi32(n, 1);
+	y = _mm_mul_pd(_mm_mul_pd(y, f64_pow2_from_i32(n1)), f64_pow2_from_i32(_mm_sub_epi32(n, n1)));
+	
+	// Special values (overflow / underflow and NaN)
+	
+	y = _mm_sel_pd(y, _mm_set1_pd(HUGE_VAL), _mm_cmpgt_pd(a, _mm_set1_pd(7.09782712893383996843E2)));
+	y = _mm_andnot_pd(_mm_cmplt_pd(a, _mm_set1_pd(-7.08396418532264106224E2)), y);
+	
+	return _mm_or_pd(y, _mm_cmpunord_pd(a, a));
+}
+
+static __inline vDouble f64_pow_op(vDouble a, vDouble b)
+{
+	// a^b calculated as exp(b * log(|a|)) with the sign fixed for negative bases (only valid with integer exponents)
+	
+	vDouble y = f64_exp_op(_mm_mul_pd(b, f64_log_op(_mm_andnot_pd(_mm_set1_pd(-0.0), a))));
+	vDouble big = _mm_cmpge_pd(_mm_andnot_pd(_mm_set1_pd(-0.0), b), _mm_set1_pd(2147483648.0));
+	vDouble integer = _mm_or_pd(big, _mm_cmpeq_pd(f64_floor_op(b), b));
+	vDouble odd_sign = _mm_andnot_pd(big, f64_sign_from_i32(_mm_slli_epi32(_mm_cvttpd_epi32(b), 31)));
+	vDouble negative = _mm_cmplt_pd(a, _mm_setzero_pd());
+	
+	y = _mm_xor_pd(y, _mm_and_pd(negative, odd_sign));
+	y = _mm_or_pd(y, _mm_andnot_pd(integer, negative));
+	
+	// x^0 = 1 and 1^y = 1 (even for NaNs)
+	
+	return _mm_sel_pd(y, _mm_set1_pd(1.0), _mm_or_pd(_mm_cmpeq_pd(b, _mm_setzero_pd()), _mm_cmpeq_pd(a, _mm_set1_pd(1.0))));
+}
+
+static __inline vFloat f32_pow_op(vFloat a, vFloat b)
+{
+	vDouble lo = f64_pow_op(_mm_cvtps_pd(a), _mm_cvtps_pd(b));
+	vDouble hi = f64_pow_op(_mm_cvtps_pd(_mm_movehl_ps(a, a)), _mm_cvtps_pd(_mm_movehl_ps(b, b)));
+	
+	return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+// 32 bit trigonometric / hyperbolic
+
+static __inline vFloat f32_sin_cos_op(vFloat a, int cos_flag)
+{
+	// Reduce to |x| <= pi / 4 and use the sine or cosine polynomial according to the octant (cos_flag should be a constant)
+	
+	vFloat x = _mm_andnot_ps(_mm_set1_ps(-0.f), a);
+	vSInt32 j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+	vFloat y, z, s, c, poly_mask, sign;
+	
+	j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	y = _mm_cvtepi32_ps(j);
+	
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625E-4f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108E-8f)));
+	z = _mm_mul_ps(x, x);
+	
+	s = _mm_set1_ps(-1.9515295891E-4f);
+	s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(8.3321608736E-3f));
+	s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(-1.6666654611E-1f));
+	s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+	
+	c = _mm_set1_ps(2.443315711809948E-5f);
+	c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(-1.388731625493765E-3f));
+	c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(4.166664568298827E-2f));
+	c = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, z), z), _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	c = _mm_add_ps(c, _mm_set1_ps(1.f));
+	
+	poly_mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+	
+	if (cos_flag)
+	{
+		sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_xor_si128(j, _mm_slli_epi32(j, 1)), 29));
+		return _mm_xor_ps(_mm_sel_ps(c, s, poly_mask), _mm_and_ps(sign, _mm_set1_ps(-0.f)));
+	}
+	
+	sign = _mm_xor_ps(_mm_and_ps(a, _mm_set1_ps(-0.f)), _mm_castsi128_ps(_mm_slli_epi32(j, 29)));
+	return _mm_xor_ps(_mm_sel_ps(s, c, poly_mask), _mm_and_ps(sign, _mm_set1_ps(-0.f)));
+}
+
+static __inline vFloat f32_sin_op(vFloat a)
+{
+	return f32_sin_cos_op(a, 0);
+}
+
+static __inline vFloat f32_cos_op(vFloat a)
+{
+	return f32_sin_cos_op(a, 1);
+}
+
+static __inline vFloat f32_tan_op(vFloat a)
+{
+	vFloat x = _mm_andnot_ps(_mm_set1_ps(-0.f), a);
+	vSInt32 j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+	vFloat y, z, inverse_mask;
+	
+	// Reduce to |x| <= pi / 4 (and use -1 / tan(x) in odd quadrants)
+	
+	j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	y = _mm_cvtepi32_ps(j);
+	
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625E-4f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108E-8f)));
+	z = _mm_mul_ps(x, x);
+	
+	y = _mm_set1_ps(9.38540185543E-3f);
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(3.11992232697E-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(2.44301354525E-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(5.34112807005E-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(1.33387994085E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(3.33331568548E-1f));
+	y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, z), x), x);
+	
+	inverse_mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+	y = _mm_sel_ps(y, _mm_div_ps(_mm_set1_ps(-1.f), y), inverse_mask);
+	
+	return _mm_xor_ps(y, _mm_and_ps(a, _mm_set1_ps(-0.f)));
+}
+
+static __inline vFloat f32_tanh_op(vFloat a)
+{
+	vFloat x = _mm_andnot_ps(_mm_set1_ps(-0.f), a);
+	vFloat z = _mm_mul_ps(x, x);
+	vFloat y, large;
+	
+	// Polynomial for |x| < 0.625 and 1 - 2 / (exp(2x) + 1) otherwise
+	
+	y = _mm_set1_ps(-5.70498872745E-3f);
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(2.06390887954E-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(-5.37397155531E-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(1.33314422036E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(-3.33332819422E-1f));
+	y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, z), x), x);
+	
+	large = f32_exp_op(_mm_add_ps(x, x));
+	large = _mm_sub_ps(_mm_set1_ps(1.f), _mm_div_ps(_mm_set1_ps(2.f), _mm_add_ps(large, _mm_set1_ps(1.f))));
+	
+	y = _mm_sel_ps(y, large, _mm_cmpge_ps(x, _mm_set1_ps(0.625f)));
+	
+	return _mm_xor_ps(y, _mm_and_ps(a, _mm_set1_ps(-0.f)));
+}
+
+static __inline vFloat f32_atan_op(vFloat a)
+{
+	vFloat x = _mm_andnot_ps(_mm_set1_ps(-0.f), a);
+	vFloat large = _mm_cmpgt_ps(x, _mm_set1_ps(2.414213562373095f));
+	vFloat medium = _mm_andnot_ps(large, _mm_cmpgt_ps(x, _mm_set1_ps(0.4142135623730950f)));
+	vFloat y, z, offset;
+	
+	// Reduce to |x| <= tan(pi / 8) using atan(x) = pi / 2 - atan(1 / x) and atan(x) = pi / 4 + atan((x - 1) / (x + 1))
+	
+	x = _mm_sel_ps(x, _mm_div_ps(_mm_set1_ps(-1.f), x), large);
+	x = _mm_sel_ps(x, _mm_div_ps(_mm_sub_ps(x, _mm_set1_ps(1.f)), _mm_add_ps(x, _mm_set1_ps(1.f))), medium);
+	offset = _mm_or_ps(_mm_and_ps(large, _mm_set1_ps(1.5707963267948966f)), _mm_and_ps(medium, _mm_set1_ps(0.7853981633974483f)));
+	z = _mm_mul_ps(x, x);
+	
+	y = _mm_set1_ps(8.05374449538E-2f);
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(-1.38776856032E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(1.99777106478E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(-3.33329491539E-1f));
+	y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, z), x), x), offset);
+	
+	return _mm_xor_ps(y, _mm_and_ps(a, _mm_set1_ps(-0.f)));
+}
+
+// 64 bit trigonometric / hyperbolic
+
+static __inline vDouble f64_sin_cos_op(vDouble a, int cos_flag)
+{
+	// Reduce to |x| <= pi / 4 and use the sine or cosine polynomial according to the octant (cos_flag should be a constant)
+	
+	vDouble x = _mm_andnot_pd(_mm_set1_pd(-0.0), a);
+	vSInt32 j = _mm_cvttpd_epi32(_mm_mul_pd(x, _mm_set1_pd(1.27323954473516268615)));
+	vDouble y, z, s, c, poly_mask, sign;
+	
+	j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	y = _mm_cvtepi32_pd(j);
+	
+	x = _mm_sub_pd(x, _mm_mul_pd(y, _mm_set1_pd(7.85398125648498535156E-1)));
+	x = _mm_sub_pd(x, _mm_mul_pd(y, _mm_set1_pd(3.77489470793079817668E-8)));
+	x = _mm_sub_pd(x, _mm_mul_pd(y, _mm_set1_pd(2.69515142907905952645E-15)));
+	z = _mm_mul_pd(x, x);
+	
+	s = _mm_set1_pd(1.58962301576546568060E-10);
+	s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(-2.50507477628578072866E-8));
+	s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(2.75573136213857245213E-6));
+	s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(-1.98412698295895385996E-4));
+	s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(8.33333333332211858878E-3));
+	s = _mm_add_pd(_mm_mul_pd(s, z), _mm_set1_pd(-1.66666666666666307295E-1));
+	s = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(s, z), x), x);
+	
+	c = _mm_set1_pd(-1.13585365213876817300E-11);
+	c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(2.08757008419747316778E-9));
+	c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(-2.75573141792967388112E-7));
+	c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(2.48015872888517045348E-5));
+	c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(-1.38888888888730564116E-3));
+	c = _mm_add_pd(_mm_mul_pd(c, z), _mm_set1_pd(4.16666666666665929218E-2));
+	c = _mm_sub_pd(_mm_mul_pd(_mm_mul_pd(c, z), z), _mm_mul_pd(z, _mm_set1_pd(0.5)));
+	c = _mm_add_pd(c, _mm_set1_pd(1.0));
+	
+	poly_mask = f64_sel_mask_from_i32(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+	
+	if (cos_flag)
+	{
+		sign = f64_sign_from_i32(_mm_slli_epi32(_mm_xor_si128(j, _mm_slli_epi32(j, 1)), 29));
+		return _mm_xor_pd(_mm_sel_pd(c, s, poly_mask), _mm_and_pd(sign, _mm_set1_pd(-0.0)));
+	}
+	
+	sign = _mm_xor_pd(_mm_and_pd(a, _mm_set1_pd(-0.0)), f64_sign_from_i32(_mm_slli_epi32(j, 29)));
+	return _mm_xor_pd(_mm_sel_pd(s, c, poly_mask), _mm_and_pd(sign, _mm_set1_pd(-0.0)));
+}
+
+static __inline vDouble f64_sin_op(vDouble a)
+{
+	return f64_sin_cos_op(a, 0);
+}
+
+static __inline vDouble f64_cos_op(vDouble a)
+{
+	return f64_sin_cos_op(a, 1);
+}
+
+static __inline vDouble f64_tan_op(vDouble a)
+{
+	vDouble x = _mm_andnot_pd(_mm_set1_pd(-0.0), a);
+	vSInt32 j = _mm_cvttpd_epi32(_mm_mul_pd(x, _mm_set1_pd(1.27323954473516268615)));
+	vDouble p, q, y, z, inverse_mask;
+	
+	// Reduce to |x| <= pi / 4 (and use -1 / tan(x) in odd quadrants)
+	
+	j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	y = _mm_cvtepi32_pd(j);
+	
+	x = _mm_sub_pd(x, _mm_mul_pd(y, _mm_set1_pd(7.853981554508209228515625E-1)));
+	x = _mm_sub_pd(x, _mm_mul_pd(y, _mm_set1_pd(7.94662735614792836714E-9)));
+	x = _mm_sub_pd(x, _mm_mul_pd(y, _mm_set1_pd(3.06161699786838294307E-17)));
+	z = _mm_mul_pd(x, x);
+	
+	p = _mm_set1_pd(-1.30936939181383777646E4);
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(1.15351664838587416140E6));
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-1.79565251976484877988E7));
+	
+	q = _mm_add_pd(z, _mm_set1_pd(1.36812963470692954678E4));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(-1.32089234440210967447E6));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(2.50083801823357915839E7));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(-5.38695755929454629881E7));
+	
+	y = _mm_add_pd(x, _mm_mul_pd(x, _mm_div_pd(_mm_mul_pd(z, p), q)));
+	
+	inverse_mask = f64_sel_mask_from_i32(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+	y = _mm_sel_pd(y, _mm_div_pd(_mm_set1_pd(-1.0), y), inverse_mask);
+	
+	return _mm_xor_pd(y, _mm_and_pd(a, _mm_set1_pd(-0.0)));
+}
+
+static __inline vDouble f64_tanh_op(vDouble a)
+{
+	vDouble x = _mm_andnot_pd(_mm_set1_pd(-0.0), a);
+	vDouble z = _mm_mul_pd(x, x);
+	vDouble p, q, y, large;
+	
+	// Rational function for |x| < 0.625 and 1 - 2 / (exp(2x) + 1) otherwise
+	
+	p = _mm_set1_pd(-9.64399179425052238628E-1);
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-9.92877231001918586564E1));
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-1.61468768441708447952E3));
+	
+	q = _mm_add_pd(z, _mm_set1_pd(1.12811678491632931402E2));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(2.23548839060100448583E3));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(4.84406305325125486048E3));
+	
+	y = _mm_add_pd(x, _mm_mul_pd(x, _mm_div_pd(_mm_mul_pd(z, p), q)));
+	
+	large = f64_exp_op(_mm_add_pd(x, x));
+	large = _mm_sub_pd(_mm_set1_pd(1.0), _mm_div_pd(_mm_set1_pd(2.0), _mm_add_pd(large, _mm_set1_pd(1.0))));
+	
+	y = _mm_sel_pd(y, large, _mm_cmpge_pd(x, _mm_set1_pd(0.625)));
+	
+	return _mm_xor_pd(y, _mm_and_pd(a, _mm_set1_pd(-0.0)));
+}
+
+static __inline vDouble f64_atan_op(vDouble a)
+{
+	vDouble x = _mm_andnot_pd(_mm_set1_pd(-0.0), a);
+	vDouble large = _mm_cmpgt_pd(x, _mm_set1_pd(2.41421356237309504880));
+	vDouble medium = _mm_andnot_pd(large, _mm_cmpgt_pd(x, _mm_set1_pd(0.66)));
+	vDouble p, q, y, z, offset;
+	
+	// Reduce using atan(x) = pi / 2 - atan(1 / x) and atan(x) = pi / 4 + atan((x - 1) / (x + 1))
+	
+	x = _mm_sel_pd(x, _mm_div_pd(_mm_set1_pd(-1.0), x), large);
+	x = _mm_sel_pd(x, _mm_div_pd(_mm_sub_pd(x, _mm_set1_pd(1.0)), _mm_add_pd(x, _mm_set1_pd(1.0))), medium);
+	offset = _mm_or_pd(_mm_and_pd(large, _mm_set1_pd(1.57079632679489661923 + 6.123233995736765886130E-17)), _mm_and_pd(medium, _mm_set1_pd(7.85398163397448309616E-1 + 3.061616997868382943065E-17)));
+	z = _mm_mul_pd(x, x);
+	
+	p = _mm_set1_pd(-8.750608600031904122785E-1);
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-1.615753718733365076637E1));
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-7.500855792314704667340E1));
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-1.228866684490136173410E2));
+	p = _mm_add_pd(_mm_mul_pd(p, z), _mm_set1_pd(-6.485021904942025371773E1));
+	
+	q = _mm_add_pd(z, _mm_set1_pd(2.485846490142306297962E1));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(1.650270098316988542046E2));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(4.328810604912902668951E2));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(4.853903996359136964868E2));
+	q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(1.945506571482613964425E2));
+	
+	y = _mm_add_pd(_mm_add_pd(x, _mm_mul_pd(x, _mm_div_pd(_mm_mul_pd(z, p), q))), offset);
+	
+	return _mm_xor_pd(y, _mm_and_pd(a, _mm_set1_pd(-0.0)));
+}
+
+// 64 bit array versions (any length or alignment)
+
+static __inline void f64_log_array(double *out, double *in, long length)
+{
+	long i;
+	
+	for (i = 0; i + 1 < length; i += 2)
+		_mm_storeu_pd(out + i, f64_log_op(_mm_loadu_pd(in + i)));
+	if (i < length)
+		_mm_store_sd(out + i, f64_log_op(_mm_load_sd(in + i)));
+}
+
+static __inline void f64_exp_array(double *out, double *in, long length)
+{
+	long i;
+	
+	for (i = 0; i + 1 < length; i += 2)
+		_mm_storeu_pd(out + i, f64_exp_op(_mm_loadu_pd(in + i)));
+	if (i < length)
+		_mm_store_sd(out + i, f64_exp_op(_mm_load_sd(in + i)));
+}
+
+static __inline void f64_pow_array(double *out, double *in1, double *in2, long length)
+{
+	// N.B. the argument order matches vvpow (out = in2^in1)
+	
+	long i;
+	
+	for (i = 0; i + 1 < length; i += 2)
+		_mm_storeu_pd(out + i, f64_pow_op(_mm_loadu_pd(in2 + i), _mm_loadu_pd(in1 + i)));
+	if (i < length)
+		_mm_store_sd(out + i, f64_pow_op(_mm_load_sd(in2 + i), _mm_load_sd(in1 + i)));
+}
+
+static __inline void f64_sin_array(double *out, double *in, long length)
+{
+	long i;
+	
+	for (i = 0; i + 1 < length; i += 2)
+		_mm_storeu_pd(out + i, f64_sin_op(_mm_loadu_pd(in + i)));
+	if (i < length)
+		_mm_store_sd(out + i, f64_sin_op(_mm_load_sd(in + i)));
+}
+
+static __inline void f64_cos_array(double *out, double *in, long length)
+{
+	long i;
+	
+	for (i = 0; i + 1 < length; i += 2)
+		_mm_storeu_pd(out + i, f64_cos_op(_mm_loadu_pd(in + i)));
+	if (i < length)
+		_mm_store_sd(out + i, f64_cos_op(_mm_load_sd(in + i)));
+}
+
+static __inline void f64_tan_array(double *out, double *in, long length)
+{
+	long i;
+	
+	for (i = 0; i + 1 < length; i += 2)
+		_mm_storeu_pd(out + i, f64_tan_op(_mm_loadu_pd(in + i)));
+	if (i < length)
+		_mm_store_sd(out + i, f64_tan_op(_mm_load_sd(in + i)));
+}
+
+static __inline void f64_tanh_array(double *out, double *in, long length)
+{
+	long i;
+	
+	for (i = 0; i + 1 < length; i += 2)
+		_mm_storeu_pd(out + i, f64_tanh_op(_mm_loadu_pd(in + i)));
+	if (i < length)
+		_mm_store_sd(out + i, f64_tanh_op(_mm_load_sd(in + i)));
+}
+
+static __inline void f64_atan_array(double *out, double *in, long length)
+{
+	long i;
+	
+	for (i = 0; i + 1 < length; i += 2)
+		_mm_storeu_pd(out + i, f64_atan_op(_mm_loadu_pd(in + i)));
+	if (i < length)
+		_mm_store_sd(out + i, f64_atan_op(_mm_load_sd(in + i)));
+}
+
+#define F64_VEC_SIN_ARRAY(o, i, l) f64_sin_array(o, i, l)
+#define F64_VEC_COS_ARRAY(o, i, l) f64_cos_array(o, i, l)
+#define F64_VEC_TAN_ARRAY(o, i, l) f64_tan_array(o, i, l)
+#define F64_VEC_TANH_ARRAY(o, i, l) f64_tanh_array(o, i, l)
+#define F64_VEC_ATAN_ARRAY(o, i, l) f64_atan_array(o, i, l)
+
+#define F64_VEC_LOG_ARRAY(o, i, l) f64_log_array(o, i, l)
+#define F64_VEC_EXP_ARRAY(o, i, l) f64_exp_array(o, i, l)
+#define F64_VEC_POW_ARRAY(o, i1, i2, l) f64_pow_array(o, i1, i2, l)
+
+#define F32_VEC_COS_OP					f32_cos_op
+#define F32_VEC_SIN_OP					f32_sin_op
+#define F32_VEC_TAN_OP					f32_tan_op
+#define F32_VEC_TANH_OP					f32_tanh_op
+#define F32_VEC_ATAN_OP					f32_atan_op
+
+#define F32_VEC_LOG_OP					f32_log_op
+#define F32_VEC_EXP_OP					f32_exp_op
+#define F32_VEC_POW_OP					f32_pow_op
+
+#define F64_VEC_COS_OP					f64_cos_op
+#define F64_VEC_SIN_OP					f64_sin_op
+#define F64_VEC_TAN_OP					f64_tan_op
+#define F64_VEC_TANH_OP					f64_tanh_op
+#define F64_VEC_ATAN_OP					f64_atan_op
+
+#define F64_VEC_LOG_OP					f64_log_op
+#define F64_VEC_EXP_OP					f64_exp_op
+#define F64_VEC_POW_OP					f64_pow_op
+
 #endif
 
 #endif	/* _AH_CROSS_PLATFORM_VECTOR_OPS_EXTENDED_ */
@@ -9,7 +9,7 @@
 #ifndef _AH_WIN_MATH_
 #define _AH_WIN_MATH_
 
-#ifndef __APPLE__
+#if !defined (__APPLE__) && !defined (__linux__)
 
 #define _USE_MATH_DEFINES
 
@@ -5,6 +5,11 @@
 #ifdef __APPLE__
 #define ALIGNED_MALLOC malloc
 #define ALIGNED_FREE free
+#elif defined (__linux__)
+#include <malloc.h>
+#include <cpuid.h>
+#define ALIGNED_MALLOC(x)  memalign(16, x)
+#define ALIGNED_FREE(x)  free(x)
 #else
 #include <malloc.h>
 #define ALIGNED_MALLOC(x)  _aligned_malloc(x, 16)
@@ -42,8 +47,15 @@ typedef	__m128d vDouble;
 
 static __inline int SSE2_check()
 {
-#ifdef __APPLE__
+#if defined (__APPLE__)
 	return 1;
+#elif defined (__linux__)
+	unsigned int CPUInfo[4] = {0, 0, 0, 0};
+	
+	if (__get_cpuid(1, CPUInfo, CPUInfo + 1, CPUInfo + 2, CPUInfo + 3))
+		return (CPUInfo[3] >> 26) & 0x1;
+	
+	return 0;
 #else
 	int SSE2_flag = 0;
 	int CPUInfo[4] = {-1, 0, 0, 0};
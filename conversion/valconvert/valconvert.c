@@ -467,7 +467,7 @@ void valconvert_perform_SIMD64(t_valconvert *x, t_object *dsp64, double **ins, l
 			while (vec_size_over_2--)
 			{
 				scaled = F64_VEC_LOG_OP(*in++);
-				scaled = F64_VEC_SUB_OP(F64_VEC_MUL_OP(*out, mult), subtract);
+				scaled = F64_VEC_SUB_OP(F64_VEC_MUL_OP(scaled, mult), subtract);
 				*out++ = F64_VEC_MIN_OP(F64_VEC_MAX_OP(min, scaled), max);		
 			}
 			break;
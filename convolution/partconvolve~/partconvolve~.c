@@ -17,6 +17,8 @@
 #include <ext_obex.h>
 #include <z_dsp.h>
 
+#include <AH_Atomic.h>
+#include <AH_Types.h>
 #include <AH_VectorOps.h>
 #include <AH_Denormals.h>
 #include <AH_Random.h>
@@ -28,6 +30,7 @@
 #define MAX_FFT_SIZE_LOG2					20
 #define DEFAULT_MAX_FFT_SIZE_LOG2			16;
 #define BUFFER_SIZE_DEFAULT					1323000							// N.B. = 44100 * 30 or 30 seconds at 44.1kHz 
+#define DEFAULT_PARTITION_THRESHOLD			-200.							// N.B. in dB relative to the loudest partition
 
 #define FFTW_TWOPI							6.28318530717958647692
 
@@ -40,6 +43,59 @@ complex1.imagp = complex2.imagp + offset;
 void *this_class;
 
 
+// Partitioned impulse spectra are cached (per process) so that instances loading the same impulse can share them read-only
+
+typedef struct _partconvolve_kernel_key
+{
+	t_symbol *buffer_name;
+	AH_UInt64 hash;
+	
+	t_atom_long chan;
+	t_atom_long offset;
+	AH_SIntPtr length;
+	
+	long fft_size_log2;
+	long direct_flag;
+	long eq_flag;
+	
+} t_partconvolve_kernel_key;
+
+
+typedef struct _partconvolve_kernel
+{
+	t_partconvolve_kernel_key key;
+	
+	FFT_SPLIT_COMPLEX_F impulse_buffer;
+	long num_partitions;
+	
+	long ref_count;
+	struct _partconvolve_kernel *next;
+	
+} t_partconvolve_kernel;
+
+
+t_partconvolve_kernel *partconvolve_kernel_cache = 0;
+t_int32_atomic partconvolve_kernel_cache_lock = 0;
+
+
+// The kernel and the partitions to process are planned on load and published to the audio thread as a single pointer
+// Replaced plans (and the kernels they reference) are retired and only freed once the audio thread has acknowledged the current plan
+
+typedef struct _partconvolve_plan
+{
+	t_partconvolve_kernel *kernel;		// N.B. the plan holds a reference to the kernel
+	
+	long num_partitions;				// the number of partitions in the input buffer
+	long num_active;					// the number of active partitions after the first
+	long first_active;
+	
+	long *active;						// indices of the active partitions after the first (in order)
+	
+	struct _partconvolve_plan *next;
+	
+} t_partconvolve_plan;
+
+
 typedef struct _partconvolve
 {
     t_pxobject x_obj;
@@ -65,8 +121,8 @@ typedef struct _partconvolve
 	
 	// Scheduling variables
 	
-	long num_partitions;
 	long valid_partitions;
+	long valid_active;
 	long partitions_done;
 	long last_partition;
 	
@@ -77,19 +133,29 @@ typedef struct _partconvolve
 	
 	vFloat *fft_buffers[5];
 	
-	FFT_SPLIT_COMPLEX_F impulse_buffer;
 	FFT_SPLIT_COMPLEX_F	input_buffer;
 	FFT_SPLIT_COMPLEX_F	accum_buffer;
 	FFT_SPLIT_COMPLEX_F	partition_temp;
 	
 	long max_impulse_length;
 	
+	// Partition plans (partitions below the threshold are not processed)
+	
+	t_partconvolve_plan *plan;
+	t_partconvolve_plan *plan_ack;
+	t_partconvolve_plan *retired_plans;
+	
+	t_int32_atomic plan_lock;
+	void *plan_clock;
+	
 	// Attributes
 	
 	t_atom_long chan;
 	t_atom_long offset;
 	t_atom_long length;
 	
+	double threshold;
+	
 	// Flags
 	
 	bool reset_flag;				// reset fft data on next perform call
@@ -134,6 +200,7 @@ void *partconvolve_new(t_symbol *s, long argc, t_atom *argv);
 void partconvolve_max_fft_size_set(t_partconvolve *x, long max_fft_size);
 t_max_err partconvolve_fft_size_set(t_partconvolve *x, t_object *attr, long argc, t_atom *argv);
 t_max_err partconvolve_fft_size_get(t_partconvolve *x, t_object *attr, long *argc, t_atom **argv);
+t_max_err partconvolve_threshold_set(t_partconvolve *x, t_object *attr, long argc, t_atom *argv);
 
 t_max_err partconvolve_notify(t_partconvolve *x, t_symbol *s, t_symbol *msg, void *sender, void *data);
 
@@ -143,6 +210,19 @@ void partconvolve_set(t_partconvolve *x,  t_symbol *msg, long argc, t_atom *argv
 void partconvolve_set_internal(t_partconvolve *x, t_symbol *s, bool direct_flag, bool eq_flag);
 
 void partconvolve_partition(t_partconvolve *x, long direct_flag);
+double partconvolve_partition_energy(FFT_SPLIT_COMPLEX_F partition, long fft_size_halved);
+t_partconvolve_plan *partconvolve_plan_new(t_partconvolve *x, t_partconvolve_kernel *kernel);
+void partconvolve_plan_publish(t_partconvolve *x, t_partconvolve_plan *plan);
+void partconvolve_plan_collect(t_partconvolve *x);
+void partconvolve_plan_free(t_partconvolve_plan *plan);
+
+AH_UInt64 partconvolve_kernel_hash(t_partconvolve *x, void *buffer_samples_ptr, AH_SIntPtr buffer_pos, AH_SIntPtr impulse_length, long n_chans, long chan, long format);
+bool partconvolve_kernel_key_equal(t_partconvolve_kernel_key *key1, t_partconvolve_kernel_key *key2);
+t_partconvolve_kernel *partconvolve_kernel_find(t_partconvolve_kernel_key *key);
+t_partconvolve_kernel *partconvolve_kernel_retain(t_partconvolve_kernel_key *key);
+t_partconvolve_kernel *partconvolve_kernel_insert(t_partconvolve_kernel *kernel);
+void partconvolve_kernel_release(t_partconvolve_kernel *kernel);
+void partconvolve_kernel_free(t_partconvolve_kernel *kernel);
 
 void partconvolve_perform_partition(FFT_SPLIT_COMPLEX_F in1, FFT_SPLIT_COMPLEX_F in2, FFT_SPLIT_COMPLEX_F out, long num_vecs);
 void partconvolve_perform_eq(FFT_SPLIT_COMPLEX_F in1, FFT_SPLIT_COMPLEX_F in2, FFT_SPLIT_COMPLEX_F out, long num_vecs);
@@ -198,6 +278,10 @@ int C74_EXPORT main(void)
     CLASS_ATTR_LONG(this_class, "chan", 0L, t_partconvolve, chan);
     CLASS_ATTR_FILTER_CLIP(this_class, "chan", 1, 4);
     CLASS_ATTR_LABEL(this_class, "chan", 0L, "Buffer Read Channel");
+    
+    CLASS_ATTR_DOUBLE(this_class, "threshold", 0L, t_partconvolve, threshold);
+    CLASS_ATTR_ACCESSORS(this_class, "threshold", 0L, partconvolve_threshold_set);
+    CLASS_ATTR_LABEL(this_class, "threshold", 0L, "Partition Silence Threshold (dB)");
 
 	// Add dsp and register 
 	
@@ -217,8 +301,11 @@ int C74_EXPORT main(void)
 void partconvolve_free(t_partconvolve *x)
 {
 	dsp_free(&x->x_obj);
+	freeobject(x->plan_clock);
 	hisstools_destroy_setup_f(x->fft_setup_real);
-	ALIGNED_FREE(x->impulse_buffer.realp);
+	partconvolve_plan_free(x->retired_plans);
+	partconvolve_plan_free(x->plan);
+	ALIGNED_FREE(x->input_buffer.realp);
 	ALIGNED_FREE(x->fft_buffers[0]);
 	ALIGNED_FREE(x->safe_signal);
 }
@@ -242,7 +329,12 @@ void *partconvolve_new(t_symbol *s, long argc, t_atom *argv)
 	
 	x->buffer_pointer = 0;
 	x->buffer_name = 0;
-	x->num_partitions = 0;
+	
+	x->plan = partconvolve_plan_new(x, 0);
+	x->plan_ack = x->plan;
+	x->retired_plans = 0;
+	x->plan_lock = 0;
+	x->plan_clock = clock_new(x, (method) partconvolve_plan_collect);
 	
 	x->max_fft_size_log2 = DEFAULT_MAX_FFT_SIZE_LOG2;
 	x->max_fft_size = 1 << x->max_fft_size_log2;
@@ -252,6 +344,7 @@ void *partconvolve_new(t_symbol *s, long argc, t_atom *argv)
 	x->length = 0;
 	x->offset = 0;
 	x->chan = 1;
+	x->threshold = DEFAULT_PARTITION_THRESHOLD;
 	
 	// Check arguments
 	
@@ -280,7 +373,7 @@ void *partconvolve_new(t_symbol *s, long argc, t_atom *argv)
 		argc--;
 	}
 	
-	// Allocate impulse buffer and input buffer
+	// Allocate input buffer (the impulse buffer is shared via the kernel cache)
 	
 	max_impulse_length = x->max_impulse_length;
 	
@@ -295,9 +388,7 @@ void *partconvolve_new(t_symbol *s, long argc, t_atom *argv)
 		max_impulse_length *= (max_fft_over_4 * 2);
 	}
 	
-	x->impulse_buffer.realp = (float *) ALIGNED_MALLOC ((max_impulse_length * 4 * sizeof(float)));
-	x->impulse_buffer.imagp = x->impulse_buffer.realp + max_impulse_length;
-	x->input_buffer.realp = x->impulse_buffer.imagp + max_impulse_length;
+	x->input_buffer.realp = (float *) ALIGNED_MALLOC ((max_impulse_length * 2 * sizeof(float)));
 	x->input_buffer.imagp = x->input_buffer.realp + max_impulse_length;
 	
 	// Allocate fft and temporary buffers	
@@ -316,7 +407,7 @@ void *partconvolve_new(t_symbol *s, long argc, t_atom *argv)
 	
 	x->fft_setup_real = hisstools_create_setup_f (x->max_fft_size_log2);			
 	
-	x->memory_flag = 1 && x->fft_buffers[0] && x->impulse_buffer.realp && x->fft_setup_real;
+	x->memory_flag = 1 && x->fft_buffers[0] && x->input_buffer.realp && x->plan && x->fft_setup_real;
 	
 	// Set attributes from arguments
 	
@@ -394,7 +485,7 @@ t_max_err partconvolve_fft_size_set(t_partconvolve *x, t_object *attr, long argc
 	
 	if (fft_size_log2 != x->fft_size_log2 && x->memory_flag)					
 	{
-		x->num_partitions = 0;
+		partconvolve_plan_publish(x, partconvolve_plan_new(x, 0));
 		
 		// Initialise fft info
 		
@@ -443,6 +534,22 @@ t_max_err partconvolve_fft_size_get(t_partconvolve *x, t_object *attr, long *arg
 }
 
 
+t_max_err partconvolve_threshold_set(t_partconvolve *x, t_object *attr, long argc, t_atom *argv)
+{
+	if (!argc)
+		return MAX_ERR_NONE;
+	
+	x->threshold = atom_getfloat(argv);
+	
+	// Replan the loaded impulse if appropriate (the audio thread carries on with the current plan until the new one is published)
+	
+	if (x->memory_flag && x->plan->kernel && !x->eq_flag)
+		partconvolve_plan_publish(x, partconvolve_plan_new(x, partconvolve_kernel_retain(&x->plan->kernel->key)));
+	
+	return MAX_ERR_NONE;
+}
+
+
 t_max_err partconvolve_notify(t_partconvolve *x, t_symbol *s, t_symbol *msg, void *sender, void *data)
 {
     if (msg == gensym("attr_modified"))
@@ -508,7 +615,7 @@ void partconvolve_set_internal(t_partconvolve *x, t_symbol *s, bool direct_flag,
 	void *b = ibuffer_get_ptr (s);
 	
 	if (!eq_flag || !x->eq_flag) 
-		x->num_partitions = 0;
+		partconvolve_plan_publish(x, partconvolve_plan_new(x, 0));
 	
 	if (b)
 	{
@@ -527,7 +634,7 @@ void partconvolve_set_internal(t_partconvolve *x, t_symbol *s, bool direct_flag,
 			object_error( (t_object *) x, "%s is not a valid buffer", s->s_name);
 			x->buffer_pointer = 0;
 			x->buffer_name = s; 
-			x->num_partitions = 0;
+			partconvolve_plan_publish(x, partconvolve_plan_new(x, 0));
 			
 			// We still store the buffer_name, as it may become valid later
 		}
@@ -535,8 +642,8 @@ void partconvolve_set_internal(t_partconvolve *x, t_symbol *s, bool direct_flag,
 		{
 			x->buffer_pointer = 0;
 			x->buffer_name = 0;
-			x->num_partitions = 0;
 			x->reset_flag = 1;
+			partconvolve_plan_publish(x, partconvolve_plan_new(x, 0));
 		}
 	}
 }
@@ -569,9 +676,12 @@ void partconvolve_partition(t_partconvolve *x, long direct_flag)
 	// Partition variables
 	
 	float *buffer_temp1 = (float *) x->partition_temp.realp;
-	FFT_SPLIT_COMPLEX_F impulse_buffer = x->impulse_buffer;
 	FFT_SPLIT_COMPLEX_F buffer_temp2;
 	
+	t_partconvolve_kernel_key key;
+	t_partconvolve_kernel *kernel;
+	t_partconvolve_plan *plan;
+	
     AH_SIntPtr impulse_length;
     AH_SIntPtr buffer_pos;
     long num_partitions, n_samps, i;
@@ -583,7 +693,7 @@ void partconvolve_partition(t_partconvolve *x, long direct_flag)
 	
 	if (!ibuffer_info (b, &buffer_samples_ptr, &impulse_length, &n_chans, &format))
 	{
-		x->num_partitions = 0;
+		partconvolve_plan_publish(x, partconvolve_plan_new(x, 0));
 		return;
 	}
 		
@@ -609,60 +719,434 @@ void partconvolve_partition(t_partconvolve *x, long direct_flag)
 		object_error( (t_object *) x, "internal buffer is not large enough to load entire buffer~ into memory");
 	}
 	
-	// Partition / load the impulse
+	// Look for an existing kernel with the same contents and parameters
+	
+	key.buffer_name = buffer_name;
+	key.hash = partconvolve_kernel_hash(x, buffer_samples_ptr, offset, impulse_length, n_chans, chan, format);
+	key.chan = chan;
+	key.offset = offset;
+	key.length = impulse_length;
+	key.fft_size_log2 = fft_size_log2;
+	key.direct_flag = direct_flag ? 1 : 0;
+	key.eq_flag = x->eq_flag ? 1 : 0;
 	
-	if (direct_flag)
+	kernel = impulse_length ? partconvolve_kernel_retain(&key) : 0;
+	
+	if (impulse_length && !kernel)
 	{
-		for (buffer_pos = offset, buffer_temp2 = impulse_buffer, num_partitions = 0; impulse_length > 0; buffer_pos += fft_size_halved, impulse_length -= fft_size_halved, num_partitions++)
+		// Allocate a new kernel
+		
+		num_partitions = direct_flag ? (long) ((impulse_length + fft_size - 1) / fft_size) : (long) ((impulse_length + fft_size_halved - 1) / fft_size_halved);
+		
+		kernel = (t_partconvolve_kernel *) malloc(sizeof(t_partconvolve_kernel));
+		
+		if (kernel)
+			kernel->impulse_buffer.realp = (float *) ALIGNED_MALLOC(num_partitions * fft_size * sizeof(float));
+		
+		if (!kernel || !kernel->impulse_buffer.realp)
 		{
-			// Get real values (zero pad if not enough data)
-			
-			n_samps = (impulse_length > fft_size_halved) ? fft_size_halved : impulse_length;			
-			ibuffer_get_samps (buffer_samples_ptr, buffer_temp2.realp, buffer_pos, n_samps, n_chans, chan, format);
-			for (i = n_samps; i < fft_size_halved; i++)
-				buffer_temp2.realp[i] = 0;
-			
-			// Get imag values (zero pad if not enough data)
+			free(kernel);
+			ibuffer_decrement_inuse (b);
+			object_error( (t_object *) x, "couldn't allocate memory for impulse");
+			return;
+		}
+		
+		kernel->impulse_buffer.imagp = kernel->impulse_buffer.realp + (num_partitions * fft_size_halved);
+		kernel->num_partitions = num_partitions;
+		kernel->key = key;
+		kernel->ref_count = 1;
+		kernel->next = 0;
+		
+		// Partition / load the impulse
+		
+		if (direct_flag)
+		{
+			for (buffer_pos = offset, buffer_temp2 = kernel->impulse_buffer; impulse_length > 0; buffer_pos += fft_size_halved, impulse_length -= fft_size_halved)
+			{
+				// Get real values (zero pad if not enough data)
+				
+				n_samps = (impulse_length > fft_size_halved) ? fft_size_halved : impulse_length;			
+				ibuffer_get_samps (buffer_samples_ptr, buffer_temp2.realp, buffer_pos, n_samps, n_chans, chan, format);
+				for (i = n_samps; i < fft_size_halved; i++)
+					buffer_temp2.realp[i] = 0;
+				
+				// Get imag values (zero pad if not enough data)
+				
+				impulse_length -= fft_size_halved;
+				n_samps = (impulse_length > fft_size_halved) ? fft_size_halved : impulse_length;			
+				ibuffer_get_samps (buffer_samples_ptr, buffer_temp2.imagp, buffer_pos + fft_size_halved, n_samps, n_chans, chan, format);			
+				for (i = n_samps; i < fft_size_halved; i++)
+					buffer_temp2.imagp[i] = 0;
+				
+				DSP_SPLIT_COMPLEX_POINTER_CALC (buffer_temp2, buffer_temp2, fft_size_halved);
+			}
 			
-			impulse_length -= fft_size_halved;
-			n_samps = (impulse_length > fft_size_halved) ? fft_size_halved : impulse_length;			
-			ibuffer_get_samps (buffer_samples_ptr, buffer_temp2.imagp, buffer_pos + fft_size_halved, n_samps, n_chans, chan, format);			
-			for (i = n_samps; i < fft_size_halved; i++)
-				buffer_temp2.imagp[i] = 0;
+		}
+		else
+		{
+			for (buffer_pos = offset, buffer_temp2 = kernel->impulse_buffer; impulse_length > 0; buffer_pos += fft_size_halved, impulse_length -= fft_size_halved)
+			{
+				 // Get samples up to half the fft size
+				
+				n_samps = (impulse_length > fft_size_halved) ? fft_size_halved : impulse_length;			
+				ibuffer_get_samps (buffer_samples_ptr, buffer_temp1, buffer_pos, n_samps, n_chans, chan, format);
+				
+				// Zero pad
+				
+				for (i = n_samps; i < fft_size; i++)
+					buffer_temp1[i] = 0;
+				
+				// Do fft straight into position
+				
+				hisstools_unzip_f (buffer_temp1, &buffer_temp2, fft_size_log2);
+				hisstools_rfft_f (fft_setup_real, &buffer_temp2, fft_size_log2);
+				DSP_SPLIT_COMPLEX_POINTER_CALC (buffer_temp2, buffer_temp2, fft_size_halved);
+			}
+		}
+		
+		// Add to the cache (if an identical kernel was added in the meantime that one is returned instead)
+		
+		kernel = partconvolve_kernel_insert(kernel);
+	}
+	
+	ibuffer_decrement_inuse (b);
+	
+	// Plan the partitions to process (skipping silent partitions)
+	
+	plan = partconvolve_plan_new(x, kernel);
+	
+	if (!plan)
+		return;
+	
+	// Set flags and publish the plan (the old kernel is released once the audio thread has stopped using it)
+	
+	if (!x->plan->num_partitions) 
+		x->reset_flag = 1;
+	
+	partconvolve_plan_publish(x, plan);
+}
+
+
+AH_UInt64 partconvolve_kernel_hash(t_partconvolve *x, void *buffer_samples_ptr, AH_SIntPtr buffer_pos, AH_SIntPtr impulse_length, long n_chans, long chan, long format)
+{
+	float *buffer_temp = (float *) x->partition_temp.realp;
+	
+	long fft_size_halved = x->fft_size >> 1;
+	long n_samps, i, j;
+	
+	// 64 bit FNV-1a hash of the sample values as loaded
+	
+	AH_UInt64 hash = 14695981039346656037ULL;
+	
+	for (; impulse_length > 0; buffer_pos += n_samps, impulse_length -= n_samps)
+	{
+		n_samps = (impulse_length > fft_size_halved) ? fft_size_halved : impulse_length;
+		ibuffer_get_samps (buffer_samples_ptr, buffer_temp, buffer_pos, n_samps, n_chans, chan, format);
+		
+		for (i = 0; i < n_samps; i++)
+		{
+			unsigned char *bytes = (unsigned char *) (buffer_temp + i);
 			
-			DSP_SPLIT_COMPLEX_POINTER_CALC (buffer_temp2, buffer_temp2, fft_size_halved);
+			for (j = 0; j < (long) sizeof(float); j++)
+			{
+				hash ^= bytes[j];
+				hash *= 1099511628211ULL;
+			}
 		}
+	}
+	
+	return hash;
+}
+
+
+bool partconvolve_kernel_key_equal(t_partconvolve_kernel_key *key1, t_partconvolve_kernel_key *key2)
+{
+	// N.B. the fields are compared individually as the struct may contain padding
+	
+	return key1->buffer_name == key2->buffer_name && key1->hash == key2->hash && key1->chan == key2->chan && key1->offset == key2->offset && key1->length == key2->length && key1->fft_size_log2 == key2->fft_size_log2 && key1->direct_flag == key2->direct_flag && key1->eq_flag == key2->eq_flag;
+}
+
+
+t_partconvolve_kernel *partconvolve_kernel_find(t_partconvolve_kernel_key *key)
+{
+	t_partconvolve_kernel *kernel;
+	
+	// N.B. the caller must hold the lock
+	
+	for (kernel = partconvolve_kernel_cache; kernel; kernel = kernel->next)
+		if (partconvolve_kernel_key_equal(&kernel->key, key))
+			break;
+	
+	return kernel;
+}
+
+
+t_partconvolve_kernel *partconvolve_kernel_retain(t_partconvolve_kernel_key *key)
+{
+	t_partconvolve_kernel *kernel;
+	
+	// Spin on the lock
+	
+	while (!Atomic_Compare_And_Swap_Barrier(0, 1, &partconvolve_kernel_cache_lock));
+	
+	kernel = partconvolve_kernel_find(key);
+	
+	if (kernel)
+		kernel->ref_count++;
+	
+	// This should never fail as this thread has the lock 
+	
+	Atomic_Compare_And_Swap_Barrier(1, 0, &partconvolve_kernel_cache_lock);
+	
+	return kernel;
+}
+
+
+t_partconvolve_kernel *partconvolve_kernel_insert(t_partconvolve_kernel *kernel)
+{
+	t_partconvolve_kernel *existing;
+	
+	// Spin on the lock (the lookup and the insertion are done under the same lock so that no duplicates are added)
+	
+	while (!Atomic_Compare_And_Swap_Barrier(0, 1, &partconvolve_kernel_cache_lock));
+	
+	existing = partconvolve_kernel_find(&kernel->key);
+	
+	if (existing)
+		existing->ref_count++;
+	else
+	{
+		kernel->next = partconvolve_kernel_cache;
+		partconvolve_kernel_cache = kernel;
+	}
+	
+	// This should never fail as this thread has the lock 
+	
+	Atomic_Compare_And_Swap_Barrier(1, 0, &partconvolve_kernel_cache_lock);
+	
+	if (existing)
+	{
+		partconvolve_kernel_free(kernel);
+		return existing;
+	}
+	
+	return kernel;
+}
+
+
+void partconvolve_kernel_release(t_partconvolve_kernel *kernel)
+{
+	t_partconvolve_kernel **ptr;
+	
+	if (!kernel)
+		return;
+	
+	// Spin on the lock
+	
+	while (!Atomic_Compare_And_Swap_Barrier(0, 1, &partconvolve_kernel_cache_lock));
+	
+	if (!--kernel->ref_count)
+	{
+		// Remove from the cache
 		
+		for (ptr = &partconvolve_kernel_cache; *ptr; ptr = &(*ptr)->next)
+		{
+			if (*ptr == kernel)
+			{
+				*ptr = kernel->next;
+				break;
+			}
+		}
 	}
 	else
+		kernel = 0;
+	
+	// This should never fail as this thread has the lock 
+	
+	Atomic_Compare_And_Swap_Barrier(1, 0, &partconvolve_kernel_cache_lock);
+	
+	// N.B. kernels are only released by plans that the audio thread is no longer using, so the free can be immediate
+	
+	if (kernel)
+		partconvolve_kernel_free(kernel);
+}
+
+
+void partconvolve_kernel_free(t_partconvolve_kernel *kernel)
+{
+	ALIGNED_FREE(kernel->impulse_buffer.realp);
+	free(kernel);
+}
+
+
+double partconvolve_partition_energy(FFT_SPLIT_COMPLEX_F partition, long fft_size_halved)
+{
+	double energy = 0.;
+	
+	// N.B. the nyquist bin is stored in the first imaginary value, so all values can be summed together
+	
+	for (long i = 0; i < fft_size_halved; i++)
+		energy += (partition.realp[i] * partition.realp[i]) + (partition.imagp[i] * partition.imagp[i]);
+	
+	return energy;
+}
+
+
+t_partconvolve_plan *partconvolve_plan_new(t_partconvolve *x, t_partconvolve_kernel *kernel)
+{
+	t_partconvolve_plan *plan = (t_partconvolve_plan *) malloc(sizeof(t_partconvolve_plan));
+	
+	FFT_SPLIT_COMPLEX_F impulse_temp;
+	
+	long num_partitions = kernel ? kernel->num_partitions : 0;
+	
+	double max_energy = 0.;
+	double energy_threshold;
+	
+	long fft_size_halved = x->fft_size >> 1;
+	long last_active = 0;
+	long i;
+	
+	if (plan)
 	{
-		for (buffer_pos = offset, buffer_temp2 = impulse_buffer, num_partitions = 0; impulse_length > 0; buffer_pos += fft_size_halved, impulse_length -= fft_size_halved, num_partitions++)
+		plan->active = num_partitions ? (long *) malloc(num_partitions * sizeof(long)) : 0;
+		
+		if (num_partitions && !plan->active)
 		{
-			 // Get samples up to half the fft size
-			
-			n_samps = (impulse_length > fft_size_halved) ? fft_size_halved : impulse_length;			
-			ibuffer_get_samps (buffer_samples_ptr, buffer_temp1, buffer_pos, n_samps, n_chans, chan, format);
-			
-			// Zero pad
-			
-			for (i = n_samps; i < fft_size; i++)
-				buffer_temp1[i] = 0;
-			
-			// Do fft straight into position
-			
-			hisstools_unzip_f (buffer_temp1, &buffer_temp2, fft_size_log2);
-			hisstools_rfft_f (fft_setup_real, &buffer_temp2, fft_size_log2);
-			DSP_SPLIT_COMPLEX_POINTER_CALC (buffer_temp2, buffer_temp2, fft_size_halved);
+			free(plan);
+			plan = 0;
 		}
 	}
 	
-	// Set flags
+	if (!plan)
+	{
+		partconvolve_kernel_release(kernel);
+		object_error( (t_object *) x, "couldn't allocate memory for partition plan");
+		return 0;
+	}
 	
-	ibuffer_decrement_inuse (b);
+	plan->kernel = kernel;
+	plan->num_partitions = num_partitions;
+	plan->num_active = 0;
+	plan->first_active = num_partitions ? 1 : 0;
+	plan->next = 0;
 	
-	if (!x->num_partitions) 
-		x->reset_flag = 1;
-	x->num_partitions = num_partitions;
+	// In eq mode the single partition is applied multiplicatively so must always be processed
+	
+	if (!num_partitions || x->eq_flag)
+	{
+		for (i = 1; i < num_partitions; i++)
+			plan->active[plan->num_active++] = i;
+		
+		return plan;
+	}
+	
+	// Find the energy of the loudest partition
+	
+	for (i = 0, impulse_temp = kernel->impulse_buffer; i < num_partitions; i++)
+	{
+		double energy = partconvolve_partition_energy(impulse_temp, fft_size_halved);
+		
+		if (energy > max_energy)
+			max_energy = energy;
+		
+		DSP_SPLIT_COMPLEX_POINTER_CALC (impulse_temp, impulse_temp, fft_size_halved);
+	}
+	
+	// List the partitions that are above the threshold (relative to the loudest partition) so that only those are scheduled
+	
+	energy_threshold = max_energy * pow(10., x->threshold / 10.);
+	
+	for (i = 0, impulse_temp = kernel->impulse_buffer; i < num_partitions; i++)
+	{
+		if (partconvolve_partition_energy(impulse_temp, fft_size_halved) > energy_threshold)
+		{
+			if (i)
+				plan->active[plan->num_active++] = i;
+			last_active = i;
+		}
+		else if (!i)
+			plan->first_active = 0;
+		
+		DSP_SPLIT_COMPLEX_POINTER_CALC (impulse_temp, impulse_temp, fft_size_halved);
+	}
+	
+	// N.B. any silent tail is never scheduled (the input buffer keeps the full number of partitions so the plan can change without a reset)
+	
+	if (plan->num_active + plan->first_active < num_partitions)
+		object_post((t_object *) x, "dropped %ld of %ld partitions below threshold (%ld truncated from tail)", num_partitions - (plan->num_active + plan->first_active), num_partitions, num_partitions - (last_active + 1));
+	
+	return plan;
+}
+
+
+void partconvolve_plan_publish(t_partconvolve *x, t_partconvolve_plan *plan)
+{
+	if (!plan)
+		return;
+	
+	// Spin on the lock (the barrier also makes sure that the plan is complete before it is published)
+	
+	while (!Atomic_Compare_And_Swap_Barrier(0, 1, &x->plan_lock));
+	
+	x->plan->next = x->retired_plans;
+	x->retired_plans = x->plan;
+	x->plan = plan;
+	
+	// This should never fail as this thread has the lock 
+	
+	Atomic_Compare_And_Swap_Barrier(1, 0, &x->plan_lock);
+	
+	partconvolve_plan_collect(x);
+}
+
+
+void partconvolve_plan_collect(t_partconvolve *x)
+{
+	t_partconvolve_plan *retired = 0;
+	bool waiting;
+	
+	// Spin on the lock
+	
+	while (!Atomic_Compare_And_Swap_Barrier(0, 1, &x->plan_lock));
+	
+	// Retired plans are no longer in use once the audio thread has acknowledged the current plan (or if dsp is off)
+	
+	if (x->plan_ack != x->plan && !sys_getdspobjdspstate((t_object *) x))
+		x->plan_ack = x->plan;
+	
+	if (x->plan_ack == x->plan)
+	{
+		retired = x->retired_plans;
+		x->retired_plans = 0;
+	}
+	
+	waiting = x->retired_plans != 0;
+	
+	// This should never fail as this thread has the lock 
+	
+	Atomic_Compare_And_Swap_Barrier(1, 0, &x->plan_lock);
+	
+	partconvolve_plan_free(retired);
+	
+	// Otherwise try again later
+	
+	if (waiting)
+		clock_delay(x->plan_clock, 20);
+}
+
+
+void partconvolve_plan_free(t_partconvolve_plan *plan)
+{
+	t_partconvolve_plan *next;
+	
+	for (; plan; plan = next)
+	{
+		next = plan->next;
+		partconvolve_kernel_release(plan->kernel);
+		free(plan->active);
+		free(plan);
+	}
 }
 
 
@@ -718,12 +1202,18 @@ void partconvolve_perform_eq(FFT_SPLIT_COMPLEX_F in1, FFT_SPLIT_COMPLEX_F in2, F
 
 void partconvolve_perform_internal(t_partconvolve *x, vFloat *in, vFloat *out, long vec_size)
 {
-	FFT_SPLIT_COMPLEX_F impulse_buffer = x->impulse_buffer;
+	t_partconvolve_plan *plan = (t_partconvolve_plan *) Atomic_Load_Pointer_Barrier((void **) &x->plan);
+	t_partconvolve_kernel *kernel;
+	
+	FFT_SPLIT_COMPLEX_F impulse_buffer;
 	FFT_SPLIT_COMPLEX_F input_buffer = x->input_buffer;
 	FFT_SPLIT_COMPLEX_F accum_buffer = x->accum_buffer;
 	FFT_SPLIT_COMPLEX_F impulse_temp, buffer_temp;	
 	
-	long num_partitions = x->num_partitions;
+	long *active;
+	
+	long num_partitions;
+	long num_active;
 	long input_position = x->input_position;
 	long calculated_offset;
 	
@@ -733,7 +1223,8 @@ void partconvolve_perform_internal(t_partconvolve *x, vFloat *in, vFloat *out, l
 	long schedule_counter = x->schedule_counter;
 	long last_partition = x->last_partition;
 	long valid_partitions = x->valid_partitions;
-	long num_partitions_to_do, next_partition;
+	long valid_active = x->valid_active;
+	long num_partitions_to_do, buffer_partition;
 	
 	// FFT variables
 	
@@ -761,9 +1252,33 @@ void partconvolve_perform_internal(t_partconvolve *x, vFloat *in, vFloat *out, l
 	vFloat vscale_mult = float2vector((float) (1.0 / (double) (fft_size << 2)));	
 	vFloat Zero = {0.,0.,0.,0.};
 	
-	if  (!num_partitions || x->x_obj.z_disabled || !x->memory_flag)
+	if (!plan)
+		goto zero_output;
+	
+	kernel = plan->kernel;
+	active = plan->active;
+	num_partitions = plan->num_partitions;
+	num_active = plan->num_active;
+	
+	// Acknowledge the plan (retired plans are freed once this has been seen, so the old plan is never read)
+	
+	if (plan != x->plan_ack)
+	{
+		// Count the active partitions that are valid and those done this frame against the new plan
+		
+		for (valid_active = 0; valid_active < num_active && active[valid_active] < valid_partitions; valid_active++);
+		for (partitions_done = 0; partitions_done < valid_active && active[partitions_done] <= last_partition; partitions_done++);
+		
+		x->valid_active = valid_active;
+		x->partitions_done = partitions_done;
+		x->plan_ack = plan;
+	}
+	
+	if  (!num_partitions || !kernel || x->x_obj.z_disabled || !x->memory_flag)
 		goto zero_output;
 	
+	impulse_buffer = kernel->impulse_buffer;
+	
 	// If we need to reset everything we do that here - happens when the fft size changes, or a new buffer is loaded
 	
 	if (reset_flag)
@@ -788,6 +1303,7 @@ void partconvolve_perform_internal(t_partconvolve *x, vFloat *in, vFloat *out, l
 		partitions_done = 0;
 		last_partition = 0;
 		valid_partitions = 1;
+		valid_active = 0;
 		
 		// Set reset flag off
 		
@@ -820,36 +1336,32 @@ void partconvolve_perform_internal(t_partconvolve *x, vFloat *in, vFloat *out, l
 		
 		// Work loop and scheduling - this is where most of the convolution is done
 		// How many partitions to do this vector (make sure that all partitions are done before we need to do the next fft)?
+		// N.B. only active partitions are scheduled, so that the work is spread evenly
 		
 		if (++schedule_counter >= (fft_size_halved / vec_size) - 1) 
-			num_partitions_to_do = (valid_partitions - partitions_done) - 1;
+			num_partitions_to_do = valid_active - partitions_done;
 		else
-			num_partitions_to_do = ((schedule_counter * (valid_partitions - 1)) / ((fft_size_halved / vec_size) - 1)) - partitions_done;
+			num_partitions_to_do = ((schedule_counter * valid_active) / ((fft_size_halved / vec_size) - 1)) - partitions_done;
 		
-		while (num_partitions_to_do > 0)
+		for (; num_partitions_to_do > 0; num_partitions_to_do--, partitions_done++)
 		{
-			// Calculate buffer wraparounds (if wraparound is in the middle of this set of partitions this loop will run again)
+			// Calculate the input buffer position (with wraparound) for this partition
 			
-			next_partition = (last_partition < num_partitions) ? last_partition : 0;
-			last_partition = (next_partition + num_partitions_to_do) > num_partitions ? num_partitions : next_partition + num_partitions_to_do;
-			num_partitions_to_do -= last_partition - next_partition;
+			last_partition = active[partitions_done];
+			buffer_partition = input_position + last_partition;
+			if (buffer_partition >= num_partitions)
+				buffer_partition -= num_partitions;
 			
 			// Calculate offsets and pointers
 			
-			calculated_offset = (partitions_done + 1) * fft_size_halved;
+			calculated_offset = last_partition * fft_size_halved;
 			DSP_SPLIT_COMPLEX_POINTER_CALC (impulse_temp, impulse_buffer, calculated_offset);
-			calculated_offset = next_partition * fft_size_halved;
+			calculated_offset = buffer_partition * fft_size_halved;
 			DSP_SPLIT_COMPLEX_POINTER_CALC (buffer_temp, input_buffer, calculated_offset);			
 			
 			// Do processing
 			
-			for (i = next_partition; i < last_partition; i++)
-			{	
-				partconvolve_perform_partition (buffer_temp, impulse_temp, accum_buffer, fft_size_halved_over_4);
-				DSP_SPLIT_COMPLEX_POINTER_CALC (impulse_temp, impulse_temp, fft_size_halved);
-				DSP_SPLIT_COMPLEX_POINTER_CALC (buffer_temp, buffer_temp, fft_size_halved);
-				partitions_done++;
-			}
+			partconvolve_perform_partition (buffer_temp, impulse_temp, accum_buffer, fft_size_halved_over_4);
 		}
 		
 		// FFT processing - this is where we deal with the fft, any windowing, the first partition and overlapping	
@@ -880,7 +1392,7 @@ void partconvolve_perform_internal(t_partconvolve *x, vFloat *in, vFloat *out, l
 			
 			if (eq_flag) 
 				partconvolve_perform_eq(buffer_temp, impulse_buffer, accum_buffer, fft_size_halved_over_4); 
-			else 
+			else if (plan->first_active)
 				partconvolve_perform_partition(buffer_temp, impulse_buffer, accum_buffer, fft_size_halved_over_4);
 			
 			// Processing done - do inverse fft on the accumulation buffer
@@ -946,10 +1458,13 @@ void partconvolve_perform_internal(t_partconvolve *x, vFloat *in, vFloat *out, l
 			if (++valid_partitions > num_partitions) 
 				valid_partitions = num_partitions;
 			
+			while (valid_active < num_active && active[valid_active] < valid_partitions)
+				valid_active++;
+			
 			if (--input_position < 0)
 				input_position = num_partitions - 1;
 			
-			last_partition = input_position + 1;
+			last_partition = 0;
 			schedule_counter = 0;
 			partitions_done = 0;
 		}
@@ -964,6 +1479,7 @@ void partconvolve_perform_internal(t_partconvolve *x, vFloat *in, vFloat *out, l
 	
 	x->schedule_counter = schedule_counter;
 	x->valid_partitions = valid_partitions;
+	x->valid_active = valid_active;
 	x->partitions_done = partitions_done;
 	x->last_partition = last_partition;
 		
@@ -1044,12 +1560,30 @@ void partconvolve_dsp64 (t_partconvolve *x, t_object *dsp64, short *count, doubl
 
 void partconvolve_memoryusage(t_partconvolve *x)
 {
-	long memory_size = ((x->max_impulse_length * 4 * sizeof(float)) + ((x->max_fft_size >> 2) * 7 * sizeof(vFloat)));
+	t_partconvolve_kernel *kernel = x->plan ? x->plan->kernel : 0;
+	
+	long memory_size = ((x->max_impulse_length * 2 * sizeof(float)) + ((x->max_fft_size >> 2) * 7 * sizeof(vFloat)));
+	long kernel_size = kernel ? (kernel->num_partitions << kernel->key.fft_size_log2) * sizeof(float) : 0;
+	long ref_count = 0;
+	
+	// Spin on the lock (other instances change the reference count whilst holding it)
+	
+	while (!Atomic_Compare_And_Swap_Barrier(0, 1, &partconvolve_kernel_cache_lock));
+	
+	if (kernel)
+		ref_count = kernel->ref_count;
+	
+	// This should never fail as this thread has the lock 
+	
+	Atomic_Compare_And_Swap_Barrier(1, 0, &partconvolve_kernel_cache_lock);
 	
 	if (memory_size > 1024)
 		object_post ((t_object *)x, "using %.2lf MB", memory_size / 1048576.0);
 	else
 		object_post ((t_object *)x, "using %.2lf KB", memory_size / 1024.0);
+	
+	if (kernel)
+		object_post ((t_object *)x, "impulse using %.2lf MB (shared between %ld instances)", kernel_size / 1048576.0, ref_count);
 }
 
 
@@ -0,0 +1,298 @@
+
+/*
+ *  descriptors_cli
+ *
+ *	A command line tool for offline corpus analysis using the descriptors~ analysis (via descriptors_lib).
+ *
+ *	Files (WAV / AIFF) are read using IAudioFile and analysed in parallel, one file per job.
+ *	The analysis is set up using the same messages as the descriptors~ object, and each file produces one tab separated line of output:
+ *
+ *	descriptors_cli -m "fftparams 4096 1024" -m "descriptors energy mean pitch median" -j 8 -o corpus.txt sounds/
+ *
+ *	Options:
+ *
+ *	-m <message>	send a message to the analysers (fftparams / energythresh / descriptors / streaming / profile) - may be repeated
+ *	-j <jobs>		number of files to analyse in parallel (default 1)
+ *	-t <threads>	number of threads to use for each file (default 1)
+ *	-c <chan>		channel to analyse (one-based, default 1)
+ *	-f <size>		maximum fft size (default as descriptors~)
+ *	-d <bytes>		descriptor data size per analyser (default as descriptors~)
+ *	-o <file>		output file (default stdout)
+ *
+ *	Directories are searched recursively for .wav / .aif / .aiff / .aifc files, and output is written in sorted path order.
+ *	Build along with descriptors_lib (see descriptors_lib.h), IAudioFile.cpp and BaseAudioFile.cpp using -std=c++11.
+ *
+ *  Copyright 2010 Alex Harker. All rights reserved.
+ *
+ */
+
+
+#include "../descriptors_lib/descriptors_lib.h"
+#include "../../ibuffer suite/ibuffer~/AudioFile/IAudioFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#define MAX_RESULTS 4096
+
+struct CLIOptions
+{
+    CLIOptions() : jobs(1), threads(1), chan(0), maxFFTSize(0), descriptorDataSize(0), outputPath() {}
+
+    std::vector<std::string> messages;
+    std::vector<std::string> paths;
+
+    long jobs;
+    long threads;
+    long chan;
+    long maxFFTSize;
+    long descriptorDataSize;
+
+    std::string outputPath;
+};
+
+struct CLIResult
+{
+    CLIResult() : success(false) {}
+
+    bool success;
+    std::vector<double> values;
+};
+
+// File gathering
+
+bool isAudioFile(const std::string& path)
+{
+    const char *extensions[] = {".wav", ".aif", ".aiff", ".aifc"};
+
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+    {
+        size_t length = strlen(extensions[i]);
+
+        if (path.size() > length && !strcasecmp(path.c_str() + path.size() - length, extensions[i]))
+            return true;
+    }
+
+    return false;
+}
+
+void addFiles(std::vector<std::string>& files, const std::string& path)
+{
+    struct stat info;
+
+    if (stat(path.c_str(), &info))
+    {
+        fprintf(stderr, "descriptors_cli: could not find %s\n", path.c_str());
+        return;
+    }
+
+    if (!S_ISDIR(info.st_mode))
+    {
+        files.push_back(path);
+        return;
+    }
+
+    if (DIR *dir = opendir(path.c_str()))
+    {
+        while (struct dirent *entry = readdir(dir))
+        {
+            std::string name(entry->d_name);
+            std::string fullPath = path + "/" + name;
+
+            if (name == "." || name == "..")
+                continue;
+
+            if (!stat(fullPath.c_str(), &info) && S_ISDIR(info.st_mode))
+                addFiles(files, fullPath);
+            else if (isAudioFile(name))
+                files.push_back(fullPath);
+        }
+
+        closedir(dir);
+    }
+}
+
+// Analysis
+
+bool setupAnalyser(t_descriptors_lib *analyser, const CLIOptions& options)
+{
+    for (size_t i = 0; i < options.messages.size(); i++)
+        if (!descriptors_lib_message(analyser, options.messages[i].c_str()))
+            return false;
+
+    return true;
+}
+
+void analyseFile(t_descriptors_lib *analyser, const CLIOptions& options, const std::string& path, CLIResult& result)
+{
+    HISSTools::Utility::IAudioFile file(path);
+
+    if (!file.isOpen() || file.getIsError() || !file.getFrames())
+    {
+        fprintf(stderr, "descriptors_cli: could not read %s\n", path.c_str());
+        return;
+    }
+
+    long frames = file.getFrames();
+    long channels = file.getChannels();
+
+    std::vector<float> samples(frames * channels);
+    std::vector<double> output(MAX_RESULTS);
+
+    file.readInterleaved(&samples[0], frames);
+
+    long chan = options.chan < channels ? options.chan : options.chan % channels;
+    long numValues = descriptors_lib_analyse(analyser, &samples[0], frames, channels, file.getSamplingRate(), chan, 0.0, 0.0, options.threads, &output[0], MAX_RESULTS);
+
+    if (numValues < 0)
+    {
+        fprintf(stderr, "descriptors_cli: analysis failed for %s\n", path.c_str());
+        return;
+    }
+
+    result.values.assign(output.begin(), output.begin() + std::min(numValues, (long) MAX_RESULTS));
+    result.success = true;
+}
+
+void analysisJob(const CLIOptions *options, const std::vector<std::string> *files, std::vector<CLIResult> *results, std::atomic<size_t> *next)
+{
+    t_descriptors_lib *analyser = descriptors_lib_new(options->maxFFTSize, options->descriptorDataSize);
+
+    if (!analyser || !setupAnalyser(analyser, *options))
+    {
+        descriptors_lib_free(analyser);
+        return;
+    }
+
+    // Take the next unanalysed file until there are none left
+
+    for (size_t i = (*next)++; i < files->size(); i = (*next)++)
+        analyseFile(analyser, *options, (*files)[i], (*results)[i]);
+
+    descriptors_lib_free(analyser);
+}
+
+// Main
+
+void usage()
+{
+    fprintf(stderr, "usage: descriptors_cli [-m message]... [-j jobs] [-t threads] [-c chan] [-f max_fft_size] [-d data_size] [-o output] <file or directory>...\n");
+}
+
+int main(int argc, char **argv)
+{
+    CLIOptions options;
+    std::vector<std::string> files;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next(0);
+
+    // Parse arguments
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+
+        if (arg.size() == 2 && arg[0] == '-')
+        {
+            if (++i >= argc)
+            {
+                usage();
+                return 1;
+            }
+
+            switch (arg[1])
+            {
+                case 'm':   options.messages.push_back(argv[i]);                    break;
+                case 'j':   options.jobs = std::max(1L, atol(argv[i]));              break;
+                case 't':   options.threads = std::max(1L, atol(argv[i]));           break;
+                case 'c':   options.chan = std::max(1L, atol(argv[i])) - 1;          break;
+                case 'f':   options.maxFFTSize = atol(argv[i]);                      break;
+                case 'd':   options.descriptorDataSize = atol(argv[i]);              break;
+                case 'o':   options.outputPath = argv[i];                            break;
+
+                default:
+                    usage();
+                    return 1;
+            }
+        }
+        else
+            options.paths.push_back(arg);
+    }
+
+    if (options.paths.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    descriptors_lib_init();
+
+    // Check the messages once before starting any jobs
+
+    t_descriptors_lib *analyser = descriptors_lib_new(options.maxFFTSize, options.descriptorDataSize);
+    bool valid = analyser && setupAnalyser(analyser, options);
+    descriptors_lib_free(analyser);
+
+    if (!valid)
+        return 1;
+
+    // Gather files (sorted so that output order does not depend on the filesystem)
+
+    for (size_t i = 0; i < options.paths.size(); i++)
+        addFiles(files, options.paths[i]);
+
+    std::sort(files.begin(), files.end());
+
+    std::vector<CLIResult> results(files.size());
+
+    // Analyse
+
+    for (long i = 0; i < std::min(options.jobs, (long) files.size()); i++)
+        threads.push_back(std::thread(analysisJob, &options, &files, &results, &next));
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    // Write results
+
+    FILE *output = options.outputPath.empty() ? stdout : fopen(options.outputPath.c_str(), "w");
+    int failures = 0;
+
+    if (!output)
+    {
+        fprintf(stderr, "descriptors_cli: could not open %s for writing\n", options.outputPath.c_str());
+        return 1;
+    }
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (!results[i].success)
+        {
+            failures++;
+            continue;
+        }
+
+        fprintf(output, "%s", files[i].c_str());
+
+        for (size_t j = 0; j < results[i].values.size(); j++)
+            fprintf(output, "\t%.9g", results[i].values[j]);
+
+        fprintf(output, "\n");
+    }
+
+    if (output != stdout)
+        fclose(output);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,458 @@
+
+/*
+ *  descriptors_lib.c
+ *
+ *	Hosts the descriptors~ non real-time analysis outside of Max (see descriptors_lib.h).
+ *
+ *	This file provides the analyser interface, and implements the small set of Max routines declared in descriptors_standalone.h.
+ *	Buffers are plain interleaved 32 bit float arrays owned by the caller, threads are pthreads and posts / errors go to stderr.
+ *
+ *  Copyright 2010 Alex Harker. All rights reserved.
+ *
+ */
+
+
+#include "descriptors_lib.h"
+#include "descriptors_object.h"
+
+#include <stdarg.h>
+#include <pthread.h>
+
+
+// The analyser is the outlet, so the object must be the first member
+
+typedef struct _descriptors_lib_buffer
+{
+	float *samples;
+	AH_SIntPtr length;
+	long num_chans;
+	double sr;
+
+} t_descriptors_lib_buffer;
+
+struct _descriptors_lib
+{
+	t_descriptors x;
+	t_descriptors_lib_buffer buffer;
+
+	long output_length;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////// Analyser Interface ////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static pthread_once_t descriptors_lib_once = PTHREAD_ONCE_INIT;
+
+
+void descriptors_lib_init ()
+{
+	pthread_once(&descriptors_lib_once, descriptors_main_common);
+}
+
+
+t_descriptors_lib *descriptors_lib_new (long max_fft_size, long descriptor_data_size)
+{
+	t_descriptors_lib *x = calloc(1, sizeof(t_descriptors_lib));
+
+	if (!x)
+		return 0;
+
+	descriptors_lib_init();
+
+	if (!descriptors_non_rt_init(&x->x, max_fft_size, descriptor_data_size, 0))
+	{
+		free(x);
+		return 0;
+	}
+
+	return x;
+}
+
+
+void descriptors_lib_free (t_descriptors_lib *x)
+{
+	if (!x)
+		return;
+
+	descriptors_free(&x->x);
+	free(x);
+}
+
+
+static long descriptors_lib_parse_atom (t_atom *a, char *token)
+{
+	char *end;
+	double val = strtod(token, &end);
+
+	if (end == token || *end)
+		atom_setsym(a, gensym(token));
+	else if (strpbrk(token, ".eEnN"))
+		atom_setfloat(a, val);
+	else
+		atom_setlong(a, strtol(token, 0, 10));
+
+	return 1;
+}
+
+
+long descriptors_lib_message (t_descriptors_lib *x, const char *message)
+{
+	const char *separators = " \t\r\n";
+
+	char *copy = malloc(strlen(message) + 1);
+	char *token;
+	char *state;
+
+	t_symbol *msg = 0;
+	t_atom *argv;
+	long argc = 0;
+	long success = 1;
+
+	if (!copy)
+		return 0;
+
+	// Make one atom per token (there cannot be more tokens than half the characters)
+
+	argv = malloc(((strlen(message) + 2) / 2) * sizeof(t_atom));
+
+	if (!argv)
+	{
+		free(copy);
+		return 0;
+	}
+
+	strcpy(copy, message);
+
+	for (token = strtok_r(copy, separators, &state); token; token = strtok_r(0, separators, &state))
+	{
+		if (!msg)
+			msg = gensym(token);
+		else
+			argc += descriptors_lib_parse_atom(argv + argc, token);
+	}
+
+	if (!msg)
+		success = 0;
+	else if (msg == gensym("descriptors"))
+		descriptors_descriptors_non_rt(&x->x, msg, (short) argc, argv);
+	else if (msg == gensym("fftparams"))
+		descriptors_fft_params(&x->x, msg, (short) argc, argv);
+	else if (msg == gensym("energythresh"))
+		descriptors_energy_thresh(&x->x, msg, (short) argc, argv);
+	else if (msg == gensym("streaming"))
+		descriptors_streaming(&x->x, argc ? atom_getlong(argv) : 0);
+	else if (msg == gensym("profile"))
+		descriptors_profile(&x->x, msg, (short) argc, argv);
+	else
+	{
+		error("descriptors_lib: unknown message %s", msg->s_name);
+		success = 0;
+	}
+
+	free(argv);
+	free(copy);
+
+	return success;
+}
+
+
+long descriptors_lib_analyse (t_descriptors_lib *x, const float *samples, long length, long num_chans, double sr, long chan, double start_point_ms, double end_point_ms, long num_threads, double *output, long max_output)
+{
+	double mstosamps_val = sr / 1000.;
+	long i;
+
+	if (!x->x.descriptor_data_size || !samples || num_chans < 1 || sr <= 0.)
+		return -1;
+
+	// Range check (as descriptors_analyse)
+
+	if (start_point_ms < 0)
+		start_point_ms = 0;
+	if (end_point_ms < 0)
+		return -1;
+	if (chan < 0)
+		chan = 0;
+	if (num_threads < 1)
+		num_threads = 1;
+	if (num_threads > MAX_ANALYSIS_THREADS)
+		num_threads = MAX_ANALYSIS_THREADS;
+
+	// Point the object at the samples (the stored sample rate is left alone so that the curves are recalculated if necessary)
+
+	x->buffer.samples = (float *) samples;
+	x->buffer.length = length;
+	x->buffer.num_chans = num_chans;
+	x->buffer.sr = sr;
+
+	x->x.buffer_pointer = &x->buffer;
+	x->x.start_point = start_point_ms * mstosamps_val;
+	x->x.end_point = end_point_ms * mstosamps_val;
+	x->x.buffer_chan = chan;
+	x->x.num_threads = num_threads;
+
+	x->output_length = -1;
+
+	calc_descriptors_non_rt(&x->x);
+
+	x->x.buffer_pointer = 0;
+
+	for (i = 0; i < x->output_length && i < max_output; i++)
+		output[i] = atom_getfloat(x->x.output_list + i);
+
+	return x->output_length;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////// Symbols and Atoms /////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+#define SYMBOL_TABLE_SIZE 1024
+
+typedef struct _descriptors_lib_symbol
+{
+	t_symbol sym;
+	struct _descriptors_lib_symbol *next;
+
+} t_descriptors_lib_symbol;
+
+static t_descriptors_lib_symbol *descriptors_lib_symbols[SYMBOL_TABLE_SIZE];
+static pthread_mutex_t descriptors_lib_symbols_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+t_symbol *gensym (const char *s)
+{
+	t_descriptors_lib_symbol *entry;
+	unsigned long hash = 5381;
+	const char *c;
+
+	for (c = s; *c; c++)
+		hash = (hash * 33) ^ (unsigned char) *c;
+
+	hash %= SYMBOL_TABLE_SIZE;
+
+	// Symbols are never freed (as in Max)
+
+	pthread_mutex_lock(&descriptors_lib_symbols_lock);
+
+	for (entry = descriptors_lib_symbols[hash]; entry; entry = entry->next)
+		if (!strcmp(entry->sym.s_name, s))
+			break;
+
+	if (!entry && (entry = malloc(sizeof(t_descriptors_lib_symbol) + strlen(s) + 1)))
+	{
+		entry->sym.s_name = (char *) (entry + 1);
+		entry->sym.s_thing = 0;
+		strcpy(entry->sym.s_name, s);
+		entry->next = descriptors_lib_symbols[hash];
+		descriptors_lib_symbols[hash] = entry;
+	}
+
+	pthread_mutex_unlock(&descriptors_lib_symbols_lock);
+
+	return entry ? &entry->sym : 0;
+}
+
+
+long atom_gettype (const t_atom *a)
+{
+	return a->a_type;
+}
+
+
+long atom_getlong (const t_atom *a)
+{
+	switch (a->a_type)
+	{
+		case A_LONG:	return a->a_w.w_long;
+		case A_FLOAT:	return (long) a->a_w.w_float;
+		default:		return 0;
+	}
+}
+
+
+double atom_getfloat (const t_atom *a)
+{
+	switch (a->a_type)
+	{
+		case A_LONG:	return (double) a->a_w.w_long;
+		case A_FLOAT:	return a->a_w.w_float;
+		default:		return 0.;
+	}
+}
+
+
+t_symbol *atom_getsym (const t_atom *a)
+{
+	return a->a_type == A_SYM ? a->a_w.w_sym : gensym("");
+}
+
+
+t_max_err atom_setlong (t_atom *a, long b)
+{
+	a->a_type = A_LONG;
+	a->a_w.w_long = b;
+	return 0;
+}
+
+
+t_max_err atom_setfloat (t_atom *a, double b)
+{
+	a->a_type = A_FLOAT;
+	a->a_w.w_float = b;
+	return 0;
+}
+
+
+t_max_err atom_setsym (t_atom *a, t_symbol *b)
+{
+	a->a_type = A_SYM;
+	a->a_w.w_sym = b;
+	return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////// Posting and Outlets /////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+void post (const char *fmt, ...)
+{
+	va_list args;
+	char str[1024];
+
+	va_start(args, fmt);
+	vsnprintf(str, 1024, fmt, args);
+	va_end(args);
+
+	fprintf(stderr, "%s\n", str);
+}
+
+
+void error (const char *fmt, ...)
+{
+	va_list args;
+	char str[1024];
+
+	va_start(args, fmt);
+	vsnprintf(str, 1024, fmt, args);
+	va_end(args);
+
+	fprintf(stderr, "error: %s\n", str);
+}
+
+
+void *listout (void *x)
+{
+	return x;
+}
+
+
+void *outlet_list (void *o, t_symbol *s, short ac, t_atom *av)
+{
+	((t_descriptors_lib *) o)->output_length = ac;
+	return 0;
+}
+
+
+void freeobject (t_object *x)
+{
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////// Threads //////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+long systhread_create (method entryproc, void *arg, unsigned long stacksize, long priority, long flags, t_systhread *thread)
+{
+	pthread_t pthread;
+
+	if (pthread_create(&pthread, 0, (void *(*)(void *)) entryproc, arg))
+		return 1;
+
+	*thread = (t_systhread) pthread;
+	return 0;
+}
+
+
+long systhread_join (t_systhread thread, unsigned int *retval)
+{
+	void *ret;
+	long result = pthread_join((pthread_t) thread, &ret);
+
+	if (retval)
+		*retval = (unsigned int) (uintptr_t) ret;
+
+	return result;
+}
+
+
+void systhread_exit (long status)
+{
+	pthread_exit((void *) (uintptr_t) status);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////// Buffers //////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+void ibuffer_init ()
+{
+}
+
+
+void *ibuffer_get_ptr (t_symbol *s)
+{
+	return s ? s->s_thing : 0;
+}
+
+
+long ibuffer_info (void *thebuffer, void **samples, AH_SIntPtr *length, long *channels, long *format)
+{
+	t_descriptors_lib_buffer *buffer = thebuffer;
+
+	if (!buffer || !buffer->samples)
+		return 0;
+
+	*samples = buffer->samples;
+	*length = buffer->length;
+	*channels = buffer->num_chans;
+	*format = PCM_FLOAT;
+
+	return 1;
+}
+
+
+double ibuffer_sample_rate (void *thebuffer)
+{
+	return ((t_descriptors_lib_buffer *) thebuffer)->sr;
+}
+
+
+void ibuffer_increment_inuse (void *thebuffer)
+{
+}
+
+
+void ibuffer_decrement_inuse (void *thebuffer)
+{
+}
+
+
+void ibuffer_get_samps (void *samps, float *out, AH_SIntPtr offset, AH_SIntPtr n_samps, long n_chans, long chan, long format)
+{
+	float *in = ((float *) samps) + chan + (offset * n_chans);
+	AH_SIntPtr i;
+
+	for (i = 0; i < n_samps; i++, in += n_chans)
+		out[i] = *in;
+}
@@ -0,0 +1,59 @@
+
+/*
+ *  descriptors_lib.h
+ *
+ *	A plain C interface to the descriptors~ non real-time analysis for use outside of Max (e.g. offline corpus analysis on build servers).
+ *
+ *	The library compiles the descriptors~ sources with DESCRIPTORS_STANDALONE defined, and hosts them in place of Max.
+ *	An analyser is configured using the same messages as the descriptors~ object (fftparams / energythresh / descriptors / streaming / profile) and produces the same output list.
+ *	Each analyser is independent, so separate analysers may be used concurrently from different threads.
+ *
+ *	To build, compile descriptors_lib.c along with the descriptors~ non real-time sources and HISSTools_FFT.c:
+ *
+ *	-DDESCRIPTORS_STANDALONE -fcommon -msse2 -I../descriptors~ -I../../AH_MaxMSP_Headers -lpthread -lm
+ *
+ *  Copyright 2010 Alex Harker. All rights reserved.
+ *
+ */
+
+
+#ifndef _DESCRIPTORS_LIB_
+#define _DESCRIPTORS_LIB_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct _descriptors_lib t_descriptors_lib;
+
+
+// Initialise (call once before creating any analysers)
+
+void descriptors_lib_init ();
+
+// Create / free an analyser (max_fft_size and descriptor_data_size match the arguments to descriptors~ - zero for defaults)
+
+t_descriptors_lib *descriptors_lib_new (long max_fft_size, long descriptor_data_size);
+void descriptors_lib_free (t_descriptors_lib *x);
+
+// Send a message to the analyser (e.g. "fftparams 4096 1024" / "energythresh -60" / "descriptors energy mean pitch median" / "streaming 1" / "profile 1")
+// With "profile 1" the cost of each per frame intermediate is posted (to stderr) after each analysis
+// Several fft sizes may be analysed in one pass (e.g. "fftparams 1024 512 resolution 4096 resolution 16384 16384 blackman" / "descriptors energy mean resolution 1 pitch median")
+// Each additional resolution is given as an fft size and optional window size and type, and shares the hop size of the first - descriptors after "resolution <n>" use that resolution
+// Returns non-zero on success
+
+long descriptors_lib_message (t_descriptors_lib *x, const char *message);
+
+// Analyse a channel (zero-based) of interleaved samples, writing up to max_output values to output
+// The start and end points are in ms (an end point of zero analyses to the end of the samples)
+// Returns the number of output values, or -1 on failure
+
+long descriptors_lib_analyse (t_descriptors_lib *x, const float *samples, long length, long num_chans, double sr, long chan, double start_point_ms, double end_point_ms, long num_threads, double *output, long max_output);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DESCRIPTORS_LIB_ */
@@ -12,13 +12,23 @@
 #ifndef _DESCRIPTORS_CONSTANTS_
 #define _DESCRIPTORS_CONSTANTS_
 
+#ifdef DESCRIPTORS_STANDALONE
+#include "descriptors_standalone.h"
+#else
 #include <ext.h>
+#endif
 #include <AH_Win_Math.h>
 
 /////////////////////////////// Constants ///////////////////////////////
 
 #define RING_BUFFER_SIZE 33
 #define MAX_N_SEARCH 4096
+#define MAX_N_CANDIDATES 16384
+#define MAX_ANALYSIS_THREADS 32
+#define STREAMING_BLOCK_FRAMES 4096
+#define SUM_AMPS_THREAD_MEMORY 16777216
+#define ASYNC_QUEUE_SIZE 8
+#define MAX_RESOLUTIONS 4
 
 /////////////////////////////// DB limits ///////////////////////////////
 
@@ -105,6 +115,25 @@ enum PBDescriptorType {
 	
 };
 
+// The intermediate values calculated for each frame (nodes in the dependency graph - each node only depends on nodes listed before it)
+
+enum PFNodeType {
+
+	PF_NODE_SPECTRUM,					// windowed fft and square amplitudes
+	PF_NODE_LOG_AMPLITUDES,
+	PF_NODE_AMPLITUDES,
+	PF_NODE_CUMULATE_AMPS,
+	PF_NODE_CUMULATE_SQ_AMPS,
+	PF_NODE_AUTOCORRELATION,
+	PF_NODE_MEDIAN_FILTER,
+	PF_NODE_SPECTRAL_PEAKS,
+	PF_NODE_DESCRIPTORS,				// the descriptors themselves (only used for profiling)
+	
+	PF_NUM_NODES
+};
+
+#define PF_NODE(node) (1L << (node))
+
 /////////////////////////// Statistics enums ///////////////////////////
 
 enum StatisticsType {
@@ -246,6 +275,7 @@ t_symbol *ps_ratio_below;
 
 t_symbol *ps_threshold;
 t_symbol *ps_masktime;
+t_symbol *ps_resolution;
 
 /////////////////////////////
 
@@ -9,6 +9,9 @@
  *	Specifically, the results of the median filter could be scaled (using a factor greater than 1) to more accurately remove noise components from the spectral peak-finding routines.
  *	However, if the number of spectral peaks to find is not large, the median filtering is still likely to have little effect.
  *
+ *	The values in the current window are kept in two heaps - a max heap holding the lower half and a min heap holding the upper half (the top of which is the median).
+ *	Both heaps share one array (the low heap from the start and the high heap from the end), and the position of each value is stored so that the value leaving the window can be replaced directly.
+ *
  *  Copyright 2010 Alex Harker. All rights reserved.
  *
  */
@@ -18,448 +21,440 @@
 
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////// Double precision median filtering /////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////// Heap routines (common) /////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////// Main routine for filter /////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////
-
+// Both heaps are stored in the indices memory (the low heap from the start and the high heap reversed from the end)
+// The heap position of each data index is stored after the heaps as an offset into the shared array
 
-void medianfilter_double (long *indices, double *medians, double *data, long num_points, long median_span)
-{	
-	long median_size = median_span + 1;
-	long median_max_size = 2 * median_span + 1;
-	long new_median_size = median_size - 1;
-	long median_val_index;
-	long i;
+typedef struct _medianheap
+{
+	long *indices;
+	long *positions;
 	
-	if (median_size > num_points) 
-		median_size = num_points;
-	if (median_max_size > num_points) 
-		median_max_size = num_points;
+	long window;
+	long num_low;
+	long num_high;
+	
+} t_medianheap;
 
-	new_median_size = median_size - 1;
-	median_val_index = (median_max_size >> 1);
 
-	for (i = 0; i < median_size; i ++)
-		indices[i] = i;
-		
-	combsort_indices_double (indices, data, median_size);
-	medians[0] = data[indices[median_size >> 1]];
+static __inline void medianheap_init (t_medianheap *h, long *indices, long window)
+{
+	h->indices = indices;
+	h->positions = indices + window;
+	h->window = window;
+	h->num_low = 0;
+	h->num_high = 0;
+}
 
-	// LH edge
-	
-	for (i = 1; i < (median_max_size - median_size) + 1; i++)										
-	{
-		median_size = medianfilter_insert_double(indices, data, median_size, i + new_median_size);
-		medians[i] = data[indices[median_size >> 1]];
-	}
 
-	// centre
-	
-	for (; i < num_points - (median_max_size - median_size); i++)								
-	{
-		medianfilter_switch_double(indices, data, median_size, i + new_median_size, i - (new_median_size + 1));
-		medians[i] = data[indices[median_val_index]];
-	}
+static __inline long medianheap_get (t_medianheap *h, long side, long i)
+{
+	return h->indices[side ? h->window - 1 - i : i];
+}
+
+
+static __inline void medianheap_set (t_medianheap *h, long side, long i, long index)
+{
+	long slot = side ? h->window - 1 - i : i;
 	
-	// RH edge
+	h->indices[slot] = index;
+	h->positions[index] = slot;
+}
 
-	for (; i < num_points; i++)														
-	{
-		median_size = medianfilter_remove_double(indices, data, median_size, i - (new_median_size + 1));
-		medians[i] = data[indices[median_size >> 1]];
-	}
-}	
+
+// The low heap is a max heap and the high heap a min heap
+
+#define medianheap_before(a, b, side) ((side) ? (a) < (b) : (a) > (b))
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////// Double precision median filtering /////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-//////////////////// Routines for inserting / switching / removing values //////////////////
+/////////////////////////// Routines for inserting / removing values ///////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////
 
 
-long medianfilter_insert_double (long *indices, double *data, long num_points, long insert_index)
+static void medianheap_sift_up_double (t_medianheap *h, double *data, long side, long i)
 {
-	double insert_val = data[insert_index];
-	long gap = num_points >> 1;
-	long insert_point = 0;
-	long i = 0;
-	
-	if (gap > 1) 
-		gap = 1;
+	long index = medianheap_get(h, side, i);
+	long parent_index;
+	long parent;
 	
-	// Find insert point
-
-	while (gap > 0)
+	while (i > 0)
 	{
-		for (i = insert_point + gap; i < num_points; i += gap)
-		{
-			if (data[indices[i]] > insert_val) 
-				break;
-			else 
-				insert_point = i;
-		}
-		gap >>= 1;
+		parent = (i - 1) >> 1;
+		parent_index = medianheap_get(h, side, parent);
+		
+		if (!medianheap_before(data[index], data[parent_index], side))
+			break;
+		
+		medianheap_set(h, side, i, parent_index);
+		i = parent;
 	}
-			
-	// Do swaps
 	
-	for (i = num_points; i > insert_point; i--)					
-		indices[i] = indices[i - 1];
+	medianheap_set(h, side, i, index);
+}
+
+
+static void medianheap_sift_down_double (t_medianheap *h, double *data, long side, long i)
+{
+	long num_items = side ? h->num_high : h->num_low;
+	long index = medianheap_get(h, side, i);
+	long child_index;
+	long child;
+	
+	while ((child = (i << 1) + 1) < num_items)
+	{
+		child_index = medianheap_get(h, side, child);
+		
+		if (child + 1 < num_items && medianheap_before(data[medianheap_get(h, side, child + 1)], data[child_index], side))
+			child_index = medianheap_get(h, side, ++child);
 		
-	indices[insert_point] = insert_index;
+		if (!medianheap_before(data[child_index], data[index], side))
+			break;
+		
+		medianheap_set(h, side, i, child_index);
+		i = child;
+	}
 	
-	return num_points + 1;
+	medianheap_set(h, side, i, index);
 }
 
 
-void medianfilter_switch_double (long *indices, double *data, long num_points, long insert_index, long remove_index)
+static void medianheap_push_double (t_medianheap *h, double *data, long side, long index)
 {
-	double insert_val = data[insert_index];
-	double remove_val = data[remove_index];
-	long gap = num_points >> 1;
-	long insert_point = 0;
-	long remove_point = 0;
-	long i = 0;
+	long i = side ? h->num_high++ : h->num_low++;
 	
-	if (gap > 1) 
-		gap = 1;
-	
-	// Find the index to replace
+	medianheap_set(h, side, i, index);
+	medianheap_sift_up_double(h, data, side, i);
+}
+
+
+static long medianheap_pop_double (t_medianheap *h, double *data, long side)
+{
+	long index = medianheap_get(h, side, 0);
+	long num_items = side ? --h->num_high : --h->num_low;
 	
-	while (gap > 0)
+	if (num_items)
 	{
-		for (i = remove_point + gap; i < num_points; i += gap)
-		{
-			if (data[indices[i]] > remove_val) 
-				break;
-			else 
-				remove_point = i;
-		}
-		gap >>= 1;
+		medianheap_set(h, side, 0, medianheap_get(h, side, num_items));
+		medianheap_sift_down_double(h, data, side, 0);
 	}
 	
-	// Note - we might actually be removing the wrong index, but we're leaving one with the same value - so it doesn't matter
-	
-	// Find where to put it
+	return index;
+}
+
+
+static void medianheap_balance_double (t_medianheap *h, double *data)
+{
+	// The high heap holds the upper half of the window, including the median (and one more value than the low heap if the size is odd)
 	
-	if (insert_val > data[remove_index])
-	{	
-		// Search right
-		
-		insert_point = remove_point;
-		gap = (num_points - remove_point) >> 1;
-		if (gap > 1) 
-			gap = 1;
-		
-		while (gap > 0)
-		{
-			for (i = insert_point + gap; i < num_points; i += gap)
-			{
-				if (data[indices[i]] > insert_val) 
-					break;
-				else 
-					insert_point = i;
-			}
-			gap >>= 1;
-		}
-		
-		// Do swaps
-			
-		for (i = remove_point; i < insert_point; i++)				
-			indices[i] = indices[i + 1];
-	}
+	if (h->num_low > h->num_high)
+		medianheap_push_double(h, data, 1, medianheap_pop_double(h, data, 0));
+	if (h->num_high > h->num_low + 1)
+		medianheap_push_double(h, data, 0, medianheap_pop_double(h, data, 1));
+}
+
+
+static void medianheap_insert_double (t_medianheap *h, double *data, long index)
+{
+	if (!h->num_high || data[index] >= data[medianheap_get(h, 1, 0)])
+		medianheap_push_double(h, data, 1, index);
 	else
+		medianheap_push_double(h, data, 0, index);
+	
+	medianheap_balance_double(h, data);
+}
+
+
+static void medianheap_remove_double (t_medianheap *h, double *data, long index)
+{
+	// Values are found by index, so the correct entry is removed even when values are repeated
+	
+	long slot = h->positions[index];
+	long side = slot >= h->num_low;
+	long i = side ? h->window - 1 - slot : slot;
+	long num_items = side ? --h->num_high : --h->num_low;
+	
+	if (i != num_items)
 	{
-		// Search left
-		
-		insert_point = remove_point;
-		gap = remove_point >> 1;
-		if (gap > 1) 
-			gap = 1;
-		
-		while (gap > 0)
-		{
-			for (i = insert_point - gap; i >= 0; i -= gap)
-			{
-				if (data[indices[i]] > insert_val) 
-					break;
-				else 
-					insert_point = i;
-			}
-			gap >>= 1;
-		}
-		
-		// Do swaps
-		
-		for (i = remove_point; i > insert_point; i--)				
-			indices[i] = indices[i - 1];
+		medianheap_set(h, side, i, medianheap_get(h, side, num_items));
+		medianheap_sift_up_double(h, data, side, i);
+		medianheap_sift_down_double(h, data, side, i);
 	}
 	
-	// Replace the index
-	
-	indices[insert_point] = insert_index;	
+	medianheap_balance_double(h, data);
 }
 
 
-long medianfilter_remove_double (long *indices, double *data, long num_points, long remove_index)
+static void medianheap_replace_double (t_medianheap *h, double *data, long remove_index, long insert_index)
 {
-	double remove_val = data[remove_index]; 
-	long gap = num_points >> 1;
-	long remove_point = 0;
-	long i;
-
-	if (gap > 1) 
-		gap = 1;
+	// Sliding the full window - if both values belong in the same heap the new value takes the old one's place, so no rebalancing is needed
 	
-	// Find remove point		
+	long slot = h->positions[remove_index];
+	long side = slot >= h->num_low;
+	long new_side = data[insert_index] >= data[medianheap_get(h, 1, 0)];
+	long i = side ? h->window - 1 - slot : slot;
+	long num_items;
 	
-	while (gap > 0)
+	if (side != new_side)
 	{
-		for (i = remove_point + gap; i < num_points; i += gap)
+		num_items = side ? --h->num_high : --h->num_low;
+		
+		if (i != num_items)
 		{
-			if (data[indices[i]] > remove_val) 
-				break;
-			else 
-				remove_point = i;
+			medianheap_set(h, side, i, medianheap_get(h, side, num_items));
+			medianheap_sift_up_double(h, data, side, i);
+			medianheap_sift_down_double(h, data, side, i);
 		}
-		gap >>= 1;
+		
+		medianheap_push_double(h, data, new_side, insert_index);
+		medianheap_push_double(h, data, side, medianheap_pop_double(h, data, new_side));
+		return;
 	}
 	
-	// Do swaps
-	
-	for (i = remove_point; i < num_points; i++)					
-		indices[i] = indices[i + 1];
-			
-	return num_points - 1;
+	medianheap_set(h, side, i, insert_index);
+	medianheap_sift_up_double(h, data, side, i);
+	medianheap_sift_down_double(h, data, side, i);
 }
 
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////// Single precision median filtering /////////////////////////////////////////////////////
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-
 ////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////// Main routine for filter /////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////
 
 
-void medianfilter_float (t_descriptors *x, long *indices, float *medians, float *data, long num_points, long median_span)
+void medianfilter_double (long *indices, double *medians, double *data, long num_points, long median_span)
 {	
-	long median_size = median_span + 1;
-	long median_max_size = 2 * median_span + 1;
-	long new_median_size = median_size - 1;
-	long median_val_index;
+	t_medianheap h;
+	long window = 2 * median_span + 1;
+	long next = 0;
 	long i;
-
-	// Note this function is only ever called in one place, and sets flags so that it is never recalculated unnecessarily
 	
-	if (x->median_flag && x->last_median_span == median_span) 
-		return;
+	if (window > num_points) 
+		window = num_points;
 	
-	x->median_flag = 1;
-	x->last_median_span = median_span;
-	
-	if (median_size > num_points) 
-		median_size = num_points;
-	if (median_max_size > num_points) 
-		median_max_size = num_points;
+	medianheap_init(&h, indices, window);
 	
-	new_median_size = median_size - 1;
-	median_val_index = (median_max_size >> 1);
-
-	for (i = 0; i < median_size; i ++)
-		indices[i] = i;
-		
-	combsort_indices_float (indices, data, median_size);
-	medians[0] = data[indices[median_size >> 1]];
-
-	// LH edge
+	// The window for each bin is clipped to the edges of the data
 	
-	for (i = 1; i < (median_max_size - median_size) + 1; i++)
+	for (i = 0; i < num_points; i++)
 	{
-		median_size = medianfilter_insert_float(indices, data, median_size, i + new_median_size);
-		medians[i] = data[indices[median_size >> 1]];
+		if (i - median_span > 0 && next < num_points)
+			medianheap_replace_double(&h, data, i - (median_span + 1), next++);
+		else if (i - median_span > 0)
+			medianheap_remove_double(&h, data, i - (median_span + 1));
+		
+		for (; next < num_points && next <= i + median_span; next++)
+			medianheap_insert_double(&h, data, next);
+		
+		medians[i] = data[medianheap_get(&h, 1, 0)];
 	}
+}	
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////// Single precision median filtering /////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////// Routines for inserting / removing values ///////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
+
 
-	// centre
+static void medianheap_sift_up_float (t_medianheap *h, float *data, long side, long i)
+{
+	long index = medianheap_get(h, side, i);
+	long parent_index;
+	long parent;
 	
-	for (; i < num_points - (median_max_size - median_size); i++)
+	while (i > 0)
 	{
-		medianfilter_switch_float(indices, data, median_size, i + new_median_size, i - (new_median_size + 1));
-		medians[i] = data[indices[median_val_index]];
+		parent = (i - 1) >> 1;
+		parent_index = medianheap_get(h, side, parent);
+		
+		if (!medianheap_before(data[index], data[parent_index], side))
+			break;
+		
+		medianheap_set(h, side, i, parent_index);
+		i = parent;
 	}
+	
+	medianheap_set(h, side, i, index);
+}
+
 
-	// RH edge
+static void medianheap_sift_down_float (t_medianheap *h, float *data, long side, long i)
+{
+	long num_items = side ? h->num_high : h->num_low;
+	long index = medianheap_get(h, side, i);
+	long child_index;
+	long child;
 	
-	for (; i < num_points; i++)
+	while ((child = (i << 1) + 1) < num_items)
 	{
-		median_size = medianfilter_remove_float(indices, data, median_size, i - (new_median_size + 1));
-		medians[i] = data[indices[median_size >> 1]];
+		child_index = medianheap_get(h, side, child);
+		
+		if (child + 1 < num_items && medianheap_before(data[medianheap_get(h, side, child + 1)], data[child_index], side))
+			child_index = medianheap_get(h, side, ++child);
+		
+		if (!medianheap_before(data[child_index], data[index], side))
+			break;
+		
+		medianheap_set(h, side, i, child_index);
+		i = child;
 	}
-}	
+	
+	medianheap_set(h, side, i, index);
+}
 
 
-////////////////////////////////////////////////////////////////////////////////////////////
-//////////////////// Routines for inserting / switching / removing values //////////////////
-////////////////////////////////////////////////////////////////////////////////////////////
+static void medianheap_push_float (t_medianheap *h, float *data, long side, long index)
+{
+	long i = side ? h->num_high++ : h->num_low++;
+	
+	medianheap_set(h, side, i, index);
+	medianheap_sift_up_float(h, data, side, i);
+}
 
 
-long medianfilter_insert_float (long *indices, float *data, long num_points, long insert_index)
+static long medianheap_pop_float (t_medianheap *h, float *data, long side)
 {
-	float insert_val = data[insert_index];
-	long gap = num_points >> 1;
-	long insert_point = 0;
-	long i = 0;
+	long index = medianheap_get(h, side, 0);
+	long num_items = side ? --h->num_high : --h->num_low;
 	
-	if (gap > 1) 
-		gap = 1;
-	
-	// Find insert point
-
-	while (gap > 0)
+	if (num_items)
 	{
-		for (i = insert_point + gap; i < num_points; i += gap)
-		{
-			if (data[indices[i]] > insert_val) 
-				break;
-			else 
-				insert_point = i;
-		}
-		gap >>= 1;
+		medianheap_set(h, side, 0, medianheap_get(h, side, num_items));
+		medianheap_sift_down_float(h, data, side, 0);
 	}
-			
-	// Do swaps
 	
-	for (i = num_points; i > insert_point; i--)
-		indices[i] = indices[i - 1];
-		
-	indices[insert_point] = insert_index;
+	return index;
+}
+
+
+static void medianheap_balance_float (t_medianheap *h, float *data)
+{
+	// The high heap holds the upper half of the window, including the median (and one more value than the low heap if the size is odd)
 	
-	return num_points + 1;
+	if (h->num_low > h->num_high)
+		medianheap_push_float(h, data, 1, medianheap_pop_float(h, data, 0));
+	if (h->num_high > h->num_low + 1)
+		medianheap_push_float(h, data, 0, medianheap_pop_float(h, data, 1));
 }
 
 
-void medianfilter_switch_float (long *indices, float *data, long num_points, long insert_index, long remove_index)
-{	
-	float remove_val = data[remove_index];
-	float insert_val = data[insert_index];
-	long gap = num_points >> 1;
-	long remove_point = 0;
-	long insert_point = 0;
-	long i = 0;	
+static void medianheap_insert_float (t_medianheap *h, float *data, long index)
+{
+	if (!h->num_high || data[index] >= data[medianheap_get(h, 1, 0)])
+		medianheap_push_float(h, data, 1, index);
+	else
+		medianheap_push_float(h, data, 0, index);
 	
-	if (gap > 1) 
-		gap = 1;
+	medianheap_balance_float(h, data);
+}
+
+
+static void medianheap_remove_float (t_medianheap *h, float *data, long index)
+{
+	// Values are found by index, so the correct entry is removed even when values are repeated
 	
-	// Find the value to replace
+	long slot = h->positions[index];
+	long side = slot >= h->num_low;
+	long i = side ? h->window - 1 - slot : slot;
+	long num_items = side ? --h->num_high : --h->num_low;
 	
-	while (gap > 0)
+	if (i != num_items)
 	{
-		for (i = remove_point + gap; i < num_points; i += gap)
-		{
-			if (data[indices[i]] > remove_val) 
-				break;
-			else 
-				remove_point = i;
-		}
-		gap >>= 1;
+		medianheap_set(h, side, i, medianheap_get(h, side, num_items));
+		medianheap_sift_up_float(h, data, side, i);
+		medianheap_sift_down_float(h, data, side, i);
 	}
 	
-	// Note - we might actually be removing the wrong index, but we're leaving one with the same value - so it doesn't matter
+	medianheap_balance_float(h, data);
+}
+
+
+static void medianheap_replace_float (t_medianheap *h, float *data, long remove_index, long insert_index)
+{
+	// Sliding the full window - if both values belong in the same heap the new value takes the old one's place, so no rebalancing is needed
 	
-	// Find where to put it
-		
-	if (insert_val > data[remove_index])							
-	{	
-		// Search right
-
-		insert_point = remove_point;
-		gap = (num_points - remove_point) >> 1;
-		if (gap > 1) 
-			gap = 1;
-		
-		while (gap > 0)
-		{
-			for (i = insert_point + gap; i < num_points; i += gap)
-			{
-				if (data[indices[i]] > insert_val) 
-					break;
-				else 
-					insert_point = i;
-			}
-			gap >>= 1;
-		}
-			
-		// Do swaps
-		
-		for (i = remove_point; i < insert_point; i++)				
-			indices[i] = indices[i + 1];
-	}
-	else														
+	long slot = h->positions[remove_index];
+	long side = slot >= h->num_low;
+	long new_side = data[insert_index] >= data[medianheap_get(h, 1, 0)];
+	long i = side ? h->window - 1 - slot : slot;
+	long num_items;
+	
+	if (side != new_side)
 	{
-		// Search left
-		
-		insert_point = remove_point;
-		gap = remove_point >> 1;
-		if (gap > 1) 
-			gap = 1;
+		num_items = side ? --h->num_high : --h->num_low;
 		
-		while (gap > 0)
+		if (i != num_items)
 		{
-			for (i = insert_point - gap; i >= 0; i -= gap)
-			{
-				if (data[indices[i]] > insert_val) 
-					break;
-				else 
-					insert_point = i;
-			}
-			gap >>= 1;
+			medianheap_set(h, side, i, medianheap_get(h, side, num_items));
+			medianheap_sift_up_float(h, data, side, i);
+			medianheap_sift_down_float(h, data, side, i);
 		}
-			
-		// Do swaps
 		
-		for (i = remove_point; i > insert_point; i--)				
-			indices[i] = indices[i - 1];
+		medianheap_push_float(h, data, new_side, insert_index);
+		medianheap_push_float(h, data, side, medianheap_pop_float(h, data, new_side));
+		return;
 	}
 	
-	// Replace the index
-	
-	indices[insert_point] = insert_index;	
+	medianheap_set(h, side, i, insert_index);
+	medianheap_sift_up_float(h, data, side, i);
+	medianheap_sift_down_float(h, data, side, i);
 }
 
 
-long medianfilter_remove_float (long *indices, float *data, long num_points, long remove_index)
-{
-	float remove_val = data[remove_index]; 
-	long gap = num_points >> 1;
-	long remove_point = 0;
+////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////// Main routine for filter /////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////
+
+
+void medianfilter_float (t_descriptors *x, long *indices, float *medians, float *data, long num_points, long median_span)
+{	
+	t_medianheap h;
+	double profile_time;
+	long window = 2 * median_span + 1;
+	long next = 0;
 	long i;
+
+	// Note this function is only ever called in one place, and sets flags so that it is never recalculated unnecessarily
 	
-	if (gap > 1) 
-		gap = 1;
+	if (x->median_flag && x->last_median_span == median_span) 
+		return;
+	
+	x->median_flag = 1;
+	x->last_median_span = median_span;
+	profile_time = x->profile ? descriptors_profile_time() : 0.;
+	
+	if (window > num_points) 
+		window = num_points;
 	
-	// Find remove point
+	medianheap_init(&h, indices, window);
 	
-	while (gap > 0)
+	// The window for each bin is clipped to the edges of the data
+	
+	for (i = 0; i < num_points; i++)
 	{
-		for (i = remove_point + gap; i < num_points; i += gap)
-		{
-			if (data[indices[i]] > remove_val) 
-				break;
-			else 
-				remove_point = i;
-		}
-		gap >>= 1;
+		if (i - median_span > 0 && next < num_points)
+			medianheap_replace_float(&h, data, i - (median_span + 1), next++);
+		else if (i - median_span > 0)
+			medianheap_remove_float(&h, data, i - (median_span + 1));
+		
+		for (; next < num_points && next <= i + median_span; next++)
+			medianheap_insert_float(&h, data, next);
+		
+		medians[i] = data[medianheap_get(&h, 1, 0)];
 	}
 	
-	// Do swaps
-	
-	for (i = remove_point; i < num_points; i++)
-		indices[i] = indices[i + 1];
-			
-	return num_points - 1;
+	descriptors_profile_node(x, PF_NODE_MEDIAN_FILTER, profile_time);
 }
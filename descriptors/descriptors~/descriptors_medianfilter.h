@@ -8,6 +8,9 @@
  *	There are more state-of-the-art (but also more expensive) methods for doing this, and even in its current state some improvements could be made to its use within the spectral peak-finding routines.
  *	As it is this code is far from fundamental to the functioning of these objects, and could be removed, but with improvements it could be made more useful.
  *
+ *	The filter slides a window of (2 * median_span + 1) bins across the spectrum, keeping the window values in a pair of heaps so that each bin costs O(log span).
+ *	The indices memory must have space for (num_points + 2 * median_span + 1) longs, or (2 * num_points) longs if that is smaller.
+ *
  *  Copyright 2010 Alex Harker. All rights reserved.
  *
  */
@@ -21,19 +24,13 @@
 #include "descriptors_combsort.h"
 
 
-// Double precision median filter functions 
+// Double precision median filter
 
 void medianfilter_double (long *indices, double *medians, double *data, long num_points, long median_span);
-long medianfilter_insert_double (long *indices, double *data, long num_points, long insert_index);
-void medianfilter_switch_double (long *indices, double *data, long num_points, long insert_index, long remove_index);
-long medianfilter_remove_double (long *indices, double *data, long num_points, long remove_index);
 
-// Single precision median filter functions
+// Single precision median filter
 
 void medianfilter_float (t_descriptors *x, long *indices, float *medians, float *data, long num_points, long median_span);
-long medianfilter_insert_float (long *indices, float *data, long num_points, long insert_index);
-void medianfilter_switch_float (long *indices, float *data, long num_points, long insert_index, long remove_index);
-long medianfilter_remove_float (long *indices, float *data, long num_points, long remove_index);
 
 
 #endif /* _DESCRIPTORS_MEDIAN_FILTER_ */
@@ -19,7 +19,10 @@
 
 #include "descriptors_object.h"
 
+#ifndef DESCRIPTORS_STANDALONE
 #include <ibuffer_access.h>
+#include <ext_systhread.h>
+#endif
 
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -27,6 +30,8 @@
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
+#ifndef DESCRIPTORS_STANDALONE
+
 int C74_EXPORT main (void)
 {	
 	this_class = class_new ("descriptors~",
@@ -40,6 +45,7 @@ int C74_EXPORT main (void)
 	class_addmethod (this_class, (method)descriptors_analyse, "analyse", A_GIMME, 0L);
 	class_addmethod (this_class, (method)descriptors_analyse, "analyze", A_GIMME, 0L);
 	class_addmethod (this_class, (method)descriptors_descriptors_non_rt, "descriptors", A_GIMME, 0L);
+	class_addmethod (this_class, (method)descriptors_streaming, "streaming", A_LONG, 0L);
 	
 	descriptors_main_common();
 	
@@ -55,16 +61,9 @@ void *descriptors_new (t_symbol *s, short argc, t_atom *argv)
 {
     t_descriptors *x = (t_descriptors *)object_alloc(this_class);
 	
-	long max_fft_size_log2;
 	long max_fft_size_in = 0;
-	long max_fft_size;
 	long descriptor_data_size = 0;
 	long descriptor_feedback = 0;
-	
-	long mask_max_size = MAX_N_SEARCH;
-	long n_search_memory_size = MAX_N_SEARCH * 22;
-
-	void *allocated_memory;
 
 	if (!x)
 		return 0;
@@ -78,15 +77,36 @@ void *descriptors_new (t_symbol *s, short argc, t_atom *argv)
 	if (argc > 2)
 		descriptor_feedback = atom_getlong(argv++);
 	
+	// This below sorts out the z_compile crash
+	
+	dsp_setup((t_pxobject *)x, 0);					
+	
+	if (!descriptors_non_rt_init(x, max_fft_size_in, descriptor_data_size, descriptor_feedback))
+		return 0;
+	
+	return x;
+}
+
+#endif /* DESCRIPTORS_STANDALONE */
+
+
+long descriptors_non_rt_init (t_descriptors *x, long max_fft_size_in, long descriptor_data_size, long descriptor_feedback)
+{
+	// Allocates memory and sets defaults (shared between the max object and standalone builds)
+	
+	long max_fft_size_log2;
+	long max_fft_size;
+	
+	long mask_max_size = MAX_N_SEARCH;
+	long n_search_memory_size = MAX_N_SEARCH * 22;
+
+	void *allocated_memory;
+	
 	// Set maximum fft size
 
 	max_fft_size_log2 = descriptors_max_fft_size(x, max_fft_size_in);
 	x->max_fft_size_log2 = max_fft_size_log2;
 	x->max_fft_size = max_fft_size = 1 << (max_fft_size_log2);
-
-	// This below sorts out the z_compile crash
-	
-	dsp_setup((t_pxobject *)x, 0);					
 	
 	// Allocate 4Mb of memory for the descriptors as a default
 	
@@ -98,7 +118,7 @@ void *descriptors_new (t_symbol *s, short argc, t_atom *argv)
 	// Allocate memory
 
 	 allocated_memory = ALIGNED_MALLOC(
-		descriptor_data_size + (n_search_memory_size * 22 * sizeof(double)) + (mask_max_size * sizeof(char)) + (max_fft_size * sizeof(float)) + + ((max_fft_size * 3) * sizeof(float)) + ((max_fft_size >> 1) * 3 * RING_BUFFER_SIZE * sizeof(float))
+		descriptor_data_size + (n_search_memory_size * 22 * sizeof(double)) + (mask_max_size * sizeof(char)) + N_SEARCH_CANDIDATE_MEMORY + (max_fft_size * sizeof(float)) + + ((max_fft_size * 3) * sizeof(float)) + ((max_fft_size >> 1) * 3 * RING_BUFFER_SIZE * sizeof(float))
 		+ (max_fft_size * 3 * sizeof(float)) + (max_fft_size * (sizeof(double) + sizeof(long))) + ((max_fft_size >> 1) * sizeof(double)) + (max_fft_size * RING_BUFFER_SIZE * sizeof(double)) + ((max_fft_size >> 1) * sizeof(double)) 
 		+ ((max_fft_size >> 1) * sizeof(double)) + (MAX_OUTPUT * sizeof(t_atom)));
 	
@@ -130,6 +150,9 @@ void *descriptors_new (t_symbol *s, short argc, t_atom *argv)
 	x->n_data = allocated_memory;
 	allocated_memory = (void *) ((char *) ((double *) allocated_memory + n_search_memory_size) + mask_max_size);
 	
+	x->n_candidates = allocated_memory;
+	allocated_memory = (void *) ((char *) allocated_memory + N_SEARCH_CANDIDATE_MEMORY);
+	
 	x->median_memory = allocated_memory;
 	allocated_memory = (void *) ((long *) ((double *) allocated_memory + max_fft_size) + max_fft_size);
 	
@@ -151,12 +174,13 @@ void *descriptors_new (t_symbol *s, short argc, t_atom *argv)
 	
 	descriptors_new_common (x, max_fft_size_log2, descriptor_feedback);
 
-	return x;
+	return 1;
 }
 
 
 void descriptors_free(t_descriptors *x)
 {
+	descriptors_resolutions_free(x);
 	ALIGNED_FREE (x->window);
 	hisstools_destroy_setup_f(x->fft_setup_real);
 	if (x->output_rt_clock) 
@@ -180,6 +204,7 @@ void descriptors_analyse (t_descriptors *x, t_symbol *msg, short argc, t_atom *a
 	double end_point_ms = 0.;
 	
 	long buffer_chan = 1;
+	long num_threads = 1;
 	
 	if (!x->descriptor_data_size) return;
 	
@@ -200,6 +225,8 @@ void descriptors_analyse (t_descriptors *x, t_symbol *msg, short argc, t_atom *a
 	if (argc > 3) 
 		end_point_ms = atom_getfloat (argv + 3);		
 	if (argc > 4) 
+		num_threads = atom_getlong (argv + 4);
+	if (argc > 5) 
 		error ("descriptors(rt)~: too many arguments to analyse function");
 	
 	// Check the buffer
@@ -228,24 +255,278 @@ void descriptors_analyse (t_descriptors *x, t_symbol *msg, short argc, t_atom *a
 	if (buffer_chan < 1) 
 		buffer_chan = 1;
 	
+	if (num_threads < 1)
+		num_threads = 1;
+	if (num_threads > MAX_ANALYSIS_THREADS)
+	{
+		error ("descriptors(rt)~: too many analysis threads - using %ld", (long) MAX_ANALYSIS_THREADS);
+		num_threads = MAX_ANALYSIS_THREADS;
+	}
+	
 	// Store variables
 	
 	x->start_point = start_point_ms * mstosamps_val;
 	x->end_point = end_point_ms * mstosamps_val;
 	x->buffer_chan = buffer_chan - 1;
+	x->num_threads = num_threads;
 	
 	calc_descriptors_non_rt (x);
 }
 
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/////////////////////////////////////////////////////// Handle Non RT descriptor Calculation ////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////// Multiple Resolutions //////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-void calc_descriptors_non_rt (t_descriptors *x)
+static long descriptors_scratch_size (long fft_size)
 {
-	t_atom *output_list = x->output_list;
+	// The per frame scratch memory (in bytes) for a given fft size
+	
+	long fft_size_halved = fft_size >> 1;
+	long scratch_size = ((fft_size * 3) * sizeof(float)) + (fft_size_halved * 3 * RING_BUFFER_SIZE * sizeof(float)) + ((fft_size * 3) * sizeof(float))
+						+ (fft_size * RING_BUFFER_SIZE * sizeof(double)) + (fft_size * (sizeof(double) + sizeof(long))) + (fft_size_halved * sizeof(double))
+						+ ((fft_size * 2) * sizeof(float)) + (fft_size * sizeof(char));
+	
+	// Keep each block of scratch memory aligned
+	
+	return (scratch_size + 15) & ~15;
+}
+
+
+static void descriptors_assign_scratch (t_descriptors *y, void *allocated_memory, long fft_size)
+{
+	long fft_size_halved = fft_size >> 1;
+	
+	y->fft_memory = allocated_memory;
+	allocated_memory = (void *) ((float *) allocated_memory + (fft_size * 3));
+	
+	y->amps_buffer = allocated_memory;
+	allocated_memory = (void *) ((float *) allocated_memory + (fft_size_halved * 3 * RING_BUFFER_SIZE));
+	
+	y->ac_memory = allocated_memory;
+	allocated_memory = (void *) ((float *) allocated_memory + (fft_size * 3));
+	
+	y->cumulate = allocated_memory;
+	allocated_memory = (void *) ((double *) allocated_memory + (fft_size * RING_BUFFER_SIZE));
+	
+	y->median_memory = allocated_memory;
+	allocated_memory = (void *) ((long *) ((double *) allocated_memory + fft_size) + fft_size);
+	
+	y->summed_amplitudes = allocated_memory;
+	allocated_memory = (void *) ((double *) allocated_memory + fft_size_halved);
+	
+	y->n_data = allocated_memory;
+}
+
+
+static __inline t_descriptors *descriptors_resolution (t_descriptors *x, long resolution)
+{
+	return resolution ? x->resolutions[resolution] : x;
+}
+
+
+t_descriptors *descriptors_resolution_new (t_descriptors *x, long fft_size, long window_size, t_symbol *window_type)
+{
+	// An additional resolution is a copy of the object with its own window, curves and scratch memory (the fft setup is shared)
+	// N.B. the memory is sized for the maximum fft size and the object comes first in the allocation, so that it is the pointer that is freed
+	
+	long max_fft_size = x->max_fft_size;
+	long object_size = (sizeof(t_descriptors) + 15) & ~15;
+	
+	t_descriptors *y;
+	void *allocated_memory = ALIGNED_MALLOC(object_size + (max_fft_size * sizeof(float)) + (max_fft_size * sizeof(double)) + descriptors_scratch_size(max_fft_size));
+	
+	if (!allocated_memory)
+		return 0;
+	
+	y = allocated_memory;
+	allocated_memory = (void *) ((char *) allocated_memory + object_size);
+	
+	*y = *x;
+	y->num_resolutions = 1;
+	
+	y->window = allocated_memory;
+	allocated_memory = (void *) ((float *) allocated_memory + max_fft_size);
+	
+	y->loudness_curve = allocated_memory;
+	allocated_memory = (void *) ((double *) allocated_memory + (max_fft_size >> 1));
+	
+	y->log_freq = allocated_memory;
+	allocated_memory = (void *) ((double *) allocated_memory + (max_fft_size >> 1));
+	
+	descriptors_assign_scratch(y, allocated_memory, max_fft_size);
+	descriptors_profile_reset(y);
+	
+	// Frames are aligned to the hop size of the primary resolution
+	
+	descriptors_fft_params_internal(y, fft_size, x->hop_size, window_size, window_type);
+	
+	return y;
+}
+
+
+void descriptors_resolutions_free (t_descriptors *x)
+{
+	long i;
+	
+	for (i = 1; i < x->num_resolutions; i++)
+		ALIGNED_FREE(x->resolutions[i]);
+	
+	x->num_resolutions = 1;
+}
+
+
+void descriptors_resolutions (t_descriptors *x, short argc, t_atom *argv)
+{
+	// Sets the additional resolutions from arguments of the form resolution <fft_size> [window_size] [window_type] (repeated as necessary)
+	// Any previous resolutions are freed, so with no arguments only the primary resolution remains
+	
+	t_descriptors *y;
+	
+	long fft_size;
+	long window_size;
+	t_symbol *window_type;
+	
+	short resolution_argc;
+	
+	descriptors_resolutions_free(x);
+	
+	while (argc)
+	{
+		// Skip the resolution symbol and find the arguments for this resolution
+		
+		argv++;
+		argc--;
+		
+		for (resolution_argc = 0; resolution_argc < argc; resolution_argc++)
+			if (atom_gettype(argv + resolution_argc) == A_SYM && atom_getsym(argv + resolution_argc) == ps_resolution)
+				break;
+		
+		fft_size = (resolution_argc > 0) ? atom_getlong(argv + 0) : 0;
+		window_size = (resolution_argc > 1) ? atom_getlong(argv + 1) : 0;
+		window_type = (resolution_argc > 2) ? atom_getsym(argv + 2) : ps_nullsym;
+		
+		argv += resolution_argc;
+		argc -= resolution_argc;
+		
+		if (x->num_resolutions >= MAX_RESOLUTIONS)
+		{
+			error ("descriptors(rt)~: too many resolutions - using the first %ld", (long) MAX_RESOLUTIONS);
+			break;
+		}
+		
+		if (!(y = descriptors_resolution_new(x, fft_size, window_size, window_type)))
+		{
+			error ("descriptors(rt)~: couldn't allocate memory for resolution %ld", x->num_resolutions);
+			break;
+		}
+		
+		x->resolutions[x->num_resolutions++] = y;
+	}
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////// Multithreaded Analysis ////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+t_descriptors *descriptors_alloc_thread_objects (t_descriptors *x, long num_objects)
+{
+	// Each additional thread works on a copy of the object with its own scratch memory (the window, curves and fft setup are shared read-only)
+	// Additional resolutions are copied in the same way, so that each thread object refers to its own copies
+	// N.B. the scratch memory comes first in the allocation, so the returned pointer is not the one that is freed
+	
+	long fft_size = x->fft_size;
+	long scratch_size = descriptors_scratch_size(fft_size);
+	
+	t_descriptors *objects;
+	t_descriptors *resolutions;
+	void *allocated_memory;
+	long i, j;
+	
+	allocated_memory = ALIGNED_MALLOC(num_objects * (scratch_size + sizeof(t_descriptors)));
+	
+	if (!allocated_memory)
+		return 0;
+	
+	objects = (t_descriptors *) ((char *) allocated_memory + (num_objects * scratch_size));
+	
+	for (i = 0; i < num_objects; i++)
+	{
+		objects[i] = *x;
+		descriptors_assign_scratch(objects + i, (char *) allocated_memory + (i * scratch_size), fft_size);
+	}
+	
+	for (j = 1; j < x->num_resolutions; j++)
+	{
+		if (!(resolutions = descriptors_alloc_thread_objects(x->resolutions[j], num_objects)))
+		{
+			objects[0].num_resolutions = j;
+			descriptors_free_thread_objects(objects);
+			return 0;
+		}
+		
+		for (i = 0; i < num_objects; i++)
+			objects[i].resolutions[j] = resolutions + i;
+	}
+	
+	return objects;
+}
+
+
+void descriptors_free_thread_objects (t_descriptors *objects)
+{
+	long i;
+	
+	if (!objects)
+		return;
+	
+	for (i = 1; i < objects[0].num_resolutions; i++)
+		descriptors_free_thread_objects(objects[0].resolutions[i]);
+	
+	ALIGNED_FREE(objects[0].fft_memory);
+}
+
+
+void *descriptors_non_rt_thread (t_descriptors_frame_job *job)
+{
+	descriptors_non_rt_calc_frames(job);
+	systhread_exit(0);
+	
+	return 0;
+}
+
+
+void descriptors_non_rt_calc_frames (t_descriptors_frame_job *job)
+{
+	// Calculates the per frame descriptors for a contiguous range of frames
+	// Frames before the range (up to the length of the ring buffer) are analysed first so that descriptors looking back in time match a single threaded analysis
+	// With multiple resolutions the samples are read once per frame for the largest window, and the windows of all resolutions are centred on the primary window
+	
+	t_descriptors *x = job->x;
+	t_descriptors *y;
+	t_descriptors *resolutions[MAX_RESOLUTIONS] = {0};
+	
+	void *buffer_samples_ptr = job->buffer_samples_ptr;
+	
+	AH_SIntPtr file_length = job->file_length;
+	long start_point = job->start_point;
+	long num_of_chans = job->num_of_chans;
+	long buffer_chan = job->buffer_chan;
+	long int_size = job->int_size;
+	
+	long from_frame = job->from_frame;
+	long to_frame = job->to_frame;
+	long warm_up_frame = from_frame - (RING_BUFFER_SIZE - 1) > 0 ? from_frame - (RING_BUFFER_SIZE - 1) : 0;
+	long from_pf_descriptor = job->from_pf_descriptor;
+	long to_pf_descriptor = job->to_pf_descriptor;
+	long do_sum_amps = job->do_sum_amps;
+	
+	double num_frames_recip = job->num_frames_recip;
+	double *summed_amplitudes = job->summed_amplitudes;
+	float *frame_amplitudes = job->frame_amplitudes;
 	
 	double energy_thresh = x->energy_thresh;
 	
@@ -255,38 +536,364 @@ void calc_descriptors_non_rt (t_descriptors *x)
 	
 	long fft_size = x->fft_size;
 	long fft_size_halved = fft_size >> 1;
-	long fft_size_log2 = x->fft_size_log2;
-	long window_size = x->window_size;
 	long hop_size = x->hop_size;
 	
-	FFT_SETUP_F fft_setup_real = x->fft_setup_real;
-	FFT_SPLIT_COMPLEX_F raw_fft_frame;
+	FFT_SPLIT_COMPLEX_F raw_fft_frames[MAX_RESOLUTIONS];
+	
+	float *raw_frames[MAX_RESOLUTIONS] = {0};
+	float *windowed_frames[MAX_RESOLUTIONS];
+	float *read_frame;
+	
+	// Resolution variables
+	
+	long num_resolutions = x->num_resolutions;
+	long nodes[MAX_RESOLUTIONS] = {0};
+	long read_offsets[MAX_RESOLUTIONS];
+	long read_resolution = 0;
+	long read_size;
+	long read_fft_size;
+	long read_from;
+	long read_to;
+	long r;
+	
+	// descriptor variables
+	
+	double *descriptor_data = job->descriptor_data;
+	double *pf_params = x->pf_params + x->pf_params_pos[from_pf_descriptor];
+	double *pf_params_temp;
+	double profile_time;
+	
+	long *pf_resolutions = x->pf_resolutions;
+	long data_stride = job->data_stride;
+	long data_offset = job->data_offset;
+	long buffer_pos;
+	long j, k;
+	
+	char frame_pointer = warm_up_frame % RING_BUFFER_SIZE;
+	
+	// Only calculate the intermediates needed by the descriptors in this range (the primary resolution is always analysed for the energy threshold and summed amplitudes)
+	
+	for (r = 0; r < num_resolutions; r++)
+		nodes[r] = 0;
+	
+	for (j = from_pf_descriptor; j < to_pf_descriptor; j++)
+		nodes[pf_resolutions[j]] |= descriptors_pf_nodes(x->pf_params + x->pf_params_pos[j]);
+	
+	nodes[0] = descriptors_frame_nodes(x, nodes[0], do_sum_amps);
+	
+	for (r = 0; r < num_resolutions; r++)
+	{
+		y = resolutions[r] = descriptors_resolution(x, r);
+		
+		if (r)
+			nodes[r] = descriptors_resolve_nodes(nodes[r]);
+		
+		raw_frames[r] = y->fft_memory;
+		windowed_frames[r] = raw_frames[r] + y->fft_size;
+		raw_fft_frames[r].realp = windowed_frames[r] + y->fft_size;
+		raw_fft_frames[r].imagp = raw_fft_frames[r].realp + (y->fft_size >> 1);
+		
+		if (nodes[r] && y->window_size > resolutions[read_resolution]->window_size)
+			read_resolution = r;
+		
+		descriptors_zero_ring_buffers(y, y->fft_size);
+	}
+	
+	// The largest window contains all the others (each is offset to share its centre)
+	
+	read_frame = raw_frames[read_resolution];
+	read_size = resolutions[read_resolution]->window_size;
+	read_fft_size = resolutions[read_resolution]->fft_size;
+	
+	for (r = 0; r < num_resolutions; r++)
+		read_offsets[r] = (read_size - resolutions[r]->window_size) >> 1;
+	
+	for (k = warm_up_frame; k < to_frame; k++)
+	{
+		double *cumulate_sq_amps = x->cumulate + (fft_size * frame_pointer) + fft_size_halved;
+		float *amplitudes = x->amps_buffer + (3 * fft_size_halved * frame_pointer) + fft_size_halved;
+		
+		// Get a window of samples (zero padded outside of the file or segment)
+		
+		buffer_pos = (k * hop_size) - read_offsets[0];
+		read_from = buffer_pos < 0 ? -buffer_pos : 0;
+		read_to = file_length - buffer_pos < read_size ? file_length - buffer_pos : read_size;
+		
+		for (j = 0; j < read_from; j++)
+			read_frame[j] = 0.;
+		
+		ibuffer_get_samps (buffer_samples_ptr, read_frame + read_from, start_point + buffer_pos + read_from, read_to - read_from, num_of_chans, buffer_chan, int_size);
+		
+		for (j = read_to; j < read_fft_size; j++)
+			read_frame[j] = 0.;
+		
+		for (r = 0; r < num_resolutions; r++)
+		{
+			y = resolutions[r];
+			
+			if (!nodes[r])
+				continue;
+			
+			y->ac_flag = 0;
+			y->median_flag = 0;
+			y->centroid_lin_flag = 0;
+			y->centroid_log_flag = 0;
+			y->last_pf_spectralpeaks_n = 0;
+			y->last_pf_spectralpeaks_med_size = 0;
+			y->last_threshold = DBL_MAX;
+			
+			// Copy the window for this resolution from the largest window and zero pad to fft size
+			
+			if (r != read_resolution)
+			{
+				for (j = 0; j < y->window_size; j++)
+					raw_frames[r][j] = read_frame[read_offsets[r] + j];
+				for (; j < y->fft_size; j++)
+					raw_frames[r][j] = 0.;
+			}
+			
+			// Calculate the intermediates (the fft, amplitudes and their cumulative sums)
+			
+			descriptors_calc_spectrum(y, raw_frames[r], windowed_frames[r], raw_fft_frames[r], frame_pointer, nodes[r]);
+		}
+		
+		// Sum amplitudes if needed (double precision) - or keep them to be summed in frame order once earlier frames are done
+		
+		if (do_sum_amps && k >= from_frame)
+		{
+			if (frame_amplitudes)
+			{
+				for (j = 0; j < fft_size_halved; j++)
+					frame_amplitudes[((k - from_frame) * fft_size_halved) + j] = amplitudes[j];
+			}
+			else
+			{
+				for (j = 0; j < fft_size_halved;j++)
+					summed_amplitudes[j] += amplitudes[j] * num_frames_recip;
+			}
+		}
+			
+		pf_params_temp = pf_params;
+		
+		////////////////////////////////////////////// Calculate Per Frame descriptors //////////////////////////////////////////
+		
+		// N.B. the energy threshold is always that of the primary resolution, so that the same frames are valid for every descriptor
+		
+		if (k < from_frame)
+		{
+			// Warm up frames only fill the ring buffers
+		}
+		else if (!use_energy_thresh || cumulate_sq_amps[fft_size_halved - 1] > energy_thresh)
+		{
+			profile_time = x->profile ? descriptors_profile_time() : 0.;
+			
+			for (j = from_pf_descriptor; j < to_pf_descriptor; j++)
+			{
+				r = pf_resolutions[j];
+				y = resolutions[r];
+				descriptor_data[((j - from_pf_descriptor) * data_stride) + k - data_offset] = calc_pf_descriptor(y, raw_frames[r], windowed_frames[r], raw_fft_frames[r], frame_pointer, y->window_size, y->fft_size, &pf_params_temp);
+			}
+			
+			descriptors_profile_node(x, PF_NODE_DESCRIPTORS, profile_time);
+		}
+		else
+		{	
+			for (j = from_pf_descriptor; j < to_pf_descriptor; j++)
+				descriptor_data[((j - from_pf_descriptor) * data_stride) + k - data_offset] = DBL_MAX;
+		}
+		
+		frame_pointer = (frame_pointer + 1) % RING_BUFFER_SIZE;
+	}
+}
 
-	double *summed_amplitudes = x->summed_amplitudes;
+
+static void descriptors_non_rt_run_round (t_descriptors_frame_job *jobs, long num_threads, long from_frame, long to_frame)
+{
+	t_systhread threads[MAX_ANALYSIS_THREADS];
+	unsigned int thread_return;
+	
+	long started[MAX_ANALYSIS_THREADS];
+	long fft_size_halved = jobs[0].x->fft_size >> 1;
+	long num_chunk_frames;
+	long i, j, k;
+	
+	// Never use more threads than frames
 	
-	float *window = x->window;	
-	float *raw_frame = x->fft_memory;
-	float *windowed_frame = raw_frame + fft_size;
+	if (num_threads > to_frame - from_frame)
+		num_threads = to_frame - from_frame;
+	
+	num_chunk_frames = (to_frame - from_frame + num_threads - 1) / num_threads;
+	
+	for (i = 0; i < num_threads; i++)
+	{
+		jobs[i].from_frame = from_frame + (i * num_chunk_frames);
+		jobs[i].to_frame = jobs[i].from_frame + num_chunk_frames > to_frame ? to_frame : jobs[i].from_frame + num_chunk_frames;
+	}
+	
+	// Each thread object (and its resolutions) profiles separately (the main object keeps its running profile)
+	
+	for (i = 1; i < num_threads; i++)
+		for (j = 0; j < jobs[i].x->num_resolutions; j++)
+			descriptors_profile_reset(descriptors_resolution(jobs[i].x, j));
+	
+	for (i = 1; i < num_threads; i++)
+		started[i] = !systhread_create((method) descriptors_non_rt_thread, jobs + i, 0, 0, 0, threads + i);
+	
+	descriptors_non_rt_calc_frames(jobs);
+	
+	// Any job whose thread could not be started is analysed on this thread instead
+	
+	for (i = 1; i < num_threads; i++)
+	{
+		if (started[i])
+			systhread_join(threads[i], &thread_return);
+		else
+			descriptors_non_rt_calc_frames(jobs + i);
+	}
+	
+	for (i = 1; i < num_threads; i++)
+		for (j = 0; j < jobs[i].x->num_resolutions; j++)
+			descriptors_profile_combine(descriptors_resolution(jobs[0].x, j), descriptors_resolution(jobs[i].x, j));
+	
+	// The first job sums its own frames, so the kept amplitudes of the others are summed after it in frame order (exactly as on a single thread)
+	
+	if (jobs[0].do_sum_amps)
+	{
+		for (i = 1; i < num_threads; i++)
+		{
+			for (k = 0; k < jobs[i].to_frame - jobs[i].from_frame; k++)
+			{
+				float *amplitudes = jobs[i].frame_amplitudes + (k * fft_size_halved);
+				
+				for (j = 0; j < fft_size_halved; j++)
+					jobs[0].summed_amplitudes[j] += amplitudes[j] * jobs[0].num_frames_recip;
+			}
+		}
+	}
+}
 
-	vFloat *v_window = (vFloat *) window;	
-	vFloat *v_windowed_frame = (vFloat *) windowed_frame;
-	vFloat *real_data;
-	vFloat *imag_data;
 
-#if (defined F32_VEC_LOG_OP)
-	vFloat v_half = {0.5, 0.5, 0.5, 0.5};
-#endif
-#if (defined F32_VEC_LOG_OP || defined F32_VEC_LOG_ARRAY)
-	vFloat v_pow_min = {POW_MIN, POW_MIN, POW_MIN, POW_MIN};
-#endif
+void descriptors_non_rt_run_jobs (t_descriptors_frame_job *jobs, long num_threads, long from_frame, long to_frame)
+{
+	// Analyses a range of frames on the calling thread and any additional threads (each thread analyses a contiguous range of frames)
+	// When summing amplitudes the range is analysed in rounds, so that each additional thread keeps the amplitudes of at most max_frames frames
+	// N.B. all other job parameters must already be set
+	
+	long round_frames = to_frame - from_frame;
+	long round_from;
+	
+	if (jobs[0].do_sum_amps && num_threads > 1)
+		round_frames = num_threads * jobs[0].max_frames;
+	
+	for (round_from = from_frame; round_from < to_frame; round_from += round_frames)
+		descriptors_non_rt_run_round(jobs, num_threads, round_from, round_from + round_frames > to_frame ? to_frame : round_from + round_frames);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////// Streaming Analysis ////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+void descriptors_streaming (t_descriptors *x, long streaming)
+{
+	// When streaming only descriptors with statistics that need the full history of values keep it - all others use running statistics
+	// N.B. streaming is also used whenever the full history of all descriptors does not fit in the descriptor memory
+	
+	x->streaming = streaming ? 1 : 0;
+}
+
+
+long descriptors_non_rt_needs_history (double *pf_calc_params_current, double ms_to_frame_val)
+{
+	// Medians, peaks / troughs and crossings need all values, as do masked n searches and thresholds relative to the final mean or peak
+	
+	long descriptor_flags = (long) pf_calc_params_current[0];
+	long mask_size = pf_calc_params_current[1] * ms_to_frame_val;
+	long do_n_max = (long) pf_calc_params_current[2];
+	long do_n_min = (long) pf_calc_params_current[3];
+	enum ThresholdType thresh_type = (enum ThresholdType) pf_calc_params_current[11];
+	long i;
+	
+	if (descriptor_flags & DO_MEDIAN)
+		return 1;
+	
+	for (i = 4; i < 10; i++)
+		if (pf_calc_params_current[i])
+			return 1;
+	
+	if (mask_size && (do_n_max > 1 || do_n_min > 1))
+		return 1;
+	
+	if ((descriptor_flags & (DO_RATIO_ABOVE | DO_RATIO_BELOW)) && thresh_type != THRESH_ABS)
+		return 1;
+	
+	return 0;
+}
+
+
+long descriptors_non_rt_stream_memory (double *pf_calc_params_current, long num_frames, long block_frames, double ms_to_frame_val)
+{
+	// The descriptor memory (in bytes) needed to stream one descriptor
+	
+	long do_n_max = (long) pf_calc_params_current[2];
+	long do_n_min = (long) pf_calc_params_current[3];
+	long memory_size = (block_frames * sizeof(double)) + sizeof(t_running_stats);
+	
+	if (descriptors_non_rt_needs_history(pf_calc_params_current, ms_to_frame_val))
+		return memory_size + (num_frames * sizeof(double));
+	
+	return memory_size + (running_stats_memory_size(do_n_max, do_n_min) * sizeof(double));
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////// Handle Non RT descriptor Calculation ////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+void calc_descriptors_non_rt (t_descriptors *x)
+{
+	t_atom *output_list = x->output_list;
+	
+	// FFT variables
+	
+	long fft_size = x->fft_size;
+	long fft_size_halved = fft_size >> 1;
+	long hop_size = x->hop_size;
+
+	double *summed_amplitudes = x->summed_amplitudes;
+	
+	// Threading variables
+	
+	t_descriptors_frame_job jobs[MAX_ANALYSIS_THREADS];
+	t_descriptors *thread_objects = 0;
+	float *thread_amplitudes = 0;
+	
+	long num_threads = x->num_threads;
+	long max_thread_frames = 0;
+	
+	// Streaming variables
+	
+	t_running_stats *running_stats;
+	double *block_data;
+	double *history_data;
+	double *heap_memory;
+	
+	long streaming;
+	long block_frames;
+	long block_from;
+	long block_to;
+	long num_histories;
+	long descriptor_memory;
+	long loop_memory;
+	long peak_memory = 0;
 	
 	// descriptor variables
 	
 	double *descriptor_data = x->descriptor_data;
 	double *current_data;
-	double *pf_params = x->pf_params;
 	double *pf_calc_params = x->pf_calc_params;
-	double *pf_params_temp;
 	double *pb_params = x->pb_params;
 	
 	long *pf_output_params = x->pf_output_params;
@@ -334,6 +941,7 @@ void calc_descriptors_non_rt (t_descriptors *x)
 	double *nlc_below_pos2 = n_min + (21 * MAX_N_SEARCH);
 	
 	char *mask = (char *) ((double *) n_min + (22 * MAX_N_SEARCH));
+	t_n_candidate *candidates = x->n_candidates;
 
 	// Buffer variables
 	
@@ -348,16 +956,14 @@ void calc_descriptors_non_rt (t_descriptors *x)
 	
 	double num_frames_recip;
 	
-	long buffer_pos = 0;
 	long buffer_chan = x->buffer_chan;
 	long start_point = x->start_point;
 	long end_point = x->end_point;
 	long num_frames;
-	long num_samps;
 	
 	// Loop iterators
 	
-	long i, j, k, l, m;
+	long i, j, l, m;
 
 	enum StatisticsType stats_type;
 	long output_pos;
@@ -384,12 +990,6 @@ void calc_descriptors_non_rt (t_descriptors *x)
 	long *median_indices = (long *) ((double *) median_amplitudes + num_bins);
 
 	long spectral_peak_check;
-	
-	raw_fft_frame.realp = windowed_frame + fft_size;
-	raw_fft_frame.imagp = raw_fft_frame.realp + fft_size_halved;
-	
-	real_data = (vFloat *) raw_fft_frame.realp;
-	imag_data = (vFloat *) raw_fft_frame.imagp;
 
 	// Check that some descriptors have been set
 	
@@ -399,6 +999,17 @@ void calc_descriptors_non_rt (t_descriptors *x)
 		return;
 	}
 	
+	// Check that every resolution used by the descriptors has been set
+	
+	for (i = 0; i < num_pf_descriptors; i++)
+	{
+		if (x->pf_resolutions[i] >= x->num_resolutions)
+		{
+			error("descriptors(rt)~: resolution %ld has not been set", x->pf_resolutions[i]);
+			return;
+		}
+	}
+	
 	// Access buffer and increment pointer
 	
 	if (!ibuffer_info (b, &buffer_samples_ptr, &file_length, &num_of_chans, &int_size))
@@ -415,11 +1026,16 @@ void calc_descriptors_non_rt (t_descriptors *x)
 	ms_to_frame_val = sr / (hop_size * 1000.);
 	bin_freq = sr / (double) fft_size;
 
-	// If the sample rate is different from the last one used, recalculate curves for the new sample rates
+	// If the sample rate is different from the last one used, recalculate curves for the new sample rates (for every resolution)
 	
-	if (sr != x->sr) 
-		calc_curves(x);
-	x->sr = sr;
+	for (i = 0; i < x->num_resolutions; i++)
+	{
+		t_descriptors *y = descriptors_resolution(x, i);
+		
+		if (sr != y->sr) 
+			calc_curves(y);
+		y->sr = sr;
+	}
 	
 	// Range check buffer access variables and calculate numer of frames
 	
@@ -445,13 +1061,86 @@ void calc_descriptors_non_rt (t_descriptors *x)
 	
 	num_pf_descriptors_per_loop = descriptor_data_size / (num_frames * sizeof(double));
 	
-	if (!num_pf_descriptors_per_loop)
+	// Stream if requested, or if the full history of every descriptor cannot be kept at once
+	
+	streaming = num_pf_descriptors && (x->streaming || num_pf_descriptors_per_loop < num_pf_descriptors);
+	
+	if (num_threads > num_frames)
+		num_threads = num_frames;
+	
+	if (streaming)
 	{
-		error("descriptors(rt)~: not enough memory - file is too long!");
-		ibuffer_decrement_inuse(b);
-		return;
-	}	
-
+		// Each loop analyses blocks of frames (larger blocks when using more threads, so that each thread has a reasonable number of frames)
+		// Blocks are made smaller if necessary, so that every descriptor fits into the descriptor memory
+		
+		block_frames = STREAMING_BLOCK_FRAMES * num_threads;
+		if (block_frames > num_frames)
+			block_frames = num_frames;
+		
+		for (i = 0; i < num_pf_descriptors; i++)
+		{
+			descriptor_memory = descriptors_non_rt_stream_memory(pf_calc_params + (i * 12), num_frames, 0, ms_to_frame_val);
+			
+			if (block_frames > (descriptor_data_size - descriptor_memory) / (long) sizeof(double))
+				block_frames = (descriptor_data_size - descriptor_memory) / (long) sizeof(double);
+		}
+		
+		if (block_frames < 1)
+		{
+			error("descriptors(rt)~: not enough memory - file is too long!");
+			ibuffer_decrement_inuse(b);
+			return;
+		}
+	}
+	else
+		block_frames = num_frames;
+	
+	// Resolutions profile along with the main object
+	
+	for (i = 1; i < x->num_resolutions; i++)
+		x->resolutions[i]->profile = x->profile;
+	
+	// Allocate per thread memory if analysing on more than one thread
+	
+	if (num_threads > 1)
+	{
+		thread_objects = descriptors_alloc_thread_objects(x, num_threads - 1);
+		
+		// Additional threads keep the amplitudes of their frames for summing (limited so that frames are analysed in rounds for long files)
+		
+		if (thread_objects && do_sum_amps)
+		{
+			max_thread_frames = SUM_AMPS_THREAD_MEMORY / (fft_size_halved * sizeof(float));
+			
+			if (max_thread_frames < RING_BUFFER_SIZE * 4)
+				max_thread_frames = RING_BUFFER_SIZE * 4;
+			if (max_thread_frames > (block_frames + num_threads - 1) / num_threads)
+				max_thread_frames = (block_frames + num_threads - 1) / num_threads;
+			
+			thread_amplitudes = ALIGNED_MALLOC((num_threads - 1) * max_thread_frames * fft_size_halved * sizeof(float));
+			
+			if (!thread_amplitudes)
+			{
+				descriptors_free_thread_objects(thread_objects);
+				thread_objects = 0;
+			}
+		}
+		
+		if (!thread_objects)
+		{
+			error("descriptors(rt)~: couldn't allocate memory for analysis threads - analysing on a single thread");
+			num_threads = 1;
+		}
+	}
+	
+	// Start a new profile for this analysis
+	
+	if (x->profile)
+	{
+		for (i = 0; i < x->num_resolutions; i++)
+			descriptors_profile_reset(descriptors_resolution(x, i));
+	}
+	
 	// Zero summed amplitudes if necessary
 	
 	if (do_sum_amps)
@@ -467,138 +1156,119 @@ void calc_descriptors_non_rt (t_descriptors *x)
 	if (do_sum_amps && num_pf_descriptors < 1)
 		spectral_peak_check = 1;
 	
-	for (i = 0; i < num_pf_descriptors + spectral_peak_check; i += num_pf_descriptors_per_loop)
+	for (i = 0, to_pf_descriptor = 0; to_pf_descriptor < num_pf_descriptors || (spectral_peak_check && !i); i++)
 	{
-		char frame_pointer = 0;
-		
-		from_pf_descriptor  = i;
-		to_pf_descriptor = i + num_pf_descriptors_per_loop;
-		if (to_pf_descriptor > num_pf_descriptors) 
-			to_pf_descriptor = num_pf_descriptors;
-
-		descriptors_zero_ring_buffers(x, fft_size);
+		from_pf_descriptor = to_pf_descriptor;
 		
-		for (k = 0; k < num_frames; k++)
+		if (streaming)
 		{
-			double *cumulate_amps = x->cumulate + (fft_size * frame_pointer);
-			double *cumulate_sq_amps = cumulate_amps + fft_size_halved;
-			double sum;
-			
-			float *this_frame = x->amps_buffer + (3 * fft_size_halved * frame_pointer);
-			float *sq_amplitudes = this_frame;
-			float *amplitudes = sq_amplitudes + fft_size_halved;
-			float *log_amplitudes = amplitudes + fft_size_halved;
-			
-			vFloat *v_sq_amplitudes = (vFloat *) sq_amplitudes;
-#if (defined F32_VEC_LOG_OP || defined F32_VEC_LOG_ARRAY)
-			vFloat *v_log_amplitudes = (vFloat *) log_amplitudes;	
-#endif
-			vFloat *v_raw_frame = (vFloat *) raw_frame;
-			
-			x->ac_flag = 0;
-			x->median_flag = 0;
-			x->centroid_lin_flag = 0;
-			x->centroid_log_flag = 0;
-			x->last_pf_spectralpeaks_n = 0;
-			x->last_pf_spectralpeaks_med_size = 0;
-			x->last_threshold = DBL_MAX;
+			// Fit as many descriptors as possible into the descriptor memory
 			
-			// Get a window of samples
-			
-			buffer_pos = k * hop_size;
-					
-			if (file_length >= (buffer_pos + window_size)) num_samps = window_size;
-			else num_samps = file_length - buffer_pos;
-			
-			ibuffer_get_samps (buffer_samples_ptr, raw_frame, start_point + buffer_pos, num_samps, num_of_chans, buffer_chan, int_size);
-			
-			// Zero pad to fft size
+			for (loop_memory = 0; to_pf_descriptor < num_pf_descriptors; to_pf_descriptor++)
+			{
+				descriptor_memory = descriptors_non_rt_stream_memory(pf_calc_params + (to_pf_descriptor * 12), num_frames, block_frames, ms_to_frame_val);
+				
+				if (loop_memory + descriptor_memory > descriptor_data_size)
+					break;
+				
+				loop_memory += descriptor_memory;
+			}
 			
-			for (j = num_samps; j < fft_size; j++)
-				raw_frame[j] = 0.;
+			// Lay out the memory - histories first, then the block data, then the running statistics and their heaps
 			
-			// Apply window
+			for (j = from_pf_descriptor, num_histories = 0; j < to_pf_descriptor; j++)
+				num_histories += descriptors_non_rt_needs_history(pf_calc_params + (j * 12), ms_to_frame_val);
 			
-			for (j = 0; j < window_size >> 2; j++)
-				v_windowed_frame[j] = F32_VEC_MUL_OP(v_raw_frame[j], v_window[j]);
-			for (j <<= 2; j < window_size; j++)
-				windowed_frame[j] = raw_frame[j] * window[j];
+			block_data = descriptor_data + (num_histories * num_frames);
+			running_stats = (t_running_stats *) (block_data + ((to_pf_descriptor - from_pf_descriptor) * block_frames));
+			heap_memory = (double *) (running_stats + (to_pf_descriptor - from_pf_descriptor));
 			
-			// Do FFT straight into position
+			for (j = from_pf_descriptor; j < to_pf_descriptor; j++)
+			{
+				double *pf_calc_params_current = pf_calc_params + (j * 12);
+				long do_n_max = (long) pf_calc_params_current[2];
+				long do_n_min = (long) pf_calc_params_current[3];
+				
+				if (descriptors_non_rt_needs_history(pf_calc_params_current, ms_to_frame_val))
+					continue;
+				
+				running_stats_reset(running_stats + j - from_pf_descriptor, do_n_max, do_n_min, pf_calc_params_current[10], heap_memory);
+				heap_memory += running_stats_memory_size(do_n_max, do_n_min);
+			}
+		}
+		else
+		{
+			to_pf_descriptor = from_pf_descriptor + num_pf_descriptors_per_loop;
+			if (to_pf_descriptor > num_pf_descriptors) 
+				to_pf_descriptor = num_pf_descriptors;
 			
-			hisstools_unzip_f(windowed_frame, &raw_fft_frame, fft_size_log2);
-			hisstools_rfft_f(fft_setup_real, &raw_fft_frame, fft_size_log2);
+			loop_memory = (to_pf_descriptor - from_pf_descriptor) * num_frames * sizeof(double);
+			block_data = descriptor_data;
+			running_stats = 0;
+		}
+		
+		if (loop_memory > peak_memory)
+			peak_memory = loop_memory;
+		
+		// Set up one job per thread
+		
+		for (j = 0; j < num_threads; j++)
+		{
+			jobs[j].x = j ? thread_objects + j - 1 : x;
+			jobs[j].buffer_samples_ptr = buffer_samples_ptr;
+			jobs[j].file_length = file_length;
+			jobs[j].start_point = start_point;
+			jobs[j].num_of_chans = num_of_chans;
+			jobs[j].buffer_chan = buffer_chan;
+			jobs[j].int_size = int_size;
+			jobs[j].from_pf_descriptor = from_pf_descriptor;
+			jobs[j].to_pf_descriptor = to_pf_descriptor;
+			jobs[j].descriptor_data = block_data;
+			jobs[j].data_stride = block_frames;
+			jobs[j].summed_amplitudes = summed_amplitudes;
+			jobs[j].num_frames_recip = num_frames_recip;
+			jobs[j].do_sum_amps = do_sum_amps;
+			jobs[j].frame_amplitudes = j ? thread_amplitudes + ((j - 1) * max_thread_frames * fft_size_halved) : 0;
+			jobs[j].max_frames = max_thread_frames;
+		}
+		
+		// Calculate the per frame descriptors a block at a time (when not streaming there is one block of all frames)
+		
+		for (block_from = 0; block_from < num_frames; block_from += block_frames)
+		{
+			block_to = block_from + block_frames > num_frames ? num_frames : block_from + block_frames;
 			
-			// Discard the nyquist bin (if necessary add this back later)
+			for (j = 0; j < num_threads; j++)
+				jobs[j].data_offset = block_from;
 			
-			raw_fft_frame.imagp[0] = 0.;
+			descriptors_non_rt_run_jobs(jobs, num_threads, block_from, block_to);
 			
-			// Calulate square amplitudes / amplitudes / log_amplitudes (leaving the raw data also in case phase is needed for some descriptor added later)
+			if (!streaming)
+				continue;
 			
-			for (j = 0; j < fft_size_halved >> 2; j++)
-				v_sq_amplitudes[j] = F32_VEC_ADD_OP(F32_VEC_MUL_OP(real_data[j], real_data[j]), F32_VEC_MUL_OP(imag_data[j], imag_data[j]));
-
-#ifdef F32_VEC_LOG_OP
-			for (i = 0; i < fft_size_halved >> 2; i++)
-				v_log_amplitudes[i] = F32_VEC_MUL_OP(F32_VEC_LOG_OP(F32_VEC_MAX_OP(v_sq_amplitudes[i], v_pow_min)), v_half);
-#else
-#ifdef F32_VEC_LOG_ARRAY
-			for (i = 0; i < fft_size_halved >> 2; i++)
-				v_log_amplitudes[i] = F32_VEC_SQRT_OP(F32_VEC_MAX_OP(v_sq_amplitudes[i], v_pow_min));
-			F32_VEC_LOG_ARRAY(log_amplitudes, log_amplitudes, fft_size_halved);
-#else
-			for (i = 0; i < fft_size_halved; i++)
-				log_amplitudes[i] = log((sq_amplitudes[i] < POW_MIN) ? POW_MIN : sq_amplitudes[i]) * 0.5;;
-#endif
-#endif
+			// Keep the history of descriptors that need it and update the running statistics for all others
 			
-			for (j = 0; j < fft_size_halved; j++)
-				amplitudes[j] = sqrt(sq_amplitudes[j]);
-				
-			// Sum amplitudes if needed (double precision)
+			history_data = descriptor_data;
 			
-			if (do_sum_amps)
+			for (j = from_pf_descriptor; j < to_pf_descriptor; j++)
 			{
-				for (j = 0; j < fft_size_halved;j++)
-					summed_amplitudes[j] += amplitudes[j] * num_frames_recip;
-			}
-			
-			// Cumulate amps and square amps
-			
-			cumulate_amps = x->cumulate + (fft_size * frame_pointer);
-			cumulate_sq_amps = cumulate_amps + fft_size_halved;
-			
-
-			for (sum = 0., j = 0; j < fft_size_halved; j++)
-			{
-				sum += amplitudes[j];
-				cumulate_amps[j] = sum;
-			}
-						
-			for (sum = 0., j = 0; j < fft_size_halved; j++)
-			{
-				sum += sq_amplitudes[j];
-				cumulate_sq_amps[j] = sum;
-			}
+				current_data = block_data + ((j - from_pf_descriptor) * block_frames);
 				
-			pf_params_temp = pf_params;
-			
-			////////////////////////////////////////////// Calculate Per Frame descriptors //////////////////////////////////////////
-			
-			if (!use_energy_thresh || cumulate_sq_amps[fft_size_halved - 1] > energy_thresh)
-			{
-				for (j = from_pf_descriptor; j < to_pf_descriptor; j++)
-					descriptor_data[(j * num_frames) + k] = calc_pf_descriptor(x, raw_frame, windowed_frame, raw_fft_frame, frame_pointer, window_size, fft_size, &pf_params_temp);
-			}
-			else
-			{	
-				for (j = from_pf_descriptor; j < to_pf_descriptor; j++)
-					descriptor_data[(j * num_frames) + k] = DBL_MAX;
+				if (descriptors_non_rt_needs_history(pf_calc_params + (j * 12), ms_to_frame_val))
+				{
+					memcpy(history_data + block_from, current_data, (block_to - block_from) * sizeof(double));
+					history_data += num_frames;
+				}
+				else
+					running_stats_add(running_stats + j - from_pf_descriptor, current_data, block_to - block_from);
 			}
-			
-			frame_pointer = (frame_pointer + 1) % RING_BUFFER_SIZE;
 		}
-
+		
+		// Only sum the amplitudes once
+		
+		do_sum_amps = 0;
+		
+		history_data = descriptor_data;
 		//////////////////////////////////////// Derive outputs from the raw per frame data ////////////////////////////////////////
 
 		for (j = from_pf_descriptor; j <  to_pf_descriptor; j++)
@@ -633,72 +1303,97 @@ void calc_descriptors_non_rt (t_descriptors *x)
 
 			long mask_size = mask_time * ms_to_frame_val;
 
-			current_data = descriptor_data + (j * num_frames);
-
-			if (descriptor_flags & DO_MEAN) 
-				mean = calc_mean_and_time_centroid (current_data, num_frames, &time_centroid, frame_to_ms_val);
-			if (descriptor_flags & DO_STDD) 
-				standard_deviation = calc_standard_deviation(current_data, num_frames, mean);
+			if (!running_stats || descriptors_non_rt_needs_history(pf_calc_params_current, ms_to_frame_val))
+			{
+				// Calculate from the full history of values
+				
+				current_data = history_data;
+				history_data += num_frames;
+				
+				if (descriptor_flags & DO_MEAN) 
+					mean = calc_mean_and_time_centroid (current_data, num_frames, &time_centroid, frame_to_ms_val);
+				if (descriptor_flags & DO_STDD) 
+					standard_deviation = calc_standard_deviation(current_data, num_frames, mean);
 
-			// N searchs
+				// N searchs
 			
-			if (do_n_max) 
-				calc_n_max (current_data, num_frames, mask_size, mask, do_n_max, n_max, n_max_pos, frame_to_ms_val);
-			if (do_n_min) 
-				calc_n_min (current_data, num_frames, mask_size, mask, do_n_min, n_min, n_min_pos, frame_to_ms_val);
-			if (do_n_peak) 
-				calc_n_peak (current_data, num_frames, mask_size, mask, do_n_peak, n_peaks, n_peak_pos, frame_to_ms_val);
-			if (do_n_trough) 
-				calc_n_trough (current_data, num_frames, mask_size, mask, do_n_trough, n_troughs, n_trough_pos, frame_to_ms_val);
+				if (do_n_max) 
+					calc_n_max (current_data, num_frames, mask_size, candidates, do_n_max, n_max, n_max_pos, frame_to_ms_val);
+				if (do_n_min) 
+					calc_n_min (current_data, num_frames, mask_size, candidates, do_n_min, n_min, n_min_pos, frame_to_ms_val);
+				if (do_n_peak) 
+					calc_n_peak (current_data, num_frames, mask_size, candidates, do_n_peak, n_peaks, n_peak_pos, frame_to_ms_val);
+				if (do_n_trough) 
+					calc_n_trough (current_data, num_frames, mask_size, candidates, do_n_trough, n_troughs, n_trough_pos, frame_to_ms_val);
 			
-			// Find threshold based on stats
+				// Find threshold based on stats
 			
-			switch (thresh_type)
-			{
-				case THRESH_ABS:
-					break;
-				case THRESH_MEAN_MUL:
-					threshold *= mean;
-					break;
-				case THRESH_MEAN_DB:
-					threshold = dbtoa(threshold) * mean;
-					break;
-				case THRESH_MEAN_ADD:
-					threshold += mean;
-					break;
-				case THRESH_PEAK_MUL:
-					threshold *= n_max[0];
-					break;
-				case THRESH_PEAK_DB:
-					threshold = dbtoa(threshold) * n_max[0];
-					break;
-				case THRESH_PEAK_ADD:
-					threshold += n_max[0];
-					break;
-			}
+				switch (thresh_type)
+				{
+					case THRESH_ABS:
+						break;
+					case THRESH_MEAN_MUL:
+						threshold *= mean;
+						break;
+					case THRESH_MEAN_DB:
+						threshold = dbtoa(threshold) * mean;
+						break;
+					case THRESH_MEAN_ADD:
+						threshold += mean;
+						break;
+					case THRESH_PEAK_MUL:
+						threshold *= n_max[0];
+						break;
+					case THRESH_PEAK_DB:
+						threshold = dbtoa(threshold) * n_max[0];
+						break;
+					case THRESH_PEAK_ADD:
+						threshold += n_max[0];
+						break;
+				}
 			
-			// Threshold searches
+				// Threshold searches
 			
-			if (do_cross_above) 
-				calc_n_thresh_cross_above (current_data, num_frames, mask_size, mask, do_cross_above, nc_peak, nc_peak_pos, nc_above_pos1, nc_above_pos2, threshold, frame_to_ms_val);
-			if (do_cross_below) 
-				calc_n_thresh_cross_below (current_data, num_frames, mask_size, mask, do_cross_below, nc_trough, nc_trough_pos, nc_below_pos1, nc_below_pos2, threshold, frame_to_ms_val);
-			if (do_longest_cross_above) 
-				calc_longest_crossing_points_above (current_data, num_frames, mask_size, do_longest_cross_above, nlc_above, nlc_above_pos1, nlc_above_pos2, threshold, frame_to_ms_val);
-			if (do_longest_cross_below) 
-				calc_longest_crossing_points_below (current_data, num_frames, mask_size, do_longest_cross_below, nlc_below, nlc_below_pos1, nlc_below_pos2, threshold, frame_to_ms_val);
+				if (do_cross_above) 
+					calc_n_thresh_cross_above (current_data, num_frames, mask_size, mask, do_cross_above, nc_peak, nc_peak_pos, nc_above_pos1, nc_above_pos2, threshold, frame_to_ms_val);
+				if (do_cross_below) 
+					calc_n_thresh_cross_below (current_data, num_frames, mask_size, mask, do_cross_below, nc_trough, nc_trough_pos, nc_below_pos1, nc_below_pos2, threshold, frame_to_ms_val);
+				if (do_longest_cross_above) 
+					calc_longest_crossing_points_above (current_data, num_frames, mask_size, do_longest_cross_above, nlc_above, nlc_above_pos1, nlc_above_pos2, threshold, frame_to_ms_val);
+				if (do_longest_cross_below) 
+					calc_longest_crossing_points_below (current_data, num_frames, mask_size, do_longest_cross_below, nlc_below, nlc_below_pos1, nlc_below_pos2, threshold, frame_to_ms_val);
 			
-			if (descriptor_flags & DO_RATIO_ABOVE) 
-				threshold_ratio_above = calc_threshold_ratio (current_data, num_frames, 1, threshold);
-			if (descriptor_flags & DO_RATIO_BELOW) 
-				threshold_ratio_below = calc_threshold_ratio (current_data, num_frames, 0, threshold);
+				if (descriptor_flags & DO_RATIO_ABOVE) 
+					threshold_ratio_above = calc_threshold_ratio (current_data, num_frames, 1, threshold);
+				if (descriptor_flags & DO_RATIO_BELOW) 
+					threshold_ratio_below = calc_threshold_ratio (current_data, num_frames, 0, threshold);
 		
+				if (descriptor_flags & DO_MEDIAN) 
+					median = calc_median (current_data, num_frames);
+			}
+			else
+			{
+				// Streamed statistics (the threshold is always absolute here)
+				
+				t_running_stats *stats = running_stats + j - from_pf_descriptor;
+				
+				if (descriptor_flags & DO_MEAN) 
+					mean = running_stats_mean_and_time_centroid (stats, &time_centroid, frame_to_ms_val);
+				if (descriptor_flags & DO_STDD) 
+					standard_deviation = running_stats_standard_deviation (stats);
+				if (do_n_max) 
+					running_stats_n_max (stats, do_n_max, n_max, n_max_pos, frame_to_ms_val);
+				if (do_n_min) 
+					running_stats_n_min (stats, do_n_min, n_min, n_min_pos, frame_to_ms_val);
+				if (descriptor_flags & DO_RATIO_ABOVE) 
+					threshold_ratio_above = running_stats_threshold_ratio (stats, 1);
+				if (descriptor_flags & DO_RATIO_BELOW) 
+					threshold_ratio_below = running_stats_threshold_ratio (stats, 0);
+			}
+			
 			if (descriptor_flags & DO_RANGE) 
 				range = n_max[0] - n_min[0];
 
-			if (descriptor_flags & DO_MEDIAN) 
-				median = calc_median (current_data, num_frames);
-
 			// Store all output into position
 			
 			for (l = 0; l < PF_NStore; l++)
@@ -921,9 +1616,30 @@ void calc_descriptors_non_rt (t_descriptors *x)
 		}
 	}
 	
-	// Decrement buffer pointer
+	// Report the peak descriptor memory used when streaming
+	
+	if (streaming)
+		post ("descriptors~: streamed %ld frames using %ld bytes of descriptor memory", num_frames, peak_memory);
+	
+	// Free per thread memory and decrement buffer pointer
+	
+	descriptors_free_thread_objects(thread_objects);
+	ALIGNED_FREE(thread_amplitudes);
 	
 	ibuffer_decrement_inuse(b);
+	
+	if (x->profile)
+	{
+		// The costs of other resolutions are added to the primary profile (which keeps its own frame count)
+		
+		long profile_frames = x->profile_frames;
+		
+		for (i = 1; i < x->num_resolutions; i++)
+			descriptors_profile_combine(x, x->resolutions[i]);
+		
+		x->profile_frames = profile_frames;
+		descriptors_profile_post(x);
+	}
 
 	// Output
 	
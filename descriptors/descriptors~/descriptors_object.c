@@ -10,6 +10,14 @@
 
 #include "descriptors_object.h"
 
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <time.h>
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////// Common Basics (main / new / assist) ////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -17,16 +25,21 @@
 
 void descriptors_main_common ()
 {
+#ifndef DESCRIPTORS_STANDALONE
+	
 	// Setup class basics
 	
 	class_addmethod (this_class, (method)descriptors_fft_params, "fftparams", A_GIMME, 0L);
 	class_addmethod (this_class, (method)descriptors_energy_thresh, "energythresh", A_GIMME, 0L);
+	class_addmethod (this_class, (method)descriptors_profile, "profile", A_GIMME, 0L);
 	class_addmethod (this_class, (method)descriptors_dsp, "dsp", A_CANT, 0L);
 	class_addmethod (this_class, (method)descriptors_dsp64, "dsp64", A_CANT, 0L);
 	class_addmethod (this_class, (method)descriptors_assist, "assist", A_CANT, 0L);
 
 	class_dspinit(this_class);
 	
+#endif
+	
 	// Initialise symbols
 	
 	ps_energy = gensym("energy");
@@ -105,6 +118,7 @@ void descriptors_main_common ()
 	ps_mean_db = gensym("mean_db");
 	
 	ps_masktime = gensym("masktime");
+	ps_resolution = gensym("resolution");
 
 	ps_rectangle = gensym("rectangle");
 	ps_hann = gensym("hann");
@@ -142,6 +156,8 @@ void descriptors_new_common (t_descriptors *x, long max_fft_size_log2, long desc
 	x->use_energy_thresh = 0;
 	
 	x->do_sum_amps = 0;
+	x->pf_nodes = 0;
+	x->profile = 0;
 	x->num_pf_descriptors = 0;	
 	x->num_pb_descriptors = 0;
 	x->output_length = 0;
@@ -149,6 +165,9 @@ void descriptors_new_common (t_descriptors *x, long max_fft_size_log2, long desc
 	x->buffer_chan = 0;
 	x->start_point = 0;
 	x->end_point = 0; 
+	x->num_threads = 1;
+	x->streaming = 0;
+	x->num_resolutions = 1;
 	
 	x->buffer_pointer = 0;
 	x->buffer_name = 0;
@@ -248,12 +267,25 @@ long descriptors_max_fft_size (t_descriptors *x, long max_fft_size)
 
 void descriptors_fft_params (t_descriptors *x, t_symbol *msg, short argc, t_atom *argv)
 {
+	long fft_size;
+	long hop_size;
+	long window_size;
+	t_symbol *window_type;
+	
+	short primary_argc;
+	
+	// Arguments from the first "resolution" onwards set additional resolutions (see descriptors_resolutions)
+	
+	for (primary_argc = 0; primary_argc < argc; primary_argc++)
+		if (atom_gettype(argv + primary_argc) == A_SYM && atom_getsym(argv + primary_argc) == ps_resolution)
+			break;
+	
 	// Load in args as relevant
 	
-	long fft_size = (argc > 0) ? atom_getlong(argv + 0) : 0;
-	long hop_size = (argc > 1) ? atom_getlong(argv + 1) : 0;
-	long window_size = (argc > 2) ? atom_getlong(argv + 2) : 0;
-	t_symbol *window_type = (argc > 3) ? atom_getsym(argv + 3) : ps_nullsym;
+	fft_size = (primary_argc > 0) ? atom_getlong(argv + 0) : 0;
+	hop_size = (primary_argc > 1) ? atom_getlong(argv + 1) : 0;
+	window_size = (primary_argc > 2) ? atom_getlong(argv + 2) : 0;
+	window_type = (primary_argc > 3) ? atom_getsym(argv + 3) : ps_nullsym;
 	
 		
 	// Ignore blank argument set (keep current values)
@@ -262,6 +294,7 @@ void descriptors_fft_params (t_descriptors *x, t_symbol *msg, short argc, t_atom
 		return;
 	
 	descriptors_fft_params_internal(x, fft_size, hop_size, window_size, window_type);
+	descriptors_resolutions(x, argc - primary_argc, argv + primary_argc);
 }
 	
 void descriptors_fft_params_internal (t_descriptors *x, long fft_size, long hop_size, long window_size, t_symbol *window_type)
@@ -568,6 +601,291 @@ void descriptors_energy_thresh (t_descriptors *x, t_symbol *msg, short argc, t_a
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////// Per Frame Intermediates ////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+long descriptors_frame_nodes (t_descriptors *x, long nodes, long do_sum_amps)
+{
+	// Add the intermediates needed for the energy threshold and summed amplitudes to those needed by the descriptors
+
+	if (x->use_energy_thresh)
+		nodes |= PF_NODE(PF_NODE_CUMULATE_SQ_AMPS);
+	if (do_sum_amps)
+		nodes |= PF_NODE(PF_NODE_AMPLITUDES);
+
+	return descriptors_resolve_nodes(nodes);
+}
+
+
+void descriptors_calc_spectrum (t_descriptors *x, float *raw_frame, float *windowed_frame, FFT_SPLIT_COMPLEX_F raw_fft_frame, long frame_pointer, long nodes)
+{
+	// Calculate the spectral intermediates of a frame in dependency order, skipping any that are not needed (the raw frame must already be zero padded)
+	// N.B. the autocorrelation, median filter and spectral peaks depend on descriptor parameters, so they are calculated on demand (once per frame)
+
+	long fft_size = x->fft_size;
+	long fft_size_halved = fft_size >> 1;
+	long fft_size_log2 = x->fft_size_log2;
+	long window_size = x->window_size;
+
+	float *window = x->window;
+
+	float *this_frame = x->amps_buffer + (3 * fft_size_halved * frame_pointer);
+	float *sq_amplitudes = this_frame;
+	float *amplitudes = sq_amplitudes + fft_size_halved;
+	float *log_amplitudes = amplitudes + fft_size_halved;
+
+	double *cumulate_amps = x->cumulate + (fft_size * frame_pointer);
+	double *cumulate_sq_amps = cumulate_amps + fft_size_halved;
+	double sum;
+
+	vFloat *v_window = (vFloat *) window;
+	vFloat *v_raw_frame = (vFloat *) raw_frame;
+	vFloat *v_windowed_frame = (vFloat *) windowed_frame;
+	vFloat *v_sq_amplitudes = (vFloat *) sq_amplitudes;
+#if (defined F32_VEC_LOG_OP || defined F32_VEC_LOG_ARRAY)
+	vFloat *v_log_amplitudes = (vFloat *) log_amplitudes;
+#endif
+	vFloat *real_data = (vFloat *) raw_fft_frame.realp;
+	vFloat *imag_data = (vFloat *) raw_fft_frame.imagp;
+
+#if (defined F32_VEC_LOG_OP)
+	vFloat v_half = {0.5, 0.5, 0.5, 0.5};
+#endif
+#if (defined F32_VEC_LOG_OP || defined F32_VEC_LOG_ARRAY)
+	vFloat v_pow_min = {POW_MIN, POW_MIN, POW_MIN, POW_MIN};
+#endif
+
+	double time = x->profile ? descriptors_profile_time() : 0.;
+	long i;
+
+	if (x->profile)
+		x->profile_frames++;
+
+	if (nodes & PF_NODE(PF_NODE_SPECTRUM))
+	{
+		// Apply window
+
+		for (i = 0; i < window_size >> 2; i++)
+			v_windowed_frame[i] = F32_VEC_MUL_OP(v_raw_frame[i], v_window[i]);
+		for (i <<= 2; i < window_size; i++)
+			windowed_frame[i] = raw_frame[i] * window[i];
+
+		// Zero pad to fft size (the windowed frame is scratch memory, so it cannot be assumed to be zeroed already)
+
+		for (; i < fft_size; i++)
+			windowed_frame[i] = 0.;
+
+		// Do fft straight into position
+
+		hisstools_unzip_f(windowed_frame, &raw_fft_frame, fft_size_log2);
+		hisstools_rfft_f(x->fft_setup_real, &raw_fft_frame, fft_size_log2);
+
+		// Discard the nyquist bin (if necessary add this back later)
+
+		raw_fft_frame.imagp[0] = 0.;
+
+		// Calulate square amplitudes (leaving the raw data also in case phase is needed for some descriptor added later)
+
+		for (i = 0; i < fft_size_halved >> 2; i++)
+			v_sq_amplitudes[i] = F32_VEC_ADD_OP(F32_VEC_MUL_OP(real_data[i], real_data[i]), F32_VEC_MUL_OP(imag_data[i], imag_data[i]));
+
+		time = descriptors_profile_node(x, PF_NODE_SPECTRUM, time);
+	}
+
+	if (nodes & PF_NODE(PF_NODE_LOG_AMPLITUDES))
+	{
+#ifdef F32_VEC_LOG_OP
+		for (i = 0; i < fft_size_halved >> 2; i++)
+			v_log_amplitudes[i] = F32_VEC_MUL_OP(F32_VEC_LOG_OP(F32_VEC_MAX_OP(v_sq_amplitudes[i], v_pow_min)), v_half);
+#else
+#ifdef F32_VEC_LOG_ARRAY
+		for (i = 0; i < fft_size_halved >> 2; i++)
+			v_log_amplitudes[i] = F32_VEC_SQRT_OP(F32_VEC_MAX_OP(v_sq_amplitudes[i], v_pow_min));
+		F32_VEC_LOG_ARRAY(log_amplitudes, log_amplitudes, fft_size_halved);
+#else
+		for (i = 0; i < fft_size_halved; i++)
+			log_amplitudes[i] = log((sq_amplitudes[i] < POW_MIN) ? POW_MIN : sq_amplitudes[i]) * 0.5;
+#endif
+#endif
+		time = descriptors_profile_node(x, PF_NODE_LOG_AMPLITUDES, time);
+	}
+
+	if (nodes & PF_NODE(PF_NODE_AMPLITUDES))
+	{
+		for (i = 0; i < fft_size_halved; i++)
+			amplitudes[i] = sqrt(sq_amplitudes[i]);
+
+		time = descriptors_profile_node(x, PF_NODE_AMPLITUDES, time);
+	}
+
+	// Cumulate amps and square amps
+
+	if (nodes & PF_NODE(PF_NODE_CUMULATE_AMPS))
+	{
+		for (sum = 0., i = 0; i < fft_size_halved; i++)
+		{
+			sum += amplitudes[i];
+			cumulate_amps[i] = sum;
+		}
+
+		time = descriptors_profile_node(x, PF_NODE_CUMULATE_AMPS, time);
+	}
+
+	if (nodes & PF_NODE(PF_NODE_CUMULATE_SQ_AMPS))
+	{
+		for (sum = 0., i = 0; i < fft_size_halved; i++)
+		{
+			sum += sq_amplitudes[i];
+			cumulate_sq_amps[i] = sum;
+		}
+
+		descriptors_profile_node(x, PF_NODE_CUMULATE_SQ_AMPS, time);
+	}
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////// Profiling ///////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static const char *descriptors_node_names[PF_NUM_NODES] =
+{
+	"spectrum",
+	"log amplitudes",
+	"amplitudes",
+	"cumulate amps",
+	"cumulate square amps",
+	"autocorrelation",
+	"median filter",
+	"spectral peaks",
+	"descriptors"
+};
+
+
+double descriptors_profile_time ()
+{
+	// A high resolution time in ms (only meaningful relative to other calls)
+
+#if defined (__APPLE__)
+	static mach_timebase_info_data_t timebase;
+
+	if (!timebase.denom)
+		mach_timebase_info(&timebase);
+
+	return ((double) mach_absolute_time() * timebase.numer) / (timebase.denom * 1000000.);
+#elif defined (_WIN32)
+	LARGE_INTEGER count;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+
+	return ((double) count.QuadPart * 1000.) / (double) frequency.QuadPart;
+#else
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return ((double) time.tv_sec * 1000.) + ((double) time.tv_nsec / 1000000.);
+#endif
+}
+
+
+double descriptors_profile_node (t_descriptors *x, enum PFNodeType node, double start_time)
+{
+	// Add the time since start_time to a node and return the current time (so that calls can be chained)
+
+	double time;
+
+	if (!x->profile)
+		return 0.;
+
+	time = descriptors_profile_time();
+
+	x->profile_times[node] += time - start_time;
+	x->profile_counts[node]++;
+
+	return time;
+}
+
+
+void descriptors_profile_reset (t_descriptors *x)
+{
+	long i;
+
+	for (i = 0; i < PF_NUM_NODES; i++)
+	{
+		x->profile_times[i] = 0.;
+		x->profile_counts[i] = 0;
+	}
+
+	x->profile_frames = 0;
+}
+
+
+void descriptors_profile_combine (t_descriptors *x, t_descriptors *y)
+{
+	// Add the profile of a thread object to that of the main object
+
+	long i;
+
+	for (i = 0; i < PF_NUM_NODES; i++)
+	{
+		x->profile_times[i] += y->profile_times[i];
+		x->profile_counts[i] += y->profile_counts[i];
+	}
+
+	x->profile_frames += y->profile_frames;
+}
+
+
+void descriptors_profile_post (t_descriptors *x)
+{
+	// N.B. the descriptors are timed including any intermediates calculated on demand, so these are subtracted
+
+	double total_time = 0.;
+	double time;
+	long i;
+
+	post ("descriptors(rt)~: profile of %ld frames", x->profile_frames);
+
+	for (i = 0; i < PF_NUM_NODES; i++)
+	{
+		time = x->profile_times[i];
+
+		if (i == PF_NODE_DESCRIPTORS)
+			time -= x->profile_times[PF_NODE_AUTOCORRELATION] + x->profile_times[PF_NODE_MEDIAN_FILTER] + x->profile_times[PF_NODE_SPECTRAL_PEAKS];
+
+		total_time += time;
+
+		if ((x->pf_nodes & PF_NODE(i)) || x->profile_counts[i])
+			post ("descriptors(rt)~: %s - calculated %ld times - %.3lf ms (%.4lf ms per frame)", descriptors_node_names[i], x->profile_counts[i], time, x->profile_frames ? time / x->profile_frames : 0.);
+	}
+
+	post ("descriptors(rt)~: total - %.3lf ms", total_time);
+}
+
+
+void descriptors_profile (t_descriptors *x, t_symbol *msg, short argc, t_atom *argv)
+{
+	// Profiling is turned on (with a new profile) or off with an argument of 1 / 0 - with no arguments the current profile is posted
+
+	if (!argc)
+	{
+		descriptors_profile_post(x);
+		return;
+	}
+
+	if (atom_getlong(argv))
+		descriptors_profile_reset(x);
+
+	x->profile = atom_getlong(argv) ? 1 : 0;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////// Calculate Raw Per Frame descriptors //////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -676,11 +994,11 @@ double calc_pf_descriptor(t_descriptors *x, float *raw_frame, float *windowed_fr
 		case DESCRIPTOR_PF_FLUX:
 		
 			past_frame_pointer = (frame_pointer - (long) params[6]);
-			frame1 = x->amps_buffer + (3 * num_bins * past_frame_pointer) + num_bins;
-			frame2 = amplitudes;
 			while (past_frame_pointer < 1)
 				past_frame_pointer += RING_BUFFER_SIZE;
 			past_frame_pointer %= RING_BUFFER_SIZE;
+			frame1 = x->amps_buffer + (3 * num_bins * past_frame_pointer) + num_bins;
+			frame2 = amplitudes;
 			cumulate_ptr1 = x->cumulate + (fft_size * past_frame_pointer);
 			cumulate_ptr2 = cumulateAmps;
 			forward_only = (char) params[3];
@@ -913,7 +1231,7 @@ double calc_pf_descriptor(t_descriptors *x, float *raw_frame, float *windowed_fr
 			median_span = (long) params[2];
 		
 			spectralpeaks_medianmask_float (x, median_indices, median_amplitudes, amplitudes, log_amplitudes, median_span, num_bins, mask, N, freqs, amps, bin_freq, (-90. / 20.) * log(10.));
-			descriptor = get_roughness (freqs, amps, N);
+			descriptor = get_roughness (freqs, amps, (float *) median_indices, N);
 
 			*param_ptr += 3;
 			break;
@@ -14,9 +14,13 @@
 #ifndef _DESCRIPTORS_OBJECT_
 #define _DESCRIPTORS_OBJECT_
 
+#ifdef DESCRIPTORS_STANDALONE
+#include "descriptors_standalone.h"
+#else
 #include <ext.h>
 #include <ext_obex.h>
 #include <z_dsp.h>
+#endif
 
 #include <HISSTools_FFT/HISSTools_FFT.h>
 #include <AH_Win_Math.h>
@@ -41,6 +45,7 @@ void descriptors_new_common (t_descriptors *x, long max_fft_size_log2, long desc
 void *descriptors_new (t_symbol *s, short argc, t_atom *argv);
 void descriptors_free (t_descriptors *x);
 void descriptors_assist (t_descriptors *x, void *b, long m, long a, char *s);
+long descriptors_non_rt_init (t_descriptors *x, long max_fft_size_in, long descriptor_data_size, long descriptor_feedback);
 
 // FFT parameter and window related routines
 
@@ -49,6 +54,12 @@ void descriptors_fft_params (t_descriptors *x, t_symbol *s, short argc, t_atom *
 void descriptors_fft_params_internal (t_descriptors *x, long fft_size, long hop_size, long window_size, t_symbol *window_type);
 void descriptors_generate_window (t_descriptors *x, float *window, long window_size, long fft_size, enum WindowType window_select);
 
+// Additional resolutions (non real-time only - see descriptors_non_rt.c)
+
+void descriptors_resolutions (t_descriptors *x, short argc, t_atom *argv);
+t_descriptors *descriptors_resolution_new (t_descriptors *x, long fft_size, long window_size, t_symbol *window_type);
+void descriptors_resolutions_free (t_descriptors *x);
+
 // Routine for zero ring buffers
 
 void descriptors_zero_ring_buffers (t_descriptors *x, long fft_size);
@@ -58,17 +69,29 @@ void descriptors_zero_ring_buffers (t_descriptors *x, long fft_size);
 void descriptors_descriptors (t_descriptors *x, t_symbol *msg, short argc, t_atom *argv);
 void descriptors_energy_thresh (t_descriptors *x, t_symbol *msg, short argc, t_atom *argv);
 void descriptors_analyse(t_descriptors *x, t_symbol *msg, short argc, t_atom *argv);
+void descriptors_streaming (t_descriptors *x, long streaming);
 
 // Descriptor calculation routines 
 
-void calc_descriptors_rt (t_descriptors *x, float *samples);
+long calc_descriptors_rt (t_descriptors *x, float *samples, t_atom *output_list);
 void calc_descriptors_non_rt (t_descriptors *x);
 
+t_descriptors *descriptors_alloc_thread_objects (t_descriptors *x, long num_objects);
+void descriptors_free_thread_objects (t_descriptors *objects);
+void *descriptors_non_rt_thread (t_descriptors_frame_job *job);
+void descriptors_non_rt_calc_frames (t_descriptors_frame_job *job);
+void descriptors_non_rt_run_jobs (t_descriptors_frame_job *jobs, long num_threads, long from_frame, long to_frame);
+long descriptors_non_rt_needs_history (double *pf_calc_params_current, double ms_to_frame_val);
+long descriptors_non_rt_stream_memory (double *pf_calc_params_current, long num_frames, long block_frames, double ms_to_frame_val);
+
+long descriptors_frame_nodes (t_descriptors *x, long nodes, long do_sum_amps);
+void descriptors_calc_spectrum (t_descriptors *x, float *raw_frame, float *windowed_frame, FFT_SPLIT_COMPLEX_F raw_fft_frame, long frame_pointer, long nodes);
 double calc_pf_descriptor (t_descriptors *x, float *raw_frame, float *windowed_Frame, FFT_SPLIT_COMPLEX_F Raw_FFT_Frame, long frame_pointer, long num_samps, long fft_size, double **Params);
 
 // Real-time dsp functions
 
 void output_rt (t_descriptors *x);
+void descriptors_rt_frame (t_descriptors *x, float *samples);
 
 t_int *descriptors_perform(t_int *w);
 void descriptors_dsp (t_descriptors *x, t_signal **sp, short *count);
@@ -76,6 +99,20 @@ void descriptors_dsp (t_descriptors *x, t_signal **sp, short *count);
 void descriptors_perform64 (t_descriptors *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
 void descriptors_dsp64 (t_descriptors *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
 
+// Asynchronous real-time analysis
+
+t_max_err descriptors_async_set (t_descriptors *x, t_object *attr, long argc, t_atom *argv);
+long descriptors_async_start (t_descriptors *x);
+void descriptors_async_stop (t_descriptors *x);
+void *descriptors_async_thread (t_descriptors *x);
+
+// Profiling of the per frame intermediates
+
+void descriptors_profile (t_descriptors *x, t_symbol *msg, short argc, t_atom *argv);
+void descriptors_profile_reset (t_descriptors *x);
+void descriptors_profile_combine (t_descriptors *x, t_descriptors *y);
+void descriptors_profile_post (t_descriptors *x);
+
 // Useful curves (pre-calculated for efficiency)
 
 void calc_curves (t_descriptors *x);
@@ -13,11 +13,18 @@
 #define _DESCRIPTORS_OBJECT_STRUCTURE_
 
 
+#ifdef DESCRIPTORS_STANDALONE
+#include "descriptors_standalone.h"
+#else
 #include <ext.h>
 #include <ext_obex.h>
+#include <ext_systhread.h>
 #include <z_dsp.h>
+#include <AH_Atomic.h>
+#endif
 
 #include <HISSTools_FFT/HISSTools_FFT.h>
+#include <AH_Types.h>
 
 #include "descriptors_constants.h"
 
@@ -42,6 +49,30 @@ typedef struct _descriptors
 	
 	long write_pointer;
 	long hop_count;
+	
+	////////////////////////////////// Asynchronous RT Stuff //////////////////////////////////
+	
+	// Frames are queued by the audio thread and analysed by a worker thread, which queues the output lists for the output clock
+	// N.B. both queues are single producer / single consumer, and the queue size must be a power of two
+	
+	long async;
+	long async_quit;
+	long async_dropped;
+	double async_latency;
+	
+	t_systhread async_thread;
+	
+	float *async_frames;
+	t_atom *async_outputs;
+	
+	unsigned long async_frame_times[ASYNC_QUEUE_SIZE];
+	unsigned long async_output_times[ASYNC_QUEUE_SIZE];
+	long async_output_lengths[ASYNC_QUEUE_SIZE];
+	
+	t_int32_atomic async_frames_written;
+	t_int32_atomic async_frames_read;
+	t_int32_atomic async_outputs_written;
+	t_int32_atomic async_outputs_read;
 
 	/////////////////////////////////////// Buffer Stuff //////////////////////////////////////
 	
@@ -52,6 +83,8 @@ typedef struct _descriptors
 	long buffer_chan;
 	long start_point;
 	long end_point;
+	long num_threads;
+	long streaming;
 
 	/////////////////////// Relevant Sample Rate (buffer or real-time) ////////////////////////
 
@@ -62,6 +95,7 @@ typedef struct _descriptors
 	long descriptor_data_size;
 	double *descriptor_data;
 	void *n_data;
+	void *n_candidates;
 	
 	//////////////////////////////////////// FFT Stuff ////////////////////////////////////////
 	
@@ -85,6 +119,12 @@ typedef struct _descriptors
 	
 	char reset_fft;
 	char frame_pointer;
+	
+	// Additional resolutions (non real-time only) - each is a copy of the object with its own fft size, window, curves and scratch memory
+	// N.B. all resolutions share the hop size of this object (resolution zero), and per frame descriptors are bound to a resolution by index
+	
+	long num_resolutions;
+	struct _descriptors *resolutions[MAX_RESOLUTIONS];
 
 	/////////////////////////////////// Autocorrelation Stuff /////////////////////////////////
 	
@@ -130,6 +170,17 @@ typedef struct _descriptors
 	long last_pf_spectralpeaks_n;
 	long last_pf_spectralpeaks_med_size;
 
+	//////////////////////////////////// Intermediate Graph ///////////////////////////////////
+	
+	// The per frame intermediates needed by the current descriptors (as PF_NODE flags) and their profiled cost
+	
+	long pf_nodes;
+	
+	long profile;
+	long profile_frames;
+	long profile_counts[PF_NUM_NODES];
+	double profile_times[PF_NUM_NODES];
+
 	//////////////////////////////////////// Outlets ////////////////////////////////////////
 	
 	void *the_list_outlet;
@@ -150,6 +201,8 @@ typedef struct _descriptors
 	double pf_params[MAX_PF_PARAMS];
 	double pf_calc_params[MAX_PF_CALC];
 	long pf_output_params[MAX_PF_OUTPUT_PARAMS];
+	long pf_params_pos[MAX_PF_CALC / 12];
+	long pf_resolutions[MAX_PF_CALC / 12];
 	long num_pf_descriptors;
 
 	// Per Block Descriptors
@@ -162,4 +215,43 @@ typedef struct _descriptors
 } t_descriptors;
 
 
+// A range of frames to be analysed by one thread (non real-time only)
+
+typedef struct _descriptors_frame_job
+{
+	t_descriptors *x;
+	
+	void *buffer_samples_ptr;
+	
+	AH_SIntPtr file_length;
+	long start_point;
+	long num_of_chans;
+	long buffer_chan;
+	long int_size;
+	
+	long from_frame;
+	long to_frame;
+	long from_pf_descriptor;
+	long to_pf_descriptor;
+	long do_sum_amps;
+	
+	double *descriptor_data;
+	long data_stride;
+	long data_offset;
+	
+	double *summed_amplitudes;
+	double num_frames_recip;
+	
+	float *frame_amplitudes;
+	long max_frames;
+	
+} t_descriptors_frame_job;
+
+
+// Profiling of the per frame intermediates (see descriptors_object.c)
+
+double descriptors_profile_time ();
+double descriptors_profile_node (t_descriptors *x, enum PFNodeType node, double start_time);
+
+
 #endif /* _DESCRIPTORS_OBJECT_STRUCTURE_ */
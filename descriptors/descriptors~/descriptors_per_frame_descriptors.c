@@ -684,7 +684,7 @@ double get_noise_ratio (t_descriptors *x, long *median_indices, float *median_am
 	double sum2 = 0;
 	long i;
 	
-	sum2 = cumulate_ptr[num_bins = 1];
+	sum2 = cumulate_ptr[num_bins - 1];
 	
 	if (sum2)
 	{
@@ -779,6 +779,7 @@ void calc_ac_coefficients (t_descriptors *x, float *raw_frame)
 	long window_size = x->window_size;
 		
 	double norm_factor = 0.;
+	double profile_time;
 	long i;
 	
 	full_fft_frame.realp = ac_coefficients + fft_size;
@@ -790,6 +791,7 @@ void calc_ac_coefficients (t_descriptors *x, float *raw_frame)
 		return;
 	
 	x->ac_flag = 1;
+	profile_time = x->profile ? descriptors_profile_time() : 0.;
 	
 	// Calculate normalisation factor
 	
@@ -822,6 +824,8 @@ void calc_ac_coefficients (t_descriptors *x, float *raw_frame)
 	
 	hisstools_rifft_f(fft_setup_real, &full_fft_frame, fft_size_log2);
 	hisstools_zip_f(&full_fft_frame, ac_coefficients, fft_size_log2);
+	
+	descriptors_profile_node(x, PF_NODE_AUTOCORRELATION, profile_time);
 }
 
 
@@ -966,6 +970,7 @@ double get_pitch (t_descriptors *x, float *raw_frame, float *ac_coeff, long leng
 
 
 // This roughness calulator takes num_sines partials (freq and amplitude pairs) - ordering is unimportant
+// The sort memory must be large enough for two floats per non-zero partial
 
 // This code is adapated from code by Richard Parncutt, formerly of Mcgill University, and currently based at the Univeristy of Graz
 // Richard Parncutt's current webpage is: http://www.uni-graz.at/richard.parncutt/
@@ -980,18 +985,20 @@ double get_pitch (t_descriptors *x, float *raw_frame, float *ac_coeff, long leng
 // Critical bandwidth CBW is given by P&L's function, as cited by H&K.
 
 
-double get_roughness (float *freqs, float *amps, long num_sines)
+double get_roughness (float *freqs, float *amps, float *sort_memory, long num_sines)
 {
+	float *sorted_freqs = sort_memory;
+	float *sorted_amps;
+	
 	double e; 																// base of natural logarithms
 	double cb_int; 															// interval between two partials in critical bandwidths
 	double cbw; 															// critical bandwidth according to P&L, H&K
-	double index; 															// for standard curve of P&L
 	double mean_freq; 														// mean frequency of two cpts
 	double numerator, denominator; 											// for calculating H&K Eq. (3)
 	double ratio; 															// temporary variable
 	double standard_curve; 													// P&L Fig. 10, H&K Fig. 1
-	double min_amp = 0;
 	
+	long num_partials = 0;
 	long i, j;
 	
 	// Parameters for analytic version of standard curve of P&L:
@@ -1000,50 +1007,67 @@ double get_roughness (float *freqs, float *amps, long num_sines)
 	double cb_int1 = 1.2; 													// interval beyond which roughness is negligible (P&L: 1.2)
 	double cb_int0_recip;
 		
-	index = 2.; 															// the bigger index, the narrower the curve
 	e = exp(1); 															// 2.7182818 - base of natural log
 	cb_int0_recip = 1. / cb_int0;
 	
 	numerator = 0; 
 	denominator = 0;
-		
-	for (i = 0; i < num_sines; i++) 										
+	
+	// The denominator sums the square of the first amplitude of every pair of non-zero partials (in the given order)
+	// Each partial is first in a pair with each of the non-zero partials that follow it, so this can be done in one pass from the end
+	
+	for (i = num_sines - 1; i >= 0; i--)
 	{
 		if (amps[i])
 		{
-			for (j = i + 1; j < num_sines; j++)								
-			{
-				if (amps[j])
-				{
-					mean_freq = (freqs[i] + freqs[j]) / 2; 
-					
-					// The below is from H&K p. 5
-					
-					cbw = 1.72 * pow (mean_freq, 0.65); 									
-					cb_int = (fabsf(freqs[j] - freqs[i])) / cbw; 
-					
-					// (Otherwise roughness is negligible) (save computing time)
-					
-					if (cb_int < cb_int1)												
-					{
-						ratio = cb_int * cb_int0_recip;
-
-						// Below approximates P&L
-						
-						standard_curve = pow((e * ratio) * exp(-ratio), index);			
-						numerator += amps[i] * amps[j] * standard_curve;
-					}
-					denominator += amps[i] * amps[i];
-					if (amps[i] < min_amp) 
-						min_amp = amps[i];
-				}
-			}	
+			denominator += (double) num_partials * (amps[i] * amps[i]);
+			num_partials++;
 		}
 	}
 	
-	// This hack allows the algorithm to work without needing the partials in a particular order
+	// Copy the non-zero partials and sort them into order of descending frequency
+	
+	sorted_amps = sort_memory + num_partials;
 	
-	denominator -= min_amp * min_amp;
+	for (i = 0, j = 0; i < num_sines; i++)
+	{
+		if (amps[i])
+		{
+			sorted_freqs[j] = freqs[i];
+			sorted_amps[j++] = amps[i];
+		}
+	}
+	
+	combsort_peaks_float(sorted_freqs, sorted_amps, num_partials);
+		
+	// In frequency order the interval in critical bandwidths only grows as the second partial moves away from the first (the gap widens and the mean falls)
+	// Thus once a pair is beyond the negligible interval all further pairs are also, and only near neighbours need to be visited
+	
+	for (i = 0; i < num_partials; i++) 										
+	{
+		for (j = i + 1; j < num_partials; j++)								
+		{
+			mean_freq = (sorted_freqs[i] + sorted_freqs[j]) / 2; 
+			
+			// The below is from H&K p. 5
+			
+			cbw = 1.72 * pow (mean_freq, 0.65); 									
+			cb_int = (sorted_freqs[i] - sorted_freqs[j]) / cbw; 
+			
+			// (Otherwise roughness is negligible) (save computing time)
+			
+			if (!(cb_int < cb_int1))
+				break;
+			
+			ratio = cb_int * cb_int0_recip;
+			
+			// Below approximates P&L (with an index of 2 - the bigger index, the narrower the curve)
+			
+			standard_curve = (e * ratio) * exp(-ratio);
+			standard_curve *= standard_curve;
+			numerator += sorted_amps[i] * sorted_amps[j] * standard_curve;
+		}
+	}
 	
 	if (denominator)
 		return (numerator / denominator);
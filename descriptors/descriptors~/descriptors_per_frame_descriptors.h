@@ -69,7 +69,7 @@ double get_pitch (t_descriptors *x, float *raw_frame, float *ac_coeff, long leng
 
 // Roughness
 
-double get_roughness (float *freqs, float *amps, long num_sines);
+double get_roughness (float *freqs, float *amps, float *sort_memory, long num_sines);
 
 
 #endif /* _DESCRIPTORS_PFDESCRIPTORS_ */
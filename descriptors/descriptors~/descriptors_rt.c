@@ -7,6 +7,7 @@
  *	It is the real-time counterpart to the descriptors~ object - the two objects are very similar in terms of features and usage.
  *
  *	The object only calculates and outputs the descriptors that the user requests (these can be changed in realtime).
+ *	With the async attribute on, frames are analysed on a separate thread rather than in the audio thread (at the cost of some latency).
  *	The object is designed to be as efficient as possible, avoiding unnecessary calculations and re-calculations wherever possible and making extensive use of SIMD operations.
  *
  *	For in-depth details on usage of the descriptorsrt~ object see the helpfile documentation.
@@ -17,6 +18,7 @@
 
 
 #include "descriptors_object.h"
+#include <ext_systhread.h>
 
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -36,6 +38,19 @@ int C74_EXPORT main(void)
 	
 	class_addmethod (this_class, (method)descriptors_descriptors_rt, "descriptors", A_GIMME, 0L);
 	
+	// Add attributes
+	
+	CLASS_ATTR_LONG(this_class, "async", 0L, t_descriptors, async);
+	CLASS_ATTR_ACCESSORS(this_class, "async", 0L, descriptors_async_set);
+	CLASS_ATTR_FILTER_CLIP(this_class, "async", 0, 1);
+	CLASS_ATTR_LABEL(this_class, "async", 0L, "Asynchronous Analysis");
+	
+	CLASS_ATTR_DOUBLE(this_class, "latency", ATTR_SET_OPAQUE_USER, t_descriptors, async_latency);
+	CLASS_ATTR_LABEL(this_class, "latency", 0L, "Asynchronous Latency (ms)");
+	
+	CLASS_ATTR_LONG(this_class, "dropped", ATTR_SET_OPAQUE_USER, t_descriptors, async_dropped);
+	CLASS_ATTR_LABEL(this_class, "dropped", 0L, "Dropped Frames");
+	
 	descriptors_main_common();
 	
 	class_register(CLASS_BOX, this_class);
@@ -52,18 +67,19 @@ void *descriptors_new (t_symbol *s, short argc, t_atom *argv)
 	long max_fft_size_log2;
 	long max_fft_size_in = 0;
 	long max_fft_size;
+	long num_args = attr_args_offset(argc, argv);
 	
 	void *allocated_memory;
 
 	if (!x)
 		return 0;
 
-	// Get arguments 
+	// Get arguments (attributes are processed once the object is set up)
 	
-	if (argc) 
-		max_fft_size_in = atom_getlong(argv++);
-	if (argc > 1) 
-		descriptor_feedback = atom_getlong(argv++);
+	if (num_args) 
+		max_fft_size_in = atom_getlong(argv);
+	if (num_args > 1) 
+		descriptor_feedback = atom_getlong(argv + 1);
 	
 	// Set maximum fft size
 	
@@ -118,6 +134,16 @@ void *descriptors_new (t_symbol *s, short argc, t_atom *argv)
 	
 	x->output_list = allocated_memory;
 	x->summed_amplitudes = 0;
+	
+	// Asynchronous analysis is off until requested
+	
+	x->async = 0;
+	x->async_quit = 0;
+	x->async_dropped = 0;
+	x->async_latency = 0.;
+	x->async_thread = 0;
+	x->async_frames = 0;
+	x->async_outputs = 0;
 
 	// Allocate a clock and call the common new routine
 	
@@ -125,6 +151,8 @@ void *descriptors_new (t_symbol *s, short argc, t_atom *argv)
 	
 	descriptors_new_common (x, max_fft_size_log2, descriptor_feedback);
 	
+	attr_args_process(x, argc, argv);
+	
 	return x;
 }
 
@@ -132,63 +160,46 @@ void *descriptors_new (t_symbol *s, short argc, t_atom *argv)
 void descriptors_free(t_descriptors *x)
 {
 	dsp_free(&x->x_obj);
+	descriptors_async_stop(x);
 	ALIGNED_FREE (x->window);
 	ALIGNED_FREE (x->rt_buffer);
+	ALIGNED_FREE (x->async_frames);
 	hisstools_destroy_setup_f(x->fft_setup_real);
 	if (x->output_rt_clock) 
 		freeobject((t_object *)x->output_rt_clock);
 }
 
 
+void descriptors_resolutions (t_descriptors *x, short argc, t_atom *argv)
+{
+	// Multiple resolutions are only available for non real-time analysis
+
+	if (argc)
+		error ("descriptors(rt)~: additional resolutions are not supported in real-time - ignoring");
+}
+
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////// Handle RT Descriptor Calculation /////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
-void calc_descriptors_rt (t_descriptors *x, float *samples)
+long calc_descriptors_rt (t_descriptors *x, float *samples, t_atom *output_list)
 {
-	t_atom *output_list = x->output_list;
-	
 	// FFT Variables
 	
 	char frame_pointer = x->frame_pointer;
 	
 	long fft_size = x->fft_size;
 	long fft_size_halved = fft_size >> 1;
-	long fft_size_log2 = x->fft_size_log2;
 	long window_size = x->window_size;
 	
-	FFT_SETUP_F fft_setup_real = x->fft_setup_real;
-	
 	float *raw_frame = x->fft_memory;
 	float *windowed_frame = raw_frame + fft_size;
-	
-	FFT_SPLIT_COMPLEX_F raw_fft_frame;
-	
-	float *window = x->window;
-	float *this_frame = x->amps_buffer + (3 * fft_size_halved * frame_pointer);
-	float *sq_amplitudes = this_frame;
-	float *amplitudes = sq_amplitudes + fft_size_halved;
-	float *log_amplitudes = amplitudes + fft_size_halved;
 	float *freqs = x->n_data;
 	float *amps = freqs + fft_size_halved;
 	
-	vFloat *v_window = (vFloat *) window;
-	vFloat *v_sq_amplitudes = (vFloat *) sq_amplitudes;
-#if (defined F32_VEC_LOG_OP || defined F32_VEC_LOG_ARRAY)
-	vFloat *v_log_amplitudes = (vFloat *) log_amplitudes;
-#endif
-	vFloat *v_raw_frame = (vFloat *) raw_frame;
-	vFloat *v_windowed_frame = (vFloat *) windowed_frame;
-	vFloat *real_data;
-	vFloat *imag_data;
-	
-#if (defined F32_VEC_LOG_OP)
-	vFloat v_half = {0.5, 0.5, 0.5, 0.5};
-#endif
-#if (defined F32_VEC_LOG_OP || defined F32_VEC_LOG_ARRAY)
-	vFloat v_pow_min = {POW_MIN, POW_MIN, POW_MIN, POW_MIN};
-#endif
+	FFT_SPLIT_COMPLEX_F raw_fft_frame;
 	
 	// Descriptor Variables
 	
@@ -197,20 +208,16 @@ void calc_descriptors_rt (t_descriptors *x, float *samples)
 	long n_count = 0;
 	long i, j;
 	
-	double *cumulate_amps = x->cumulate + (fft_size * frame_pointer);
-	double *cumulate_sq_amps = cumulate_amps + fft_size_halved;
-	double sum;
+	double *cumulate_sq_amps = x->cumulate + (fft_size * frame_pointer) + fft_size_halved;
+	double profile_time;
 
 	x->frame_pointer = (frame_pointer + 1) % RING_BUFFER_SIZE;
 	
 	raw_fft_frame.realp = windowed_frame + fft_size;
 	raw_fft_frame.imagp = raw_fft_frame.realp + fft_size_halved;
-	
-	real_data = (vFloat *) raw_fft_frame.realp;
-	imag_data = (vFloat *) raw_fft_frame.imagp;
 
 	if (!num_pf_descriptors) 
-		return;
+		return 0;
 	
 	// Reset flags
 
@@ -232,62 +239,12 @@ void calc_descriptors_rt (t_descriptors *x, float *samples)
 	for (i = window_size; i < fft_size; i++)
 		raw_frame[i] = 0;
 	
-	// Apply window
+	// Calculate the intermediates needed by the descriptors (the fft, amplitudes and their cumulative sums)
 	
-	for (i = 0; i < window_size >> 2; i++)
-		v_windowed_frame[i] = F32_VEC_MUL_OP(v_raw_frame[i], v_window[i]);
-	for (i <<= 2; i < window_size; i++)
-		windowed_frame[i] = raw_frame[i] * window[i];
+	descriptors_calc_spectrum(x, raw_frame, windowed_frame, raw_fft_frame, frame_pointer, descriptors_frame_nodes(x, x->pf_nodes, 0));
 	
-	// Do fft straight into position
-	
-	hisstools_unzip_f(windowed_frame, &raw_fft_frame, fft_size_log2);
-	hisstools_rfft_f(fft_setup_real, &raw_fft_frame, fft_size_log2);
-
-	// Discard The nyquist bin (if necessary add this back later)
+	profile_time = x->profile ? descriptors_profile_time() : 0.;
 	
-	raw_fft_frame.imagp[0] = 0.;
-	
-	// Calulate Square amplitudes (leaving the raw data also in case phase is needed for some descriptor added later)
-	
-	for (i = 0; i < fft_size_halved >> 2; i++)
-		v_sq_amplitudes[i] = F32_VEC_ADD_OP(F32_VEC_MUL_OP(real_data[i], real_data[i]), F32_VEC_MUL_OP(imag_data[i], imag_data[i]));
-		
-	// Calculate log amplitudes
-	
-#ifdef F32_VEC_LOG_OP
-	for (i = 0; i < fft_size_halved >> 2; i++)
-		v_log_amplitudes[i] = F32_VEC_MUL_OP(F32_VEC_LOG_OP(F32_VEC_MAX_OP(v_sq_amplitudes[i], v_pow_min)), v_half);
-#else
-#ifdef F32_VEC_LOG_ARRAY
-	for (i = 0; i < fft_size_halved >> 2; i++)
-		v_log_amplitudes[i] = F32_VEC_SQRT_OP(F32_VEC_MAX_OP(v_sq_amplitudes[i], v_pow_min));
-	F32_VEC_LOG_ARRAY(log_amplitudes, log_amplitudes, fft_size_halved);
-#else
-	for (i = 0; i < fft_size_halved; i++)
-		log_amplitudes[i] = log((sq_amplitudes[i] < POW_MIN) ? POW_MIN : sq_amplitudes[i]) * 0.5;;
-#endif
-#endif
-	
-	// Now sqrt amplitudes
-	
-	for (i = 0; i < fft_size_halved; i++)
-		amplitudes[i] = sqrt(sq_amplitudes[i]);
-		
-	// Cumulate amps and square amps
-		
-	for (sum = 0., i = 0; i < fft_size_halved; i++)
-	{
-		sum += amplitudes[i];
-		cumulate_amps[i] = sum;
-	}
-		
-	for (sum = 0., i = 0; i < fft_size_halved; i++)
-	{
-		sum += sq_amplitudes[i];
-		cumulate_sq_amps[i] = sum;
-	}
-		
 	////////////////////////////////////////////// Calculate And Store Per Frame descriptors //////////////////////////////////////////
 	
 	if (!x->use_energy_thresh || cumulate_sq_amps[fft_size_halved - 1] > x->energy_thresh)
@@ -314,6 +271,8 @@ void calc_descriptors_rt (t_descriptors *x, float *samples)
 				n_count--;												
 			}
 		}
+		
+		descriptors_profile_node(x, PF_NODE_DESCRIPTORS, profile_time);
 	}
 	else 
 	{
@@ -321,9 +280,7 @@ void calc_descriptors_rt (t_descriptors *x, float *samples)
 			atom_setfloat(output_list + i, FLT_MAX);
 	}
 	
-	// Output - call A clock To do this!
-	
-	clock_delay (x->output_rt_clock, 0);
+	return 1;
 }
 
 
@@ -334,7 +291,58 @@ void calc_descriptors_rt (t_descriptors *x, float *samples)
 
 void output_rt (t_descriptors *x)
 {
-	outlet_list (x->the_list_outlet, 0L, x->output_length, x->output_list);
+	long slot;
+	
+	if (!x->async)
+	{
+		outlet_list (x->the_list_outlet, 0L, x->output_length, x->output_list);
+		return;
+	}
+	
+	// Output all queued lists in order (measuring the latency from when the frame was queued)
+	
+	while (x->async_outputs_read != x->async_outputs_written)
+	{
+		slot = x->async_outputs_read & (ASYNC_QUEUE_SIZE - 1);
+		x->async_latency = (double) (systime_ms() - x->async_output_times[slot]);
+		outlet_list (x->the_list_outlet, 0L, x->async_output_lengths[slot], x->async_outputs + (slot * MAX_OUTPUT));
+		ATOMIC_INCREMENT_BARRIER(&x->async_outputs_read);
+	}
+}
+
+
+void descriptors_rt_frame (t_descriptors *x, float *samples)
+{
+	float *frame;
+	long window_size = x->window_size;
+	long slot;
+	long i;
+	
+	// Analyse now and output via the clock
+	
+	if (!x->async)
+	{
+		if (calc_descriptors_rt (x, samples, x->output_list))
+			clock_delay (x->output_rt_clock, 0);
+		return;
+	}
+	
+	// Otherwise queue the frame for the analysis thread (dropping it if the queue is full - the audio thread never waits)
+	
+	if (x->async_frames_written - x->async_frames_read >= ASYNC_QUEUE_SIZE)
+	{
+		x->async_dropped++;
+		return;
+	}
+	
+	slot = x->async_frames_written & (ASYNC_QUEUE_SIZE - 1);
+	frame = x->async_frames + (slot * x->max_fft_size);
+	
+	for (i = 0; i < window_size; i++)
+		frame[i] = samples[i];
+	
+	x->async_frame_times[slot] = systime_ms();
+	ATOMIC_INCREMENT_BARRIER(&x->async_frames_written);
 }
 
 
@@ -384,7 +392,7 @@ t_int *descriptors_perform(t_int *w)
 		
 		if (hop_count <= 0)
 		{
-			calc_descriptors_rt (x, rt_buffer + ((block_pointer + frametime + hop_count) % (bufffer_size >> 1)));
+			descriptors_rt_frame (x, rt_buffer + ((block_pointer + frametime + hop_count) % (bufffer_size >> 1)));
 			hop_count += hop_size;
 		}
 	}
@@ -489,7 +497,7 @@ void descriptors_perform64 (t_descriptors *x, t_object *dsp64, double **ins, lon
 		
 		if (hop_count <= 0)
 		{
-			calc_descriptors_rt (x, rt_buffer + ((block_pointer + frametime + hop_count) % (bufffer_size >> 1)));
+			descriptors_rt_frame (x, rt_buffer + ((block_pointer + frametime + hop_count) % (bufffer_size >> 1)));
 			hop_count += hop_size;
 		}
 	}
@@ -539,3 +547,113 @@ void descriptors_dsp64 (t_descriptors *x, t_object *dsp64, short *count, double
 		x->rt_memory_size = 0;
 }
 
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////// Asynchronous RT Analysis ////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+t_max_err descriptors_async_set (t_descriptors *x, t_object *attr, long argc, t_atom *argv)
+{
+	long async = argc ? atom_getlong(argv) != 0 : 0;
+	
+	if (async && !x->async)
+		descriptors_async_start(x);
+	if (!async && x->async)
+		descriptors_async_stop(x);
+	
+	return MAX_ERR_NONE;
+}
+
+
+long descriptors_async_start (t_descriptors *x)
+{
+	long max_fft_size = x->max_fft_size;
+	
+	// Allocate the queues (kept until the object is freed)
+	
+	if (!x->async_frames)
+	{
+		x->async_frames = ALIGNED_MALLOC(ASYNC_QUEUE_SIZE * ((max_fft_size * sizeof(float)) + (MAX_OUTPUT * sizeof(t_atom))));
+		
+		if (!x->async_frames)
+		{
+			error ("descriptors(rt)~: couldn't allocate memory for asynchronous analysis");
+			return 0;
+		}
+		
+		x->async_outputs = (t_atom *) (x->async_frames + (ASYNC_QUEUE_SIZE * max_fft_size));
+	}
+	
+	// Reset the queues and counters and start the thread (before the audio thread starts queuing frames)
+	
+	x->async_frames_written = 0;
+	x->async_frames_read = 0;
+	x->async_outputs_written = 0;
+	x->async_outputs_read = 0;
+	x->async_dropped = 0;
+	x->async_latency = 0.;
+	x->async_quit = 0;
+	
+	if (systhread_create((method) descriptors_async_thread, x, 0, 0, 0, &x->async_thread))
+	{
+		error ("descriptors(rt)~: couldn't start the asynchronous analysis thread");
+		x->async_thread = 0;
+		return 0;
+	}
+	
+	x->async = 1;
+	
+	return 1;
+}
+
+
+void descriptors_async_stop (t_descriptors *x)
+{
+	unsigned int thread_return;
+	
+	if (!x->async_thread)
+		return;
+	
+	// Stop the thread before returning to synchronous analysis, so that only one thread ever analyses frames
+	
+	x->async_quit = 1;
+	systhread_join(x->async_thread, &thread_return);
+	x->async_thread = 0;
+	x->async = 0;
+}
+
+
+void *descriptors_async_thread (t_descriptors *x)
+{
+	long frame_slot;
+	long output_slot;
+	
+	while (!x->async_quit)
+	{
+		// Wait for a frame to analyse and space to queue the output
+		
+		if (x->async_frames_read == x->async_frames_written || x->async_outputs_written - x->async_outputs_read >= ASYNC_QUEUE_SIZE)
+		{
+			systhread_sleep(1);
+			continue;
+		}
+		
+		frame_slot = x->async_frames_read & (ASYNC_QUEUE_SIZE - 1);
+		output_slot = x->async_outputs_written & (ASYNC_QUEUE_SIZE - 1);
+		
+		if (calc_descriptors_rt (x, x->async_frames + (frame_slot * x->max_fft_size), x->async_outputs + (output_slot * MAX_OUTPUT)))
+		{
+			x->async_output_lengths[output_slot] = x->output_length;
+			x->async_output_times[output_slot] = x->async_frame_times[frame_slot];
+			ATOMIC_INCREMENT_BARRIER(&x->async_outputs_written);
+			clock_delay (x->output_rt_clock, 0);
+		}
+		
+		ATOMIC_INCREMENT_BARRIER(&x->async_frames_read);
+	}
+	
+	systhread_exit(0);
+	
+	return 0;
+}
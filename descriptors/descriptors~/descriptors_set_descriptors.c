@@ -1181,6 +1181,131 @@ long descriptors_descriptors_pf (enum PFDescriptorType descriptor_type, double *
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////// Per Frame Intermediate Graph //////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+long descriptors_resolve_nodes (long nodes)
+{
+	// Add the intermediates that the given intermediates depend on (nodes only depend on earlier nodes, so one backwards pass is enough)
+	
+	static const long node_dependencies[PF_NUM_NODES] = 
+	{
+		0,																						// spectrum
+		PF_NODE(PF_NODE_SPECTRUM),																// log amplitudes
+		PF_NODE(PF_NODE_SPECTRUM),																// amplitudes
+		PF_NODE(PF_NODE_AMPLITUDES),															// cumulate amps
+		PF_NODE(PF_NODE_SPECTRUM),																// cumulate square amps
+		0,																						// autocorrelation (uses the raw frame)
+		PF_NODE(PF_NODE_AMPLITUDES),															// median filter
+		PF_NODE(PF_NODE_AMPLITUDES) | PF_NODE(PF_NODE_LOG_AMPLITUDES),							// spectral peaks
+		0																						// descriptors
+	};
+	
+	long i;
+	
+	for (i = PF_NUM_NODES - 1; i >= 0; i--)
+		if (nodes & PF_NODE(i))
+			nodes |= node_dependencies[i];
+	
+	return nodes;
+}
+
+
+long descriptors_pf_nodes (double *pf_params)
+{
+	// Return the intermediates needed to calculate a per frame descriptor (given its parameters)
+	
+	long nodes = PF_NODE(PF_NODE_DESCRIPTORS);
+	
+	switch ((enum PFDescriptorType) (long) pf_params[0])
+	{
+		case DESCRIPTOR_PF_ENERGY:
+		case DESCRIPTOR_PF_ENERGY_RATIO:
+		case DESCRIPTOR_PF_SPECTRAL_ROLLOFF:
+		case DESCRIPTOR_PF_SPECTRAL_CREST:
+			
+			nodes |= PF_NODE(PF_NODE_CUMULATE_SQ_AMPS);
+			break;
+			
+		case DESCRIPTOR_PF_LOUDNESS:
+			
+			nodes |= PF_NODE(PF_NODE_SPECTRUM);
+			break;
+		
+		case DESCRIPTOR_PF_FLUX:
+		case DESCRIPTOR_PF_CENTROID_LIN: 
+		case DESCRIPTOR_PF_SPREAD_LIN:
+		case DESCRIPTOR_PF_SKEWNESS_LIN:
+		case DESCRIPTOR_PF_KURTOSIS_LIN:
+		case DESCRIPTOR_PF_CENTROID_LOG: 
+		case DESCRIPTOR_PF_SPREAD_LOG:
+		case DESCRIPTOR_PF_SKEWNESS_LOG:
+		case DESCRIPTOR_PF_KURTOSIS_LOG:
+			
+			nodes |= PF_NODE(PF_NODE_CUMULATE_AMPS);
+			break;
+			
+		case DESCRIPTOR_PF_MKL:
+			
+			nodes |= PF_NODE(PF_NODE_LOG_AMPLITUDES) | PF_NODE(PF_NODE_CUMULATE_AMPS);
+			break;
+			
+		case DESCRIPTOR_PF_FOOTE:
+			
+			nodes |= PF_NODE(PF_NODE_AMPLITUDES);
+			break;
+			
+		case DESCRIPTOR_PF_BRIGHTNESS_LIN: 
+		case DESCRIPTOR_PF_BRIGHTNESS_LOG: 
+			
+			nodes |= PF_NODE(PF_NODE_CUMULATE_AMPS) | PF_NODE(PF_NODE_AUTOCORRELATION);
+			break;
+			
+		case DESCRIPTOR_PF_SPECTRAL_FLATNESS:
+			
+			nodes |= PF_NODE(PF_NODE_LOG_AMPLITUDES) | PF_NODE(PF_NODE_CUMULATE_SQ_AMPS);
+			break;
+			
+		case DESCRIPTOR_PF_NOISE_RATIO:
+		case DESCRIPTOR_PF_NON_NOISE_RATIO:
+			
+			nodes |= PF_NODE(PF_NODE_MEDIAN_FILTER) | PF_NODE(PF_NODE_CUMULATE_SQ_AMPS);
+			break;
+			
+		case DESCRIPTOR_PF_PITCH:
+		case DESCRIPTOR_PF_PITCH_CONFIDENCE:
+			
+			nodes |= PF_NODE(PF_NODE_AUTOCORRELATION);
+			break;
+			
+		case DESCRIPTOR_PF_INHARMONICITY:
+			
+			nodes |= PF_NODE(PF_NODE_SPECTRAL_PEAKS) | PF_NODE(PF_NODE_AUTOCORRELATION);
+			if (pf_params[2]) nodes |= PF_NODE(PF_NODE_MEDIAN_FILTER);
+			break;
+			
+		case DESCRIPTOR_PF_ROUGHNESS:
+		case DESCRIPTOR_PF_SPECTRAL_PEAKS:
+			
+			nodes |= PF_NODE(PF_NODE_SPECTRAL_PEAKS);
+			if (pf_params[2]) nodes |= PF_NODE(PF_NODE_MEDIAN_FILTER);
+			break;
+		
+		// The amplitude descriptors only use the raw frame
+		
+		case DESCRIPTOR_PF_AVERAGE_AMP_ABS:
+		case DESCRIPTOR_PF_AVERAGE_AMP_RMS:
+		case DESCRIPTOR_PF_PEAK_AMP:
+		case DESCRIPTOR_PF_NONE:
+			break;
+	}
+	
+	return descriptors_resolve_nodes(nodes);
+}
+
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////// Main routines for setting the desciprotrs (by object) ////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1205,11 +1330,30 @@ void descriptors_descriptors_non_rt (t_descriptors *x, t_symbol *msg, short argc
 	
 	long *pf_output_params = x->pf_output_params;
 	long *pb_pos = x->pb_pos;
+	long pf_nodes = 0;
+	long resolution = 0;
 	
 	x->do_sum_amps = 0;
 
 	while (argc)
 	{
+		// Per frame descriptors that follow "resolution <index>" are calculated at that resolution (zero is the primary resolution)
+		
+		if (atom_gettype(argv) == A_SYM && atom_getsym(argv) == ps_resolution)
+		{
+			resolution = (argc > 1) ? atom_getlong(argv + 1) : -1;
+			argv += (argc > 1) ? 2 : 1;
+			argc -= (argc > 1) ? 2 : 1;
+			
+			if (resolution < 0 || resolution >= MAX_RESOLUTIONS)
+			{
+				error ("descriptors(rt)~: resolution out of range - bailing with %ld valid descriptors", num_pf_descriptors + num_pb_descriptors);
+				break;
+			}
+			
+			continue;
+		}
+		
 		// Get descriptor type
 		
 		descriptor_type = match_descriptor(argv++, 0);
@@ -1265,8 +1409,11 @@ void descriptors_descriptors_non_rt (t_descriptors *x, t_symbol *msg, short argc
 			
 			if (descriptor_num_params)
 			{
-				// Update variables and pointers
+				// Update variables and pointers (storing the parameter position so that descriptors can be calculated in separate loops)
 
+				x->pf_params_pos[num_pf_descriptors] = num_pf_params;
+				x->pf_resolutions[num_pf_descriptors] = resolution;
+				pf_nodes |= descriptors_pf_nodes(pf_params);
 				pf_params += descriptor_num_params;
 				num_pf_params += descriptor_num_params;
 				
@@ -1299,6 +1446,7 @@ void descriptors_descriptors_non_rt (t_descriptors *x, t_symbol *msg, short argc
 	
 	x->num_pb_descriptors = num_pb_descriptors;
 	x->num_pf_descriptors = num_pf_descriptors;
+	x->pf_nodes = pf_nodes;
 	x->output_length = output_pos;
 	if (x->descriptor_feedback)
 		post ("descriptors(rt)~: set %ld descriptors", num_pf_descriptors + num_pb_descriptors);
@@ -1313,6 +1461,7 @@ void descriptors_descriptors_rt (t_descriptors *x, t_symbol *msg, short argc, t_
 	long num_params = 0;
 	long output_pos = 0;
 	long num_to_output;
+	long pf_nodes = 0;
 
 	double *pf_params = x->pf_params;
 	
@@ -1347,6 +1496,7 @@ void descriptors_descriptors_rt (t_descriptors *x, t_symbol *msg, short argc, t_
 		{
 			// Update variables and pointers
 			
+			pf_nodes |= descriptors_pf_nodes(pf_params);
 			pf_params += descriptor_num_params;
 			num_params += descriptor_num_params;
 			output_pos += num_to_output;
@@ -1370,6 +1520,7 @@ void descriptors_descriptors_rt (t_descriptors *x, t_symbol *msg, short argc, t_
 	// Store variables
 	
 	x->num_pf_descriptors = num_pf_descriptors;
+	x->pf_nodes = pf_nodes;
 	x->output_length = output_pos;
 	if (x->descriptor_feedback)
 		post ("descriptors(rt)~: set %ld descriptors", num_pf_descriptors);
@@ -41,6 +41,11 @@ long match_descriptor (t_atom *arg, char rt_flag);
 long descriptors_descriptors_pb (enum PBDescriptorType descriptor_type, double *pb_params, t_atom **argv, short *argc, long num_params, long num_pb_descriptors, long *num_to_output);
 long descriptors_descriptors_pf (enum PFDescriptorType descriptor_type, double *pf_params, t_atom **argv, short *argc, long num_params, long num_pf_descriptors, long *num_to_output, char rt_flag);
 
+// The per frame intermediates needed by the descriptors
+
+long descriptors_resolve_nodes (long nodes);
+long descriptors_pf_nodes (double *pf_params);
+
 // Main routines for setting the desciprotrs (by object)
 
 void descriptors_descriptors_rt (t_descriptors *x, t_symbol *msg, short argc, t_atom *argv);
@@ -173,7 +173,12 @@ void spectralpeaks_medianmask_float (t_descriptors *x, long * median_indices, fl
 	}
 	
 	if (!x->last_pf_spectralpeaks_n) 
+	{
+		double profile_time = x->profile ? descriptors_profile_time() : 0.;
+		
 		spectralpeaks_float (amplitudes, log_amplitudes, median_amplitudes, num_bins, freqs, amps, bin_freq, log_thresh);
+		descriptors_profile_node(x, PF_NODE_SPECTRAL_PEAKS, profile_time);
+	}
 	
 	x->last_pf_spectralpeaks_med_size = median_span;
 	x->last_pf_spectralpeaks_n = 1;
@@ -0,0 +1,124 @@
+
+/*
+ *  descriptors_standalone.h
+ *
+ *	Minimal definitions of the Max types and routines used by the descriptors~ analysis code.
+ *	When DESCRIPTORS_STANDALONE is defined this header replaces the Max headers, so that the non real-time analysis can be compiled outside of Max.
+ *	The routines declared here are implemented by the host (see descriptors_lib.c).
+ *
+ *  Copyright 2010 Alex Harker. All rights reserved.
+ *
+ */
+
+
+#ifndef _DESCRIPTORS_STANDALONE_
+#define _DESCRIPTORS_STANDALONE_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+
+#include <AH_Types.h>
+
+
+// Basic types
+
+typedef intptr_t t_int;
+typedef long t_max_err;
+typedef void *t_systhread;
+typedef volatile int32_t t_int32_atomic;
+typedef void *(*method)(void *, ...);
+
+typedef struct _object t_object;
+typedef struct _signal t_signal;
+
+typedef struct _pxobject
+{
+	t_object *z_object;
+
+} t_pxobject;
+
+typedef struct _symbol
+{
+	char *s_name;
+	void *s_thing;
+
+} t_symbol;
+
+// Atoms (type values match the Max SDK)
+
+enum {
+
+	A_NOTHING = 0,
+	A_LONG = 1,
+	A_FLOAT = 2,
+	A_SYM = 3,
+	A_GIMME = 8,
+	A_CANT = 9
+};
+
+typedef union _word
+{
+	long w_long;
+	double w_float;
+	t_symbol *w_sym;
+
+} t_word;
+
+typedef struct _atom
+{
+	short a_type;
+	t_word a_w;
+
+} t_atom;
+
+// Assist values (match the Max SDK)
+
+#define ASSIST_INLET 1
+#define ASSIST_OUTLET 2
+
+// Symbols, atoms and posting
+
+t_symbol *gensym (const char *s);
+
+long atom_gettype (const t_atom *a);
+long atom_getlong (const t_atom *a);
+double atom_getfloat (const t_atom *a);
+t_symbol *atom_getsym (const t_atom *a);
+
+t_max_err atom_setlong (t_atom *a, long b);
+t_max_err atom_setfloat (t_atom *a, double b);
+t_max_err atom_setsym (t_atom *a, t_symbol *b);
+
+void post (const char *fmt, ...);
+void error (const char *fmt, ...);
+
+// Outlets and objects
+
+void *listout (void *x);
+void *outlet_list (void *o, t_symbol *s, short ac, t_atom *av);
+void freeobject (t_object *x);
+
+// Threads
+
+long systhread_create (method entryproc, void *arg, unsigned long stacksize, long priority, long flags, t_systhread *thread);
+long systhread_join (t_systhread thread, unsigned int *retval);
+void systhread_exit (long status);
+
+// Buffers (only 32 bit float interleaved buffers are supported)
+
+#define PCM_FLOAT 3
+
+void ibuffer_init ();
+void *ibuffer_get_ptr (t_symbol *s);
+long ibuffer_info (void *thebuffer, void **samples, AH_SIntPtr *length, long *channels, long *format);
+double ibuffer_sample_rate (void *thebuffer);
+void ibuffer_increment_inuse (void *thebuffer);
+void ibuffer_decrement_inuse (void *thebuffer);
+void ibuffer_get_samps (void *samps, float *out, AH_SIntPtr offset, AH_SIntPtr n_samps, long n_chans, long chan, long format);
+
+
+#endif /* _DESCRIPTORS_STANDALONE_ */
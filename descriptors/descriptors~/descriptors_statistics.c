@@ -11,6 +11,12 @@
 
 
 #include "descriptors_statistics.h"
+#include <AH_VectorOps.h>
+
+
+// Block size for vector min / max searches (must be a multiple of four)
+
+#define STATS_VECTOR_BLOCK 64
 
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -27,9 +33,44 @@ double calc_mean_and_time_centroid (double *current_data, long num_frames, doubl
 	double centroid_sum = 0;
 	double sum = 0;
 	long num_valid = 0;
-	long i;
+	long i = 0;
 
-	for (i = 0; i < num_frames; i++)
+#ifdef VECTOR_F64_128BIT
+	
+	// Vector sums (invalid values are masked out)
+	
+	vDouble v_invalid = double2vector(DBL_MAX);
+	vDouble v_one = double2vector(1.);
+	vDouble v_two = double2vector(2.);
+	vDouble v_position = {0., 1.};
+	vDouble v_sum = double2vector(0.);
+	vDouble v_centroid_sum = double2vector(0.);
+	vDouble v_num_valid = double2vector(0.);
+	vDouble v_val;
+	vDouble v_mask;
+	double sums[2];
+	
+	for (; i + 1 < num_frames; i += 2)
+	{
+		v_val = F64_VEC_ULOAD(current_data + i);
+		v_mask = F64_VEC_NEQ_OP(v_val, v_invalid);
+		v_val = F64_VEC_AND_OP(v_val, v_mask);
+		v_sum = F64_VEC_ADD_OP(v_sum, v_val);
+		v_centroid_sum = F64_VEC_ADD_OP(v_centroid_sum, F64_VEC_MUL_OP(v_val, v_position));
+		v_num_valid = F64_VEC_ADD_OP(v_num_valid, F64_VEC_AND_OP(v_one, v_mask));
+		v_position = F64_VEC_ADD_OP(v_position, v_two);
+	}
+	
+	F64_VEC_USTORE(sums, v_sum);
+	sum = sums[0] + sums[1];
+	F64_VEC_USTORE(sums, v_centroid_sum);
+	centroid_sum = sums[0] + sums[1];
+	F64_VEC_USTORE(sums, v_num_valid);
+	num_valid = (long) (sums[0] + sums[1]);
+	
+#endif
+	
+	for (; i < num_frames; i++)
 	{
 		current_val = current_data[i];
 		if (current_val != DBL_MAX)
@@ -59,9 +100,38 @@ double calc_standard_deviation (double *current_data, long num_frames, double me
 	double current_val;
 	double sum = 0;
 	long num_valid = 0;
-	long i;
+	long i = 0;
 
-	for (i = 0; i < num_frames; i++)
+#ifdef VECTOR_F64_128BIT
+	
+	// Vector sum of squared deviations (invalid values are masked out)
+	
+	vDouble v_invalid = double2vector(DBL_MAX);
+	vDouble v_one = double2vector(1.);
+	vDouble v_mean = double2vector(mean);
+	vDouble v_sum = double2vector(0.);
+	vDouble v_num_valid = double2vector(0.);
+	vDouble v_val;
+	vDouble v_mask;
+	double sums[2];
+	
+	for (; i + 1 < num_frames; i += 2)
+	{
+		v_val = F64_VEC_ULOAD(current_data + i);
+		v_mask = F64_VEC_NEQ_OP(v_val, v_invalid);
+		v_val = F64_VEC_AND_OP(F64_VEC_SUB_OP(v_val, v_mean), v_mask);
+		v_sum = F64_VEC_ADD_OP(v_sum, F64_VEC_MUL_OP(v_val, v_val));
+		v_num_valid = F64_VEC_ADD_OP(v_num_valid, F64_VEC_AND_OP(v_one, v_mask));
+	}
+	
+	F64_VEC_USTORE(sums, v_sum);
+	sum = sums[0] + sums[1];
+	F64_VEC_USTORE(sums, v_num_valid);
+	num_valid = (long) (sums[0] + sums[1]);
+	
+#endif
+
+	for (; i < num_frames; i++)
 	{
 		current_val = current_data[i];
 		if (current_val != DBL_MAX)
@@ -80,24 +150,98 @@ double calc_standard_deviation (double *current_data, long num_frames, double me
 }
 
 
+// Find the kth smallest value, partially reordering the data (quickselect, falling back to sorting if partitioning goes badly)
+
+static double calc_select (double *current_data, long num_frames, long k)
+{
+	double pivot;
+	double temp;
+	long lo = 0;
+	long hi = num_frames - 1;
+	long max_depth = 0;
+	long i, j;
+	
+	for (i = num_frames; i > 1; i >>= 1)
+		max_depth += 2;
+	
+	while (hi > lo)
+	{
+		if (max_depth-- <= 0)
+		{
+			combsort_double (current_data + lo, (hi - lo) + 1);
+			break;
+		}
+		
+		// Median of three pivot (also ordering the three values)
+		
+		i = lo + ((hi - lo) >> 1);
+		
+		if (current_data[i] < current_data[lo])
+		{
+			temp = current_data[i]; current_data[i] = current_data[lo]; current_data[lo] = temp;
+		}
+		if (current_data[hi] < current_data[lo])
+		{
+			temp = current_data[hi]; current_data[hi] = current_data[lo]; current_data[lo] = temp;
+		}
+		if (current_data[hi] < current_data[i])
+		{
+			temp = current_data[hi]; current_data[hi] = current_data[i]; current_data[i] = temp;
+		}
+		
+		pivot = current_data[i];
+		
+		// Partition and continue with the side containing k
+		
+		for (i = lo, j = hi; i <= j; i++, j--)
+		{
+			while (current_data[i] < pivot) 
+				i++;
+			while (current_data[j] > pivot) 
+				j--;
+			
+			if (i > j)
+				break;
+			
+			temp = current_data[i]; current_data[i] = current_data[j]; current_data[j] = temp;
+		}
+		
+		if (k <= j) 
+			hi = j;
+		else if (k >= i) 
+			lo = i;
+		else 
+			break;
+	}
+	
+	return current_data[k];
+}
+
+
 double calc_median (double *current_data, long num_frames)
 {
+	double temp;
+	long num_valid = 0;
 	long i;
 	
-	// Sort data
+	// Move the *valid* results to the start of the data
 	
-	combsort_double (current_data, num_frames);
-
-	// Pick the value that is at the halfway point through the *valid* results
+	for (i = 0; i < num_frames; i++)
+	{
+		if (current_data[i] < DBL_MAX)
+		{
+			temp = current_data[i];
+			current_data[i] = current_data[num_valid];
+			current_data[num_valid++] = temp;
+		}
+	}
 	
-	for (i = num_frames - 1; i >= 0 ; i--)
-		if (current_data[i] < DBL_MAX) 
-			break;
-		
-	if (i == -1) 
+	if (!num_valid) 
 		return DBL_MAX;
-	else 
-		return (current_data[i >> 1]);
+	
+	// Pick the value that is at the halfway point through the valid results (without sorting them)
+	
+	return calc_select (current_data, num_valid, (num_valid - 1) >> 1);
 }
 
 
@@ -124,306 +268,349 @@ void n_search_mask (char *mask, long num_frames, long pos, long mask_size)
 }
 
 
-// Find the N maximum values, with a mask preventing close toegther values from being chosen
+// Find the position of the maximum / minimum valid value (used for the first search, when no values are masked)
+// Vector maxima / minima are found for blocks of values, and only blocks containing a new maximum / minimum are searched for its position
 
-void calc_n_max (double *current_data, long num_frames, long mask_size, char *mask, long N, double *n_max, double *n_max_pos, double frame_to_ms_val)
+static long calc_max_pos (double *current_data, long num_frames)
 {
-	double current_val;
 	double max = -DBL_MAX;
-	long max_pos;
-	long i, j;
+	long max_pos = -1;
+	long i = 0;
+	long j;
 	
-	// Zero the mask
+#ifdef VECTOR_F64_128BIT
 	
-	for (i = 0; i < num_frames; i++)
-		mask[i] = 0;
+	vDouble v_invalid = double2vector(DBL_MAX);
+	vDouble v_lowest = double2vector(-DBL_MAX);
+	vDouble v_max1, v_max2;
+	vDouble v_val1, v_val2;
+	double maxes[2];
 	
-	for (j = 0; j < N; j++)
+	for (; i + STATS_VECTOR_BLOCK <= num_frames; i += STATS_VECTOR_BLOCK)
 	{
-		// Assume there is not another valid maximum
-		
-		max = -DBL_MAX;
-		max_pos = -1;
+		v_max1 = v_lowest;
+		v_max2 = v_lowest;
 		
-		// Find the next maximum
+		// N.B. - the current values are the first argument so that NaNs are ignored
 		
-		for (i = 0; i < num_frames; i++)
+		for (j = i; j < i + STATS_VECTOR_BLOCK; j += 4)
 		{
-			current_val = current_data[i];
-			if (current_val > max && !mask[i] && current_val != DBL_MAX)
-			{
-				max = current_val;
-				max_pos = i;
-			}
+			v_val1 = F64_VEC_ULOAD(current_data + j);
+			v_val2 = F64_VEC_ULOAD(current_data + j + 2);
+			v_max1 = F64_VEC_MAX_OP(F64_VEC_SEL_OP(v_val1, v_lowest, F64_VEC_EQ_OP(v_val1, v_invalid)), v_max1);
+			v_max2 = F64_VEC_MAX_OP(F64_VEC_SEL_OP(v_val2, v_lowest, F64_VEC_EQ_OP(v_val2, v_invalid)), v_max2);
 		}
 		
-		// If max_pos is invalid then we are done
+		F64_VEC_USTORE(maxes, F64_VEC_MAX_OP(v_max1, v_max2));
 		
-		if (max_pos == -1) 
-			break;
-		
-		// Apply the mask and store the found values
-		
-		n_search_mask (mask, num_frames, max_pos, mask_size);
-		n_max[j] = max;
-		n_max_pos[j] = max_pos * frame_to_ms_val;
+		if (maxes[0] > max || maxes[1] > max)
+		{
+			max = maxes[0] > maxes[1] ? maxes[0] : maxes[1];
+			for (max_pos = i; current_data[max_pos] != max; max_pos++);
+		}
 	}
 	
-	// Store DBL_MAX if there aren't any more values to be found
+#endif
 	
-	for (; j < N; j++)
+	for (; i < num_frames; i++)
 	{
-		n_max[j] = DBL_MAX;
-		n_max_pos[j] = DBL_MAX;
+		if (current_data[i] > max && current_data[i] != DBL_MAX)
+		{
+			max = current_data[i];
+			max_pos = i;
+		}
 	}
-}			
-
+	
+	return max_pos;
+}
 
-// Find the N minimum values, with a mask preventing close toegther values from being chosen
 
-void calc_n_min (double *current_data, long num_frames, long mask_size, char *mask, long N, double *n_min, double *n_min_pos, double frame_to_ms_val)
+static long calc_min_pos (double *current_data, long num_frames)
 {
-	double current_val;
 	double min = DBL_MAX;
-	long min_pos;
-	long i, j;
+	long min_pos = -1;
+	long i = 0;
+	long j;
 	
-	// Zero the mask
+#ifdef VECTOR_F64_128BIT
 	
-	for (i = 0; i < num_frames; i++)
-		mask[i] = 0;
-
-	for (j = 0; j < N; j++)
+	vDouble v_highest = double2vector(DBL_MAX);
+	vDouble v_min1, v_min2;
+	double mins[2];
+	
+	for (; i + STATS_VECTOR_BLOCK <= num_frames; i += STATS_VECTOR_BLOCK)
 	{
-		// Assume there is not another valid minimum
-
-		min = DBL_MAX;
-		min_pos = -1;
+		v_min1 = v_highest;
+		v_min2 = v_highest;
 		
-		for (i = 0; i < num_frames; i++)
+		// N.B. - the current values are the first argument so that NaNs are ignored
+		
+		for (j = i; j < i + STATS_VECTOR_BLOCK; j += 4)
 		{
-			// Find the next minimum
-
-			current_val = current_data[i];
-			if (current_val < min && !mask[i])
-			{
-				min = current_val;
-				min_pos = i;
-			}
+			v_min1 = F64_VEC_MIN_OP(F64_VEC_ULOAD(current_data + j), v_min1);
+			v_min2 = F64_VEC_MIN_OP(F64_VEC_ULOAD(current_data + j + 2), v_min2);
 		}
 		
-		// If min_pos is invalid then we are done
+		F64_VEC_USTORE(mins, F64_VEC_MIN_OP(v_min1, v_min2));
+		
+		if (mins[0] < min || mins[1] < min)
+		{
+			min = mins[0] < mins[1] ? mins[0] : mins[1];
+			for (min_pos = i; current_data[min_pos] != min; min_pos++);
+		}
+	}
+	
+#endif
+	
+	for (; i < num_frames; i++)
+	{
+		if (current_data[i] < min)
+		{
+			min = current_data[i];
+			min_pos = i;
+		}
+	}
+	
+	return min_pos;
+}
 
-		if (min_pos == -1) 
+
+// The N searches are greedy - each search finds the best value that is not within mask_size frames of a previously found value
+// Rather than rescanning the data for each value, candidates are taken in order (best first) and accepted if they are not masked
+// Candidates are gathered a batch at a time using a heap of the best values (the worst at the top), with the batch size doubling on each pass
+// Accepted positions are kept sorted so that masking can be checked by binary search
+
+enum NSearchType {
+
+	N_SEARCH_MAX,
+	N_SEARCH_MIN,
+	N_SEARCH_PEAK,
+	N_SEARCH_TROUGH
+};
+
+
+// Candidates are ordered by key (the value, or the negated value for minima), and then by position (earliest first)
+
+static __inline long n_search_better (double key1, long pos1, double key2, long pos2)
+{
+	return key1 > key2 || (key1 == key2 && pos1 < pos2);
+}
+
+
+static __inline void n_search_heap_down (t_n_candidate *heap, long num_candidates, long i)
+{
+	t_n_candidate candidate = heap[i];
+	long child;
+	
+	while ((child = (i << 1) + 1) < num_candidates)
+	{
+		if (child + 1 < num_candidates && n_search_better(heap[child].key, heap[child].pos, heap[child + 1].key, heap[child + 1].pos))
+			child++;
+		if (!n_search_better(candidate.key, candidate.pos, heap[child].key, heap[child].pos))
 			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	
+	heap[i] = candidate;
+}
 
-		// Apply the mask and store the found values
 
-		n_search_mask (mask, num_frames, min_pos, mask_size);
-		n_min[j] = min;
-		n_min_pos[j] = min_pos  * frame_to_ms_val;
+static __inline void n_search_heap_add (t_n_candidate *heap, long *num_candidates, long max_candidates, double key, long pos)
+{
+	long i = *num_candidates;
+	long parent;
+	
+	// If the heap is full replace the worst candidate (if the new one is better)
+	
+	if (i == max_candidates)
+	{
+		if (n_search_better(key, pos, heap[0].key, heap[0].pos))
+		{
+			heap[0].key = key;
+			heap[0].pos = pos;
+			n_search_heap_down(heap, i, 0);
+		}
+		return;
 	}
 	
+	for (; i > 0; i = parent)
+	{
+		parent = (i - 1) >> 1;
+		if (!n_search_better(heap[parent].key, heap[parent].pos, key, pos))
+			break;
+		heap[i] = heap[parent];
+	}
 	
-	// Store DBL_MAX if there aren't any more values to be found
+	heap[i].key = key;
+	heap[i].pos = pos;
+	(*num_candidates)++;
+}
+
+
+static __inline long n_search_eligible (double *current_data, long i, enum NSearchType type)
+{
+	double current_val = current_data[i];
 	
-	for (; j < N; j++)
+	switch (type)
 	{
-		n_min[j] = DBL_MAX;
-		n_min_pos[j] = DBL_MAX;
+		case N_SEARCH_MAX:
+			return current_val > -DBL_MAX && current_val != DBL_MAX;
+		case N_SEARCH_MIN:
+			return current_val < DBL_MAX;
+		case N_SEARCH_PEAK:
+			return current_val > -DBL_MAX && current_val != DBL_MAX && (!i || current_val > current_data[i - 1]);
+		case N_SEARCH_TROUGH:
+			return current_val < DBL_MAX && (!i || current_val < current_data[i - 1]);
 	}
-}		
 	
+	return 0;
+}
 
-// Find the N peak values (values that are larger than the two surrounding values), with a mask preventing close toegther values from being chosen
 
-void calc_n_peak (double *current_data, long num_frames, long mask_size, char *mask, long N, double *n_max, double *n_max_pos, double frame_to_ms_val)
+static void calc_n_search (double *current_data, long num_frames, long mask_size, t_n_candidate *candidates, long N, double *n_vals, double *n_pos, double frame_to_ms_val, enum NSearchType type)
 {
-	double current_val;
-	double prev_val;
-	double next_val;
-	double new_max;
-	double max; 
-	long max_pos;
-	long new_max_pos;
+	long *accepted = (long *) (candidates + MAX_N_CANDIDATES);
+	long batch_size = N;
+	long num_accepted = 0;
+	long num_candidates;
+	long last_pos = -1;
+	long pos;
+	long lo, hi, mid;
 	long i, j;
+
+	double sign = (type == N_SEARCH_MIN || type == N_SEARCH_TROUGH) ? -1. : 1.;
+	double last_key = DBL_MAX;
+	double key;
 	
-	// Zero the mask
+	if (mask_size < 0)
+		mask_size = 0;
 	
-	for (i = 0; i < num_frames; i++)
-		mask[i] = 0;
-		
-	for (j = 0; j < N; j++)
+	for (j = 0; j < N; )
 	{
-		// Assume there is not another valid peak
-
-		max = -DBL_MAX;
-		max_pos = -1;
+		// Gather the best batch of eligible candidates after the last candidate considered
 		
-		current_val = -DBL_MAX;
-		next_val = current_data[0];
+		num_candidates = 0;
 		
-		// Search for the next largest peak value
-		
-		for (i = 0; i < num_frames; i++)		
+		for (i = 0; i < num_frames; i++)
 		{
-			// Pass values through
-
-			prev_val = current_val;
-			current_val = next_val;
-			next_val = current_data[i + 1];
+			key = sign * current_data[i];
 			
-			// See if the current value is a larger than the previous one and not masked
+			// Once the batch is full most values can be rejected before checking eligibility
 			
-			if (current_val > max && current_val > prev_val && !mask[i] && current_val != DBL_MAX)
+			if (num_candidates == batch_size && !n_search_better(key, i, candidates[0].key, candidates[0].pos))
+				continue;
+			
+			if (n_search_eligible(current_data, i, type) && (last_pos == -1 || n_search_better(last_key, last_pos, key, i)))
+				n_search_heap_add(candidates, &num_candidates, batch_size, key, i);
+		}
+		
+		// Sort the batch (best first)
+		
+		for (i = num_candidates - 1; i > 0; i--)
+		{
+			t_n_candidate temp = candidates[0];
+			candidates[0] = candidates[i];
+			candidates[i] = temp;
+			n_search_heap_down(candidates, i, 0);
+		}
+		
+		// Accept candidates in order if they are not masked by a previously accepted position
+		
+		for (i = 0; i < num_candidates && j < N; i++)
+		{
+			pos = candidates[i].pos;
+			
+			for (lo = 0, hi = num_accepted; lo < hi; )
 			{
-				new_max = current_val;
-				new_max_pos = i;
-				
-				// Now search right to find if this is a peak value
-				
-				for (; i < num_frames - 1; i++)
-				{
-					next_val = current_data[i + 1];
-					
-					// If the next value is not equal then break (we know if it is a peak or not)
-
-					if (current_val > next_val)
-					{
-						max = new_max;
-						max_pos = new_max_pos;
-						break;
-					}	
-										
-					if (current_val < next_val)
-						break;
-					
-					prev_val = current_val;
-					current_val = next_val;
-				}
-				
-				if (current_val >= prev_val)
-				{
-					max = new_max;
-					max_pos = new_max_pos;
-				}
+				mid = (lo + hi) >> 1;
+				if (accepted[mid] < pos)
+					lo = mid + 1;
+				else 
+					hi = mid;
 			}
+			
+			if ((lo && accepted[lo - 1] >= pos - mask_size) || (lo < num_accepted && accepted[lo] <= pos + mask_size))
+				continue;
+			
+			memmove(accepted + lo + 1, accepted + lo, (num_accepted - lo) * sizeof(long));
+			accepted[lo] = pos;
+			num_accepted++;
+			
+			n_vals[j] = current_data[pos];
+			n_pos[j++] = pos * frame_to_ms_val;
 		}
 		
-		// If max_pos is invalid then we are done
-
-		if (max_pos == -1) 
+		// Stop if there are no more candidates, otherwise continue after the last one considered
+		
+		if (num_candidates < batch_size)
 			break;
-
-		// Apply the mask and store the found values
-
-		n_search_mask (mask, num_frames, max_pos, mask_size);
-		n_max[j] = max;
-		n_max_pos[j] = max_pos * frame_to_ms_val;
+		
+		last_key = candidates[num_candidates - 1].key;
+		last_pos = candidates[num_candidates - 1].pos;
+		
+		batch_size = (batch_size << 1) > MAX_N_CANDIDATES ? MAX_N_CANDIDATES : (batch_size << 1);
 	}
 	
-	
 	// Store DBL_MAX if there aren't any more values to be found
 	
 	for (; j < N; j++)
 	{
-		n_max[j] = DBL_MAX;
-		n_max_pos[j] = DBL_MAX;
+		n_vals[j] = DBL_MAX;
+		n_pos[j] = DBL_MAX;
 	}
-}			
+}
 
 
-// Find the N trough values (values that are smaller than the two surrounding values), with a mask preventing close toegther values from being chosen
+// Find the N maximum / minimum values, with a mask preventing close together values from being chosen (the single value case is a vector search)
 
-void calc_n_trough (double *current_data, long num_frames, long mask_size, char *mask, long N, double *n_min, double *n_min_pos, double frame_to_ms_val)
+void calc_n_max (double *current_data, long num_frames, long mask_size, t_n_candidate *candidates, long N, double *n_max, double *n_max_pos, double frame_to_ms_val)
 {
-	double current_val, prev_val, next_val, min, new_min;
-	long min_pos, new_min_pos;
-	long i, j;
+	long max_pos;
 	
-	// Zero the mask
-
-	for (i = 0; i < num_frames; i++)
-		mask[i] = 0;
-		
-	// Search for the next smallest trough value
-
-	for (j = 0; j < N; j++)
+	if (N != 1)
 	{
-		// Assume there is not another valid trough
+		calc_n_search(current_data, num_frames, mask_size, candidates, N, n_max, n_max_pos, frame_to_ms_val, N_SEARCH_MAX);
+		return;
+	}
+	
+	max_pos = calc_max_pos(current_data, num_frames);
+	n_max[0] = max_pos == -1 ? DBL_MAX : current_data[max_pos];
+	n_max_pos[0] = max_pos == -1 ? DBL_MAX : max_pos * frame_to_ms_val;
+}			
 
-		min = DBL_MAX;
-		min_pos = -1;
-		
-		current_val = DBL_MAX;
-		next_val = current_data[0];
-		
-		// Search for a nex smallest trough
-		
-		for (i = 0; i < num_frames; i++)		
-		{
-			// Pass values through
 
-			prev_val = current_val;
-			current_val = next_val;
-			next_val = current_data[i + 1];
-			
-			// See if the current value is a smaller than the previous one and not masked
+void calc_n_min (double *current_data, long num_frames, long mask_size, t_n_candidate *candidates, long N, double *n_min, double *n_min_pos, double frame_to_ms_val)
+{
+	long min_pos;
+	
+	if (N != 1)
+	{
+		calc_n_search(current_data, num_frames, mask_size, candidates, N, n_min, n_min_pos, frame_to_ms_val, N_SEARCH_MIN);
+		return;
+	}
+	
+	min_pos = calc_min_pos(current_data, num_frames);
+	n_min[0] = min_pos == -1 ? DBL_MAX : current_data[min_pos];
+	n_min_pos[0] = min_pos == -1 ? DBL_MAX : min_pos * frame_to_ms_val;
+}		
+	
 
-			if (current_val > min && current_val < prev_val && !mask[i] && current_val != DBL_MAX)
-			{
-				new_min = current_val;
-				new_min_pos = i;
-			
-				// Now search right to find if this is a trough value
-				
-				for (; i < num_frames - 1; i++)
-				{
-					next_val = current_data[i + 1];
-					
-					// If the next value is not equal then break (we know if it is a trough or not)
-					
-					if (current_val < next_val)
-					{
-						min = new_min;
-						min_pos = new_min_pos;
-						break;
-					}	
-					
-					if (current_val > next_val)
-						break;
-					
-					prev_val = current_val;
-					current_val = next_val;
-				}
-				
-				if (current_val <= prev_val)
-				{
-					min = new_min;
-					min_pos = new_min_pos;
-				}
-			}
-		}
+// Find the N peak values, with a mask preventing close together values from being chosen
+// Any value larger than the previous one is a candidate - the best unmasked candidate is always a local maximum, unless the value after it is masked
 
-		// If min_pos is invalid then we are done
+void calc_n_peak (double *current_data, long num_frames, long mask_size, t_n_candidate *candidates, long N, double *n_max, double *n_max_pos, double frame_to_ms_val)
+{
+	calc_n_search(current_data, num_frames, mask_size, candidates, N, n_max, n_max_pos, frame_to_ms_val, N_SEARCH_PEAK);
+}			
 
-		if (min_pos == -1) 
-			break;
 
-		// Apply the mask and store the found values
+// Find the N trough values, with a mask preventing close together values from being chosen
+// Any value smaller than the previous one is a candidate - the best unmasked candidate is always a local minimum, unless the value after it is masked
 
-		n_search_mask (mask, num_frames, min_pos, mask_size);
-		n_min[j] = min;
-		n_min_pos[j] = min_pos * frame_to_ms_val;
-	}
-	
-	// Store DBL_MAX if there aren't any more values to be found
-	
-	for (; j < N; j++)
-	{
-		n_min[j] = DBL_MAX;
-		n_min_pos[j] = DBL_MAX;
-	}
+void calc_n_trough (double *current_data, long num_frames, long mask_size, t_n_candidate *candidates, long N, double *n_min, double *n_min_pos, double frame_to_ms_val)
+{
+	calc_n_search(current_data, num_frames, mask_size, candidates, N, n_min, n_min_pos, frame_to_ms_val, N_SEARCH_TROUGH);
 }	
 
 
@@ -927,3 +1114,225 @@ double calc_threshold_ratio (double *current_data, long num_frames, char above_f
 }	
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////// Running Statistics (Streaming Analysis) ///////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+// The n max / min values are kept in bounded heaps with the worst kept value at the root
+// Min values are stored negated so that both searches can share the same heap routines
+// Values are added in frame order, so a later equal value is always worse (matching the first found value used by the full searches)
+
+static __inline long running_stats_heap_worse (double *heap, double *heap_pos, long a, long b)
+{
+	return (heap[a] < heap[b]) || (heap[a] == heap[b] && heap_pos[a] > heap_pos[b]);
+}
+
+
+static __inline void running_stats_heap_swap (double *heap, double *heap_pos, long a, long b)
+{
+	double temp;
+	
+	temp = heap[a];
+	heap[a] = heap[b];
+	heap[b] = temp;
+	
+	temp = heap_pos[a];
+	heap_pos[a] = heap_pos[b];
+	heap_pos[b] = temp;
+}
+
+
+static void running_stats_heap_sift_down (double *heap, double *heap_pos, long count, long i)
+{
+	long child;
+	
+	for (child = (i << 1) + 1; child < count; i = child, child = (i << 1) + 1)
+	{
+		if (child + 1 < count && running_stats_heap_worse(heap, heap_pos, child + 1, child))
+			child++;
+		
+		if (!running_stats_heap_worse(heap, heap_pos, child, i))
+			break;
+		
+		running_stats_heap_swap(heap, heap_pos, i, child);
+	}
+}
+
+
+static void running_stats_heap_insert (double *heap, double *heap_pos, long N, long *count, double value, double pos)
+{
+	long i = *count;
+	
+	if (i < N)
+	{
+		// Add to the end and sift up
+		
+		heap[i] = value;
+		heap_pos[i] = pos;
+		
+		for (; i && running_stats_heap_worse(heap, heap_pos, i, (i - 1) >> 1); i = (i - 1) >> 1)
+			running_stats_heap_swap(heap, heap_pos, i, (i - 1) >> 1);
+		
+		(*count)++;
+	}
+	else if (N && value > heap[0])
+	{
+		// Replace the worst kept value
+		
+		heap[0] = value;
+		heap_pos[0] = pos;
+		running_stats_heap_sift_down(heap, heap_pos, N, 0);
+	}
+}
+
+
+static void running_stats_heap_output (double *heap, double *heap_pos, long count, long N, double *n_val, double *n_pos, double sign, double frame_to_ms_val)
+{
+	long i;
+	
+	// Heap sort in place (the worst value ends up last), then output best first
+	
+	for (i = count - 1; i > 0; i--)
+	{
+		running_stats_heap_swap(heap, heap_pos, 0, i);
+		running_stats_heap_sift_down(heap, heap_pos, i, 0);
+	}
+	
+	for (i = 0; i < count && i < N; i++)
+	{
+		n_val[i] = sign * heap[i];
+		n_pos[i] = heap_pos[i] * frame_to_ms_val;
+	}
+	
+	// Store DBL_MAX if there aren't any more values to be found
+	
+	for (; i < N; i++)
+	{
+		n_val[i] = DBL_MAX;
+		n_pos[i] = DBL_MAX;
+	}
+}
+
+
+long running_stats_memory_size (long n_max, long n_min)
+{
+	// The size of the heap memory (in doubles)
+	
+	return 2 * (n_max + n_min);
+}
+
+
+void running_stats_reset (t_running_stats *stats, long n_max, long n_min, double threshold, double *heap_memory)
+{
+	stats->sum = 0.;
+	stats->centroid_sum = 0.;
+	stats->welford_mean = 0.;
+	stats->welford_m2 = 0.;
+	stats->threshold = threshold;
+	
+	stats->num_frames = 0;
+	stats->num_valid = 0;
+	stats->num_above = 0;
+	stats->num_below = 0;
+	
+	stats->n_max = n_max;
+	stats->n_max_count = 0;
+	stats->n_max_heap = heap_memory;
+	stats->n_max_heap_pos = heap_memory + n_max;
+	
+	stats->n_min = n_min;
+	stats->n_min_count = 0;
+	stats->n_min_heap = heap_memory + (2 * n_max);
+	stats->n_min_heap_pos = heap_memory + (2 * n_max) + n_min;
+}
+
+
+void running_stats_add (t_running_stats *stats, double *current_data, long num_frames)
+{
+	double current_val;
+	double delta;
+	double threshold = stats->threshold;
+	double frame;
+	long i;
+	
+	for (i = 0, frame = stats->num_frames; i < num_frames; i++, frame++)
+	{
+		current_val = current_data[i];
+		
+		// N max / min (using the same validity tests as calc_n_max / calc_n_min)
+		
+		if (stats->n_max && current_val > -DBL_MAX && current_val != DBL_MAX)
+			running_stats_heap_insert(stats->n_max_heap, stats->n_max_heap_pos, stats->n_max, &stats->n_max_count, current_val, frame);
+		if (stats->n_min && current_val < DBL_MAX)
+			running_stats_heap_insert(stats->n_min_heap, stats->n_min_heap_pos, stats->n_min, &stats->n_min_count, -current_val, frame);
+		
+		if (current_val != DBL_MAX)
+		{
+			// Sums for the mean and time centroid (accumulated in the same order as calc_mean_and_time_centroid)
+			
+			stats->sum += current_val;
+			stats->centroid_sum += frame * current_val;
+			stats->num_valid++;
+			
+			// Welford's method for the variance
+			
+			delta = current_val - stats->welford_mean;
+			stats->welford_mean += delta / (double) stats->num_valid;
+			stats->welford_m2 += delta * (current_val - stats->welford_mean);
+			
+			// Threshold ratio counts
+			
+			if (current_val > threshold) 
+				stats->num_above++;
+			if (current_val < threshold) 
+				stats->num_below++;
+		}
+	}
+	
+	stats->num_frames += num_frames;
+}
+
+
+double running_stats_mean_and_time_centroid (t_running_stats *stats, double *time_centroid_ret, double frame_to_ms_val)
+{
+	if (stats->sum) 
+		*time_centroid_ret = (stats->centroid_sum / stats->sum) * frame_to_ms_val;
+	else 
+		*time_centroid_ret = DBL_MAX;
+	
+	if (stats->num_valid) 
+		return stats->sum / (double) stats->num_valid;
+	else 
+		return DBL_MAX;
+}
+
+
+double running_stats_standard_deviation (t_running_stats *stats)
+{
+	if (stats->num_valid) 
+		return sqrt (stats->welford_m2 / (double) stats->num_valid);
+	else 
+		return DBL_MAX;
+}
+
+
+void running_stats_n_max (t_running_stats *stats, long N, double *n_max, double *n_max_pos, double frame_to_ms_val)
+{
+	running_stats_heap_output(stats->n_max_heap, stats->n_max_heap_pos, stats->n_max_count, N, n_max, n_max_pos, 1., frame_to_ms_val);
+}
+
+
+void running_stats_n_min (t_running_stats *stats, long N, double *n_min, double *n_min_pos, double frame_to_ms_val)
+{
+	running_stats_heap_output(stats->n_min_heap, stats->n_min_heap_pos, stats->n_min_count, N, n_min, n_min_pos, -1., frame_to_ms_val);
+}
+
+
+double running_stats_threshold_ratio (t_running_stats *stats, char above_flag)
+{
+	if (stats->num_valid) 
+		return (double) (above_flag ? stats->num_above : stats->num_below) / (double) stats->num_valid;
+	
+	return DBL_MAX;
+}
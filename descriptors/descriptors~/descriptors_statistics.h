@@ -23,12 +23,22 @@ double calc_standard_deviation (double *current_data, long num_frames, double me
 double calc_median (double *current_data, long num_frames);
 
 // N searches (search for n min / max / peak / trough values)
+// The candidate memory must be N_SEARCH_CANDIDATE_MEMORY bytes
+
+typedef struct _n_candidate
+{
+	double key;
+	long pos;
+	
+} t_n_candidate;
+
+#define N_SEARCH_CANDIDATE_MEMORY ((MAX_N_CANDIDATES * sizeof(t_n_candidate)) + (MAX_N_SEARCH * sizeof(long)))
 
 void n_search_mask (char *mask, long num_frames, long pos, long mask_size);
-void calc_n_max (double *current_data, long num_frames, long mask_size, char *mask, long N, double *n_max, double *n_max_pos, double frame_to_ms_val);
-void calc_n_min (double *current_data, long num_frames, long mask_size, char *mask, long N, double *n_min, double *n_min_pos, double frame_to_ms_val);
-void calc_n_peak (double *current_data, long num_frames, long mask_size, char *mask, long N, double *n_max, double *n_max_pos, double frame_to_ms_val);
-void calc_n_trough (double *current_data, long num_frames, long mask_size, char *mask, long N, double *n_min, double *n_min_pos, double frame_to_ms_val);
+void calc_n_max (double *current_data, long num_frames, long mask_size, t_n_candidate *candidates, long N, double *n_max, double *n_max_pos, double frame_to_ms_val);
+void calc_n_min (double *current_data, long num_frames, long mask_size, t_n_candidate *candidates, long N, double *n_min, double *n_min_pos, double frame_to_ms_val);
+void calc_n_peak (double *current_data, long num_frames, long mask_size, t_n_candidate *candidates, long N, double *n_max, double *n_max_pos, double frame_to_ms_val);
+void calc_n_trough (double *current_data, long num_frames, long mask_size, t_n_candidate *candidates, long N, double *n_min, double *n_min_pos, double frame_to_ms_val);
 
 // Threshold searches (search for crossing above / below threshold
 
@@ -42,5 +52,43 @@ void calc_longest_crossing_points_below (double *current_data, long num_frames,
 
 double calc_threshold_ratio (double *current_data, long num_frames, char above_flag, double threshold);
 
+// Running statistics (for streaming analysis - data is added in frame order a block at a time, so the full history is not needed)
+// N.B. the n max / min values are only equivalent to calc_n_max / calc_n_min when no masking is needed (mask size of zero or N of one)
+
+typedef struct _running_stats
+{
+	double sum;
+	double centroid_sum;
+	double welford_mean;
+	double welford_m2;
+	double threshold;
+
+	long num_frames;
+	long num_valid;
+	long num_above;
+	long num_below;
+
+	long n_max;
+	long n_max_count;
+	double *n_max_heap;
+	double *n_max_heap_pos;
+
+	long n_min;
+	long n_min_count;
+	double *n_min_heap;
+	double *n_min_heap_pos;
+
+} t_running_stats;
+
+long running_stats_memory_size (long n_max, long n_min);
+void running_stats_reset (t_running_stats *stats, long n_max, long n_min, double threshold, double *heap_memory);
+void running_stats_add (t_running_stats *stats, double *current_data, long num_frames);
+
+double running_stats_mean_and_time_centroid (t_running_stats *stats, double *time_centroid_ret, double frame_to_ms_val);
+double running_stats_standard_deviation (t_running_stats *stats);
+void running_stats_n_max (t_running_stats *stats, long N, double *n_max, double *n_max_pos, double frame_to_ms_val);
+void running_stats_n_min (t_running_stats *stats, long N, double *n_min, double *n_min_pos, double frame_to_ms_val);
+double running_stats_threshold_ratio (t_running_stats *stats, char above_flag);
+
 
 #endif /* _DESCRIPTORS_STATS_ */
@@ -0,0 +1,244 @@
+
+#ifndef ASYNCMATCHER_H
+#define ASYNCMATCHER_H
+
+#include <ext.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EntryDatabase.h"
+#include "Matchers.h"
+#include "entry_database_max.h"
+
+// Matching on a worker thread for entrymatcher~ (so that the cost of matching is never paid on the audio thread)
+// Requests are written by the audio thread into a ring of slots, and the results are written back into the same slot by the worker
+// Each result becomes current exactly one vector after the sample at which it was requested (or as soon as it is ready after that)
+// N.B. the audio thread never waits or allocates - if the ring is full a request is dropped, and both late and dropped requests are counted
+
+class AsyncMatcher
+{
+    static const long kNumSlots = 32;
+    static const long kMaxTargets = 256;
+    
+    struct Slot
+    {
+        Slot() : mDue(0), mNumTargets(0), mRatioKept(1.0), mLimit(0), mLate(false) {}
+        
+        // Request (written by the audio thread)
+        
+        long long mDue;
+        long mNumTargets;
+        double mTargets[kMaxTargets];
+        double mRatioKept;
+        long mLimit;
+        bool mLate;
+        
+        // Result (written by the worker)
+        
+        std::vector<long> mIndices;
+    };
+    
+public:
+    
+    AsyncMatcher(Matchers& matchers)
+    : mMatchers(matchers), mDatabase(NULL), mSlots(kNumSlots), mNumRequested(0), mNumCompleted(0), mNumApplied(0), mNumSubmitted(0), mCurrent(-1), mNumLate(0), mNumDropped(0), mRunning(false), mQuit(false) {}
+    
+    ~AsyncMatcher() { stop(); }
+    
+    // Starting and stopping the worker (main thread only)
+    
+    void start()
+    {
+        if (!mRunning)
+        {
+            mQuit = false;
+            mThread = std::thread(&AsyncMatcher::run, this);
+            mRunning = true;
+        }
+    }
+    
+    void stop()
+    {
+        if (mRunning)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mWakeLock);
+                mQuit = true;
+            }
+            
+            mWake.notify_one();
+            mThread.join();
+            mRunning = false;
+        }
+    }
+    
+    // The matchers are used by the worker whilst this lock is held (so it must be held to change them on any other thread)
+    
+    std::mutex& getMatchersLock() { return mMatchersLock; }
+    
+    // Requests are matched against the database set most recently (set with the matchers lock held, so that it is never released during a match)
+    
+    void setDatabase(t_object *database) { mDatabase = database; }
+    
+    // Audio thread only
+    
+    bool running() const { return mRunning; }
+    bool busy() const { return mRunning && mNumCompleted.load(std::memory_order_acquire) != mNumRequested.load(std::memory_order_relaxed); }
+    
+    // Forget the current result and any that have not yet been applied
+    
+    void reset()
+    {
+        mNumApplied = mNumCompleted.load(std::memory_order_acquire);
+        mCurrent = -1;
+    }
+    
+    template <typename T> bool request(long long time, long latency, double ratioKept, long limit, T **targets, long numTargets, long offset)
+    {
+        unsigned long long numRequested = mNumRequested.load(std::memory_order_relaxed);
+        
+        // Keep the current result intact
+        
+        if (numRequested + 1 - mNumApplied >= kNumSlots)
+        {
+            mNumDropped++;
+            return false;
+        }
+        
+        Slot& slot = mSlots[numRequested % kNumSlots];
+        
+        slot.mDue = time + latency;
+        slot.mNumTargets = numTargets < kMaxTargets ? numTargets : kMaxTargets;
+        slot.mRatioKept = ratioKept;
+        slot.mLimit = limit;
+        slot.mLate = false;
+        
+        for (long i = 0; i < slot.mNumTargets; i++)
+            slot.mTargets[i] = targets[i][offset];
+        
+        mNumRequested.store(numRequested + 1, std::memory_order_release);
+        
+        return true;
+    }
+    
+    // Wake the worker if there have been any requests since the last submission (at most once per vector)
+    
+    void submit()
+    {
+        unsigned long long numRequested = mNumRequested.load(std::memory_order_relaxed);
+        
+        if (numRequested != mNumSubmitted)
+        {
+            mNumSubmitted = numRequested;
+            mWake.notify_one();
+        }
+    }
+    
+    // Apply any results due by the given time (returns true if the current result has changed)
+    
+    bool update(long long time)
+    {
+        bool changed = false;
+        
+        while (mNumApplied != mNumRequested.load(std::memory_order_relaxed))
+        {
+            Slot& slot = mSlots[mNumApplied % kNumSlots];
+            
+            if (slot.mDue > time)
+                break;
+            
+            if (mNumApplied == mNumCompleted.load(std::memory_order_acquire))
+            {
+                if (!slot.mLate)
+                    mNumLate++;
+                slot.mLate = true;
+                break;
+            }
+            
+            mCurrent = mNumApplied++ % kNumSlots;
+            changed = true;
+        }
+        
+        return changed;
+    }
+    
+    long getNumMatches() const          { return mCurrent < 0 ? 0 : mSlots[mCurrent].mIndices.size(); }
+    long getIndex(long idx) const       { return mSlots[mCurrent].mIndices[idx]; }
+    
+    unsigned long getNumLate() const    { return mNumLate; }
+    unsigned long getNumDropped() const { return mNumDropped; }
+    
+private:
+    
+    // Worker thread
+    
+    void run()
+    {
+        while (true)
+        {
+            {
+                // N.B. the audio thread notifies without holding the lock, so the wait times out in case a wakeup is missed
+                
+                std::unique_lock<std::mutex> lock(mWakeLock);
+                mWake.wait_for(lock, std::chrono::milliseconds(1), [this]{ return mQuit || mNumCompleted.load() != mNumRequested.load(); });
+                
+                if (mQuit)
+                    return;
+            }
+            
+            unsigned long long numCompleted = mNumCompleted.load(std::memory_order_relaxed);
+            
+            while (numCompleted != mNumRequested.load(std::memory_order_acquire))
+            {
+                process(mSlots[numCompleted % kNumSlots]);
+                mNumCompleted.store(++numCompleted, std::memory_order_release);
+            }
+        }
+    }
+    
+    void process(Slot& slot)
+    {
+        std::lock_guard<std::mutex> lock(mMatchersLock);
+        
+        EntryDatabase::ReadPointer database = database_getptr_read(mDatabase);
+        
+        for (long i = 0; i < slot.mNumTargets; i++)
+            mMatchers.setTarget(i, slot.mTargets[i]);
+        
+        long numMatches = mMatchers.match(database, slot.mRatioKept, slot.mLimit, true);
+        
+        slot.mIndices.resize(numMatches);
+        
+        for (long i = 0; i < numMatches; i++)
+            slot.mIndices[i] = mMatchers.getIndex(i);
+    }
+    
+    // Data
+    
+    Matchers& mMatchers;
+    t_object *mDatabase;
+    std::vector<Slot> mSlots;
+    
+    std::atomic<unsigned long long> mNumRequested;
+    std::atomic<unsigned long long> mNumCompleted;
+    unsigned long long mNumApplied;
+    unsigned long long mNumSubmitted;
+    long mCurrent;
+    
+    unsigned long mNumLate;
+    unsigned long mNumDropped;
+    
+    std::thread mThread;
+    std::mutex mMatchersLock;
+    std::mutex mWakeLock;
+    std::condition_variable mWake;
+    std::atomic<bool> mRunning;
+    bool mQuit;
+};
+
+#endif
@@ -5,43 +5,72 @@
 #include <algorithm>
 #include <functional>
 #include <cmath>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+// Errors are only reported when there is an object to report them (changes repeated on the second copy of a shared database have none)
+
+template <typename... Args> void reportError(void *x, const char *format, Args... args)
+{
+    if (x)
+        object_error((t_object *) x, format, args...);
+}
 
 void EntryDatabase::reserve(long items)
 {
-    HoldLock lock(&mWriteLock);
-    
     mIdentifiers.reserve(items);
     mOrder.reserve(items);
-    mEntries.reserve(items * numColumns());
-    mTypes.reserve(items * numColumns());
+    
+    for (long i = 0; i < numColumns(); i++)
+    {
+        mEntries[i].reserve(items);
+        mTypes[i].reserve(items);
+    }
 }
 
-void EntryDatabase::clear()
+void EntryDatabase::resizeColumns(long numCols)
 {
-    HoldLock lock(&mWriteLock);
-    clear(lock);
+    mColumns.resize(numCols);
+    mEntries.resize(numCols);
+    mTypes.resize(numCols);
+    updateColumnNames();
 }
 
-void EntryDatabase::clear(HoldLock &lock)
+void EntryDatabase::updateColumnNames()
 {
-    mEntries.clear();
-    mIdentifiers.clear();
-    mOrder.clear();
-    mTypes.clear();
+    // Columns are looked up by name in a hash map (where names are repeated the first column with the name is found)
+    
+    mColumnNames.clear();
+    
+    for (long i = numColumns() - 1; i >= 0; i--)
+        mColumnNames[mColumns[i].mName] = i;
 }
 
-void EntryDatabase::setColumnLabelModes(void *x, long argc, t_atom *argv)
+void EntryDatabase::resizeItems(long numItems)
 {
-    HoldLock lock(&mWriteLock);
-    setColumnLabelModes(lock, x, argc, argv);
+    for (long i = 0; i < numColumns(); i++)
+    {
+        mEntries[i].resize(numItems);
+        mTypes[i].resize(numItems);
+    }
+}
+
+void EntryDatabase::clear()
+{
+    mModifiedCount++;
+    
+    resizeItems(0);
+    mIdentifiers.clear();
+    mOrder.clear();
 }
 
-void EntryDatabase::setColumnLabelModes(HoldLock &lock, void *x, long argc, t_atom *argv)
+void EntryDatabase::setColumnLabelModes(void *x, long argc, t_atom *argv)
 {
     bool labelsModesChanged = false;
     
     if (argc > numColumns())
-        object_error((t_object *) x, "more label modes than columns");
+        reportError(x, "more label modes than columns");
     
     argc = (argc > numColumns()) ? numColumns() : argc;
     
@@ -53,37 +82,27 @@ void EntryDatabase::setColumnLabelModes(HoldLock &lock, void *x, long argc, t_at
     }
     
     if (labelsModesChanged)
-        clear(lock);
+        clear();
 }
 
 void EntryDatabase::setColumnNames(void *x, long argc, t_atom *argv)
-{
-    HoldLock lock(&mWriteLock);
-    setColumnNames(lock, x, argc, argv);
-}
-
-void EntryDatabase::setColumnNames(HoldLock &lock, void *x, long argc, t_atom *argv)
 {
     if (argc > numColumns())
-        object_error((t_object *) x, "more names than columns");
+        reportError(x, "more names than columns");
     
     argc = (argc > numColumns()) ? numColumns() : argc;
     
     for (long i = 0; i < argc; i++)
         mColumns[i].mName = atom_getsym(argv++);
+    
+    updateColumnNames();
 }
 
 void EntryDatabase::addEntry(void *x, long argc, t_atom *argv)
-{
-    HoldLock lock(&mWriteLock);
-    addEntry(lock, x, argc, argv);
-}
-
-void EntryDatabase::addEntry(HoldLock &lock, void *x, long argc, t_atom *argv)
 {
     if (!argc--)
     {
-        object_error((t_object *)x, "no arguments for entry");
+        reportError(x, "no arguments for entry");
         return;
     }
     
@@ -91,6 +110,9 @@ void EntryDatabase::addEntry(HoldLock &lock, void *x, long argc, t_atom *argv)
     
     t_atom *identifier = argv++;
     long order;
+    
+    mModifiedCount++;
+    
     long idx = searchIdentifiers(identifier, order);
 
     // Make a space for a new entry in the case that this identifier does *not* exist
@@ -98,12 +120,148 @@ void EntryDatabase::addEntry(HoldLock &lock, void *x, long argc, t_atom *argv)
     if (idx < 0)
     {
         idx = numItems();
-        mEntries.resize((idx + 1) * numColumns());
-        mTypes.resize((idx + 1) * numColumns());
+        resizeItems(idx + 1);
         mOrder.insert(mOrder.begin() + order, idx);
         mIdentifiers.push_back(CustomAtom(identifier, false));
     }
 
+    setEntryData(x, idx, argc, argv);
+}
+
+// Add all entries (without ordering) then sort the new identifiers once and merge them into the order
+
+struct IdentifierOrder
+{
+    IdentifierOrder(const std::vector<CustomAtom>& identifiers) : mIdentifiers(identifiers) {}
+    
+    bool operator()(const long a, const long b) const { return compare(mIdentifiers[a], mIdentifiers[b]) == CustomAtom::kLess; }
+    
+    const std::vector<CustomAtom>& mIdentifiers;
+};
+
+void EntryDatabase::addEntries(void *x, long argc, t_atom *argv)
+{
+    long rowSize = numColumns() + 1;
+    std::vector<Entry> entries;
+    
+    if (argc % rowSize)
+        reportError(x, "entries should have an identifier and a value for each column (incomplete entry ignored)");
+    
+    for (long i = 0; i + rowSize <= argc; i += rowSize)
+        entries.push_back(Entry(rowSize, argv + i));
+    
+    addEntries(x, entries);
+}
+
+void EntryDatabase::addEntries(void *x, const std::vector<Entry>& entries)
+{
+    long start = numItems();
+    long end = start;
+    
+    mModifiedCount++;
+    
+    // Reserve once (growing geometrically so that repeated additions remain amortised)
+    
+    size_t capacity = mIdentifiers.capacity();
+    
+    if (start + entries.size() > capacity)
+        reserve(std::max(start + entries.size(), capacity + capacity / 2));
+    
+    resizeItems(start + entries.size());
+    
+    for (std::vector<Entry>::const_iterator it = entries.begin(); it != entries.end(); it++)
+    {
+        if (!it->mArgc)
+        {
+            reportError(x, "no arguments for entry");
+            continue;
+        }
+        
+        mIdentifiers.push_back(CustomAtom(it->mArgv, false));
+        setEntryData(x, end++, it->mArgc - 1, it->mArgv + 1);
+    }
+    
+    // Sort the new entries by identifier (equal identifiers remain in the order they were given)
+    
+    std::vector<long> order(end - start);
+    std::vector<long> position(end - start, 0);
+    std::vector<long> added;
+    
+    for (long i = start; i < end; i++)
+        order[i - start] = i;
+    
+    std::stable_sort(order.begin(), order.end(), IdentifierOrder(mIdentifiers));
+    
+    // As when adding entries one at a time, the last values for an identifier are stored in the existing entry or the first new one
+    // Entries to be removed are marked by a negative position
+    
+    for (long i = 0, j; i < end - start; i = j)
+    {
+        long orderPosition;
+        long target = searchIdentifiers(mIdentifiers[order[i]], orderPosition);
+        
+        for (j = i + 1; j < end - start; j++)
+            if (compare(mIdentifiers[order[i]], mIdentifiers[order[j]]) != CustomAtom::kEqual)
+                break;
+        
+        if (target < 0)
+        {
+            target = order[i];
+            added.push_back(target);
+        }
+        
+        if (order[j - 1] != target)
+        {
+            for (long k = 0; k < numColumns(); k++)
+            {
+                mEntries[k][target] = mEntries[k][order[j - 1]];
+                mTypes[k][target] = mTypes[k][order[j - 1]];
+            }
+        }
+        
+        for (long k = i; k < j; k++)
+            if (order[k] != target)
+                position[order[k] - start] = -1;
+    }
+    
+    // Remove repeated entries and then merge the new identifiers into the order
+    
+    long size = start;
+    
+    for (long i = start; i < end; i++)
+    {
+        if (position[i - start] < 0)
+            continue;
+        
+        position[i - start] = size;
+        
+        if (i != size)
+        {
+            mIdentifiers[size] = mIdentifiers[i];
+            
+            for (long k = 0; k < numColumns(); k++)
+            {
+                mEntries[k][size] = mEntries[k][i];
+                mTypes[k][size] = mTypes[k][i];
+            }
+        }
+        
+        size++;
+    }
+    
+    mIdentifiers.resize(size);
+    resizeItems(size);
+    
+    for (std::vector<long>::iterator it = added.begin(); it != added.end(); it++)
+        *it = position[*it - start];
+    
+    std::vector<long> newOrder(size);
+    std::merge(mOrder.begin(), mOrder.end(), added.begin(), added.end(), newOrder.begin(), IdentifierOrder(mIdentifiers));
+    std::swap(mOrder, newOrder);
+}
+
+void EntryDatabase::setEntryData(void *x, long idx, long argc, t_atom *argv)
+{
     // Store data of the correct data type but store null data for any unspecified columns / incorrect types
     
     for (long i = 0; i < numColumns(); i++, argv++)
@@ -115,7 +273,7 @@ void EntryDatabase::addEntry(HoldLock &lock, void *x, long argc, t_atom *argv)
         else
         {
             if (i < argc)
-                object_error((t_object *)x, "incorrect type in entry - column number %ld", i + 1);
+                reportError(x, "incorrect type in entry - column number %ld", i + 1);
             
             setData(idx, i, mColumns[i].mLabel ? CustomAtom(gensym("")) : CustomAtom());
         }
@@ -125,13 +283,11 @@ void EntryDatabase::addEntry(HoldLock &lock, void *x, long argc, t_atom *argv)
 void EntryDatabase::removeEntries(void *x, long argc, t_atom *argv)
 {
     if (!argc)
-        object_error((t_object *)x, "no identifiers given for remove message");
+        reportError(x, "no identifiers given for remove message");
     else
     {
-        HoldLock lock(&mWriteLock);
-        
         while (argc--)
-             removeEntry(lock, x, argv++);
+             removeEntry(x, argv++);
     }
 }
 
@@ -143,10 +299,8 @@ void EntryDatabase::removeMatchedEntries(void *x, long argc, t_atom *argv)
     
     if (argc)
     {
-        ReadPointer database(this);
-    
-        matchers.setMatchers(x, argc, argv, database);
-        numMatches = matchers.match(database, true);
+        matchers.setMatchers(x, argc, argv, *this);
+        numMatches = matchers.match(*this, true);
         indices.resize(numMatches);
         
         for (long i = 0; i < numMatches; i++)
@@ -154,16 +308,12 @@ void EntryDatabase::removeMatchedEntries(void *x, long argc, t_atom *argv)
     }
     
     if (numMatches && matchers.size())
-    {
-        HoldLock lock(&mWriteLock);
-        
-        removeEntries(lock, indices);
-    }
+        removeEntries(indices);
 }
 
-template <class T> void copyRange(std::vector<T>& data, long from, long to, long size, long itemSize = 1)
+template <class T> void copyRange(std::vector<T>& data, long from, long to, long size)
 {
-    std::copy(data.begin() + (from * itemSize), data.begin() + (from + size) * itemSize, data.begin() + to * itemSize);
+    std::copy(data.begin() + from, data.begin() + from + size, data.begin() + to);
 }
 
 long EntryDatabase::getOrder(long idx)
@@ -176,8 +326,10 @@ long EntryDatabase::getOrder(long idx)
     return order;
 }
 
-void EntryDatabase::removeEntries(HoldLock &lock, const std::vector<long>& indices)
+void EntryDatabase::removeEntries(const std::vector<long>& indices)
 {
+    mModifiedCount++;
+    
     long orderStart = getOrder(indices[0]);
     long offset = indices[0];
     long next = indices[0];
@@ -227,8 +379,12 @@ void EntryDatabase::removeEntries(HoldLock &lock, const std::vector<long>& indic
         // Move data
         
         copyRange(mIdentifiers, end, offset, size);
-        copyRange(mTypes, end, offset, size, numColumns());
-        copyRange(mEntries, end, offset, size, numColumns());
+        
+        for (long j = 0; j < numColumns(); j++)
+        {
+            copyRange(mTypes[j], end, offset, size);
+            copyRange(mEntries[j], end, offset, size);
+        }
     }
 
     // Swap order vectors and do deletion
@@ -254,26 +410,31 @@ void EntryDatabase::removeEntries(HoldLock &lock, const std::vector<long>& indic
     long newSize = numItems() - indices.size();
     
     mIdentifiers.resize(newSize);
-    mEntries.resize(newSize * numColumns());
-    mTypes.resize(newSize * numColumns());
     mOrder.resize(newSize);
+    resizeItems(newSize);
 }
 
-void EntryDatabase::removeEntry(HoldLock &lock, void *x, t_atom *identifier)
+void EntryDatabase::removeEntry(void *x, t_atom *identifier)
 {
     long order;
     long idx = searchIdentifiers(identifier, order);
     
     if (idx < 0)
     {
-        object_error((t_object *) x, "entry does not exist");
+        reportError(x, "entry does not exist");
         return;
     }
     
+    mModifiedCount++;
+    
     mIdentifiers.erase(mIdentifiers.begin() + idx);
     mOrder.erase(mOrder.begin() + order);
-    mEntries.erase(mEntries.begin() + (idx * numColumns()), mEntries.begin() + ((idx + 1) * numColumns()));
-    mTypes.erase(mTypes.begin() + (idx * numColumns()), mTypes.begin() + ((idx + 1) * numColumns()));
+    
+    for (long i = 0; i < numColumns(); i++)
+    {
+        mEntries[i].erase(mEntries[i].begin() + idx);
+        mTypes[i].erase(mTypes[i].begin() + idx);
+    }
  
     std::vector<long>::iterator it = mOrder.begin();
     
@@ -294,12 +455,18 @@ void EntryDatabase::removeEntry(HoldLock &lock, void *x, t_atom *identifier)
 
 long EntryDatabase::searchIdentifiers(const t_atom *identifierAtom, long& idx) const
 {
-    CustomAtom identifier(identifierAtom, false);
-    
-    long gap = idx = numItems() / 2;
+    return searchIdentifiers(CustomAtom(identifierAtom, false), idx);
+}
+
+// N.B. only ordered entries are searched (entries being added in bulk are not yet ordered)
+
+long EntryDatabase::searchIdentifiers(const CustomAtom& identifier, long& idx) const
+{
+    long numOrdered = mOrder.size();
+    long gap = idx = numOrdered / 2;
     gap = gap < 1 ? 1 : gap;
     
-    while (gap && idx < numItems())
+    while (gap && idx < numOrdered)
     {
         gap /= 2;
         gap = gap < 1 ? 1 : gap;
@@ -335,11 +502,9 @@ long EntryDatabase::columnFromSpecifier(const t_atom *specifier) const
     if (columnName == gensym("identifier"))
         return -1;
     
-    for (long i = 0; i < numColumns(); i++)
-        if (columnName == mColumns[i].mName)
-            return i;
+    std::unordered_map<t_symbol *, long>::const_iterator it = mColumnNames.find(columnName);
     
-    return -2;
+    return it == mColumnNames.end() ? -2 : it->second;
 }
 
 double EntryDatabase::columnMin(const t_atom *specifier) const
@@ -420,6 +585,13 @@ void EntryDatabase::view(t_object *database_object) const
     object_attr_setsym(editor, gensym("title"), mName);
 }
 
+bool isBinaryFile(const char *filename)
+{
+    size_t length = strlen(filename);
+    
+    return length >= 5 && !strcmp(filename + length - 5, ".emdb");
+}
+
 void EntryDatabase::save(t_object *x, t_symbol *fileSpecifier) const
 {
     char filepath[MAX_PATH_CHARS];
@@ -442,6 +614,12 @@ void EntryDatabase::save(t_object *x, t_symbol *fileSpecifier) const
             return;
     }
     
+    if (isBinaryFile(filename))
+    {
+        saveBinary(x, filename, path);
+        return;
+    }
+    
     t_dictionary *dict = saveDictionary(true);
     dictionary_write(dict, filename, path);
     object_free(dict);
@@ -453,21 +631,25 @@ void EntryDatabase::load(t_object *x, t_symbol *fileSpecifier)
     short path;
 
     t_fourcc type;
-    t_fourcc types = 'JSON';
+    
+    // N.B. files of any type are accepted as the format is detected from the contents
     
     if (fileSpecifier && fileSpecifier != gensym(""))
     {
         strncpy_zero(filename, fileSpecifier->s_name, MAX_PATH_CHARS);
-        if (locatefile_extended(filename, &path, &type, &types, 1))
+        if (locatefile_extended(filename, &path, &type, NULL, 0))
             return;
     }
     else
     {
         strcpy(filename, "");
-        if (open_dialog(filename, &path, &type, &types, 1))
+        if (open_dialog(filename, &path, &type, NULL, 0))
             return;
     }
     
+    if (loadBinary(x, filename, path))
+        return;
+    
     t_dictionary *dict;
     dictionary_read(filename, path, &dict);
     loadDictionary(x, dict);
@@ -547,8 +729,7 @@ void EntryDatabase::loadDictionary(t_object *x, t_dictionary *dict)
     
     if (dictMeta && dictData)
     {
-        HoldLock lock(&mWriteLock);
-        clear(lock);
+        clear();
         
         t_atom_long newNumColumns;
         dictionary_getlong(dictMeta, gensym("numcolumns"), &newNumColumns);
@@ -556,22 +737,26 @@ void EntryDatabase::loadDictionary(t_object *x, t_dictionary *dict)
         if (newNumColumns != numColumns())
         {
             mColumns.clear();
-            mColumns.resize(newNumColumns);
+            resizeColumns(newNumColumns);
         }
         
         t_atom *argv;
         long argc;
         
         dictionary_getatoms(dictMeta, gensym("names"), &argc, &argv);
-        setColumnNames(lock, x, argc, argv);
+        setColumnNames(x, argc, argv);
         
         dictionary_getatoms(dictMeta, gensym("labelmodes"), &argc, &argv);
-        setColumnLabelModes(lock, x, argc, argv);
+        setColumnLabelModes(x, argc, argv);
+        
+        // Data (added in bulk)
         
-        // Data
+        std::vector<Entry> entries;
         
         if (dictionary_getatoms(dictData, gensym("all_entries"), &argc, &argv) == MAX_ERR_NONE)
         {
+            entries.reserve(argc);
+            
             for (long i = 0; i < argc; i++)
             {
                 t_atom *entryArgv;
@@ -579,7 +764,7 @@ void EntryDatabase::loadDictionary(t_object *x, t_dictionary *dict)
                 
                 t_dictionary *entryDict = (t_dictionary *) atom_getobj(argv + i);
                 if ((err = dictionary_getatoms(entryDict, gensym("entry"), &entryArgc, &entryArgv)) == MAX_ERR_NONE)
-                    addEntry(lock, x, entryArgc, entryArgv);
+                    entries.push_back(Entry(entryArgc, entryArgv));
             }
         }
         else
@@ -588,8 +773,496 @@ void EntryDatabase::loadDictionary(t_object *x, t_dictionary *dict)
             {
                 std::string str("entry_" + std::to_string(i + 1));
                 if ((err = dictionary_getatoms(dictData, gensym(str.c_str()), &argc, &argv)) == MAX_ERR_NONE)
-                    addEntry(lock, x, argc, argv);
+                    entries.push_back(Entry(argc, argv));
             }
         }
+        
+        addEntries(x, entries);
     }
 }
+
+// Binary files contain a header, the column metadata, a symbol table and then the data (the identifiers, their order and then each column)
+// Sections are aligned to eight bytes and values are stored in native byte order (which is checked on loading)
+// Symbols are stored as indices into the symbol table, which holds null terminated strings
+
+struct BinaryHeader
+{
+    char mMagic[4];
+    uint32_t mByteOrder;
+    uint32_t mVersion;
+    uint32_t mNumColumns;
+    uint64_t mNumItems;
+    uint64_t mNumSymbols;
+    uint64_t mSymbolTableSize;
+};
+
+struct BinaryColumn
+{
+    uint64_t mName;
+    uint64_t mLabel;
+};
+
+static const char binaryMagic[4] = { 'E', 'M', 'D', 'B' };
+static const uint32_t binaryByteOrder = 0x01020304;
+static const uint32_t binaryVersion = 1;
+
+size_t binaryPadding(size_t size)
+{
+    return (8 - (size & 7)) & 7;
+}
+
+class BinaryWriter
+{
+public:
+    
+    void write(const void *data, size_t size)
+    {
+        const char *bytes = (const char *) data;
+        mData.insert(mData.end(), bytes, bytes + size);
+        mData.insert(mData.end(), binaryPadding(size), 0);
+    }
+    
+    void writeValues(const UntypedAtom *values, const CustomAtom::Type *types, size_t size)
+    {
+        std::vector<UntypedAtom> encoded(values, values + size);
+        
+        for (size_t i = 0; i < size; i++)
+            if (types[i] == CustomAtom::kSymbol)
+                encoded[i] = UntypedAtom((t_atom_long) symbolIndex(values[i].mSymbol));
+        
+        write(encoded.data(), size * sizeof(UntypedAtom));
+        write(types, size * sizeof(CustomAtom::Type));
+    }
+    
+    // Symbols are indexed in order of first use
+    
+    uint64_t symbolIndex(t_symbol *symbol)
+    {
+        std::unordered_map<t_symbol *, uint64_t>::iterator it = mSymbolIndices.find(symbol);
+        
+        if (it != mSymbolIndices.end())
+            return it->second;
+        
+        uint64_t index = mSymbolIndices.size();
+        
+        mSymbolIndices[symbol] = index;
+        mSymbols.insert(mSymbols.end(), symbol->s_name, symbol->s_name + strlen(symbol->s_name) + 1);
+        
+        return index;
+    }
+    
+    const std::vector<char>& data() const       { return mData; }
+    const std::vector<char>& symbols() const    { return mSymbols; }
+    uint64_t numSymbols() const                 { return mSymbolIndices.size(); }
+    
+private:
+    
+    std::vector<char> mData;
+    std::vector<char> mSymbols;
+    std::unordered_map<t_symbol *, uint64_t> mSymbolIndices;
+};
+
+class BinaryReader
+{
+public:
+    
+    enum ValueType { kNumeric, kLabel, kIdentifier };
+    
+    BinaryReader(const std::vector<char>& data) : mData(data), mOffset(0), mValid(true) {}
+    
+    // Sections that would extend past the end of the data are not read (and the reader becomes invalid)
+    
+    const void *read(uint64_t size)
+    {
+        if (size > mData.size() - mOffset)
+        {
+            mValid = false;
+            return NULL;
+        }
+        
+        const void *section = mData.data() + mOffset;
+        mOffset = std::min(mOffset + size + binaryPadding(size), (uint64_t) mData.size());
+        
+        return section;
+    }
+    
+    // Copies values and types, translating symbol indices and checking that each type is valid for the values (symbols only for labels)
+    
+    bool readValues(std::vector<UntypedAtom>& values, std::vector<CustomAtom::Type>& types, uint64_t size, const std::vector<t_symbol *>& symbols, ValueType valueType)
+    {
+        const void *valueData = read(size * sizeof(UntypedAtom));
+        const void *typeData = read(size * sizeof(CustomAtom::Type));
+        
+        if (!mValid)
+            return false;
+        
+        values.resize(size);
+        types.resize(size);
+        
+        if (size)
+        {
+            memcpy(values.data(), valueData, size * sizeof(UntypedAtom));
+            memcpy(types.data(), typeData, size * sizeof(CustomAtom::Type));
+        }
+        
+        for (uint64_t i = 0; i < size; i++)
+        {
+            bool symbol = types[i] == CustomAtom::kSymbol;
+            
+            if (types[i] > CustomAtom::kInt || (valueType != kIdentifier && symbol != (valueType == kLabel)))
+                return false;
+            
+            if (symbol)
+            {
+                t_atom_long index = values[i].mInt;
+                
+                if (index < 0 || index >= (t_atom_long) symbols.size())
+                    return false;
+                
+                values[i] = symbols[index];
+            }
+        }
+        
+        return true;
+    }
+    
+    bool isValid() const { return mValid; }
+    
+private:
+    
+    const std::vector<char>& mData;
+    uint64_t mOffset;
+    bool mValid;
+};
+
+void EntryDatabase::saveBinary(t_object *x, const char *filename, short path) const
+{
+    BinaryWriter columnWriter;
+    BinaryWriter dataWriter;
+    BinaryWriter fileWriter;
+    
+    // Metadata
+    
+    for (long i = 0; i < numColumns(); i++)
+    {
+        BinaryColumn column = { dataWriter.symbolIndex(mColumns[i].mName), mColumns[i].mLabel };
+        columnWriter.write(&column, sizeof(BinaryColumn));
+    }
+    
+    // Data (collecting the symbol table)
+    
+    std::vector<UntypedAtom> identifiers(numItems());
+    std::vector<CustomAtom::Type> identifierTypes(numItems());
+    std::vector<int64_t> order(mOrder.begin(), mOrder.end());
+    
+    for (long i = 0; i < numItems(); i++)
+    {
+        identifiers[i] = mIdentifiers[i].mData;
+        identifierTypes[i] = mIdentifiers[i].mType;
+    }
+    
+    dataWriter.writeValues(identifiers.data(), identifierTypes.data(), numItems());
+    dataWriter.write(order.data(), numItems() * sizeof(int64_t));
+    
+    for (long i = 0; i < numColumns(); i++)
+        dataWriter.writeValues(mEntries[i].data(), mTypes[i].data(), numItems());
+    
+    // File
+    
+    BinaryHeader header;
+    
+    memcpy(header.mMagic, binaryMagic, sizeof(binaryMagic));
+    header.mByteOrder = binaryByteOrder;
+    header.mVersion = binaryVersion;
+    header.mNumColumns = (uint32_t) numColumns();
+    header.mNumItems = numItems();
+    header.mNumSymbols = dataWriter.numSymbols();
+    header.mSymbolTableSize = dataWriter.symbols().size();
+    
+    fileWriter.write(&header, sizeof(BinaryHeader));
+    fileWriter.write(columnWriter.data().data(), columnWriter.data().size());
+    fileWriter.write(dataWriter.symbols().data(), dataWriter.symbols().size());
+    fileWriter.write(dataWriter.data().data(), dataWriter.data().size());
+    
+    t_filehandle file;
+    t_ptr_size size = fileWriter.data().size();
+    
+    if (path_createsysfile(filename, path, 'EMDB', &file))
+    {
+        object_error(x, "couldn't create file %s", filename);
+        return;
+    }
+    
+    if (sysfile_write(file, &size, fileWriter.data().data()) || size != fileWriter.data().size())
+        object_error(x, "error writing file %s", filename);
+    
+    sysfile_close(file);
+}
+
+// Returns false if the file is not a binary file (so that it can be loaded as a dictionary)
+// N.B. the file is checked fully before the database is changed
+
+bool EntryDatabase::loadBinary(t_object *x, const char *filename, short path)
+{
+    BinaryHeader header;
+    t_filehandle file;
+    t_ptr_size fileSize = 0;
+    t_ptr_size size = sizeof(BinaryHeader);
+    
+    if (path_opensysfile(filename, path, &file, READ_PERM))
+        return false;
+    
+    if (sysfile_read(file, &size, &header) || size != sizeof(BinaryHeader) || memcmp(header.mMagic, binaryMagic, sizeof(binaryMagic)))
+    {
+        sysfile_close(file);
+        return false;
+    }
+    
+    if (header.mByteOrder != binaryByteOrder || header.mVersion != binaryVersion)
+    {
+        object_error(x, "binary file %s has an unsupported version or byte order", filename);
+        sysfile_close(file);
+        return true;
+    }
+    
+    // Read the remainder of the file in one go
+    
+    sysfile_geteof(file, &fileSize);
+    size = fileSize > sizeof(BinaryHeader) ? fileSize - sizeof(BinaryHeader) : 0;
+    std::vector<char> data(size);
+    
+    bool error = sysfile_read(file, &size, data.data()) || size != data.size();
+    sysfile_close(file);
+    
+    // Metadata and symbols
+    
+    BinaryReader reader(data);
+    uint64_t numItems = header.mNumItems;
+    
+    const BinaryColumn *columns = (const BinaryColumn *) reader.read(header.mNumColumns * sizeof(BinaryColumn));
+    const char *symbolTable = (const char *) reader.read(header.mSymbolTableSize);
+    
+    std::vector<t_symbol *> symbols;
+    
+    error |= !reader.isValid() || numItems > data.size() / sizeof(UntypedAtom);
+    
+    if (!error)
+        symbols.reserve(std::min(header.mNumSymbols, header.mSymbolTableSize));
+    
+    for (uint64_t i = 0; !error && i < header.mSymbolTableSize && symbols.size() < header.mNumSymbols; )
+    {
+        const char *symbol = symbolTable + i;
+        const char *terminator = (const char *) memchr(symbol, 0, header.mSymbolTableSize - i);
+        
+        if (!terminator)
+            break;
+        
+        symbols.push_back(gensym(symbol));
+        i += (terminator - symbol) + 1;
+    }
+    
+    error |= symbols.size() != header.mNumSymbols;
+    
+    for (uint32_t i = 0; !error && i < header.mNumColumns; i++)
+        error |= columns[i].mName >= symbols.size();
+    
+    // Data
+    
+    std::vector<UntypedAtom> identifiers;
+    std::vector<CustomAtom::Type> identifierTypes;
+    std::vector<std::vector<UntypedAtom> > entries(error ? 0 : header.mNumColumns);
+    std::vector<std::vector<CustomAtom::Type> > types(error ? 0 : header.mNumColumns);
+    
+    error = error || !reader.readValues(identifiers, identifierTypes, numItems, symbols, BinaryReader::kIdentifier);
+    
+    const int64_t *order = error ? NULL : (const int64_t *) reader.read(numItems * sizeof(int64_t));
+    
+    for (uint32_t i = 0; !error && i < header.mNumColumns; i++)
+        error |= !reader.readValues(entries[i], types[i], numItems, symbols, columns[i].mLabel ? BinaryReader::kLabel : BinaryReader::kNumeric);
+    
+    // The order must be a permutation of the indices
+    
+    std::vector<bool> ordered(error ? 0 : numItems);
+    
+    error |= !reader.isValid();
+    
+    for (uint64_t i = 0; !error && i < numItems; i++)
+    {
+        error |= order[i] < 0 || order[i] >= (int64_t) numItems || ordered[order[i]];
+        
+        if (!error)
+            ordered[order[i]] = true;
+    }
+    
+    // The identifiers must be sorted under the order (symbols are ordered by address so the stored order may be stale) and unique
+    
+    std::vector<CustomAtom> identifierAtoms;
+    std::vector<long> sortedOrder;
+    
+    if (!error)
+    {
+        identifierAtoms.resize(numItems);
+        sortedOrder.assign(order, order + numItems);
+        
+        for (uint64_t i = 0; i < numItems; i++)
+            identifierAtoms[i] = CustomAtom(identifiers[i], identifierTypes[i]);
+        
+        IdentifierOrder identifierOrder(identifierAtoms);
+        
+        if (!std::is_sorted(sortedOrder.begin(), sortedOrder.end(), identifierOrder))
+            std::sort(sortedOrder.begin(), sortedOrder.end(), identifierOrder);
+    }
+    
+    for (uint64_t i = 1; !error && i < numItems; i++)
+        error |= compare(identifierAtoms[sortedOrder[i - 1]], identifierAtoms[sortedOrder[i]]) != CustomAtom::kLess;
+    
+    if (error)
+    {
+        object_error(x, "binary file %s is truncated or corrupt", filename);
+        return true;
+    }
+    
+    // Replace the database
+    
+    clear();
+    
+    if (header.mNumColumns != numColumns())
+    {
+        mColumns.clear();
+        resizeColumns(header.mNumColumns);
+    }
+    
+    for (uint32_t i = 0; i < header.mNumColumns; i++)
+    {
+        mColumns[i].mName = symbols[columns[i].mName];
+        mColumns[i].mLabel = columns[i].mLabel != 0;
+    }
+    
+    updateColumnNames();
+    
+    std::swap(mIdentifiers, identifierAtoms);
+    std::swap(mOrder, sortedOrder);
+    
+    std::swap(mEntries, entries);
+    std::swap(mTypes, types);
+    
+    return true;
+}
+
+// Shared database (left-right)
+
+void EntryDatabase::Shared::reserve(long items)
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).reserve(items);
+    publish(lock);
+    unpublished(lock).reserve(items);
+}
+
+void EntryDatabase::Shared::clear()
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).clear();
+    publish(lock);
+    unpublished(lock).clear();
+}
+
+void EntryDatabase::Shared::setColumnLabelModes(void *x, long argc, t_atom *argv)
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).setColumnLabelModes(x, argc, argv);
+    publish(lock);
+    unpublished(lock).setColumnLabelModes(NULL, argc, argv);
+}
+
+void EntryDatabase::Shared::setColumnNames(void *x, long argc, t_atom *argv)
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).setColumnNames(x, argc, argv);
+    publish(lock);
+    unpublished(lock).setColumnNames(NULL, argc, argv);
+}
+
+void EntryDatabase::Shared::addEntry(void *x, long argc, t_atom *argv)
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).addEntry(x, argc, argv);
+    publish(lock);
+    unpublished(lock).addEntry(NULL, argc, argv);
+}
+
+void EntryDatabase::Shared::addEntries(void *x, long argc, t_atom *argv)
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).addEntries(x, argc, argv);
+    publish(lock);
+    unpublished(lock).addEntries(NULL, argc, argv);
+}
+
+void EntryDatabase::Shared::removeEntries(void *x, long argc, t_atom *argv)
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).removeEntries(x, argc, argv);
+    publish(lock);
+    unpublished(lock).removeEntries(NULL, argc, argv);
+}
+
+// N.B. these changes are copied rather than repeated (loading may involve a file dialog and matchers report errors directly)
+
+void EntryDatabase::Shared::removeMatchedEntries(void *x, long argc, t_atom *argv)
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).removeMatchedEntries(x, argc, argv);
+    publish(lock);
+    synchronise(lock);
+}
+
+void EntryDatabase::Shared::load(t_object *x, t_symbol *fileSpecifier)
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).load(x, fileSpecifier);
+    publish(lock);
+    synchronise(lock);
+}
+
+void EntryDatabase::Shared::loadDictionary(t_object *x, t_dictionary *dict)
+{
+    HoldLock lock(&mWriteLock);
+    
+    unpublished(lock).loadDictionary(x, dict);
+    publish(lock);
+    synchronise(lock);
+}
+
+void EntryDatabase::Shared::publish(HoldLock& lock)
+{
+    // Direct new readers to the changed copy and then wait until no readers can be using the other copy
+    
+    long version = mVersion.load();
+    
+    mPublished.store(1 - mPublished.load());
+    
+    waitForReaders(1 - version);
+    mVersion.store(1 - version);
+    waitForReaders(version);
+}
+
+void EntryDatabase::Shared::synchronise(HoldLock& lock)
+{
+    unpublished(lock) = mDatabases[mPublished.load()];
+}
+
+void EntryDatabase::Shared::waitForReaders(long version) const
+{
+    while (mReaders[version].load())
+        std::this_thread::yield();
+}
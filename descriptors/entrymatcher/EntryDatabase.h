@@ -3,45 +3,30 @@
 #define ENTRYDATABASE_H
 
 #include "ext.h"
+#include <atomic>
+#include <unordered_map>
 #include <vector>
 
 #include "CustomAtom.h"
 
 class EntryDatabase
 {
-    struct ColumnInfo
+    struct Entry
     {
-        ColumnInfo() : mName(gensym("")), mLabel(false) {}
+        Entry(long argc, t_atom *argv) : mArgc(argc), mArgv(argv) {}
         
-        t_symbol *mName;
-        bool mLabel;
+        long mArgc;
+        t_atom *mArgv;
     };
     
-    struct Lock
+    struct ColumnInfo
     {
-        Lock() : mAtomicLock(0) {}
-        ~Lock() { acquire(); }
-        
-        void acquire() { while(!attempt()); }
-        bool attempt() { return ATOMIC_COMPARE_SWAP32(0, 1, &mAtomicLock); }
-        void release() { ATOMIC_COMPARE_SWAP32(1, 0, &mAtomicLock); }
-        
-    private:
+        ColumnInfo() : mName(gensym("")), mLabel(false) {}
         
-        t_int32_atomic mAtomicLock;
+        t_symbol *mName;
+        bool mLabel;
     };
     
-    struct HoldLock
-    {
-        HoldLock() : mLock(NULL) {}
-        HoldLock(Lock *lock) : mLock(lock)  { mLock->acquire(); }
-        ~HoldLock()                         { if (mLock) mLock->release(); }
-                
-    private:
-        
-        Lock *mLock;
-    };
-
 public:
     
     class RawAccessor
@@ -50,14 +35,14 @@ public:
         
     public:
         
-        inline UntypedAtom getData(long idx, long column) const                  { return mIterator[idx * mNumColumns + column]; }
+        inline UntypedAtom getData(long idx, long column) const                  { return mEntries[column][idx]; }
+        inline const UntypedAtom *getColumn(long column) const                   { return mEntries[column].data(); }
 
     protected:
         
-        RawAccessor(const EntryDatabase& database) : mNumColumns(database.numColumns()), mIterator(database.mEntries.begin()) {}
+        RawAccessor(const EntryDatabase& database) : mEntries(database.mEntries.data()) {}
         
-        const long mNumColumns;
-        const std::vector<UntypedAtom>::const_iterator mIterator;
+        const std::vector<UntypedAtom> *mEntries;
     };
     
     class AtomAccessor : private RawAccessor
@@ -66,49 +51,51 @@ public:
         
     public:
         
-        inline void getDataAtom(t_atom *a, long idx, long column) const       { CustomAtom(getData(idx, column), mTypes[idx * mNumColumns + column]).getAtom(a); }
+        inline void getDataAtom(t_atom *a, long idx, long column) const       { CustomAtom(getData(idx, column), mTypes[column][idx]).getAtom(a); }
         
     private:
         
-        AtomAccessor(const EntryDatabase& database) : RawAccessor(database), mTypes(database.mTypes.begin()) {}
+        AtomAccessor(const EntryDatabase& database) : RawAccessor(database), mTypes(database.mTypes.data()) {}
         
-        const std::vector<CustomAtom::Type>::const_iterator mTypes;
+        const std::vector<CustomAtom::Type> *mTypes;
     };
     
+    class Shared;
+    
+    // Readers never wait - each holds whichever copy of a shared database was current when the pointer was made
+    
     struct ReadPointer
     {
-        ReadPointer(const EntryDatabase *ptr) : mPtr(ptr)
-        {
-            HoldLock lock(&mPtr->mReadLock);
-            if (mPtr->mReadCount++ == 0)
-                mPtr->mWriteLock.acquire();
-        }
-        
-        ~ReadPointer()
-        {
-            if (--mPtr->mReadCount == 0)
-                mPtr->mWriteLock.release();
-        }
+        ReadPointer(const Shared *shared);
+        ReadPointer(const ReadPointer& pointer);
+        ~ReadPointer();
         
         const EntryDatabase *operator->() const { return mPtr; }
+        const EntryDatabase& operator*() const  { return *mPtr; }
+        
+        operator const EntryDatabase&() const   { return *mPtr; }
         
     private:
         
+        ReadPointer& operator=(const ReadPointer& pointer);
+        
+        const Shared *mShared;
         const EntryDatabase *mPtr;
+        long mVersion;
     };
     
     struct WritePointer
     {
-        WritePointer(EntryDatabase *ptr) : mPtr(ptr) {}
+        WritePointer(Shared *ptr) : mPtr(ptr) {}
         
-        EntryDatabase *operator->() const { return mPtr; }
+        Shared *operator->() const { return mPtr; }
         
     private:
         
-        EntryDatabase *mPtr;
+        Shared *mPtr;
     };
     
-    EntryDatabase(t_symbol *name, long numCols) : mName(name) { mColumns.resize(numCols); }
+    EntryDatabase(t_symbol *name, long numCols) : mName(name), mModifiedCount(0) { resizeColumns(numCols); }
     
     RawAccessor rawAccessor() const { return RawAccessor(*this); }
     AtomAccessor atomAccessor() const { return AtomAccessor(*this); }
@@ -119,12 +106,20 @@ public:
     size_t numItems() const         { return mIdentifiers.size(); }
     size_t numColumns() const       { return mColumns.size(); }
     
+    // Incremented whenever the entries change (so that derived data such as search trees can be rebuilt)
+    
+    unsigned long getModifiedCount() const  { return mModifiedCount; }
+    
     void setColumnLabelModes(void *x, long argc, t_atom *argv);
     void setColumnNames(void *x, long argc, t_atom *argv);
     void addEntry(void *x, long argc, t_atom *argv);
     void removeEntries(void *x, long argc, t_atom *argv);
     void removeMatchedEntries(void *x, long argc, t_atom *argv);
     
+    // Adds entries given as a list of rows (each with an identifier and a value for every column) - the order is updated once for all entries
+    
+    void addEntries(void *x, long argc, t_atom *argv);
+    
     t_symbol *getColumnName(long idx) const                   { return mColumns[idx].mName; }
     bool getColumnLabelMode(long idx) const                   { return mColumns[idx].mLabel; }
     void getEntryIdentifier(t_atom *a, long idx) const        { return getIdentifierInternal(idx).getAtom(a); }
@@ -144,6 +139,9 @@ public:
     double columnMedian(const t_atom *specifier) const;
     
     void view(t_object *database_object) const;
+    
+    // Files named with the binary extension (.emdb) are saved in a binary format rather than as JSON (the format is detected on loading)
+    
     void save(t_object *x, t_symbol *fileSpecifier) const;
     void load(t_object *x, t_symbol *fileSpecifier);
 
@@ -152,16 +150,20 @@ public:
 
 private:
 
-    inline UntypedAtom getData(long idx, long column) const                 { return mEntries[idx * numColumns() + column]; }
-    inline CustomAtom getTypedData(long idx, long column) const             { return CustomAtom(getData(idx, column), mTypes[idx * numColumns() + column]); }
+    inline UntypedAtom getData(long idx, long column) const                 { return mEntries[column][idx]; }
+    inline CustomAtom getTypedData(long idx, long column) const             { return CustomAtom(getData(idx, column), mTypes[column][idx]); }
     inline void getDataAtom(t_atom *a, long idx, long column) const         { return getTypedData(idx, column).getAtom(a); }
     
-    void clear(HoldLock &lock);
-    void setColumnLabelModes(HoldLock &lock, void *x, long argc, t_atom *argv);
-    void setColumnNames(HoldLock &lock, void *x, long argc, t_atom *argv);
-    void addEntry(HoldLock &lock, void *x, long argc, t_atom *argv);
-    void removeEntry(HoldLock &lock, void *x, t_atom *identifier);
-    void removeEntries(HoldLock &lock, const std::vector<long>& indices);
+    void saveBinary(t_object *x, const char *filename, short path) const;
+    bool loadBinary(t_object *x, const char *filename, short path);
+    
+    void resizeColumns(long numCols);
+    void updateColumnNames();
+    void resizeItems(long numItems);
+    void addEntries(void *x, const std::vector<Entry>& entries);
+    void setEntryData(void *x, long idx, long argc, t_atom *argv);
+    void removeEntry(void *x, t_atom *identifier);
+    void removeEntries(const std::vector<long>& indices);
     
     template <const double& func(const double&, const double&)>
     struct BinaryFunctor
@@ -185,28 +187,123 @@ private:
 
     long getOrder(long idx);
     long searchIdentifiers(const t_atom *identifierAtom, long& idx) const;
+    long searchIdentifiers(const CustomAtom& identifier, long& idx) const;
 
     CustomAtom getIdentifierInternal(long idx) const                    { return mIdentifiers[idx];}
     
     inline void setData(long idx, long column, const CustomAtom& data)
     {
-        mEntries[idx * numColumns() + column] = data.mData;
-        mTypes[idx * numColumns() + column] = data.mType;
+        mEntries[column][idx] = data.mData;
+        mTypes[column][idx] = data.mType;
     }
     
     // Data
     
     t_symbol *mName;
     std::vector<ColumnInfo> mColumns;
+    std::unordered_map<t_symbol *, long> mColumnNames;
     std::vector<CustomAtom> mIdentifiers;
     std::vector<long> mOrder;
-    std::vector<UntypedAtom> mEntries;
-    std::vector<CustomAtom::Type> mTypes;
+    
+    // Entries are stored by column, so that the values of each column are contiguous
+    
+    std::vector<std::vector<UntypedAtom> > mEntries;
+    std::vector<std::vector<CustomAtom::Type> > mTypes;
+    
+    unsigned long mModifiedCount;
+};
 
-    mutable Lock mWriteLock;
-    mutable Lock mReadLock;
-    mutable long mReadCount;
+// A database shared between threads, which is kept as two copies (left-right concurrency control)
+// Readers use the copy that is currently published, whilst writers change the other copy, publish it and then repeat the change on the first copy
+// N.B. writers wait for any readers of the copy they are about to change (and for each other) but readers never wait
+
+class EntryDatabase::Shared
+{
+    friend EntryDatabase::ReadPointer;
+    
+    struct Lock
+    {
+        Lock() : mAtomicLock(0) {}
+        ~Lock() { acquire(); }
+        
+        void acquire() { while(!attempt()); }
+        bool attempt() { return ATOMIC_COMPARE_SWAP32(0, 1, &mAtomicLock); }
+        void release() { ATOMIC_COMPARE_SWAP32(1, 0, &mAtomicLock); }
+        
+    private:
+        
+        t_int32_atomic mAtomicLock;
+    };
+    
+    struct HoldLock
+    {
+        HoldLock(Lock *lock) : mLock(lock)  { mLock->acquire(); }
+        ~HoldLock()                         { mLock->release(); }
+        
+    private:
+        
+        Lock *mLock;
+    };
+    
+public:
+    
+    Shared(t_symbol *name, long numCols) : mDatabases{ EntryDatabase(name, numCols), EntryDatabase(name, numCols) }, mPublished(0), mVersion(0)
+    {
+        mReaders[0] = 0;
+        mReaders[1] = 0;
+    }
+    
+    void reserve(long items);
+    void clear();
+    
+    void setColumnLabelModes(void *x, long argc, t_atom *argv);
+    void setColumnNames(void *x, long argc, t_atom *argv);
+    void addEntry(void *x, long argc, t_atom *argv);
+    void addEntries(void *x, long argc, t_atom *argv);
+    void removeEntries(void *x, long argc, t_atom *argv);
+    void removeMatchedEntries(void *x, long argc, t_atom *argv);
+    
+    void load(t_object *x, t_symbol *fileSpecifier);
+    void loadDictionary(t_object *x, t_dictionary *dict);
+    
+private:
+    
+    // The copy not currently available to new readers
+    
+    EntryDatabase& unpublished(HoldLock& lock) { return mDatabases[1 - mPublished.load()]; }
+    
+    void publish(HoldLock& lock);
+    void synchronise(HoldLock& lock);
+    void waitForReaders(long version) const;
+    
+    // Data
+    
+    EntryDatabase mDatabases[2];
+    
+    std::atomic<long> mPublished;
+    std::atomic<long> mVersion;
+    mutable std::atomic<long> mReaders[2];
+    
+    Lock mWriteLock;
 };
 
+// Readers register against the current version before reading which copy is published, so that a writer can wait until a copy is no longer in use
+
+inline EntryDatabase::ReadPointer::ReadPointer(const Shared *shared) : mShared(shared), mVersion(shared->mVersion.load())
+{
+    mShared->mReaders[mVersion]++;
+    mPtr = mShared->mDatabases + mShared->mPublished.load();
+}
+
+inline EntryDatabase::ReadPointer::ReadPointer(const ReadPointer& pointer) : mShared(pointer.mShared), mPtr(pointer.mPtr), mVersion(pointer.mVersion)
+{
+    mShared->mReaders[mVersion]++;
+}
+
+inline EntryDatabase::ReadPointer::~ReadPointer()
+{
+    mShared->mReaders[mVersion]--;
+}
+
 
 #endif
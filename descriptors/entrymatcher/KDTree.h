@@ -0,0 +1,369 @@
+
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "EntryDatabase.h"
+
+// A k-d tree over a set of numeric columns of an EntryDatabase for nearest neighbour and range (within) queries
+// N.B. distances are calculated exactly as for a linear scan (so the results are the same) - the tree is only used to avoid visiting entries
+
+class KDTree
+{
+    static const long kLeafSize = 16;
+    static const long kMinQueries = 4;
+    
+    struct Node
+    {
+        Node(long start, long end) : mStart(start), mEnd(end), mLeft(-1), mRight(-1) {}
+        
+        long mStart;
+        long mEnd;
+        long mLeft;
+        long mRight;
+    };
+    
+    struct Compare
+    {
+        Compare(const std::vector<double>& values, long numDimensions, long dimension) : mValues(values), mNumDimensions(numDimensions), mDimension(dimension) {}
+        
+        bool operator()(const long a, const long b) const { return mValues[a * mNumDimensions + mDimension] < mValues[b * mNumDimensions + mDimension]; }
+        
+        const std::vector<double>& mValues;
+        long mNumDimensions;
+        long mDimension;
+    };
+    
+public:
+    
+    struct Dimension
+    {
+        Dimension(long column, double scale, double target, bool reject) : mColumn(column), mScale(scale), mTarget(target), mReject(reject) {}
+        
+        long mColumn;
+        double mScale;
+        double mTarget;
+        bool mReject;
+    };
+    
+    struct Neighbour
+    {
+        Neighbour() {}
+        Neighbour(long index, double distance) : mIndex(index), mDistance(distance) {}
+        
+        friend bool operator < (const Neighbour& a, const Neighbour& b) { return a.mDistance < b.mDistance || (a.mDistance == b.mDistance && a.mIndex < b.mIndex); }
+        
+        long mIndex;
+        double mDistance;
+    };
+    
+    KDTree() : mDatabase(NULL), mModifiedCount(0), mNumQueries(0), mBuilt(false) {}
+    
+    // Returns true if the tree can be used for the database and columns / scales given
+    // N.B. the tree is only (re)built once it has been requested kMinQueries times with no changes, so that frequent modification doesn't cause repeated rebuilding
+    // If building is not allowed (on the audio thread) the tree is only used when it has already been built for the database and columns / scales
+    
+    bool update(const EntryDatabase& database, const std::vector<Dimension>& dimensions, bool allowBuild = true)
+    {
+        if (!allowBuild)
+            return mBuilt && current(database, dimensions);
+        
+        if (!current(database, dimensions))
+            reset(database, dimensions);
+        
+        if (!mBuilt && ++mNumQueries >= kMinQueries)
+            build(database);
+        
+        return mBuilt;
+    }
+    
+    // Build the tree immediately (if it is not already built for the database and columns / scales given)
+    
+    void prepare(const EntryDatabase& database, const std::vector<Dimension>& dimensions)
+    {
+        if (!current(database, dimensions))
+            reset(database, dimensions);
+        
+        if (!mBuilt)
+            build(database);
+    }
+    
+    // Find the closest maxNeighbours entries within the reject limits (or all entries within the limits if maxNeighbours is zero)
+    // Neighbours are returned in order of distance (or in order of index when all entries are requested)
+    
+    long search(std::vector<Neighbour>& neighbours, const std::vector<Dimension>& dimensions, long maxNeighbours) const
+    {
+        neighbours.clear();
+        
+        if (mNodes.size())
+            searchNode(0, neighbours, dimensions, maxNeighbours);
+        
+        if (maxNeighbours)
+            std::sort_heap(neighbours.begin(), neighbours.end());
+        else
+            sortByIndex(neighbours);
+        
+        return neighbours.size();
+    }
+    
+    static void sortByIndex(std::vector<Neighbour>& neighbours)
+    {
+        std::sort(neighbours.begin(), neighbours.end(), indexOrder);
+    }
+    
+private:
+    
+    static bool indexOrder(const Neighbour& a, const Neighbour& b) { return a.mIndex < b.mIndex; }
+    
+    bool current(const EntryDatabase& database, const std::vector<Dimension>& dimensions) const
+    {
+        return &database == mDatabase && database.getModifiedCount() == mModifiedCount && sameColumns(dimensions);
+    }
+    
+    void reset(const EntryDatabase& database, const std::vector<Dimension>& dimensions)
+    {
+        mDatabase = &database;
+        mModifiedCount = database.getModifiedCount();
+        mDimensions = dimensions;
+        mNumQueries = 0;
+        mBuilt = false;
+    }
+    
+    bool sameColumns(const std::vector<Dimension>& dimensions) const
+    {
+        if (dimensions.size() != mDimensions.size())
+            return false;
+        
+        for (long i = 0; i < dimensions.size(); i++)
+            if (dimensions[i].mColumn != mDimensions[i].mColumn || dimensions[i].mScale != mDimensions[i].mScale)
+                return false;
+        
+        return true;
+    }
+    
+    void build(const EntryDatabase& database)
+    {
+        const EntryDatabase::RawAccessor accessor = database.rawAccessor();
+        long numItems = database.numItems();
+        long numDimensions = mDimensions.size();
+        
+        // Copy the values (in database order) and build the tree over a permutation of the indices
+        
+        std::vector<double> values(numItems * numDimensions);
+        
+        for (long j = 0; j < numDimensions; j++)
+        {
+            const UntypedAtom *column = accessor.getColumn(mDimensions[j].mColumn);
+            
+            for (long i = 0; i < numItems; i++)
+                values[i * numDimensions + j] = column[i].mValue;
+        }
+        
+        mIndices.resize(numItems);
+        mNodes.clear();
+        mBounds.clear();
+        
+        for (long i = 0; i < numItems; i++)
+            mIndices[i] = i;
+        
+        if (numItems)
+            buildNode(values, 0, numItems);
+        
+        // Store the values in tree order so that each leaf is contiguous
+        
+        mPoints.resize(numItems * numDimensions);
+        
+        for (long i = 0; i < numItems; i++)
+            for (long j = 0; j < numDimensions; j++)
+                mPoints[i * numDimensions + j] = values[mIndices[i] * numDimensions + j];
+        
+        mBuilt = true;
+    }
+    
+    long buildNode(const std::vector<double>& values, long start, long end)
+    {
+        long numDimensions = mDimensions.size();
+        long node = mNodes.size();
+        long splitDimension = -1;
+        double maxSpread = 0.0;
+        
+        mNodes.push_back(Node(start, end));
+        mBounds.resize(mBounds.size() + numDimensions * 2);
+        
+        // Calculate the bounds (min / max) of the node and choose the dimension with the largest scaled spread to split
+        
+        double *bounds = &mBounds[node * numDimensions * 2];
+        
+        for (long j = 0; j < numDimensions; j++)
+        {
+            bounds[j * 2] = HUGE_VAL;
+            bounds[j * 2 + 1] = -HUGE_VAL;
+        }
+        
+        for (long i = start; i < end; i++)
+        {
+            for (long j = 0; j < numDimensions; j++)
+            {
+                double value = values[mIndices[i] * numDimensions + j];
+                bounds[j * 2] = std::min(bounds[j * 2], value);
+                bounds[j * 2 + 1] = std::max(bounds[j * 2 + 1], value);
+            }
+        }
+        
+        for (long j = 0; j < numDimensions; j++)
+        {
+            double spread = (bounds[j * 2 + 1] - bounds[j * 2]) * mDimensions[j].mScale;
+            
+            if (spread > maxSpread)
+            {
+                maxSpread = spread;
+                splitDimension = j;
+            }
+        }
+        
+        if (end - start <= kLeafSize || splitDimension < 0)
+            return node;
+        
+        long mid = (start + end) / 2;
+        
+        std::nth_element(mIndices.begin() + start, mIndices.begin() + mid, mIndices.begin() + end, Compare(values, numDimensions, splitDimension));
+        
+        long left = buildNode(values, start, mid);
+        long right = buildNode(values, mid, end);
+        
+        mNodes[node].mLeft = left;
+        mNodes[node].mRight = right;
+        
+        return node;
+    }
+    
+    // Calculate the smallest distance possible for any entry in a node (returns false if no entry can be within the reject limits)
+    // N.B. each term is calculated as for the entries themselves, so the bound can never be more than the distance of an entry
+    
+    bool nodeDistance(long node, const std::vector<Dimension>& dimensions, double& distanceSquared) const
+    {
+        const double *bounds = &mBounds[node * dimensions.size() * 2];
+        
+        distanceSquared = 0.0;
+        
+        for (long j = 0; j < dimensions.size(); j++)
+        {
+            double target = dimensions[j].mTarget;
+            double distance = 0.0;
+            
+            if (target < bounds[j * 2])
+                distance = (target - bounds[j * 2]) * dimensions[j].mScale;
+            else if (target > bounds[j * 2 + 1])
+                distance = (target - bounds[j * 2 + 1]) * dimensions[j].mScale;
+            
+            distance *= distance;
+            distance = distance < HUGE_VAL ? distance : HUGE_VAL;
+            
+            if (dimensions[j].mReject && !(distance <= 1.0))
+                return false;
+            
+            distanceSquared += distance;
+        }
+        
+        return true;
+    }
+    
+    void searchNode(long node, std::vector<Neighbour>& neighbours, const std::vector<Dimension>& dimensions, long maxNeighbours) const
+    {
+        const Node& current = mNodes[node];
+        
+        if (current.mLeft < 0)
+        {
+            long numDimensions = dimensions.size();
+            
+            for (long i = current.mStart; i < current.mEnd; i++)
+            {
+                const double *point = &mPoints[i * numDimensions];
+                double distanceSquared = 0.0;
+                bool matched = true;
+                
+                for (long j = 0; j < numDimensions; j++)
+                {
+                    double distance = (dimensions[j].mTarget - point[j]) * dimensions[j].mScale;
+                    distance *= distance;
+                    distance = distance < HUGE_VAL ? distance : HUGE_VAL;
+                    
+                    if (dimensions[j].mReject && !(distance <= 1.0))
+                    {
+                        matched = false;
+                        break;
+                    }
+                    
+                    distanceSquared += distance;
+                }
+                
+                if (matched)
+                    addNeighbour(neighbours, Neighbour(mIndices[i], distanceSquared), maxNeighbours);
+            }
+            
+            return;
+        }
+        
+        // Visit the closer child first and skip any child that cannot contain a closer neighbour
+        
+        long first = current.mLeft;
+        long second = current.mRight;
+        double firstDistance, secondDistance;
+        bool firstValid = nodeDistance(first, dimensions, firstDistance);
+        bool secondValid = nodeDistance(second, dimensions, secondDistance);
+        
+        if (secondValid && (!firstValid || secondDistance < firstDistance))
+        {
+            std::swap(first, second);
+            std::swap(firstDistance, secondDistance);
+            std::swap(firstValid, secondValid);
+        }
+        
+        if (firstValid && !prune(neighbours, firstDistance, maxNeighbours))
+            searchNode(first, neighbours, dimensions, maxNeighbours);
+        if (secondValid && !prune(neighbours, secondDistance, maxNeighbours))
+            searchNode(second, neighbours, dimensions, maxNeighbours);
+    }
+    
+    bool prune(const std::vector<Neighbour>& neighbours, double distance, long maxNeighbours) const
+    {
+        return maxNeighbours && neighbours.size() == maxNeighbours && distance > neighbours.front().mDistance;
+    }
+    
+    void addNeighbour(std::vector<Neighbour>& neighbours, const Neighbour& neighbour, long maxNeighbours) const
+    {
+        // With no limit keep everything - otherwise keep a max heap of the closest neighbours
+        
+        if (!maxNeighbours)
+            neighbours.push_back(neighbour);
+        else if (neighbours.size() < maxNeighbours)
+        {
+            neighbours.push_back(neighbour);
+            std::push_heap(neighbours.begin(), neighbours.end());
+        }
+        else if (neighbour < neighbours.front())
+        {
+            std::pop_heap(neighbours.begin(), neighbours.end());
+            neighbours.back() = neighbour;
+            std::push_heap(neighbours.begin(), neighbours.end());
+        }
+    }
+    
+    // Data
+    
+    const EntryDatabase *mDatabase;
+    unsigned long mModifiedCount;
+    long mNumQueries;
+    bool mBuilt;
+    
+    std::vector<Dimension> mDimensions;
+    std::vector<Node> mNodes;
+    std::vector<double> mBounds;
+    std::vector<double> mPoints;
+    std::vector<long> mIndices;
+};
+
+#endif
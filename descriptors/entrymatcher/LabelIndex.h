@@ -0,0 +1,130 @@
+
+#ifndef LABELINDEX_H
+#define LABELINDEX_H
+
+#include <vector>
+#include <unordered_map>
+
+#include "EntryDatabase.h"
+
+// An inverted index of a label column of an EntryDatabase for label matching
+// Each distinct label is given a dense integer id, and the entries with each id are stored contiguously (in index order)
+
+class LabelIndex
+{
+    static const long kMinQueries = 4;
+    
+public:
+    
+    LabelIndex() : mDatabase(NULL), mModifiedCount(0), mColumn(-1), mNumQueries(0), mBuilt(false) {}
+    
+    // Returns true if the index can be used for the database and column given
+    // N.B. as for the k-d tree the index is only (re)built once it has been requested kMinQueries times with no changes (and never if building is not allowed)
+    
+    bool update(const EntryDatabase& database, long column, bool allowBuild = true)
+    {
+        if (!allowBuild)
+            return mBuilt && current(database, column);
+        
+        if (!current(database, column))
+            reset(database, column);
+        
+        if (!mBuilt && ++mNumQueries >= kMinQueries)
+            build(database);
+        
+        return mBuilt;
+    }
+    
+    // Build the index immediately (if it is not already built for the database and column given)
+    
+    void prepare(const EntryDatabase& database, long column)
+    {
+        if (!current(database, column))
+            reset(database, column);
+        
+        if (!mBuilt)
+            build(database);
+    }
+    
+    // The number of entries with a given label (and a pointer to their indices)
+    
+    long getEntries(t_symbol *label, const long*& entries) const
+    {
+        std::unordered_map<t_symbol *, long>::const_iterator it = mIDs.find(label);
+        
+        if (it == mIDs.end())
+            return 0;
+        
+        entries = mEntries.data() + mOffsets[it->second];
+        
+        return mOffsets[it->second + 1] - mOffsets[it->second];
+    }
+    
+private:
+    
+    bool current(const EntryDatabase& database, long column) const
+    {
+        return &database == mDatabase && database.getModifiedCount() == mModifiedCount && column == mColumn;
+    }
+    
+    void reset(const EntryDatabase& database, long column)
+    {
+        mDatabase = &database;
+        mModifiedCount = database.getModifiedCount();
+        mColumn = column;
+        mNumQueries = 0;
+        mBuilt = false;
+    }
+    
+    void build(const EntryDatabase& database)
+    {
+        const UntypedAtom *column = database.rawAccessor().getColumn(mColumn);
+        long numItems = database.numItems();
+        
+        // Give each label an id (in order of first appearance) and count the entries with each id
+        
+        std::vector<long> ids(numItems);
+        
+        mIDs.clear();
+        mOffsets.assign(1, 0);
+        
+        for (long i = 0; i < numItems; i++)
+        {
+            std::pair<std::unordered_map<t_symbol *, long>::iterator, bool> added = mIDs.insert(std::make_pair(column[i].mSymbol, (long) mIDs.size()));
+            
+            if (added.second)
+                mOffsets.push_back(0);
+            
+            ids[i] = added.first->second;
+            mOffsets[ids[i] + 1]++;
+        }
+        
+        // Then place the entries for each id contiguously (a counting sort, so that each list remains in index order)
+        
+        for (long i = 1; i < mOffsets.size(); i++)
+            mOffsets[i] += mOffsets[i - 1];
+        
+        std::vector<long> positions(mOffsets.begin(), mOffsets.end() - 1);
+        
+        mEntries.resize(numItems);
+        
+        for (long i = 0; i < numItems; i++)
+            mEntries[positions[ids[i]]++] = i;
+        
+        mBuilt = true;
+    }
+    
+    // Data
+    
+    const EntryDatabase *mDatabase;
+    unsigned long mModifiedCount;
+    long mColumn;
+    long mNumQueries;
+    bool mBuilt;
+    
+    std::unordered_map<t_symbol *, long> mIDs;
+    std::vector<long> mOffsets;
+    std::vector<long> mEntries;
+};
+
+#endif
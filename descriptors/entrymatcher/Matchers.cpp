@@ -1,23 +1,45 @@
 
 #include "Matchers.h"
-#include "Sort.h"
 #include <algorithm>
+#include <cmath>
 #include <functional>
+#include <system_error>
+#include <thread>
 
+struct Distance { double operator()(double a, double b, double scale) { return (a - b) * scale; } };
+struct Ratio { double operator()(double a, double b, double scale) { return ((((a > b) ? a : b) / ((a > b) ? b : a)) - 1.0) * scale; }};
 
-long Matchers::match(const EntryDatabase::ReadPointer database, double ratioMatched, long maxMatches, bool sortOnlyIfLimited) const
+long Matchers::match(const EntryDatabase& database, double ratioMatched, long maxMatches, bool sortOnlyIfLimited, bool realtime) const
 {
-    struct Distance { double operator()(double a, double b, double scale) { return (a - b) * scale; } };
-    struct Ratio { double operator()(double a, double b, double scale) { return (((a > b) ? a / b : b / a) - 1.0) * scale; }};
+    long numItems = database.numItems();
+    
+    // In realtime the results must fit in the memory reserved by prepare() (otherwise the previous results are kept)
+    
+    if (realtime && mResults.capacity() < numItems)
+        return mNumMatches;
     
-    long numItems = database->numItems();
     mNumMatches = 0;
+    mRealtime = realtime;
     
     mResults.resize(numItems);
     
-    const EntryDatabase::RawAccessor accessor = database->rawAccessor();
+    if (size() && matchIndexed(database, maxMatches, sortOnlyIfLimited))
+        return mNumMatches;
+    
+    const EntryDatabase::RawAccessor accessor = database.rawAccessor();
+    
+    // Only entries with the labels requested are tested when the label index is selective enough
+    
+    bool labelled = size() && !mIncremental && matchLabels(database);
     
-    if (!size() || mAudioStyle)
+    if (labelled && mAudioStyle)
+    {
+        for (long i = 0; i < mCandidates.size(); i++)
+            mResults[i] = Result(mCandidates[i], 0.0);
+        
+        mNumMatches = mCandidates.size();
+    }
+    else if (!size() || mAudioStyle)
     {
         for (long i = 0; i < numItems; i++)
             mResults[i] = Result(i, 0.0);
@@ -38,7 +60,7 @@ long Matchers::match(const EntryDatabase::ReadPointer database, double ratioMatc
             switch (it->mType)
             {
                 case kTestMatch:
-                    if (database->getColumnLabelMode(it->mColumn))
+                    if (database.getColumnLabelMode(it->mColumn))
                         mNumMatches = it->comparisonTest<t_symbol *>(mResults, mNumMatches, accessor, std::equal_to<t_symbol *>());
                     else
                         mNumMatches = it->comparisonTest<double>(mResults, mNumMatches, accessor, std::equal_to<double>());
@@ -55,66 +77,451 @@ long Matchers::match(const EntryDatabase::ReadPointer database, double ratioMatc
             }
         }
     }
+    else if (labelled)
+        mNumMatches = matchCandidates(database);
+    else if (mIncremental && (!mRealtime || cacheReserved(numItems)))
+        mNumMatches = matchIncremental(database);
+    else if (mParallelThreshold && numItems >= mParallelThreshold && !mRealtime)
+        return matchParallel(database, maxMatches, sortOnlyIfLimited);
     else
+        mNumMatches = matchRange(database, 0, numItems);
+    
+    ratioMatched = std::min(std::max(ratioMatched, 0.0), 1.0);
+    maxMatches = std::max(maxMatches, 0L);
+    long numMatches = round(mNumMatches * ratioMatched);
+    numMatches = (maxMatches && mNumMatches > maxMatches) ? maxMatches : mNumMatches;
+
+    if (numMatches != mNumMatches && !sortOnlyIfLimited)
+        numMatches = sortTopN(0, numMatches, mNumMatches);
+    
+    return mNumMatches = numMatches;
+}
+
+void Matchers::testBlock(const EntryDatabase& database, const Matcher& matcher, unsigned char *matched, double *distances, double *temp, const UntypedAtom *data, long size) const
+{
+    switch (matcher.mType)
     {
-        for (long i = 0; i < numItems; i++)
-        {
-            // Assume a match for each entry (for the case of no matchers)
+        case kTestMatch:
+            if (database.getColumnLabelMode(matcher.mColumn))
+                matcher.comparisonBlock<t_symbol *>(matched, data, size, std::equal_to<t_symbol *>());
+            else
+                matcher.comparisonBlock<double>(matched, data, size, std::equal_to<double>());
+            break;
             
-            bool matched = true;
-            double distanceSquared = 0.0;
+        case kTestLess:             matcher.comparisonBlock<double>(matched, data, size, std::less<double>()); break;
+        case kTestGreater:          matcher.comparisonBlock<double>(matched, data, size, std::greater<double>()); break;
+        case kTestLessEqual:        matcher.comparisonBlock<double>(matched, data, size, std::less_equal<double>()); break;
+        case kTestGreaterEqual:     matcher.comparisonBlock<double>(matched, data, size, std::greater_equal<double>()); break;
+        case kTestDistance:         matcher.distanceBlock(false, matched, distances, temp, data, size, Distance()); break;
+        case kTestDistanceReject:   matcher.distanceBlock(true, matched, distances, temp, data, size, Distance()); break;
+        case kTestRatio:            matcher.distanceBlock(false, matched, distances, temp, data, size, Ratio()); break;
+        case kTestRatioReject:      matcher.distanceBlock(true, matched, distances, temp, data, size, Ratio()); break;
+    }
+}
+
+long Matchers::matchRange(const EntryDatabase& database, long start, long end) const
+{
+    // Test the entries from start to end (the matches are stored in order from the start position of the results)
+    
+    const EntryDatabase::RawAccessor accessor = database.rawAccessor();
+    
+    unsigned char matched[kBlockSize];
+    double distances[kBlockSize];
+    double temp[kBlockSize];
+    long numMatches = 0;
+    
+    for (long i = start; i < end; i += kBlockSize)
+    {
+        long blockSize = (end - i) < kBlockSize ? end - i : kBlockSize;
+        
+        // Assume a match for each entry and then test one matcher at a time on the contiguous column data
+        
+        std::fill_n(matched, blockSize, 1);
+        std::fill_n(distances, blockSize, 0.0);
+        
+        for (std::vector<Matcher>::const_iterator it = mMatchers.begin(); it != mMatchers.end(); it++)
+        {
+            testBlock(database, *it, matched, distances, temp, accessor.getColumn(it->mColumn) + i, blockSize);
             
-            for (std::vector<Matcher>::const_iterator it = mMatchers.begin(); it != mMatchers.end(); it++)
-            {
-                switch (it->mType)
-                {
-                    case kTestMatch:
-                        if (database->getColumnLabelMode(it->mColumn))
-                            matched = it->comparisonTest(accessor.getData(i, it->mColumn), std::equal_to<t_symbol *>());
-                        else
-                            matched = it->comparisonTest(accessor.getData(i, it->mColumn), std::equal_to<double>());
-                        break;
-                        
-                    case kTestLess:             matched = it->comparisonTest(accessor.getData(i, it->mColumn), std::less<double>()); break;
-                    case kTestGreater:          matched = it->comparisonTest(accessor.getData(i, it->mColumn), std::greater<double>()); break;
-                    case kTestLessEqual:        matched = it->comparisonTest(accessor.getData(i, it->mColumn), std::less_equal<double>()); break;
-                    case kTestGreaterEqual:     matched = it->comparisonTest(accessor.getData(i, it->mColumn), std::greater_equal<double>()); break;
-                    case kTestDistance:         matched = it->distanceTest(false, accessor.getData(i, it->mColumn), distanceSquared, Distance()); break;
-                    case kTestDistanceReject:   matched = it->distanceTest(true, accessor.getData(i, it->mColumn), distanceSquared, Distance()); break;
-                    case kTestRatio:            matched = it->distanceTest(false, accessor.getData(i, it->mColumn), distanceSquared, Ratio()); break;
-                    case kTestRatioReject:      matched = it->distanceTest(true, accessor.getData(i, it->mColumn), distanceSquared, Ratio()); break;
-                }
+            if (std::find(matched, matched + blockSize, 1) == matched + blockSize)
+                break;
+        }
+        
+        // Store the entries that are valid matches (without branching - an entry is overwritten if it doesn't match)
+        
+        for (long j = 0; j < blockSize; j++)
+        {
+            mResults[start + numMatches] = Result(i + j, distances[j]);
+            numMatches += matched[j];
+        }
+    }
+    
+    return numMatches;
+}
 
-                if (!matched)
-                    break;
-            }
+long Matchers::matchCandidates(const EntryDatabase& database) const
+{
+    // Test only the candidate entries (gathering their values for each matcher so that the block tests can be used)
+    
+    const EntryDatabase::RawAccessor accessor = database.rawAccessor();
+    long numCandidates = mCandidates.size();
+    long numMatches = 0;
+    
+    UntypedAtom data[kBlockSize];
+    unsigned char matched[kBlockSize];
+    double distances[kBlockSize];
+    double temp[kBlockSize];
+    
+    for (long i = 0; i < numCandidates; i += kBlockSize)
+    {
+        long blockSize = (numCandidates - i) < kBlockSize ? numCandidates - i : kBlockSize;
+        const long *indices = mCandidates.data() + i;
+        
+        std::fill_n(matched, blockSize, 1);
+        std::fill_n(distances, blockSize, 0.0);
+        
+        // Every candidate passes the indexed matchers
+        
+        for (long j = 0; j < size(); j++)
+        {
+            if (mIndexed[j])
+                continue;
+            
+            const UntypedAtom *column = accessor.getColumn(mMatchers[j].mColumn);
             
-            // Store the entry if it is a valid match
+            for (long k = 0; k < blockSize; k++)
+                data[k] = column[indices[k]];
             
-            if (matched)
-                mResults[mNumMatches++] = Result(i, distanceSquared);
+            testBlock(database, mMatchers[j], matched, distances, temp, data, blockSize);
+            
+            if (std::find(matched, matched + blockSize, 1) == matched + blockSize)
+                break;
+        }
+        
+        for (long j = 0; j < blockSize; j++)
+        {
+            mResults[numMatches] = Result(indices[j], distances[j]);
+            numMatches += matched[j];
         }
     }
     
-    ratioMatched = std::min(std::max(ratioMatched, 0.0), 1.0);
-    maxMatches = std::max(maxMatches, 0L);
-    long numMatches = round(mNumMatches * ratioMatched);
-    numMatches = (maxMatches && mNumMatches > maxMatches) ? maxMatches : mNumMatches;
+    return numMatches;
+}
 
-    // FIX - better heuristics and more info on what has been sorted...
+bool Matchers::matchLabels(const EntryDatabase& database) const
+{
+    long numItems = database.numItems();
+    bool found = false;
     
-    if (numMatches != mNumMatches && !sortOnlyIfLimited)
+    if (numItems < kIndexMinItems)
+        return false;
+    
+    // In realtime the indices are only used once prepare() has built them (and the entry lists must fit in the memory it reserves)
+    
+    if (mRealtime && (mLabelIndices.size() != size() || mIndexed.capacity() < size() || mCandidates.capacity() < numItems || mLabelEntries.capacity() < numItems || mIntersection.capacity() < numItems))
+        return false;
+    
+    mLabelIndices.resize(size());
+    mIndexed.assign(size(), 0);
+    
+    for (long i = 0; i < size(); i++)
     {
-        if (numMatches < (database->numItems() / 8))
-            numMatches = sortTopN(numMatches, mNumMatches);
+        const Matcher& matcher = mMatchers[i];
+        const std::vector<CustomAtom>& values = matcher.mValues;
+        const long *entries = NULL;
+        long numEntries = 0;
+        
+        if (!labelIndexable(database, matcher) || !mLabelIndices[i].update(database, matcher.mColumn, !mRealtime))
+            continue;
+        
+        // Labels that are too common are tested as normal (the index is only quicker than testing every entry for rarer labels)
+        
+        for (std::vector<CustomAtom>::const_iterator it = values.begin(); it != values.end(); it++)
+            numEntries += mLabelIndices[i].getEntries(it->mData.mSymbol, entries);
+        
+        if (numEntries * kLabelMaxRatio > numItems)
+            continue;
+        
+        // Gather the entries with any of the labels (in index order)
+        
+        mLabelEntries.clear();
+        
+        for (std::vector<CustomAtom>::const_iterator it = values.begin(); it != values.end(); it++)
+        {
+            long size = mLabelIndices[i].getEntries(it->mData.mSymbol, entries);
+            
+            // Merge into the spare list (std::inplace_merge would allocate a temporary buffer)
+            
+            mIntersection.resize(mLabelEntries.size() + size);
+            std::merge(mLabelEntries.begin(), mLabelEntries.end(), entries, entries + size, mIntersection.begin());
+            std::swap(mLabelEntries, mIntersection);
+        }
+        
+        mLabelEntries.erase(std::unique(mLabelEntries.begin(), mLabelEntries.end()), mLabelEntries.end());
+        
+        // Keep only entries that also have the labels of any other indexed matchers
+        
+        if (found)
+        {
+            mIntersection.resize(std::min(mCandidates.size(), mLabelEntries.size()));
+            mIntersection.erase(std::set_intersection(mCandidates.begin(), mCandidates.end(), mLabelEntries.begin(), mLabelEntries.end(), mIntersection.begin()), mIntersection.end());
+            std::swap(mCandidates, mIntersection);
+        }
         else
-            sort(mResults, mNumMatches);
+            std::swap(mCandidates, mLabelEntries);
+        
+        mIndexed[i] = 1;
+        found = true;
+    }
+    
+    return found;
+}
+
+bool Matchers::labelIndexable(const EntryDatabase& database, const Matcher& matcher) const
+{
+    // Only match tests on label columns with symbol targets can use a label index
+    
+    bool labels = matcher.mType == kTestMatch && database.getColumnLabelMode(matcher.mColumn);
+    
+    for (std::vector<CustomAtom>::const_iterator it = matcher.mValues.begin(); labels && it != matcher.mValues.end(); it++)
+        labels = it->mType == CustomAtom::kSymbol;
+    
+    return labels;
+}
+
+long Matchers::matchIncremental(const EntryDatabase& database) const
+{
+    const EntryDatabase::RawAccessor accessor = database.rawAccessor();
+    long numItems = database.numItems();
+    long numMatches = 0;
+    
+    unsigned char matched[kBlockSize];
+    double distances[kBlockSize];
+    double temp[kBlockSize];
+    
+    if (&database != mCacheDatabase || database.getModifiedCount() != mCacheModifiedCount || mCache.size() != size())
+    {
+        // Invalidate the cached results (keeping their memory so that realtime matching never allocates)
+        
+        for (std::vector<CachedMatcher>::iterator it = mCache.begin(); it != mCache.end(); it++)
+            it->mValid = false;
+        
+        mCache.resize(size());
+        mNumRejections.assign(numItems, 0);
+        mCacheDatabase = &database;
+        mCacheModifiedCount = database.getModifiedCount();
+    }
+    
+    // Retest only matchers with changed targets (keeping a count of the matchers that reject each entry)
+    
+    for (long i = 0; i < size(); i++)
+    {
+        const Matcher& matcher = mMatchers[i];
+        CachedMatcher& cache = mCache[i];
+        bool distanceTest = matcher.mType >= kTestDistance;
+        
+        if (cache.mValid && cache.mValues.size() == matcher.mValues.size())
+        {
+            bool same = true;
+            
+            for (long j = 0; j < matcher.mValues.size(); j++)
+                same &= cache.mValues[j].mType == matcher.mValues[j].mType && cache.mValues[j].mData.mInt == matcher.mValues[j].mData.mInt;
+            
+            if (same)
+            {
+                mCacheHits++;
+                continue;
+            }
+        }
+        
+        mCacheMisses++;
+        
+        if (cache.mValid)
+        {
+            for (long j = 0; j < numItems; j++)
+                mNumRejections[j] -= !cache.mMatched[j];
+        }
+        
+        cache.mMatched.resize(numItems);
+        cache.mDistances.resize(distanceTest ? numItems : 0);
+        
+        for (long j = 0; j < numItems; j += kBlockSize)
+        {
+            long blockSize = (numItems - j) < kBlockSize ? numItems - j : kBlockSize;
+            double *blockDistances = distanceTest ? &cache.mDistances[j] : distances;
+            
+            std::fill_n(&cache.mMatched[j], blockSize, 1);
+            std::fill_n(blockDistances, blockSize, 0.0);
+            testBlock(database, matcher, &cache.mMatched[j], blockDistances, temp, accessor.getColumn(matcher.mColumn) + j, blockSize);
+        }
+        
+        for (long j = 0; j < numItems; j++)
+            mNumRejections[j] += !cache.mMatched[j];
+        
+        cache.mValues = matcher.mValues;
+        cache.mValid = true;
+    }
+    
+    // Store the entries that no matcher rejects (without branching) and then sum distances in matcher order (as for a full test)
+    
+    for (long i = 0; i < numItems; i += kBlockSize)
+    {
+        long blockSize = (numItems - i) < kBlockSize ? numItems - i : kBlockSize;
+        
+        for (long j = 0; j < blockSize; j++)
+            matched[j] = !mNumRejections[i + j];
+        
+        for (long j = 0; j < blockSize; j++)
+        {
+            mResults[numMatches] = Result(i + j, 0.0);
+            numMatches += matched[j];
+        }
+    }
+    
+    for (long i = 0; i < size(); i++)
+    {
+        if (mMatchers[i].mType < kTestDistance)
+            continue;
+        
+        const double *cachedDistances = mCache[i].mDistances.data();
+        
+        for (long j = 0; j < numMatches; j++)
+            mResults[j].mDistance += cachedDistances[mResults[j].mIndex];
+    }
+    
+    return numMatches;
+}
+
+bool Matchers::cacheReserved(long numItems) const
+{
+    // True if the cache can be used for this many entries without allocating (as it will be after prepare())
+    
+    if (mCache.size() != size() || mNumRejections.capacity() < numItems)
+        return false;
+    
+    for (long i = 0; i < size(); i++)
+    {
+        const CachedMatcher& cache = mCache[i];
+        
+        if (cache.mMatched.capacity() < numItems || cache.mValues.capacity() < mMatchers[i].mValues.size())
+            return false;
+        if (mMatchers[i].mType >= kTestDistance && cache.mDistances.capacity() < numItems)
+            return false;
+    }
+    
+    return true;
+}
+
+void Matchers::resetCache() const
+{
+    mCache.clear();
+    mCacheDatabase = NULL;
+}
+
+long Matchers::matchParallel(const EntryDatabase& database, long maxMatches, bool sortOnlyIfLimited) const
+{
+    long numItems = database.numItems();
+    long numThreads = std::max(1L, static_cast<long>(std::thread::hardware_concurrency()));
+    long totalMatches = 0;
+    long numMatches;
+    
+    if (numThreads > kMaxThreads)
+        numThreads = kMaxThreads;
+    
+    maxMatches = std::max(maxMatches, 0L);
+    
+    long sortLimit = sortOnlyIfLimited ? 0 : maxMatches;
+    
+    // Split the entries into one contiguous chunk per thread (the calling thread tests the first chunk)
+    
+    std::vector<std::thread> threads;
+    
+    mChunks.clear();
+    
+    for (long i = 0; i < numThreads; i++)
+        mChunks.push_back(Chunk((numItems * i) / numThreads, (numItems * (i + 1)) / numThreads));
+    
+    for (long i = 1; i < numThreads; i++)
+    {
+        // If a thread can't be started its chunk is tested on the calling thread instead
+        
+        try
+        {
+            threads.push_back(std::thread(&Matchers::matchChunk, this, std::cref(database), std::ref(mChunks[i]), sortLimit));
+        }
+        catch (const std::system_error&)
+        {
+            matchChunk(database, mChunks[i], sortLimit);
+        }
+    }
+    
+    matchChunk(database, mChunks[0], sortLimit);
+    
+    for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); it++)
+        it->join();
+    
+    for (long i = 0; i < numThreads; i++)
+        totalMatches += mChunks[i].mNumMatches;
+    
+    numMatches = (maxMatches && totalMatches > maxMatches) ? maxMatches : totalMatches;
+    
+    if (numMatches != totalMatches && !sortOnlyIfLimited)
+    {
+        // Merge the closest matches from each chunk (these are already sorted) to get the overall closest matches
+        
+        mMerged.resize(numMatches);
+        
+        for (long i = 0; i < numThreads; i++)
+            mChunks[i].mEnd = mChunks[i].mStart + std::min(mChunks[i].mNumMatches, numMatches);
+        
+        for (long i = 0; i < numMatches; i++)
+        {
+            Chunk *closest = NULL;
+            
+            for (std::vector<Chunk>::iterator it = mChunks.begin(); it != mChunks.end(); it++)
+                if (it->mStart != it->mEnd && (!closest || mResults[it->mStart] < mResults[closest->mStart]))
+                    closest = &(*it);
+            
+            mMerged[i] = mResults[closest->mStart++];
+        }
+        
+        std::copy(mMerged.begin(), mMerged.end(), mResults.begin());
+    }
+    else
+    {
+        // Join the matches from each chunk in order of index (as for a serial match)
+        
+        long offset = 0;
+        
+        for (long i = 0; i < numThreads && offset < numMatches; i++)
+        {
+            long size = std::min(mChunks[i].mNumMatches, numMatches - offset);
+            std::copy(mResults.begin() + mChunks[i].mStart, mResults.begin() + mChunks[i].mStart + size, mResults.begin() + offset);
+            offset += size;
+        }
+        
+        // If the chunks were sorted in anticipation of a limit that wasn't reached restore the order of index
+        
+        if (sortLimit)
+            std::sort(mResults.begin(), mResults.begin() + numMatches, Result::indexOrder);
     }
     
     return mNumMatches = numMatches;
 }
 
-void Matchers::setMatchers(void *x, long argc, t_atom *argv, const EntryDatabase::ReadPointer database)
+void Matchers::matchChunk(const EntryDatabase& database, Chunk& chunk, long sortLimit) const
+{
+    chunk.mNumMatches = matchRange(database, chunk.mStart, chunk.mEnd);
+    
+    // If the matches might be limited sort the closest matches in this chunk (so that they can be merged)
+    
+    long numSorted = std::min(chunk.mNumMatches, sortLimit);
+    
+    if (numSorted)
+        sortTopN(chunk.mStart, numSorted, chunk.mNumMatches);
+}
+
+void Matchers::setMatchers(void *x, long argc, t_atom *argv, const EntryDatabase& database)
 {
     // Empty the matchers
     
@@ -132,7 +539,7 @@ void Matchers::setMatchers(void *x, long argc, t_atom *argv, const EntryDatabase
         
         // Get the column and test type
         
-        long column = database->columnFromSpecifier(argv++);
+        long column = database.columnFromSpecifier(argv++);
         ::TestType type = entrymatcher_test_types(argv++);
         argc -= 2;
         
@@ -143,12 +550,12 @@ void Matchers::setMatchers(void *x, long argc, t_atom *argv, const EntryDatabase
             object_error((t_object *) x, "invalid test / no test specified in unparsed segment of matchers message");
             break;
         }
-        else if (column < 0 || column >= database->numColumns())
+        else if (column < 0 || column >= database.numColumns())
         {
             object_error((t_object *) x, "specified column in matchers message does not exist");
             continue;
         }
-        else if (database->getColumnLabelMode(column) && type != TEST_MATCH)
+        else if (database.getColumnLabelMode(column) && type != TEST_MATCH)
         {
             object_error((t_object *) x, "incorrect matcher for label type column (should be equals or ==)  column number %ld", column + 1);
             continue;
@@ -158,7 +565,7 @@ void Matchers::setMatchers(void *x, long argc, t_atom *argv, const EntryDatabase
         
         // Parse values
         
-        if (database->getColumnLabelMode(column))
+        if (database.getColumnLabelMode(column))
         {
             // If this column is for labels store details of a valid match test (other tests are not valid)
             
@@ -221,35 +628,187 @@ void Matchers::setMatchers(void *x, long argc, t_atom *argv, const EntryDatabase
     }
 }
 
-long Matchers::sortTopN(long N, long size) const
+bool Matchers::matchIndexed(const EntryDatabase& database, long maxMatches, bool sortOnlyIfLimited) const
 {
-    N = std::min(N, size);
+    long numItems = database.numItems();
+    long numMatches;
+    bool reject = false;
+    
+    if (numItems < kIndexMinItems || !indexDimensions(database, false))
+        return false;
     
-    // Partial insertion sort (faster sorting for small numbers of n)...
+    for (std::vector<KDTree::Dimension>::const_iterator it = mDimensions.begin(); it != mDimensions.end(); it++)
+        reject |= it->mReject;
     
-    for (long i = 0; i < N; i++)
+    // Either find the closest matches (when sorting a limited number) or all matches within the reject limits (when results are in index order)
+    
+    bool nearest = maxMatches && !sortOnlyIfLimited && maxMatches < (numItems / kIndexMaxRatio);
+    bool within = reject && (!maxMatches || sortOnlyIfLimited);
+    
+    if ((!nearest && !within) || !mTree.update(database, mDimensions, !mRealtime))
+        return false;
+    
+    // In realtime the search must fit in the memory reserved by prepare()
+    
+    if (mRealtime && mNeighbours.capacity() < (nearest ? maxMatches + 1 : numItems))
+        return false;
+    
+    if (nearest)
+    {
+        // Search for one extra match to know if the limit was reached (if not the results are left in index order as for a linear scan)
+        
+        numMatches = mTree.search(mNeighbours, mDimensions, maxMatches + 1);
+        
+        if (numMatches > maxMatches)
+            numMatches = maxMatches;
+        else
+            KDTree::sortByIndex(mNeighbours);
+    }
+    else
+    {
+        numMatches = mTree.search(mNeighbours, mDimensions, 0);
+        numMatches = (maxMatches && numMatches > maxMatches) ? maxMatches : numMatches;
+    }
+    
+    for (long i = 0; i < numMatches; i++)
+        mResults[i] = Result(mNeighbours[i].mIndex, mNeighbours[i].mDistance);
+    
+    mNumMatches = numMatches;
+    
+    return true;
+}
+
+bool Matchers::indexDimensions(const EntryDatabase& database, bool building) const
+{
+    // The tree can only be used for distance tests on numeric columns with a single target value
+    // N.B. targets aren't needed to build the tree, so when building a matcher may have no target yet
+    
+    mDimensions.clear();
+    
+    for (std::vector<Matcher>::const_iterator it = mMatchers.begin(); it != mMatchers.end(); it++)
+    {
+        if ((it->mType != kTestDistance && it->mType != kTestDistanceReject) || it->mValues.size() > 1)
+            return false;
+        if (!building && it->mValues.size() != 1)
+            return false;
+        if (database.getColumnLabelMode(it->mColumn) || !std::isfinite(it->mScale))
+            return false;
+        
+        double target = it->mValues.size() ? (double) it->mValues[0] : 0.0;
+        mDimensions.push_back(KDTree::Dimension(it->mColumn, it->mScale, target, it->mType == kTestDistanceReject));
+    }
+    
+    return true;
+}
+
+void Matchers::prepare(const EntryDatabase& database)
+{
+    long numItems = database.numItems();
+    
+    // Leave room for entries added before the next prepare() (so that realtime matching can continue without any index)
+    
+    mResults.reserve(numItems + numItems / 4);
+    mDimensions.reserve(size());
+    
+    // Targets are set on the audio thread before matching
+    
+    for (std::vector<Matcher>::iterator it = mMatchers.begin(); it != mMatchers.end(); it++)
+        it->mValues.reserve(1);
+    
+    // Reserve the cached results for incremental matching
+    
+    if (mIncremental)
     {
-        double minDistance = mResults[i].mDistance;
-        long swap = i;
+        mCache.resize(size());
+        mNumRejections.reserve(numItems);
         
-        for (long j = i + 1; j < size; j++)
+        for (long i = 0; i < size(); i++)
         {
-            if (mResults[j].mDistance < minDistance)
-            {
-                minDistance = mResults[j].mDistance;
-                swap = j;
-            }
+            mCache[i].mValues.reserve(std::max(mMatchers[i].mValues.size(), size_t(1)));
+            mCache[i].mMatched.reserve(numItems);
+            
+            if (mMatchers[i].mType >= kTestDistance)
+                mCache[i].mDistances.reserve(numItems);
         }
+    }
+    
+    // Build the k-d tree and any label indices now if the matchers can use them (realtime matching never builds them)
+    
+    if (numItems < kIndexMinItems)
+        return;
+    
+    if (indexDimensions(database, true))
+    {
+        mTree.prepare(database, mDimensions);
+        mNeighbours.reserve(numItems);
+    }
+    
+    mLabelIndices.resize(size());
+    mIndexed.reserve(size());
+    
+    for (long i = 0; i < size(); i++)
+    {
+        if (!labelIndexable(database, mMatchers[i]))
+            continue;
         
-        std::swap(mResults[swap], mResults[i]);
+        mLabelIndices[i].prepare(database, mMatchers[i].mColumn);
+        mCandidates.reserve(numItems);
+        mLabelEntries.reserve(numItems);
+        mIntersection.reserve(numItems);
+    }
+}
+
+long Matchers::sortTopN(long start, long N, long size) const
+{
+    // Relative costs (per entry / per comparison) measured for 1k-300k results
+    
+    const double heapInsertCost = 4.0;
+    const double selectCost = 3.3;
+    const double sortCost = 2.0;
+    
+    std::vector<Result>::iterator begin = mResults.begin() + start;
+    
+    N = std::min(N, size);
+    
+    if (!N)
+        return 0;
+    
+    // A heap visits each result once, but is updated each time a result displaces one of the closest N (about N * ln(size / N) times for random order)
+    // A selection (nth element followed by sorting the closest N) has a larger cost per result, but sorts the closest N only once
+    
+    double sortN = N * log2(static_cast<double>(N));
+    double heap = size + heapInsertCost * sortN * (1.0 + log(size / static_cast<double>(N)));
+    double select = selectCost * size + sortCost * sortN;
+    
+    if (heap < select)
+        std::partial_sort(begin, begin + N, begin + size);
+    else
+    {
+        std::nth_element(begin, begin + N, begin + size);
+        std::sort(begin, begin + N);
     }
     
     return N;
 }
 
+void Matchers::copyResults(const Matchers& matchers)
+{
+    mNumMatches = std::min(matchers.mNumMatches, static_cast<long>(mResults.capacity()));
+    mResults.resize(std::max(mResults.size(), static_cast<size_t>(mNumMatches)));
+    
+    std::copy(matchers.mResults.begin(), matchers.mResults.begin() + mNumMatches, mResults.begin());
+}
+
 void Matchers::clear()
 {
     mMatchers.clear();
+    resetCache();
+}
+
+void Matchers::setIncremental(bool incremental)
+{
+    mIncremental = incremental;
+    resetCache();
 }
 
 void Matchers::addTarget(double value)
@@ -267,4 +826,5 @@ void Matchers::addTarget(t_symbol *value)
 void Matchers::addMatcher(TestType type, long column, double scale)
 {
     mMatchers.push_back(Matcher(type, column, scale));
+    resetCache();
 }
@@ -4,6 +4,8 @@
 
 #include "CustomAtom.h"
 #include "EntryDatabase.h"
+#include "KDTree.h"
+#include "LabelIndex.h"
 #include "utilities.h"
 
 class Matchers
@@ -20,40 +22,42 @@ private:
         Result() {}
         Result(long index, double distance) : mIndex(index), mDistance(distance) {}
         
-        friend bool operator > (const Result& a, const Result& b) { return a.mDistance > b.mDistance; }
+        // N.B. ties are ordered by index so that the order never depends on how the entries were tested
+        
+        friend bool operator < (const Result& a, const Result& b) { return a.mDistance < b.mDistance || (a.mDistance == b.mDistance && a.mIndex < b.mIndex); }
+        friend bool operator > (const Result& a, const Result& b) { return b < a; }
+        
+        static bool indexOrder(const Result& a, const Result& b) { return a.mIndex < b.mIndex; }
         
         long mIndex;
         double mDistance;
     };
     
+    struct Chunk
+    {
+        Chunk(long start, long end) : mStart(start), mEnd(end), mNumMatches(0) {}
+        
+        long mStart;
+        long mEnd;
+        long mNumMatches;
+    };
+    
+    // Cached results for one matcher over all entries (distances are only stored for distance tests)
+    
+    struct CachedMatcher
+    {
+        CachedMatcher() : mValid(false) {}
+        
+        bool mValid;
+        std::vector<CustomAtom> mValues;
+        std::vector<unsigned char> mMatched;
+        std::vector<double> mDistances;
+    };
+    
     struct Matcher
     {
         Matcher(TestType type, long column, double scale = 1.0) : mType(type), mColumn(column), mScale(scale) {}
 
-        template <typename Op> inline bool comparisonTest(const UntypedAtom value, Op op) const
-        {
-            for (std::vector<CustomAtom>::const_iterator it = mValues.begin(); it != mValues.end(); it++)
-                if (op(value, (*it))) return true;
-            
-            return false;
-        }
-        
-        template <typename Op> inline bool distanceTest(bool reject, const double value, double& overallDistance, Op op) const
-        {
-            double distance = HUGE_VAL;
-
-            for (std::vector<CustomAtom>::const_iterator it = mValues.begin(); it != mValues.end(); it++)
-            {
-                double currentDistance = op(value, *it, mScale);
-                currentDistance *= currentDistance;
-                if (currentDistance < distance)
-                    distance = currentDistance;
-            }
-            
-            overallDistance += distance;
-            return !reject || distance <= 1.0;
-        }
-        
         template <typename T, typename Op> inline long comparisonTest(std::vector<Result>& results, long numMatches, const EntryDatabase::RawAccessor& accessor, Op op) const
         {
             long matched = 0;
@@ -93,6 +97,8 @@ private:
         
         template <typename Op> inline long distanceTest(bool reject, std::vector<Result>& results, long numMatches, const EntryDatabase::RawAccessor& accessor, Op op) const
         {
+            // N.B. invalid (NaN) distances are treated as infinite (as for the block tests) - for multiple values the minimum is taken starting from HUGE_VAL
+            
             long matched = 0;
             
             if (mValues.size() == 1)
@@ -104,6 +110,7 @@ private:
                     long idx = results[i].mIndex;
                     double distance = op(comparisonValue, accessor.getData(idx, mColumn).mValue, mScale);
                     distance *= distance;
+                    distance = distance < HUGE_VAL ? distance : HUGE_VAL;
                     
                     if (!reject || distance <= 1.0)
                         results[matched++] = Result(idx, results[i].mDistance + distance);
@@ -132,6 +139,73 @@ private:
             
             return matched;
         }
+        
+        // Block tests operate on a contiguous section of a column and are branch free (so that the compiler can vectorise them)
+        
+        template <typename T, typename Op> inline void comparisonBlock(unsigned char *matched, const UntypedAtom *data, long size, Op op) const
+        {
+            if (mValues.size() == 1)
+            {
+                const T comparisonValue = mValues[0];
+                
+                for (long i = 0; i < size; i++)
+                    matched[i] &= op(T(data[i]), comparisonValue);
+            }
+            else
+            {
+                for (long i = 0; i < size; i++)
+                {
+                    unsigned char result = 0;
+                    
+                    for (std::vector<CustomAtom>::const_iterator it = mValues.begin(); it != mValues.end(); it++)
+                        result |= op(T(data[i]), T(*it));
+                    
+                    matched[i] &= result;
+                }
+            }
+        }
+        
+        template <typename Op> inline void distanceBlock(bool reject, unsigned char *matched, double *distances, double *temp, const UntypedAtom *data, long size, Op op) const
+        {
+            // N.B. the minimum is taken (starting from HUGE_VAL) for single values also, so that invalid (NaN) distances are treated as infinite
+            
+            if (mValues.size() == 1)
+            {
+                const double comparisonValue = mValues[0];
+                
+                for (long i = 0; i < size; i++)
+                {
+                    double distance = op(data[i].mValue, comparisonValue, mScale);
+                    distance *= distance;
+                    distance = distance < HUGE_VAL ? distance : HUGE_VAL;
+                    distances[i] += distance;
+                    matched[i] &= !reject || distance <= 1.0;
+                }
+                
+                return;
+            }
+            
+            for (long i = 0; i < size; i++)
+                temp[i] = HUGE_VAL;
+            
+            for (std::vector<CustomAtom>::const_iterator it = mValues.begin(); it != mValues.end(); it++)
+            {
+                const double comparisonValue = *it;
+                
+                for (long i = 0; i < size; i++)
+                {
+                    double distance = op(data[i].mValue, comparisonValue, mScale);
+                    distance *= distance;
+                    temp[i] = distance < temp[i] ? distance : temp[i];
+                }
+            }
+            
+            for (long i = 0; i < size; i++)
+            {
+                distances[i] += temp[i];
+                matched[i] &= !reject || temp[i] <= 1.0;
+            }
+        }
 
         TestType mType;
         long mColumn;
@@ -141,9 +215,20 @@ private:
     
 public:
     
-    Matchers() : mNumMatches(0), mAudioStyle(false) {}
+    Matchers() : mNumMatches(0), mRealtime(false), mCacheDatabase(NULL), mCacheModifiedCount(0), mCacheHits(0), mCacheMisses(0), mParallelThreshold(0), mAudioStyle(false), mIncremental(false) {}
     
-    long match(const EntryDatabase::ReadPointer database, double ratioMatched = 1.0, long maxMatches = 0, bool sortOnlyIfLimited = false) const;
+    // Realtime matching (on the audio thread) never builds an index or allocates - indices are only used if prepare() has already built them for the database
+    // N.B. if the database has grown beyond the memory reserved by prepare() a realtime match keeps the previous results
+    
+    long match(const EntryDatabase& database, double ratioMatched = 1.0, long maxMatches = 0, bool sortOnlyIfLimited = false, bool realtime = false) const;
+    
+    // Build any index and reserve the memory used for realtime matching against the database, including the incremental cache (not on the audio thread)
+    
+    void prepare(const EntryDatabase& database);
+    
+    // Take the results of another set of matchers (as many as fit in the memory already reserved, so that this never allocates)
+    
+    void copyResults(const Matchers& matchers);
     
     size_t size() const { return mMatchers.size(); }
     
@@ -166,19 +251,84 @@ public:
     void addTarget(t_symbol *value);
     void addMatcher(TestType type, long column, double scale = 1.0);
     
-    void setMatchers(void *x, long argc, t_atom *argv, const EntryDatabase::ReadPointer database);
+    void setMatchers(void *x, long argc, t_atom *argv, const EntryDatabase& database);
     void setAudioStyle(bool style) { mAudioStyle = style; }
     
+    // Entries are tested on multiple threads when there are at least this many (zero for never) - never when matching in realtime
+    
+    void setParallelThreshold(long threshold) { mParallelThreshold = std::max(threshold, 0L); }
+    
+    // When incremental the results of each matcher are cached so that only matchers with changed targets are retested (not for the audio style)
+    // N.B. realtime matching only uses the cache once prepare() has reserved it for the database
+    
+    void setIncremental(bool incremental);
+    
+    // The number of times a matcher has been reused / retested when matching incrementally
+    
+    unsigned long getCacheHits() const      { return mCacheHits; }
+    unsigned long getCacheMisses() const    { return mCacheMisses; }
+    
 private:
     
-    long sortTopN(long N, long size) const;
+    // The k-d tree is only used for larger databases when the number of matches requested is small in comparison
+    
+    static const long kIndexMinItems = 4096;
+    static const long kIndexMaxRatio = 16;
+    
+    // The label index is only used when the entries with the labels requested are at most this fraction of the database
+    
+    static const long kLabelMaxRatio = 8;
+    
+    // Entries are tested in blocks of this size (one matcher at a time) when not using the audio style
+    
+    static const long kBlockSize = 256;
+    
+    // The maximum number of threads used for parallel matching
+    
+    static const long kMaxThreads = 8;
+    
+    void testBlock(const EntryDatabase& database, const Matcher& matcher, unsigned char *matched, double *distances, double *temp, const UntypedAtom *data, long size) const;
+    long matchRange(const EntryDatabase& database, long start, long end) const;
+    long matchCandidates(const EntryDatabase& database) const;
+    bool matchLabels(const EntryDatabase& database) const;
+    bool labelIndexable(const EntryDatabase& database, const Matcher& matcher) const;
+    long matchIncremental(const EntryDatabase& database) const;
+    bool cacheReserved(long numItems) const;
+    void resetCache() const;
+    long matchParallel(const EntryDatabase& database, long maxMatches, bool sortOnlyIfLimited) const;
+    void matchChunk(const EntryDatabase& database, Chunk& chunk, long sortLimit) const;
+    bool matchIndexed(const EntryDatabase& database, long maxMatches, bool sortOnlyIfLimited) const;
+    bool indexDimensions(const EntryDatabase& database, bool building) const;
+    long sortTopN(long start, long N, long size) const;
     
     mutable long mNumMatches;
+    mutable bool mRealtime;
     
     mutable std::vector<Result> mResults;
+    mutable std::vector<Result> mMerged;
+    mutable std::vector<Chunk> mChunks;
+    
+    mutable KDTree mTree;
+    mutable std::vector<KDTree::Dimension> mDimensions;
+    mutable std::vector<KDTree::Neighbour> mNeighbours;
+    
+    mutable std::vector<LabelIndex> mLabelIndices;
+    mutable std::vector<unsigned char> mIndexed;
+    mutable std::vector<long> mCandidates;
+    mutable std::vector<long> mLabelEntries;
+    mutable std::vector<long> mIntersection;
+    
+    mutable std::vector<CachedMatcher> mCache;
+    mutable std::vector<unsigned short> mNumRejections;
+    mutable const EntryDatabase *mCacheDatabase;
+    mutable unsigned long mCacheModifiedCount;
+    mutable unsigned long mCacheHits;
+    mutable unsigned long mCacheMisses;
     
     std::vector<Matcher> mMatchers;
+    long mParallelThreshold;
     bool mAudioStyle;
+    bool mIncremental;
 };
 
 
@@ -0,0 +1,100 @@
+
+#ifndef REALTIMEMATCHERS_H
+#define REALTIMEMATCHERS_H
+
+#include <atomic>
+
+#include "EntryDatabase.h"
+#include "Matchers.h"
+
+// Matchers for the audio thread of entrymatcher~ (which must never build an index or allocate whilst matching)
+// Changes are made on the main thread to a separate set of matchers, which is copied and prepared for the database before being published
+// The audio thread swaps in the latest published copy at the start of a vector and retires the one it replaces to be freed on the main thread
+
+class RealtimeMatchers
+{
+    
+public:
+    
+    RealtimeMatchers() : mCurrent(new Matchers), mPending(NULL), mRetired(NULL), mDatabase(NULL), mModifiedCount(0) {}
+    
+    ~RealtimeMatchers()
+    {
+        delete mCurrent.load();
+        delete mPending.load();
+        delete mRetired.load();
+    }
+    
+    // Main thread only
+    
+    // The matchers to change (these are never used for matching)
+    
+    Matchers& edit() { return mEdit; }
+    
+    // Copy and prepare the edited matchers and hand them to the audio thread (replacing any copy it has not yet taken)
+    
+    void publish(const EntryDatabase& database)
+    {
+        Matchers *matchers = new Matchers(mEdit);
+        
+        matchers->prepare(database);
+        mDatabase = &database;
+        mModifiedCount = database.getModifiedCount();
+        
+        delete mPending.exchange(matchers, std::memory_order_acq_rel);
+    }
+    
+    // True if the last copy published was not prepared for this database (or it has been modified since)
+    
+    bool stale(const EntryDatabase& database) const
+    {
+        return &database != mDatabase || database.getModifiedCount() != mModifiedCount;
+    }
+    
+    // Free any matchers retired by the audio thread
+    
+    void collect() { delete mRetired.exchange(NULL, std::memory_order_acq_rel); }
+    
+    // The matchers currently in use (these are only freed on the main thread, so remain valid until the next call to collect)
+    
+    const Matchers& current() const { return *mCurrent.load(std::memory_order_acquire); }
+    
+    // Audio thread only
+    
+    // Take the latest published matchers (once those replaced last time have been freed) keeping the current results
+    
+    Matchers& acquire()
+    {
+        Matchers *current = mCurrent.load(std::memory_order_relaxed);
+        
+        if (!mRetired.load(std::memory_order_acquire))
+        {
+            Matchers *pending = mPending.exchange(NULL, std::memory_order_acq_rel);
+            
+            if (pending)
+            {
+                pending->copyResults(*current);
+                mRetired.store(current, std::memory_order_release);
+                mCurrent.store(pending, std::memory_order_release);
+                current = pending;
+            }
+        }
+        
+        return *current;
+    }
+    
+private:
+    
+    // Data
+    
+    Matchers mEdit;
+    
+    std::atomic<Matchers *> mCurrent;
+    std::atomic<Matchers *> mPending;
+    std::atomic<Matchers *> mRetired;
+    
+    const EntryDatabase *mDatabase;
+    unsigned long mModifiedCount;
+};
+
+#endif
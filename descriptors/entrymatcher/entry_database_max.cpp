@@ -6,7 +6,7 @@ typedef struct entry_database{
     
     t_object a_obj;
     
-    EntryDatabase *database;
+    EntryDatabase::Shared *database;
     
     long count;
     bool notify;
@@ -67,7 +67,7 @@ void *entry_database_new(t_symbol *name, t_atom_long num_reserved_entries, t_ato
     num_reserved_entries = std::max(num_reserved_entries, t_atom_long(1));
     num_columns = std::max(num_columns, t_atom_long(1));
     
-    x->database = new EntryDatabase(name, num_columns);
+    x->database = new EntryDatabase::Shared(name, num_columns);
     x->database->reserve(num_reserved_entries);
     x->count = 1;
     
@@ -9,7 +9,7 @@
 
 struct NotifyPointer : public EntryDatabase::WritePointer
 {
-    NotifyPointer(EntryDatabase *ptr, t_object *maxDatabase, t_object *client) : EntryDatabase::WritePointer(ptr), mMaxDatabase(maxDatabase), mClient(client) {}
+    NotifyPointer(EntryDatabase::Shared *ptr, t_object *maxDatabase, t_object *client) : EntryDatabase::WritePointer(ptr), mMaxDatabase(maxDatabase), mClient(client) {}
     
     ~NotifyPointer();
     
@@ -53,6 +53,7 @@ typedef struct entrymatcher{
     Matchers *matchers;
     
     long embed;
+    t_atom_long parallel;
     
     // Outlets
 	
@@ -67,6 +68,8 @@ void *entrymatcher_new(t_symbol *sym, long argc, t_atom *argv);
 void entrymatcher_free(t_entrymatcher *x);
 void entrymatcher_assist(t_entrymatcher *x, void *b, long m, long a, char *s);
 
+t_max_err entrymatcher_parallel_set(t_entrymatcher *x, t_object *attr, long argc, t_atom *argv);
+
 void entrymatcher_dump(t_entrymatcher *x);
 void entrymatcher_lookup(t_entrymatcher *x, t_symbol *msg, long argc, t_atom *argv);
 void entrymatcher_lookup_output(t_entrymatcher *x, const EntryDatabase::ReadPointer& database, long idx, long argc, t_atom *argv);
@@ -106,6 +109,14 @@ int C74_EXPORT main(void)
 	
     entrymatcher_add_common<t_entrymatcher>(this_class);
     
+    CLASS_STICKY_CATEGORY(this_class, 0, "Matching");
+    
+    CLASS_ATTR_LONG(this_class, "parallel", 0, t_entrymatcher, parallel);
+    CLASS_ATTR_ACCESSORS(this_class, "parallel", 0, entrymatcher_parallel_set);
+    CLASS_ATTR_LABEL(this_class, "parallel", 0, "Parallel Matching Threshold (Entries)");
+    
+    CLASS_STICKY_CATEGORY_CLEAR(this_class);
+    
 	class_register(CLASS_BOX, this_class);
 	
 	ps_lookup = gensym("lookup");
@@ -130,6 +141,10 @@ int C74_EXPORT main(void)
 void *entrymatcher_new(t_symbol *sym, long argc, t_atom *argv)
 {
     t_symbol *name = NULL;
+    t_atom *attr_argv = argv;
+    long attr_argc = argc;
+    
+    argc = attr_args_offset(argc, argv);
     
     if (argc && atom_gettype(argv) == A_SYM)
     {
@@ -152,6 +167,11 @@ void *entrymatcher_new(t_symbol *sym, long argc, t_atom *argv)
     x->database_object = database_create(name, num_reserved_entries, num_columns);
     x->matchers = new Matchers;
     
+    // Match on multiple threads for larger databases (by default)
+    
+    object_attr_setlong(x, gensym("parallel"), 100000);
+    attr_args_process(x, attr_argc, attr_argv);
+    
     entrymatcher_load_patcher(x);
 
     return (x);
@@ -163,6 +183,17 @@ void entrymatcher_free(t_entrymatcher *x)
     delete x->matchers;
 }
 
+t_max_err entrymatcher_parallel_set(t_entrymatcher *x, t_object *attr, long argc, t_atom *argv)
+{
+    if (argc && argv)
+    {
+        x->parallel = std::max(atom_getlong(argv), (t_atom_long) 0);
+        x->matchers->setParallelThreshold(x->parallel);
+    }
+    
+    return MAX_ERR_NONE;
+}
+
 void entrymatcher_assist(t_entrymatcher *x, void *b, long m, long a, char *s)
 {
     if (m == ASSIST_INLET) 
@@ -6,7 +6,7 @@
 #include <ext_obex.h>
 
 // ========================================================================================================================================== //
-// Entry routines: refer, clear, labelmodes, names, entry and removal
+// Entry routines: refer, clear, labelmodes, names, entry, entries and removal
 // ========================================================================================================================================== //
 
 template <class T> void entrymatcher_refer(T *x, t_symbol *name)
@@ -34,6 +34,11 @@ template <class T> void entrymatcher_entry(T *x, t_symbol *msg, long argc, t_ato
     database_getptr_write(x->database_object, (t_object *)x)->addEntry(x, argc, argv);
 }
 
+template <class T> void entrymatcher_entries(T *x, t_symbol *msg, long argc, t_atom *argv)
+{
+    database_getptr_write(x->database_object, (t_object *)x)->addEntries(x, argc, argv);
+}
+
 template <class T> void entrymatcher_remove(T *x, t_symbol *msg, long argc, t_atom *argv)
 {
     database_getptr_write(x->database_object, (t_object *)x)->removeEntries(x, argc, argv);
@@ -133,6 +138,7 @@ template <class T> void entrymatcher_add_common(t_class *class_pointer)
     class_addmethod(class_pointer, (method)entrymatcher_clear<T>,"reset", 0);
  
     class_addmethod(class_pointer, (method)entrymatcher_entry<T>,"entry", A_GIMME, 0);
+    class_addmethod(class_pointer, (method)entrymatcher_entries<T>,"entries", A_GIMME, 0);
     class_addmethod(class_pointer, (method)entrymatcher_remove<T>,"remove", A_GIMME, 0);
     class_addmethod(class_pointer, (method)entrymatcher_removeif<T>,"removeif", A_GIMME, 0);
     class_addmethod(class_pointer, (method)entrymatcher_labelmodes<T>,"labelmodes", A_GIMME, 0);
@@ -25,8 +25,10 @@
 
 #include <AH_Random.h>
 
+#include "AsyncMatcher.h"
 #include "EntryDatabase.h"
 #include "Matchers.h"
+#include "RealtimeMatchers.h"
 #include "utilities.h"
 #include "entry_database_max.h"
 #include "entrymatcher_common.h"
@@ -38,7 +40,9 @@ typedef struct entrymatcher {
     t_pxobject x_obj;
     
     t_object *database_object;
-    Matchers *matchers;
+    RealtimeMatchers *matchers;
+    Matchers *async_matchers;
+    AsyncMatcher *async_matcher;
     
     long embed;
 
@@ -46,6 +50,16 @@ typedef struct entrymatcher {
     long n_limit;
     double ratio_kept;
     
+    t_atom_long incremental;
+    t_atom_long async;
+    
+    long long time;
+    bool was_async;
+    
+    void *update_clock;
+    void *update_qelem;
+    unsigned long modified_count;
+    
     t_rand_gen gen;
     
     float *matcher_ins[256];
@@ -56,8 +70,22 @@ void *entrymatcher_new(t_symbol *sym, long argc, t_atom *argv);
 void entrymatcher_free(t_entrymatcher *x);
 void entrymatcher_assist(t_entrymatcher *x, void *b, long m, long a, char *s);
 
+template <> void entrymatcher_refer<t_entrymatcher>(t_entrymatcher *x, t_symbol *name);
+template <> void entrymatcher_audiostyle<t_entrymatcher>(t_entrymatcher *x, t_atom_long style);
+
 void entrymatcher_limit(t_entrymatcher *x, t_symbol *msg, long argc, t_atom *argv);
 void entrymatcher_matchers(t_entrymatcher *x, t_symbol *msg, long argc, t_atom *argv);
+void entrymatcher_cachestats(t_entrymatcher *x);
+void entrymatcher_asyncstats(t_entrymatcher *x);
+
+t_max_err entrymatcher_incremental_set(t_entrymatcher *x, t_object *attr, long argc, t_atom *argv);
+t_max_err entrymatcher_async_set(t_entrymatcher *x, t_object *attr, long argc, t_atom *argv);
+
+bool entrymatcher_async(t_entrymatcher *x, long num_items);
+void entrymatcher_publish(t_entrymatcher *x, const EntryDatabase& database);
+void entrymatcher_update(t_entrymatcher *x);
+void entrymatcher_poll(t_entrymatcher *x);
+void entrymatcher_tick(t_entrymatcher *x);
 
 t_int *entrymatcher_perform (t_int *w);
 void entrymatcher_dsp(t_entrymatcher *x, t_signal **sp, short *count);
@@ -81,6 +109,8 @@ int C74_EXPORT main(void)
     
     class_addmethod(this_class, (method)entrymatcher_limit,"limit", A_GIMME, 0);
     class_addmethod(this_class, (method)entrymatcher_matchers,"matchers", A_GIMME, 0);
+    class_addmethod(this_class, (method)entrymatcher_cachestats,"cachestats", 0);
+    class_addmethod(this_class, (method)entrymatcher_asyncstats,"asyncstats", 0);
     class_addmethod(this_class, (method)entrymatcher_assist, "assist", A_CANT, 0);
     
     class_addmethod(this_class, (method)entrymatcher_dsp, "dsp", A_CANT, 0);
@@ -88,6 +118,19 @@ int C74_EXPORT main(void)
 
     entrymatcher_add_common<t_entrymatcher>(this_class);
     
+    CLASS_STICKY_CATEGORY(this_class, 0, "Matching");
+    
+    CLASS_ATTR_LONG(this_class, "incremental", 0, t_entrymatcher, incremental);
+    CLASS_ATTR_STYLE(this_class, "incremental", 0, "onoff");
+    CLASS_ATTR_ACCESSORS(this_class, "incremental", 0, entrymatcher_incremental_set);
+    CLASS_ATTR_LABEL(this_class, "incremental", 0, "Incremental Matching");
+    
+    CLASS_ATTR_LONG(this_class, "async", 0, t_entrymatcher, async);
+    CLASS_ATTR_ACCESSORS(this_class, "async", 0, entrymatcher_async_set);
+    CLASS_ATTR_LABEL(this_class, "async", 0, "Asynchronous Matching Threshold (Entries)");
+    
+    CLASS_STICKY_CATEGORY_CLEAR(this_class);
+    
     class_dspinit(this_class);
 
     class_register(CLASS_BOX, this_class);
@@ -100,6 +143,10 @@ int C74_EXPORT main(void)
 void *entrymatcher_new(t_symbol *sym, long argc, t_atom *argv)
 {
     t_symbol *name = NULL;
+    t_atom *attr_argv = argv;
+    long attr_argc = argc;
+    
+    argc = attr_args_offset(argc, argv);
     
     if (argc && atom_gettype(argv) == A_SYM)
     {
@@ -119,11 +166,26 @@ void *entrymatcher_new(t_symbol *sym, long argc, t_atom *argv)
     outlet_new((t_object *)x, "signal");
     
     x->database_object = database_create(name, num_reserved_entries, num_columns);
-    x->matchers = new Matchers;
+    x->matchers = new RealtimeMatchers;
+    x->async_matchers = new Matchers;
+    x->async_matcher = new AsyncMatcher(*x->async_matchers);
+    x->async_matcher->setDatabase(x->database_object);
     
     x->max_matchers = std::max(std::min(max_matchers, t_atom_long(256)), t_atom_long(1));;
     x->ratio_kept = 1.0;
     x->n_limit = 0;
+    x->time = 0;
+    x->was_async = false;
+    
+    x->update_clock = clock_new(x, (method) entrymatcher_tick);
+    x->update_qelem = qelem_new(x, (method) entrymatcher_poll);
+    x->modified_count = 0;
+    
+    // Only retest matchers whose targets have changed and match on the audio thread (by default)
+    
+    object_attr_setlong(x, gensym("incremental"), 1);
+    object_attr_setlong(x, gensym("async"), 0);
+    attr_args_process(x, attr_argc, attr_argv);
     
     entrymatcher_load_patcher(x);
 
@@ -135,8 +197,53 @@ void *entrymatcher_new(t_symbol *sym, long argc, t_atom *argv)
 void entrymatcher_free(t_entrymatcher *x)
 {
     dsp_free(&x->x_obj);
+    freeobject((t_object *) x->update_clock);
+    qelem_free(x->update_qelem);
+    delete x->async_matcher;
     database_release(x->database_object);
     delete x->matchers;
+    delete x->async_matchers;
+}
+
+// The worker matches against the database whilst holding the matchers lock, so the lock must be held to change (and release) it
+
+template <> void entrymatcher_refer<t_entrymatcher>(t_entrymatcher *x, t_symbol *name)
+{
+    std::lock_guard<std::mutex> lock(x->async_matcher->getMatchersLock());
+    
+    x->database_object = database_change(name, x->database_object);
+    x->async_matcher->setDatabase(x->database_object);
+}
+
+// The incremental cache is reserved in a prepared copy of the matchers before it is handed to the audio thread (and the worker)
+
+t_max_err entrymatcher_incremental_set(t_entrymatcher *x, t_object *attr, long argc, t_atom *argv)
+{
+    if (argc && argv)
+    {
+        x->incremental = atom_getlong(argv) ? 1 : 0;
+        x->matchers->edit().setIncremental(x->incremental);
+        entrymatcher_publish(x, database_getptr_read(x->database_object));
+    }
+    
+    return MAX_ERR_NONE;
+}
+
+// Match on a worker thread when there are at least this many entries (zero for never) - results are then one vector late
+
+t_max_err entrymatcher_async_set(t_entrymatcher *x, t_object *attr, long argc, t_atom *argv)
+{
+    if (argc && argv)
+    {
+        x->async = std::max(atom_getlong(argv), (t_atom_long) 0);
+        
+        if (x->async)
+            x->async_matcher->start();
+        else
+            x->async_matcher->stop();
+    }
+    
+    return MAX_ERR_NONE;
 }
 
 void entrymatcher_assist(t_entrymatcher *x, void *b, long m, long a, char *s)
@@ -196,10 +303,11 @@ void entrymatcher_matchers(t_entrymatcher *x, t_symbol *msg, long argc, t_atom *
     long max_matchers = x->max_matchers;
     
     EntryDatabase::ReadPointer database = database_getptr_read(x->database_object);
+    Matchers *matchers = &x->matchers->edit();
     
-    x->matchers->clear();
+    matchers->clear();
     
-    while (argc > 1 && x->matchers->size() < max_matchers)
+    while (argc > 1 && matchers->size() < max_matchers)
     {
         // Find the column index for the test and the test type
         
@@ -243,17 +351,17 @@ void entrymatcher_matchers(t_entrymatcher *x, t_symbol *msg, long argc, t_atom *
                 switch (type)
                 {
                     case TEST_NONE:                 break;
-                    case TEST_MATCH:                x->matchers->addMatcher(Matchers::kTestMatch, column);                      break;
-                    case TEST_LESS_THAN:            x->matchers->addMatcher(Matchers::kTestLess, column);                       break;
-                    case TEST_GREATER_THAN:         x->matchers->addMatcher(Matchers::kTestGreater, column);                    break;
-                    case TEST_LESS_THAN_EQ:         x->matchers->addMatcher(Matchers::kTestLessEqual, column);                  break;
-                    case TEST_GREATER_THAN_EQ:      x->matchers->addMatcher(Matchers::kTestGreaterEqual, column);               break;
-                    case TEST_DISTANCE:             x->matchers->addMatcher(Matchers::kTestDistance, column);                   break;
-                    case TEST_SCALE:                x->matchers->addMatcher(Matchers::kTestDistance, column, scale);            break;
-                    case TEST_WITHIN:               x->matchers->addMatcher(Matchers::kTestDistanceReject, column, scale);      break;
-                    case TEST_DISTANCE_RATIO:       x->matchers->addMatcher(Matchers::kTestRatio, column);                      break;
-                    case TEST_SCALE_RATIO:          x->matchers->addMatcher(Matchers::kTestRatio, column, scale);               break;
-                    case TEST_WITHIN_RATIO:         x->matchers->addMatcher(Matchers::kTestRatioReject, column, scale);         break;
+                    case TEST_MATCH:                matchers->addMatcher(Matchers::kTestMatch, column);                         break;
+                    case TEST_LESS_THAN:            matchers->addMatcher(Matchers::kTestLess, column);                          break;
+                    case TEST_GREATER_THAN:         matchers->addMatcher(Matchers::kTestGreater, column);                       break;
+                    case TEST_LESS_THAN_EQ:         matchers->addMatcher(Matchers::kTestLessEqual, column);                     break;
+                    case TEST_GREATER_THAN_EQ:      matchers->addMatcher(Matchers::kTestGreaterEqual, column);                  break;
+                    case TEST_DISTANCE:             matchers->addMatcher(Matchers::kTestDistance, column);                      break;
+                    case TEST_SCALE:                matchers->addMatcher(Matchers::kTestDistance, column, scale);               break;
+                    case TEST_WITHIN:               matchers->addMatcher(Matchers::kTestDistanceReject, column, scale);         break;
+                    case TEST_DISTANCE_RATIO:       matchers->addMatcher(Matchers::kTestRatio, column);                         break;
+                    case TEST_SCALE_RATIO:          matchers->addMatcher(Matchers::kTestRatio, column, scale);                  break;
+                    case TEST_WITHIN_RATIO:         matchers->addMatcher(Matchers::kTestRatioReject, column, scale);            break;
                 }
             }
         }
@@ -265,11 +373,98 @@ void entrymatcher_matchers(t_entrymatcher *x, t_symbol *msg, long argc, t_atom *
     
     if (argc > 0)
     {
-        if (x->matchers->size() < max_matchers)
+        if (matchers->size() < max_matchers)
             object_error((t_object *)x, "too many arguments to matchers message for number of specified tests");
         else
             object_error((t_object *)x, "not enough arguments to matchers message to correctly specify final matcher");
     }
+    
+    entrymatcher_publish(x, database);
+}
+
+// The audio style is also changed by publishing the matchers
+
+template <> void entrymatcher_audiostyle<t_entrymatcher>(t_entrymatcher *x, t_atom_long style)
+{
+    x->matchers->edit().setAudioStyle(style ? true : false);
+    entrymatcher_publish(x, database_getptr_read(x->database_object));
+}
+
+// Post the number of matcher results reused / recalculated when matching incrementally
+
+void entrymatcher_cachestats(t_entrymatcher *x)
+{
+    object_post((t_object *)x, "incremental matching - reused %lu / recalculated %lu", x->matchers->current().getCacheHits(), x->matchers->current().getCacheMisses());
+}
+
+// Post the number of asynchronous requests that were late or dropped
+
+void entrymatcher_asyncstats(t_entrymatcher *x)
+{
+    object_post((t_object *)x, "asynchronous matching - late %lu / dropped %lu", x->async_matcher->getNumLate(), x->async_matcher->getNumDropped());
+}
+
+// Decide whether to match asynchronously for this vector (synchronous matching can only resume once the worker is finished)
+
+bool entrymatcher_async(t_entrymatcher *x, long num_items)
+{
+    AsyncMatcher *async_matcher = x->async_matcher;
+    bool async = (x->async && num_items >= x->async && async_matcher->running()) || async_matcher->busy();
+    
+    // Results from before any synchronous matching are out of date
+    
+    if (async && !x->was_async)
+        async_matcher->reset();
+    
+    x->was_async = async;
+    
+    return async;
+}
+
+// Hand a prepared copy of the edited matchers to the audio thread (which never builds an index) and another to the worker (main thread only)
+
+void entrymatcher_publish(t_entrymatcher *x, const EntryDatabase& database)
+{
+    x->matchers->collect();
+    x->matchers->publish(database);
+    
+    std::lock_guard<std::mutex> lock(x->async_matcher->getMatchersLock());
+    *x->async_matchers = x->matchers->edit();
+}
+
+// Free any matchers retired by the audio thread and publish a new prepared copy if the database has changed (main thread only)
+
+void entrymatcher_update(t_entrymatcher *x)
+{
+    EntryDatabase::ReadPointer database = database_getptr_read(x->database_object);
+    
+    x->matchers->collect();
+    
+    if (x->matchers->stale(database))
+        x->matchers->publish(database);
+}
+
+// Check for changes to the database (on the main thread) whilst dsp is running
+// N.B. the matchers are only republished once the database is unchanged for a whole interval, so that frequent modification doesn't cause repeated rebuilding
+
+void entrymatcher_poll(t_entrymatcher *x)
+{
+    unsigned long modified_count = database_getptr_read(x->database_object)->getModifiedCount();
+    
+    if (modified_count == x->modified_count)
+        entrymatcher_update(x);
+    else
+        x->matchers->collect();
+    
+    x->modified_count = modified_count;
+}
+
+void entrymatcher_tick(t_entrymatcher *x)
+{
+    qelem_set(x->update_qelem);
+    
+    if (sys_getdspobjdspstate((t_object *) x))
+        clock_delay(x->update_clock, 50);
 }
 
 // ========================================================================================================================================== //
@@ -290,12 +485,15 @@ t_int *entrymatcher_perform(t_int *w)
     t_rand_gen *gen = &x->gen;
     
     EntryDatabase::ReadPointer database = database_getptr_read(x->database_object);
-    Matchers *matchers = x->matchers;
+    Matchers *matchers = &x->matchers->acquire();
+    AsyncMatcher *async_matcher = x->async_matcher;
     
     double ratio_kept = x->ratio_kept;
     
     long n_limit = x->n_limit;
-    long num_matched_indices = matchers->getNumMatches();
+    long long time = x->time;
+    bool async = entrymatcher_async(x, database->numItems());
+    long num_matched_indices = async ? async_matcher->getNumMatches() : matchers->getNumMatches();
     
     for (long i = 0; i < vec_size; i++)
     {
@@ -303,24 +501,42 @@ t_int *entrymatcher_perform(t_int *w)
         
         long index = -1;
         
+        // Apply any asynchronous results that are due
+        
+        if (async && async_matcher->update(time + i))
+            num_matched_indices = async_matcher->getNumMatches();
+        
         if (*match_in++)
         {
             // Do matching (if requested)
             
-            for (long j = 0; j < x->max_matchers; j++)
-                matchers->setTarget(j, matcher_ins[j][i]);
-            
-            num_matched_indices = matchers->match(database, ratio_kept, n_limit, true);
+            if (async)
+                async_matcher->request(time + i, vec_size, ratio_kept, n_limit, matcher_ins, x->max_matchers, i);
+            else
+            {
+                for (long j = 0; j < x->max_matchers; j++)
+                    matchers->setTarget(j, matcher_ins[j][i]);
+                
+                num_matched_indices = matchers->match(database, ratio_kept, n_limit, true, true);
+            }
         }
         
         // Choose a random entry from the valid list (if requested)
         
         if (*choose_in++ && num_matched_indices)
-            index = matchers->getIndex(rand_int_n(gen, num_matched_indices - 1));
+        {
+            long choice = rand_int_n(gen, num_matched_indices - 1);
+            index = async ? async_matcher->getIndex(choice) : matchers->getIndex(choice);
+        }
         
         *out++ = (float) index + 1;
     }
     
+    if (async)
+        async_matcher->submit();
+    
+    x->time += vec_size;
+    
     return w + 7;
 }
 
@@ -332,6 +548,9 @@ void entrymatcher_dsp(t_entrymatcher *x, t_signal **sp, short *count)
     for (long i = 0; i < max_matchers; i++)
         matcher_ins[i] = (float *) sp[i + 2]->s_vec;
     
+    entrymatcher_update(x);
+    clock_delay(x->update_clock, 50);
+    
     dsp_add(entrymatcher_perform, 6, sp[0]->s_vec, sp[1]->s_vec, matcher_ins, sp[2 + max_matchers]->s_vec, sp[0]->s_n, x);
 }
 
@@ -351,12 +570,15 @@ void entrymatcher_perform64(t_entrymatcher *x, t_object *dsp64, double **ins, lo
     t_rand_gen *gen = &x->gen;
     
     EntryDatabase::ReadPointer database = database_getptr_read(x->database_object);
-    Matchers *matchers = x->matchers;
+    Matchers *matchers = &x->matchers->acquire();
+    AsyncMatcher *async_matcher = x->async_matcher;
     
     double ratio_kept = x->ratio_kept;
 
     long n_limit = x->n_limit;
-    long num_matched_indices = matchers->getNumMatches();
+    long long time = x->time;
+    bool async = entrymatcher_async(x, database->numItems());
+    long num_matched_indices = async ? async_matcher->getNumMatches() : matchers->getNumMatches();
     
     for (long i = 0; i < vec_size; i++)
     {
@@ -364,26 +586,47 @@ void entrymatcher_perform64(t_entrymatcher *x, t_object *dsp64, double **ins, lo
         
         long index = -1;
         
-        if (*match_in++) 
+        // Apply any asynchronous results that are due
+        
+        if (async && async_matcher->update(time + i))
+            num_matched_indices = async_matcher->getNumMatches();
+        
+        if (*match_in++)
         {
             // Do matching (if requested)
             
-            for (long j = 0; j < x->max_matchers; j++)
-                matchers->setTarget(j, matcher_ins[j][i]);
-            
-            num_matched_indices = matchers->match(database, ratio_kept, n_limit, true);
+            if (async)
+                async_matcher->request(time + i, vec_size, ratio_kept, n_limit, matcher_ins, x->max_matchers, i);
+            else
+            {
+                for (long j = 0; j < x->max_matchers; j++)
+                    matchers->setTarget(j, matcher_ins[j][i]);
+                
+                num_matched_indices = matchers->match(database, ratio_kept, n_limit, true, true);
+            }
         }
         
         // Choose a random entry from the valid list (if requested)
         
         if (*choose_in++ && num_matched_indices)
-            index = matchers->getIndex(rand_int_n(gen, num_matched_indices - 1));
+        {
+            long choice = rand_int_n(gen, num_matched_indices - 1);
+            index = async ? async_matcher->getIndex(choice) : matchers->getIndex(choice);
+        }
         
         *out++ = (float) index + 1;
     }
+    
+    if (async)
+        async_matcher->submit();
+    
+    x->time += vec_size;
 }
 
 void entrymatcher_dsp64(t_entrymatcher *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
 {				
+    entrymatcher_update(x);
+    clock_delay(x->update_clock, 50);
+    
     object_method(dsp64, gensym("dsp_add64"), x, entrymatcher_perform64, 0, NULL);
 }
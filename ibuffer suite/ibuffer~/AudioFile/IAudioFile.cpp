@@ -2,6 +2,7 @@
 
 #include <cmath>
 #include <cassert>
+#include <cstring>
 #include <vector>
 
 #define WORK_LOOP_SIZE 1024
@@ -222,7 +223,7 @@ namespace HISSTools
         void IAudioFile::u32ToOutput(T* output, uint32_t value)
         {
             *output = *reinterpret_cast<int32_t*>(&value)
-            * (T)0x1.0fp-31; // 0.00000000046566128730773925;
+            * (T) 4.656612873077392578125e-10; // 2 ^ -31
         }
         
         template <class T>
@@ -35,6 +35,10 @@
  *	To avoid using vector processing at all define NO_F32_SIMD or NO_F64_SIMD (according to which are available)
  *	It is best to define these based on the available functions (preferring the operation, then the array version, then no SIMD)
  *
+ *	Optionally for AVX processing (used at runtime for 64 bit signals if the processor and OS support it) you can define:
+ *
+ *	F64_VEC256_OP			- A binary 64 bit floating point AVX operator (vDouble256, vDouble256) - any functions used must be declared with AVX_FUNCTION
+ *
  *	Optionally for objects requiring constants you can define:
  *
  *	SET_CONSTANTS		- Set constants in main routine (if necessary)
@@ -92,6 +96,11 @@ void OBJNAME_FIRST(_perform_single1_64)(OBJNAME_SECOND(t_) *x, t_object *dsp64,
 void OBJNAME_FIRST(_perform_single2_64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
 void OBJNAME_FIRST(_perform_64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
 #endif
+#if (defined VECTOR_F64_256BIT) && (defined F64_VEC256_OP)
+AVX_FUNCTION void OBJNAME_FIRST(_perform_single1_64_avx)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
+AVX_FUNCTION void OBJNAME_FIRST(_perform_single2_64_avx)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
+AVX_FUNCTION void OBJNAME_FIRST(_perform_64_avx)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
+#endif
 void OBJNAME_FIRST(_perform_single1_scalar_64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
 void OBJNAME_FIRST(_perform_single2_scalar_64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
 void OBJNAME_FIRST(_perform_scalar_64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
@@ -568,6 +577,12 @@ void OBJNAME_FIRST(_dsp64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, short *count,
 		{	
 			routine += 3;
 			
+#if (defined VECTOR_F64_256BIT) && (defined F64_VEC256_OP)
+			// Use AVX code if the processor and OS support it
+			
+			if (AVX_check())
+				routine += 3;
+#endif
 #ifdef USE_F64_VEC_ARRAY
 			// Make temporary array for array-based vector routines
 			
@@ -598,6 +613,17 @@ void OBJNAME_FIRST(_dsp64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, short *count,
 			case 5: // Vector aligned single 1
 				current_perform_routine = (method) OBJNAME_FIRST(_perform_single2_64);
 				break;
+#endif
+#if (defined VECTOR_F64_256BIT) && (defined F64_VEC256_OP)
+			case 6: // AVX
+				current_perform_routine = (method) OBJNAME_FIRST(_perform_64_avx);
+				break;			
+			case 7: // AVX single 1
+				current_perform_routine = (method) OBJNAME_FIRST(_perform_single1_64_avx);
+				break;
+			case 8: // AVX single 2
+				current_perform_routine = (method) OBJNAME_FIRST(_perform_single2_64_avx);
+				break;
 #endif
 		}
 	
@@ -681,6 +707,76 @@ void OBJNAME_FIRST(_perform_64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double *
 
 #endif
 
+
+#if (defined VECTOR_F64_256BIT) && (defined F64_VEC256_OP)
+
+// 64 bit perform routine with one LHS signal-rate input (AVX - signal vectors are not guaranteed to be 32 byte aligned, so unaligned loads / stores are used)
+
+AVX_FUNCTION void OBJNAME_FIRST(_perform_single1_64_avx)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam)
+{	
+	double *in1 = ins[userparam ? 1 : 0];
+	double *out1 = outs[0];
+	
+	vDouble256 double_val = double2vector256(x->double_val);
+	
+	vec_size >>= 2;
+	
+	while (vec_size--)
+	{
+		F64_VEC256_USTORE(out1, F64_VEC256_OP(F64_VEC256_ULOAD(in1), double_val));
+		in1 += 4;
+		out1 += 4;
+	}
+	
+	AVX_END();
+}
+
+
+// 64 bit perform routine with one RHS signal-rate input (AVX)
+
+AVX_FUNCTION void OBJNAME_FIRST(_perform_single2_64_avx)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam)
+{	
+	double *in1 = ins[userparam ? 1 : 0];
+	double *out1 = outs[0];
+	
+	vDouble256 double_val = double2vector256(x->double_val);
+	
+	vec_size >>= 2;
+	
+	while (vec_size--)
+	{
+		F64_VEC256_USTORE(out1, F64_VEC256_OP(double_val, F64_VEC256_ULOAD(in1)));
+		in1 += 4;
+		out1 += 4;
+	}
+	
+	AVX_END();
+}
+
+
+// 64 bit perform routine with two signal-rate inputs (AVX)
+
+AVX_FUNCTION void OBJNAME_FIRST(_perform_64_avx)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam)
+{		
+	double *in1 = ins[userparam ? 1 : 0];
+	double *in2 = ins[userparam ? 0 : 1];
+	double *out1 = outs[0];
+	
+	vec_size >>= 2;
+	
+	while (vec_size--)
+	{
+		F64_VEC256_USTORE(out1, F64_VEC256_OP(F64_VEC256_ULOAD(in1), F64_VEC256_ULOAD(in2)));
+		in1 += 4;
+		in2 += 4;
+		out1 += 4;
+	}
+	
+	AVX_END();
+}
+
+#endif
+
 // 64 bit perform routine with one LHS signal-rate input (scalar calculations for small block sizes)
 
 void OBJNAME_FIRST(_perform_single1_scalar_64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam)
@@ -33,6 +33,10 @@
  *	To avoid using vector processing at all define NO_F32_SIMD or NO_F64_SIMD (according to which are available)
  *	It is best to define these based on the available functions (preferring the operation, then the array version, then no SIMD)
  *
+ *	Optionally for AVX processing (used at runtime for 64 bit signals if the processor and OS support it) you can define:
+ *
+ *	F64_VEC256_OP			- A unary 64 bit floating point AVX operator (vDouble256) - any functions used must be declared with AVX_FUNCTION
+ *
  *	Optionally for objects requiring constants you can define:
  *
  *	SET_CONSTANTS		- Set constants in main routine (if necessary)
@@ -76,6 +80,9 @@ void OBJNAME_FIRST(_dsp64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, short *count,
 #if (defined VECTOR_F64_128BIT) && !defined NO_F64_SIMD
 void OBJNAME_FIRST(_perform64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
 #endif
+#if (defined VECTOR_F64_256BIT) && (defined F64_VEC256_OP)
+AVX_FUNCTION void OBJNAME_FIRST(_perform64_avx)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
+#endif
 void OBJNAME_FIRST(_perform_scalar64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
 
 void OBJNAME_FIRST(_assist)(OBJNAME_SECOND(t_) *x, void *b, long m, long a, char *s);
@@ -249,6 +256,13 @@ void OBJNAME_FIRST(_dsp64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, short *count,
 	if ((maxvectorsize >> 1) > 0 && SSE2_check())
 		current_perform_routine = (method) OBJNAME_FIRST(_perform64);
 #endif
+	
+#if (defined VECTOR_F64_256BIT) && (defined F64_VEC256_OP)
+	// Use AVX routine if possible
+	
+	if ((maxvectorsize >> 2) > 0 && AVX_check())
+		current_perform_routine = (method) OBJNAME_FIRST(_perform64_avx);
+#endif
 		
 	object_method(dsp64, gensym("dsp_add64"), x, current_perform_routine, 0, 0);
 }
@@ -276,6 +290,30 @@ void OBJNAME_FIRST(_perform64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **
 #endif
 
 
+#if (defined VECTOR_F64_256BIT) && (defined F64_VEC256_OP)
+
+// 64 bit perform routine (AVX - signal vectors are not guaranteed to be 32 byte aligned, so unaligned loads / stores are used)
+
+AVX_FUNCTION void OBJNAME_FIRST(_perform64_avx)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam)
+{	
+	double *in1 = ins[0];
+	double *out1 = outs[0];
+	
+	vec_size >>= 2;
+	
+	while (vec_size--)
+	{
+		F64_VEC256_USTORE(out1, F64_VEC256_OP(F64_VEC256_ULOAD(in1)));
+		in1 += 4;
+		out1 += 4;
+	}
+	
+	AVX_END();
+}
+
+#endif
+
+
 // 64 bit perform routine (scalar calculations for small block sizes)
 
 void OBJNAME_FIRST(_perform_scalar64)(OBJNAME_SECOND(t_) *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam)
@@ -59,6 +59,7 @@ static __inline double abs_scalar_64 (double in)
 
 #define F64_VEC_OP(a) F64_VEC_AND_OP(a, v_bit_mask_64)
 #define F64_SCALAR_OP abs_scalar_64
+#define F64_VEC256_OP(a) F64_VEC256_ANDNOT_OP(double2vector256(-0.), a)
 
 // Having defined the necessary constants and macro the bulk of the code can now be included
 
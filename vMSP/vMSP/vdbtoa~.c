@@ -62,7 +62,7 @@ static __inline void dbtoa_array_64(double *out, double *in, long length)
 #define F32_VEC_ARRAY dbtoa_array_64
 #define F32_SCALAR_OP(a) expf (a * dbtoa_constant_32); 
 
-#define F64_VEC_OP(a) F64_VEC_EXP_OP(F32_VEC_MUL_OP(a, v_dbtoa_constant_64))
+#define F64_VEC_OP(a) F64_VEC_EXP_OP(F64_VEC_MUL_OP(a, v_dbtoa_constant_64))
 #define F64_VEC_ARRAY dbtoa_array_64
 #define F64_SCALAR_OP(a) exp (a * dbtoa_constant_64); 
 
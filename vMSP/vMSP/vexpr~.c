@@ -0,0 +1,1093 @@
+
+/*
+ *  vexpr~
+ *
+ *	vexpr~ evaluates an arithmetic expression of one or more signals in a single SIMD pass (e.g. [vexpr~ ($v1 + $v2) * 0.5]).
+ *
+ *	A chain of vMSP objects (e.g. vtimes~ -> vplus~ -> vsqrt~) makes a separate pass over memory for each object.
+ *	Here the expression is compiled when the object is created into a short program of vector operations (using the same operators as the vMSP templates).
+ *	The program is run over small blocks of the signal vector, so that intermediate results stay in the cache and each input is read (and the output written) only once.
+ *
+ *	Expressions may contain:
+ *
+ *	$v1 to $v9				- signal inputs (one inlet is created for each input up to the highest one used)
+ *	numbers					- constants (any operations on constants alone are calculated when the object is created)
+ *	+ - * /					- arithmetic (division by zero gives zero, as for vdiv~)
+ *	min(a, b) max(a, b)		- minimum / maximum
+ *	abs(a) sqrt(a)			- absolute value / square root (the square root of a negative number gives zero, as for vsqrt~)
+ *	( )						- grouping
+ *
+ *  Copyright 2010 Alex Harker. All rights reserved.
+ *
+ */
+
+
+#include <ext.h>
+#include <ext_obex.h>
+#include <z_dsp.h>
+
+#include <AH_VectorOps.h>
+#include <AH_Denormals.h>
+
+#include <ctype.h>
+
+
+#define VEXPR_MAX_INPUTS		9
+#define VEXPR_MAX_OPS			64
+#define VEXPR_MAX_REGISTERS		16
+#define VEXPR_MAX_CONSTANTS		32
+#define VEXPR_MAX_TEXT			2048
+
+// The program is run over blocks of this many samples (this must be a multiple of four)
+
+#define VEXPR_BLOCK_SIZE		64
+
+// Register index used for the output of the final operation
+
+#define VEXPR_OUTPUT			-1
+
+
+void *this_class;
+
+
+// Constants
+
+t_uint32 abs_mask_32 = 0x7FFFFFFFU;
+t_uint64 abs_mask_64 = 0x7FFFFFFFFFFFFFFFU;
+
+vFloat v_abs_mask_32;
+vFloat v_sign_mask_32;
+
+#ifdef VECTOR_F64_128BIT
+vDouble v_abs_mask_64;
+vDouble v_sign_mask_64;
+#endif
+
+
+// Program structures
+
+typedef enum _vexpr_opcode
+{
+	// Unary operations
+
+	VEXPR_COPY,
+	VEXPR_NEG,
+	VEXPR_ABS,
+	VEXPR_SQRT,
+
+	// Binary operations
+
+	VEXPR_ADD,
+	VEXPR_SUB,
+	VEXPR_MUL,
+	VEXPR_DIV,
+	VEXPR_MIN,
+	VEXPR_MAX
+
+} t_vexpr_opcode;
+
+
+typedef enum _vexpr_source
+{
+	VEXPR_REGISTER,
+	VEXPR_INPUT,
+	VEXPR_CONSTANT
+
+} t_vexpr_source;
+
+
+typedef struct _vexpr_operand
+{
+	t_vexpr_source source;
+	long index;
+
+} t_vexpr_operand;
+
+
+typedef struct _vexpr_op
+{
+	t_vexpr_opcode opcode;
+	long out;
+
+	t_vexpr_operand in1;
+	t_vexpr_operand in2;
+
+} t_vexpr_op;
+
+
+typedef struct _vexpr_program
+{
+	t_vexpr_op ops[VEXPR_MAX_OPS];
+	double constants[VEXPR_MAX_CONSTANTS];
+
+	long num_ops;
+	long num_constants;
+	long num_registers;
+	long num_inputs;
+
+} t_vexpr_program;
+
+
+typedef struct _vexpr_parser
+{
+	t_vexpr_program *program;
+
+	char *text;
+	char *ptr;
+
+	long num_registers;
+	long error;
+
+} t_vexpr_parser;
+
+
+// Object structure
+
+typedef struct _vexpr
+{
+    t_pxobject x_obj;
+
+	t_vexpr_program program;
+
+	// One block of memory for each register and constant (doubles followed by floats)
+
+	void *memory;
+
+	double *registers_64;
+	double *constants_64;
+	float *registers_32;
+	float *constants_32;
+
+	// Signal pointers for the 32 bit routines
+
+	float *ins_32[VEXPR_MAX_INPUTS];
+	float *out_32;
+
+} t_vexpr;
+
+
+void *vexpr_new(t_symbol *s, short argc, t_atom *argv);
+void vexpr_free(t_vexpr *x);
+
+long vexpr_compile(t_vexpr_program *program, short argc, t_atom *argv);
+
+void vexpr_dsp(t_vexpr *x, t_signal **sp, short *count);
+t_int *vexpr_perform(t_int *w);
+t_int *vexpr_perform_scalar(t_int *w);
+t_int *vexpr_perform_zero(t_int *w);
+
+void vexpr_dsp64(t_vexpr *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags);
+#ifdef VECTOR_F64_128BIT
+void vexpr_perform64(t_vexpr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
+#endif
+void vexpr_perform_scalar64(t_vexpr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
+void vexpr_perform_zero64(t_vexpr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam);
+
+void vexpr_assist(t_vexpr *x, void *b, long m, long a, char *s);
+
+
+// Main routine
+
+int C74_EXPORT main(void)
+{
+    this_class = class_new ("vexpr~", (method) vexpr_new, (method)vexpr_free, sizeof(t_vexpr), NULL, A_GIMME, 0);
+
+	class_addmethod(this_class, (method)vexpr_dsp, "dsp", A_CANT, 0);
+	class_addmethod(this_class, (method)vexpr_dsp64, "dsp64", A_CANT, 0);
+	class_addmethod(this_class, (method)vexpr_assist, "assist", A_CANT, 0);
+
+	class_dspinit(this_class);
+	class_register(CLASS_BOX, this_class);
+
+	v_abs_mask_32 = float2vector(*(float *)&abs_mask_32);
+	v_sign_mask_32 = float2vector(-0.f);
+
+#ifdef VECTOR_F64_128BIT
+	v_abs_mask_64 = double2vector(*(double *)&abs_mask_64);
+	v_sign_mask_64 = double2vector(-0.0);
+#endif
+
+	post ("vexpr~ - using vector version by Alex Harker");
+
+	return 0;
+}
+
+
+// Free routine
+
+void vexpr_free(t_vexpr *x)
+{
+	dsp_free(&x->x_obj);
+
+	if (x->memory)
+		ALIGNED_FREE(x->memory);
+}
+
+
+// New routine
+
+void *vexpr_new(t_symbol *s, short argc, t_atom *argv)
+{
+	t_vexpr *x;
+	t_vexpr_program program;
+
+	long num_blocks;
+	long i, j;
+
+	// Compile the expression first so that no object is made on failure
+
+	if (!vexpr_compile(&program, argc, argv))
+		return 0;
+
+    x = (t_vexpr *) object_alloc (this_class);
+
+	x->program = program;
+	x->memory = 0;
+
+	num_blocks = program.num_registers + program.num_constants;
+
+	if (num_blocks)
+	{
+		x->memory = ALIGNED_MALLOC(num_blocks * VEXPR_BLOCK_SIZE * (sizeof(double) + sizeof(float)));
+
+		if (!x->memory)
+		{
+			error ("vexpr~: could not allocate memory");
+			num_blocks = 0;
+		}
+	}
+
+	x->registers_64 = (double *) x->memory;
+	x->constants_64 = x->registers_64 + program.num_registers * VEXPR_BLOCK_SIZE;
+	x->registers_32 = (float *) (x->registers_64 + num_blocks * VEXPR_BLOCK_SIZE);
+	x->constants_32 = x->registers_32 + program.num_registers * VEXPR_BLOCK_SIZE;
+
+	// Fill a block for each constant
+
+	for (i = 0; num_blocks && i < program.num_constants; i++)
+	{
+		for (j = 0; j < VEXPR_BLOCK_SIZE; j++)
+		{
+			x->constants_64[i * VEXPR_BLOCK_SIZE + j] = program.constants[i];
+			x->constants_32[i * VEXPR_BLOCK_SIZE + j] = (float) program.constants[i];
+		}
+	}
+
+	// Without memory the object outputs silence (the dsp routines then zero the output)
+
+	if (!num_blocks && (program.num_registers || program.num_constants))
+		x->program.num_ops = 0;
+
+    dsp_setup((t_pxobject *)x, program.num_inputs);
+    outlet_new((t_object *)x,"signal");
+
+    return (x);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////// Expression Compiler ////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static __inline double vexpr_scalar_op(t_vexpr_opcode opcode, double a, double b)
+{
+	switch (opcode)
+	{
+		case VEXPR_COPY:		return a;
+		case VEXPR_NEG:			return -a;
+		case VEXPR_ABS:			return fabs(a);
+		case VEXPR_SQRT:		return a > 0. ? sqrt(a) : 0.;
+		case VEXPR_ADD:			return a + b;
+		case VEXPR_SUB:			return a - b;
+		case VEXPR_MUL:			return a * b;
+		case VEXPR_DIV:			return !b ? 0. : a / b;
+		case VEXPR_MIN:			return a < b ? a : b;
+		case VEXPR_MAX:			return a > b ? a : b;
+	}
+
+	return 0.;
+}
+
+
+static t_vexpr_operand vexpr_operand(t_vexpr_source source, long index)
+{
+	t_vexpr_operand operand;
+
+	operand.source = source;
+	operand.index = index;
+
+	return operand;
+}
+
+
+static t_vexpr_operand vexpr_fail(t_vexpr_parser *p, const char *message)
+{
+	// Only the first error is reported
+
+	if (!p->error)
+		error ("vexpr~: %s at character %ld of expression \"%s\"", message, (long) (p->ptr - p->text) + 1, p->text);
+
+	p->error = 1;
+
+	return vexpr_operand(VEXPR_CONSTANT, 0);
+}
+
+
+static t_vexpr_operand vexpr_constant(t_vexpr_parser *p, double value)
+{
+	t_vexpr_program *program = p->program;
+	long i;
+
+	for (i = 0; i < program->num_constants; i++)
+		if (program->constants[i] == value)
+			return vexpr_operand(VEXPR_CONSTANT, i);
+
+	if (program->num_constants >= VEXPR_MAX_CONSTANTS)
+		return vexpr_fail(p, "too many constants");
+
+	program->constants[program->num_constants] = value;
+
+	return vexpr_operand(VEXPR_CONSTANT, program->num_constants++);
+}
+
+
+static t_vexpr_operand vexpr_emit(t_vexpr_parser *p, t_vexpr_opcode opcode, t_vexpr_operand in1, t_vexpr_operand in2)
+{
+	// Operations on constants are calculated now - otherwise add an operation to the program
+	// N.B. registers are used as a stack - register operands are always the most recently used registers, so they are freed before the output register is chosen
+
+	t_vexpr_program *program = p->program;
+	t_vexpr_op *op;
+
+	long binary = opcode >= VEXPR_ADD;
+
+	if (!binary)
+		in2 = in1;
+
+	if (p->error)
+		return in1;
+
+	if (in1.source == VEXPR_CONSTANT && in2.source == VEXPR_CONSTANT)
+		return vexpr_constant(p, vexpr_scalar_op(opcode, program->constants[in1.index], program->constants[in2.index]));
+
+	if (program->num_ops >= VEXPR_MAX_OPS)
+		return vexpr_fail(p, "expression too long");
+
+	if (binary && in2.source == VEXPR_REGISTER)
+		p->num_registers--;
+	if (in1.source == VEXPR_REGISTER)
+		p->num_registers--;
+
+	if (p->num_registers >= VEXPR_MAX_REGISTERS)
+		return vexpr_fail(p, "expression too deeply nested");
+
+	op = program->ops + program->num_ops++;
+
+	op->opcode = opcode;
+	op->out = p->num_registers++;
+	op->in1 = in1;
+	op->in2 = in2;
+
+	if (p->num_registers > program->num_registers)
+		program->num_registers = p->num_registers;
+
+	return vexpr_operand(VEXPR_REGISTER, op->out);
+}
+
+
+static long vexpr_accept(t_vexpr_parser *p, char c)
+{
+	while (*p->ptr == ' ')
+		p->ptr++;
+
+	if (*p->ptr != c)
+		return 0;
+
+	p->ptr++;
+
+	return 1;
+}
+
+
+static t_vexpr_operand vexpr_parse_expression(t_vexpr_parser *p);
+
+
+static t_vexpr_operand vexpr_parse_primary(t_vexpr_parser *p)
+{
+	t_vexpr_operand in1;
+	t_vexpr_operand in2;
+	t_vexpr_opcode opcode;
+
+	char *end;
+	double value;
+	long index;
+	long length;
+
+	if (vexpr_accept(p, '('))
+	{
+		in1 = vexpr_parse_expression(p);
+
+		if (!vexpr_accept(p, ')'))
+			return vexpr_fail(p, "expected )");
+
+		return in1;
+	}
+
+	// Signal inputs
+
+	if (vexpr_accept(p, '$'))
+	{
+		if ((*p->ptr != 'v' && *p->ptr != 'V') || p->ptr[1] < '1' || p->ptr[1] > '9' || isdigit((unsigned char) p->ptr[2]))
+			return vexpr_fail(p, "expected a signal input ($v1 to $v9)");
+
+		index = p->ptr[1] - '1';
+		p->ptr += 2;
+
+		if (index >= p->program->num_inputs)
+			p->program->num_inputs = index + 1;
+
+		return vexpr_operand(VEXPR_INPUT, index);
+	}
+
+	// Constants
+
+	if (isdigit((unsigned char) *p->ptr) || *p->ptr == '.')
+	{
+		value = strtod(p->ptr, &end);
+
+		if (end == p->ptr)
+			return vexpr_fail(p, "bad number");
+
+		p->ptr = end;
+
+		return vexpr_constant(p, value);
+	}
+
+	// Functions
+
+	for (length = 0; isalpha((unsigned char) p->ptr[length]); length++);
+
+	if (length == 3 && !strncmp(p->ptr, "abs", 3))
+		opcode = VEXPR_ABS;
+	else if (length == 4 && !strncmp(p->ptr, "sqrt", 4))
+		opcode = VEXPR_SQRT;
+	else if (length == 3 && !strncmp(p->ptr, "min", 3))
+		opcode = VEXPR_MIN;
+	else if (length == 3 && !strncmp(p->ptr, "max", 3))
+		opcode = VEXPR_MAX;
+	else
+		return vexpr_fail(p, length ? "unknown function" : "unexpected character");
+
+	p->ptr += length;
+
+	if (!vexpr_accept(p, '('))
+		return vexpr_fail(p, "expected (");
+
+	in1 = in2 = vexpr_parse_expression(p);
+
+	if (opcode >= VEXPR_ADD)
+	{
+		if (!vexpr_accept(p, ','))
+			return vexpr_fail(p, "expected ,");
+
+		in2 = vexpr_parse_expression(p);
+	}
+
+	if (!vexpr_accept(p, ')'))
+		return vexpr_fail(p, "expected )");
+
+	return vexpr_emit(p, opcode, in1, in2);
+}
+
+
+static t_vexpr_operand vexpr_parse_unary(t_vexpr_parser *p)
+{
+	t_vexpr_operand in1;
+
+	if (vexpr_accept(p, '-'))
+	{
+		in1 = vexpr_parse_unary(p);
+		return vexpr_emit(p, VEXPR_NEG, in1, in1);
+	}
+
+	if (vexpr_accept(p, '+'))
+		return vexpr_parse_unary(p);
+
+	return vexpr_parse_primary(p);
+}
+
+
+static t_vexpr_operand vexpr_parse_term(t_vexpr_parser *p)
+{
+	t_vexpr_operand in1 = vexpr_parse_unary(p);
+	t_vexpr_operand in2;
+
+	while (!p->error)
+	{
+		if (vexpr_accept(p, '*'))
+		{
+			in2 = vexpr_parse_unary(p);
+			in1 = vexpr_emit(p, VEXPR_MUL, in1, in2);
+		}
+		else if (vexpr_accept(p, '/'))
+		{
+			in2 = vexpr_parse_unary(p);
+			in1 = vexpr_emit(p, VEXPR_DIV, in1, in2);
+		}
+		else
+			break;
+	}
+
+	return in1;
+}
+
+
+static t_vexpr_operand vexpr_parse_expression(t_vexpr_parser *p)
+{
+	t_vexpr_operand in1 = vexpr_parse_term(p);
+	t_vexpr_operand in2;
+
+	while (!p->error)
+	{
+		if (vexpr_accept(p, '+'))
+		{
+			in2 = vexpr_parse_term(p);
+			in1 = vexpr_emit(p, VEXPR_ADD, in1, in2);
+		}
+		else if (vexpr_accept(p, '-'))
+		{
+			in2 = vexpr_parse_term(p);
+			in1 = vexpr_emit(p, VEXPR_SUB, in1, in2);
+		}
+		else
+			break;
+	}
+
+	return in1;
+}
+
+
+long vexpr_compile(t_vexpr_program *program, short argc, t_atom *argv)
+{
+	// The arguments are joined into one string, as the expression may be split into atoms in any way (e.g. "$v1*2" / "$v1 * 2")
+
+	t_vexpr_parser parser;
+	t_vexpr_operand result;
+	t_vexpr_op *op;
+
+	char text[VEXPR_MAX_TEXT];
+	char token[256];
+	long used[VEXPR_MAX_CONSTANTS];
+	long length = 0;
+	long i;
+
+	for (i = 0; i < argc; i++)
+	{
+		switch (atom_gettype(argv + i))
+		{
+			case A_SYM:		strncpy(token, atom_getsym(argv + i)->s_name, 255);		break;
+			case A_LONG:	sprintf(token, "%ld", (long) atom_getlong(argv + i));	break;
+			case A_FLOAT:	sprintf(token, "%.9g", atom_getfloat(argv + i));		break;
+			case A_COMMA:	strcpy(token, ",");										break;
+			default:		strcpy(token, "?");										break;
+		}
+
+		token[255] = 0;
+
+		if (length + (long) strlen(token) + 2 > VEXPR_MAX_TEXT)
+		{
+			error ("vexpr~: expression too long");
+			return 0;
+		}
+
+		if (length)
+			text[length++] = ' ';
+
+		strcpy(text + length, token);
+		length += strlen(token);
+	}
+
+	text[length] = 0;
+
+	if (!length)
+	{
+		error ("vexpr~: no expression given");
+		return 0;
+	}
+
+	program->num_ops = 0;
+	program->num_constants = 0;
+	program->num_registers = 0;
+	program->num_inputs = 1;
+
+	parser.program = program;
+	parser.text = text;
+	parser.ptr = text;
+	parser.num_registers = 0;
+	parser.error = 0;
+
+	result = vexpr_parse_expression(&parser);
+
+	if (!parser.error && !vexpr_accept(&parser, 0))
+		vexpr_fail(&parser, "unexpected character");
+
+	if (parser.error)
+		return 0;
+
+	// The final operation writes straight to the output (adding a copy if the result is a constant or an input)
+
+	if (result.source != VEXPR_REGISTER)
+	{
+		if (program->num_ops >= VEXPR_MAX_OPS)
+		{
+			vexpr_fail(&parser, "expression too long");
+			return 0;
+		}
+
+		op = program->ops + program->num_ops++;
+		op->opcode = VEXPR_COPY;
+		op->in1 = result;
+		op->in2 = result;
+	}
+
+	program->ops[program->num_ops - 1].out = VEXPR_OUTPUT;
+
+	// Remove constants that were only used whilst folding (so that no memory is used for them)
+
+	for (i = 0; i < program->num_constants; i++)
+		used[i] = -1;
+
+	for (i = 0; i < program->num_ops; i++)
+	{
+		if (program->ops[i].in1.source == VEXPR_CONSTANT)
+			used[program->ops[i].in1.index] = 0;
+		if (program->ops[i].in2.source == VEXPR_CONSTANT)
+			used[program->ops[i].in2.index] = 0;
+	}
+
+	for (i = 0, length = 0; i < program->num_constants; i++)
+	{
+		if (!used[i])
+		{
+			program->constants[length] = program->constants[i];
+			used[i] = length++;
+		}
+	}
+
+	program->num_constants = length;
+
+	for (i = 0; i < program->num_ops; i++)
+	{
+		if (program->ops[i].in1.source == VEXPR_CONSTANT)
+			program->ops[i].in1.index = used[program->ops[i].in1.index];
+		if (program->ops[i].in2.source == VEXPR_CONSTANT)
+			program->ops[i].in2.index = used[program->ops[i].in2.index];
+	}
+
+	return 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////// Operations /////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static __inline void vexpr_op_32(t_vexpr_opcode opcode, vFloat *out, vFloat *in1, vFloat *in2, long length)
+{
+	vFloat zero = float2vector(0.f);
+	long i;
+
+	switch (opcode)
+	{
+		case VEXPR_COPY:
+			for (i = 0; i < length; i++)
+				out[i] = in1[i];
+			break;
+
+		case VEXPR_NEG:
+			for (i = 0; i < length; i++)
+				out[i] = F32_VEC_XOR_OP(in1[i], v_sign_mask_32);
+			break;
+
+		case VEXPR_ABS:
+			for (i = 0; i < length; i++)
+				out[i] = F32_VEC_AND_OP(in1[i], v_abs_mask_32);
+			break;
+
+		case VEXPR_SQRT:
+			for (i = 0; i < length; i++)
+				out[i] = F32_VEC_SQRT_OP(F32_VEC_MAX_OP(in1[i], zero));
+			break;
+
+		case VEXPR_ADD:
+			for (i = 0; i < length; i++)
+				out[i] = F32_VEC_ADD_OP(in1[i], in2[i]);
+			break;
+
+		case VEXPR_SUB:
+			for (i = 0; i < length; i++)
+				out[i] = F32_VEC_SUB_OP(in1[i], in2[i]);
+			break;
+
+		case VEXPR_MUL:
+			for (i = 0; i < length; i++)
+				out[i] = F32_VEC_MUL_OP(in1[i], in2[i]);
+			break;
+
+		case VEXPR_DIV:
+			for (i = 0; i < length; i++)
+				out[i] = F32_VEC_SEL_OP(F32_VEC_DIV_OP(in1[i], in2[i]), zero, F32_VEC_EQ_OP(in2[i], zero));
+			break;
+
+		case VEXPR_MIN:
+			for (i = 0; i < length; i++)
+				out[i] = F32_VEC_MIN_OP(in1[i], in2[i]);
+			break;
+
+		case VEXPR_MAX:
+			for (i = 0; i < length; i++)
+				out[i] = F32_VEC_MAX_OP(in1[i], in2[i]);
+			break;
+	}
+}
+
+
+static __inline void vexpr_op_scalar_32(t_vexpr_opcode opcode, float *out, float *in1, float *in2, long length)
+{
+	float out_val;
+	long i;
+
+	for (i = 0; i < length; i++)
+	{
+		out_val = (float) vexpr_scalar_op(opcode, in1[i], in2[i]);
+		out[i] = AH_FIX_DENORM_FLOAT(out_val);
+	}
+}
+
+
+#ifdef VECTOR_F64_128BIT
+
+static __inline void vexpr_op_64(t_vexpr_opcode opcode, vDouble *out, vDouble *in1, vDouble *in2, long length)
+{
+	vDouble zero = double2vector(0.);
+	long i;
+
+	switch (opcode)
+	{
+		case VEXPR_COPY:
+			for (i = 0; i < length; i++)
+				out[i] = in1[i];
+			break;
+
+		case VEXPR_NEG:
+			for (i = 0; i < length; i++)
+				out[i] = F64_VEC_XOR_OP(in1[i], v_sign_mask_64);
+			break;
+
+		case VEXPR_ABS:
+			for (i = 0; i < length; i++)
+				out[i] = F64_VEC_AND_OP(in1[i], v_abs_mask_64);
+			break;
+
+		case VEXPR_SQRT:
+			for (i = 0; i < length; i++)
+				out[i] = F64_VEC_SQRT_OP(F64_VEC_MAX_OP(in1[i], zero));
+			break;
+
+		case VEXPR_ADD:
+			for (i = 0; i < length; i++)
+				out[i] = F64_VEC_ADD_OP(in1[i], in2[i]);
+			break;
+
+		case VEXPR_SUB:
+			for (i = 0; i < length; i++)
+				out[i] = F64_VEC_SUB_OP(in1[i], in2[i]);
+			break;
+
+		case VEXPR_MUL:
+			for (i = 0; i < length; i++)
+				out[i] = F64_VEC_MUL_OP(in1[i], in2[i]);
+			break;
+
+		case VEXPR_DIV:
+			for (i = 0; i < length; i++)
+				out[i] = F64_VEC_SEL_OP(F64_VEC_DIV_OP(in1[i], in2[i]), zero, F64_VEC_EQ_OP(in2[i], zero));
+			break;
+
+		case VEXPR_MIN:
+			for (i = 0; i < length; i++)
+				out[i] = F64_VEC_MIN_OP(in1[i], in2[i]);
+			break;
+
+		case VEXPR_MAX:
+			for (i = 0; i < length; i++)
+				out[i] = F64_VEC_MAX_OP(in1[i], in2[i]);
+			break;
+	}
+}
+
+#endif
+
+
+static __inline void vexpr_op_scalar_64(t_vexpr_opcode opcode, double *out, double *in1, double *in2, long length)
+{
+	double out_val;
+	long i;
+
+	for (i = 0; i < length; i++)
+	{
+		out_val = vexpr_scalar_op(opcode, in1[i], in2[i]);
+		out[i] = AH_FIX_DENORM_DOUBLE(out_val);
+	}
+}
+
+
+// Find the memory for an operand in the current block
+
+static __inline float *vexpr_operand_32(t_vexpr *x, t_vexpr_operand *operand, long offset)
+{
+	switch (operand->source)
+	{
+		case VEXPR_REGISTER:	return x->registers_32 + (operand->index * VEXPR_BLOCK_SIZE);
+		case VEXPR_INPUT:		return x->ins_32[operand->index] + offset;
+		default:				return x->constants_32 + (operand->index * VEXPR_BLOCK_SIZE);
+	}
+}
+
+
+static __inline double *vexpr_operand_64(t_vexpr *x, double **ins, t_vexpr_operand *operand, long offset)
+{
+	switch (operand->source)
+	{
+		case VEXPR_REGISTER:	return x->registers_64 + (operand->index * VEXPR_BLOCK_SIZE);
+		case VEXPR_INPUT:		return ins[operand->index] + offset;
+		default:				return x->constants_64 + (operand->index * VEXPR_BLOCK_SIZE);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////// DSP and Perform ///////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+// 32 bit dsp routine
+
+void vexpr_dsp(t_vexpr *x, t_signal **sp, short *count)
+{
+	// Default to scalar routine
+
+	method current_perform_routine = (method) vexpr_perform_scalar;
+	long vec_size_val = sp[0]->s_n;
+	long num_inputs = x->program.num_inputs;
+	long misaligned = 0;
+	long i;
+
+	for (i = 0; i < num_inputs; i++)
+	{
+		x->ins_32[i] = sp[i]->s_vec;
+		misaligned |= (t_ptr_uint) sp[i]->s_vec % 16;
+	}
+
+	x->out_32 = sp[num_inputs]->s_vec;
+	misaligned |= (t_ptr_uint) sp[num_inputs]->s_vec % 16;
+
+	if ((vec_size_val >> 2) > 0 && SSE2_check())
+	{
+		// Check memory alignment of all relevant vectors
+
+		if (misaligned)
+			post ("vexpr~: handed a misaligned signal vector - update to Max 5.1.3 or later");
+		else
+			current_perform_routine = (method) vexpr_perform;
+	}
+
+	if (!x->program.num_ops)
+		current_perform_routine = (method) vexpr_perform_zero;
+
+	dsp_add(denormals_perform, 3, current_perform_routine, x, vec_size_val);
+}
+
+
+// 32 bit perform routine (SIMD)
+
+t_int *vexpr_perform(t_int *w)
+{
+	t_vexpr *x = (t_vexpr *) w[2];
+	long vec_size = w[3];
+
+	t_vexpr_op *ops = x->program.ops;
+	long num_ops = x->program.num_ops;
+	long block_size;
+	long offset;
+	long i;
+
+	for (offset = 0; offset < vec_size; offset += block_size)
+	{
+		block_size = (vec_size - offset) > VEXPR_BLOCK_SIZE ? VEXPR_BLOCK_SIZE : (vec_size - offset);
+
+		for (i = 0; i < num_ops; i++)
+		{
+			float *out = ops[i].out == VEXPR_OUTPUT ? x->out_32 + offset : x->registers_32 + (ops[i].out * VEXPR_BLOCK_SIZE);
+			float *in1 = vexpr_operand_32(x, &ops[i].in1, offset);
+			float *in2 = vexpr_operand_32(x, &ops[i].in2, offset);
+
+			vexpr_op_32(ops[i].opcode, (vFloat *) out, (vFloat *) in1, (vFloat *) in2, block_size >> 2);
+		}
+	}
+
+	return w + 4;
+}
+
+
+// 32 bit perform routine (scalar calculations for small block sizes)
+
+t_int *vexpr_perform_scalar(t_int *w)
+{
+	t_vexpr *x = (t_vexpr *) w[2];
+	long vec_size = w[3];
+
+	t_vexpr_op *ops = x->program.ops;
+	long num_ops = x->program.num_ops;
+	long block_size;
+	long offset;
+	long i;
+
+	for (offset = 0; offset < vec_size; offset += block_size)
+	{
+		block_size = (vec_size - offset) > VEXPR_BLOCK_SIZE ? VEXPR_BLOCK_SIZE : (vec_size - offset);
+
+		for (i = 0; i < num_ops; i++)
+		{
+			float *out = ops[i].out == VEXPR_OUTPUT ? x->out_32 + offset : x->registers_32 + (ops[i].out * VEXPR_BLOCK_SIZE);
+			float *in1 = vexpr_operand_32(x, &ops[i].in1, offset);
+			float *in2 = vexpr_operand_32(x, &ops[i].in2, offset);
+
+			vexpr_op_scalar_32(ops[i].opcode, out, in1, in2, block_size);
+		}
+	}
+
+	return w + 4;
+}
+
+
+// 32 bit perform routine (silence if the object has no program)
+
+t_int *vexpr_perform_zero(t_int *w)
+{
+	t_vexpr *x = (t_vexpr *) w[2];
+	long vec_size = w[3];
+
+	float *out = x->out_32;
+	long i;
+
+	for (i = 0; i < vec_size; i++)
+		out[i] = 0.f;
+
+	return w + 4;
+}
+
+
+// 64 bit dsp routine
+
+void vexpr_dsp64(t_vexpr *x, t_object *dsp64, short *count, double samplerate, long maxvectorsize, long flags)
+{
+	// Default to scalar routine
+
+	method current_perform_routine = (method) vexpr_perform_scalar64;
+
+#ifdef VECTOR_F64_128BIT
+	// Use SIMD routine if possible
+
+	if ((maxvectorsize >> 1) > 0 && SSE2_check())
+		current_perform_routine = (method) vexpr_perform64;
+#endif
+
+	if (!x->program.num_ops)
+		current_perform_routine = (method) vexpr_perform_zero64;
+
+	object_method(dsp64, gensym("dsp_add64"), x, current_perform_routine, 0, 0);
+}
+
+
+#ifdef VECTOR_F64_128BIT
+
+// 64 bit perform routine (SIMD)
+
+void vexpr_perform64(t_vexpr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam)
+{
+	t_vexpr_op *ops = x->program.ops;
+	long num_ops = x->program.num_ops;
+	long block_size;
+	long offset;
+	long i;
+
+	for (offset = 0; offset < vec_size; offset += block_size)
+	{
+		block_size = (vec_size - offset) > VEXPR_BLOCK_SIZE ? VEXPR_BLOCK_SIZE : (vec_size - offset);
+
+		for (i = 0; i < num_ops; i++)
+		{
+			double *out = ops[i].out == VEXPR_OUTPUT ? outs[0] + offset : x->registers_64 + (ops[i].out * VEXPR_BLOCK_SIZE);
+			double *in1 = vexpr_operand_64(x, ins, &ops[i].in1, offset);
+			double *in2 = vexpr_operand_64(x, ins, &ops[i].in2, offset);
+
+			vexpr_op_64(ops[i].opcode, (vDouble *) out, (vDouble *) in1, (vDouble *) in2, block_size >> 1);
+		}
+	}
+}
+
+#endif
+
+
+// 64 bit perform routine (scalar calculations for small block sizes)
+
+void vexpr_perform_scalar64(t_vexpr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam)
+{
+	t_vexpr_op *ops = x->program.ops;
+	long num_ops = x->program.num_ops;
+	long block_size;
+	long offset;
+	long i;
+
+	for (offset = 0; offset < vec_size; offset += block_size)
+	{
+		block_size = (vec_size - offset) > VEXPR_BLOCK_SIZE ? VEXPR_BLOCK_SIZE : (vec_size - offset);
+
+		for (i = 0; i < num_ops; i++)
+		{
+			double *out = ops[i].out == VEXPR_OUTPUT ? outs[0] + offset : x->registers_64 + (ops[i].out * VEXPR_BLOCK_SIZE);
+			double *in1 = vexpr_operand_64(x, ins, &ops[i].in1, offset);
+			double *in2 = vexpr_operand_64(x, ins, &ops[i].in2, offset);
+
+			vexpr_op_scalar_64(ops[i].opcode, out, in1, in2, block_size);
+		}
+	}
+}
+
+
+// 64 bit perform routine (silence if the object has no program)
+
+void vexpr_perform_zero64(t_vexpr *x, t_object *dsp64, double **ins, long numins, double **outs, long numouts, long vec_size, long flags, void *userparam)
+{
+	double *out = outs[0];
+	long i;
+
+	for (i = 0; i < vec_size; i++)
+		out[i] = 0.0;
+}
+
+
+// Assist routine
+
+void vexpr_assist(t_vexpr *x, void *b, long m, long a, char *s)
+{
+    if (m == ASSIST_INLET) {
+		sprintf(s,"(signal) $v%ld", a + 1);
+	}
+    else {
+		sprintf(s,"(signal) Out");
+	}
+}
@@ -32,6 +32,7 @@ vDouble one_64 = {1.0, 1.0};
 
 #define F64_VEC_OP(a,b) F64_VEC_SUB_OP(one_64, F64_VEC_GT_MSP_OP(a,b))
 #define F64_SCALAR_OP(a,b) (a <= b)
+#define F64_VEC256_OP(a,b) F64_VEC256_SUB_OP(double2vector256(1.), F64_VEC256_GT_MSP_OP(a,b))
 
 // Having defined the necessary constants and macro the bulk of the code can now be included
 
@@ -37,6 +37,7 @@ static __inline double maximum_scalar_64 (double in1, double in2)
 
 #define F64_VEC_OP F64_VEC_MAX_OP
 #define F64_SCALAR_OP maximum_scalar_64
+#define F64_VEC256_OP F64_VEC256_MAX_OP
 
 // Having defined the necessary constants and macro the bulk of the code can now be included
 
@@ -25,6 +25,7 @@
 
 #define F64_VEC_OP F64_VEC_SUB_OP
 #define F64_SCALAR_OP(a,b) (a - b)
+#define F64_VEC256_OP F64_VEC256_SUB_OP
 
 // Having defined the necessary constants and macro the bulk of the code can now be included
 
@@ -61,6 +61,7 @@ static __inline double scalar_times_64 (double a, double b)
 
 //#define F64_VEC_OP vec_times_64
 //#define F64_SCALAR_OP scalar_times_64
+#define F64_VEC256_OP F64_VEC256_MUL_OP
 
 #define F64_VEC_OP F64_VEC_MUL_OP
 #define F64_SCALAR_OP(a, b) (a * b)
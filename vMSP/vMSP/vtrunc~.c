@@ -100,6 +100,7 @@ static __inline vDouble trunc_vec_64(vDouble in)
 
 #define F64_VEC_OP trunc_vec_64
 #define F64_SCALAR_OP(a) trunc_scalar_64(a)
+#define F64_VEC256_OP F64_VEC256_TRUNC_OP
 
 // Having defined the necessary constants and macro the bulk of the code can now be included
 